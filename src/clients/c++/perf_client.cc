@@ -27,14 +27,18 @@
 #include "src/clients/c++/request.h"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <csignal>
+#include <dirent.h>
 #include <fstream>
-#include <math.h>
 #include <mutex>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <time.h>
@@ -64,8 +68,13 @@ namespace nic = nvidia::inferenceserver::client;
 // - Latency (usec):
 //     The average elapsed time between when a request is sent and
 //     when the response for the request is received.
+// - Client CPU (usec):
+//     The CPU time consumed by the perf client process divided by the
+//     number of requests completed over the same period, along with the
+//     CPU utilization in terms of a single core. Useful to verify that
+//     the client library is not spending CPU while waiting on responses.
 //
-// There are two settings (see -d option) for the data collection:
+// There are three settings (see -d and -S options) for the data collection:
 // - Fixed concurrent request mode:
 //     In this setting, the client will maintain a fixed number of concurrent
 //     requests sent to the server (see -t option). See ConcurrencyManager for
@@ -104,13 +113,44 @@ namespace nic = nvidia::inferenceserver::client;
 //     of "throughput, latency, concurrent request count" tuples will be
 //     reported in increasing load level order.
 //
+// - Search mode:
+//     Instead of increasing k by 1, k is doubled until the latency exceeds
+//     the latency threshold (see -l option) and the range between the last
+//     two k is then bisected, so that the highest k with a latency below the
+//     threshold is found with a number of iterations logarithmic in k.
+//     The latency compared can be a percentile instead of the average (see
+//     -P option) and the total search time can be limited (see -T option).
+//     Besides the highest k and the highest throughput below the threshold,
+//     the knee of the latency vs. throughput curve measured is reported,
+//     where additional load starts to cost more latency than it gains
+//     throughput.
+//
+// Instead of maintaining a number of concurrent requests, the client can
+// also send requests at a fixed rate regardless of when earlier requests
+// complete (see -R option), as independent users of a service would. The
+// latency of each request is then measured from the time the request was
+// due to be sent, so that requests delayed because the client or the
+// server falls behind are not left out of the measurement. Besides the
+// data of the fixed concurrent request mode, the request rate achieved
+// is reported against the target rate.
+//
 // Options:
 // -b: batch size for each request sent.
 // -t: number of concurrent requests sent. If -d is set, -t indicate the number
 //     of concurrent requests to start with ("starting concurrency" level).
 // -d: enable dynamic concurrent request mode.
-// -l: latency threshold in msec, will have no effect if -d is not set.
+// -l: latency threshold in msec, will have no effect if -d or -S is not set.
+// -S: enable search mode.
+// -P: latency percentile compared against the latency threshold.
+// -T: maximum search time in sec.
 // -p: time interval for each measurement window in msec.
+// -g: share one thread-safe InferContext between all worker threads.
+// -k: number of gRPC channels (connections) the contexts are spread over.
+// -w: number of worker threads the requests are spread over if -a is set.
+// -e: send the gRPC requests over a StreamInfer stream per context.
+// -R: send requests at the given rate instead of at a concurrency level.
+// -D: distribution of the time between requests sent at a rate.
+// -B: number of requests sent together in a burst.
 //
 // For detail of the options not listed, please refer to the usage.
 //
@@ -144,13 +184,37 @@ typedef struct PerformanceStatusStruct {
   uint64_t client_min_latency_ns;
   uint64_t client_max_latency_ns;
   uint64_t client_avg_latency_ns;
-  // Using usec to avoid square of large number (large in nsec)
   uint64_t std_us;
+  // Latency percentiles, to the precision of the latency histogram
+  uint64_t client_p50_latency_ns;
+  uint64_t client_p90_latency_ns;
+  uint64_t client_p95_latency_ns;
+  uint64_t client_p99_latency_ns;
+  uint64_t client_p999_latency_ns;
   uint64_t client_avg_request_time_ns;
   uint64_t client_avg_send_time_ns;
   uint64_t client_avg_receive_time_ns;
+  // CPU time consumed by the client process per completed request and
+  // as a fraction of the elapsed time (1.0 is one fully busy core)
+  uint64_t client_avg_cpu_time_ns;
+  double client_cpu_utilization;
+  // CPU utilization of the busiest thread of the client process, and
+  // whether the client rather than the server is likely limiting the
+  // throughput
+  double client_max_thread_utilization;
+  bool client_cpu_bound;
+  // Connections reused and newly opened by the client (HTTP only)
+  uint64_t client_reused_connection_count;
+  uint64_t client_new_connection_count;
   // Per infer stat
   int client_infer_per_sec;
+  // Target rate of the requests if sent at a rate, 0 otherwise, and the
+  // rate the requests were completed and sent at in requests/sec
+  double target_request_rate;
+  double client_request_rate;
+  double client_send_rate;
+  // Time between when a request was due and when it was sent
+  uint64_t client_avg_send_delay_ns;
 } PerfStatus;
 
 
@@ -159,6 +223,98 @@ enum ProtocolType {
   GRPC = 1
 };
 
+// Distribution of the time between requests sent at a rate.
+enum RequestDistribution {
+  CONSTANT = 0,
+  POISSON = 1,
+  BURSTY = 2
+};
+
+// Longest time a worker sending at a rate sleeps before checking for an
+// exit signal, the time between requests can be much longer.
+const uint64_t kRateSleepSliceNs = 100 * 1000 * 1000;
+
+// Number of records in the ring of each worker thread and the interval at
+// which the measuring thread drains the rings. A worker thread completing
+// up to 400K requests/sec can't fill its ring between two drains.
+const size_t kTimestampRingSize = 4096;
+const uint64_t kTimestampRingDrainIntervalMs = 10;
+
+//==============================================================================
+// TimestampRing
+//
+// Fixed size ring of the start and end time of completed requests, written
+// by the one worker thread that owns it and drained by the measuring
+// thread. Neither side blocks the other: Push() fails instead of waiting
+// when the ring is full and Drain() only takes the records completely
+// written. The head and tail are kept apart so that the two threads don't
+// share a cache line when updating them.
+//
+class TimestampRing {
+public:
+  struct Record {
+    uint64_t start_ns;
+    uint64_t end_ns;
+  };
+
+  // 'capacity' must be a power of 2.
+  explicit TimestampRing(const size_t capacity)
+    : records_(capacity), mask_(capacity - 1), head_(0), tail_(0),
+      cached_head_(0)
+  {
+  }
+
+  // Add a record, called by the owning worker thread.
+  // @return false if the ring is full and the record is not added.
+  bool Push(const uint64_t start_ns, const uint64_t end_ns)
+  {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == records_.size()) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == records_.size()) {
+        return false;
+      }
+    }
+
+    Record& record = records_[tail & mask_];
+    record.start_ns = start_ns;
+    record.end_ns = end_ns;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Record the latency of each record in 'histogram' and remove them
+  // from the ring, called by the measuring thread.
+  void Drain(nic::LatencyHistogram* histogram)
+  {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    for (size_t idx = head; idx != tail; ++idx) {
+      const Record& record = records_[idx & mask_];
+      if (record.start_ns <= record.end_ns) {
+        histogram->Record(record.end_ns - record.start_ns);
+      }
+    }
+    head_.store(tail, std::memory_order_release);
+  }
+
+private:
+  static const size_t kCacheLineSize = 64;
+
+  std::vector<Record> records_;
+  const size_t mask_;
+
+  // Index of the next record to drain, written by the measuring thread
+  std::atomic<size_t> head_;
+  char head_padding_[kCacheLineSize - sizeof(std::atomic<size_t>)];
+  // Index of the next record to push, written by the worker thread, and
+  // the head last seen by the worker thread
+  std::atomic<size_t> tail_;
+  size_t cached_head_;
+  char tail_padding_[
+    kCacheLineSize - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+};
+
 //==============================================================================
 // Concurrency Manager
 //
@@ -188,8 +344,11 @@ enum ProtocolType {
 // Detail:
 // Concurrency Manager will maintain the number of concurrent requests by using
 // corresponding number of worker threads that keep sending randomly generated
-// requests to the server. The worker threads will record the start time and end
-// time of each request into a shared vector.
+// requests to the server, or in async mode by spreading the requests over a
+// fixed number of worker threads that each keep their share in flight. Each
+// worker thread records the start and end time of its requests into its own
+// ring, which the main thread drains into a histogram of the request
+// latencies.
 //
 // The manager can adjust the number of concurrent requests by creating
 // new threads or by pausing existing threads (by pause_index_).
@@ -201,9 +360,9 @@ enum ProtocolType {
 // 1. Main thread gets start status from the server and records the start time.
 // 2. After given time interval, main thread gets end status from the server and
 //    records the end time.
-// 3. From the shared vector, Main thread uses data that are generated between
-//    recorded start time and end time to measure client side status and
-//    update status_summary.
+// 3. From the difference between the shared histogram at the start time and at
+//    the end time, Main thread measures client side status and updates
+//    status_summary.
 
 class ConcurrencyManager {
 public:
@@ -235,15 +394,19 @@ public:
     const bool verbose, const bool profile, const int32_t batch_size,
     const double stable_offset,
     const uint64_t measurement_window_ms, const size_t max_measurement_count,
-    const bool async,
+    const bool async, const size_t async_thread_count,
+    const bool shared_context, const bool streaming,
+    const RequestDistribution request_distribution, const size_t burst_size,
+    const size_t max_outstanding_requests,
     const std::string& model_name, const int model_version,
     const std::string& url, const ProtocolType protocol)
   {
     manager->reset(new ConcurrencyManager(
       verbose, profile, batch_size, stable_offset, measurement_window_ms,
-      max_measurement_count, async, model_name, model_version, url, protocol));
+      max_measurement_count, async, async_thread_count, shared_context,
+      streaming, request_distribution, burst_size, max_outstanding_requests,
+      model_name, model_version, url, protocol));
     (*manager)->pause_index_.reset(new size_t(0));
-    (*manager)->request_timestamps_.reset(new TimestampVector());
     return nic::Error(ni::RequestStatusCode::SUCCESS);
   }
 
@@ -261,6 +424,7 @@ public:
     PerfStatus& status_summary, const size_t concurrent_request_count)
   {
     status_summary.concurrency = concurrent_request_count;
+    status_summary.target_request_rate = 0;
 
     // Adjust concurrency level
     {
@@ -273,36 +437,55 @@ public:
 
     // Create new threads if we can not provide concurrency needed
     if (!async_) {
+      // All worker threads send their requests through one context
+      if (shared_context_ && !shared_ctx_) {
+        nic::Error err = CreateContext(&shared_ctx_);
+        if (err.IsOk()) {
+          err = shared_ctx_->SetThreadSafeMode(true);
+        }
+        if (!err.IsOk()) {
+          shared_ctx_.reset();
+          return err;
+        }
+      }
+
       while (concurrent_request_count > threads_.size()) {
-        // Launch new thread for inferencing
+        // Launch new thread for inferencing, with its own context unless
+        // the threads share one
+        std::shared_ptr<nic::InferContext> ctx;
+        if (!shared_ctx_) {
+          nic::Error err = CreateWorkerContext(&ctx);
+          if (!err.IsOk()) {
+            return err;
+          }
+        }
         threads_status_.emplace_back(
           new nic::Error(ni::RequestStatusCode::SUCCESS));
-        threads_context_stat_.emplace_back(
-          new nic::InferContext::Stat());
         size_t new_thread_index = threads_.size();
         threads_.emplace_back(
           &ConcurrencyManager::Infer, this,
-          threads_status_.back(), threads_context_stat_.back(),
-          request_timestamps_, pause_index_, new_thread_index);
+          threads_status_.back(), ctx, CreateTimestampRing(), pause_index_,
+          new_thread_index);
       }
     } else {
-      // TODO: check how much extra latency async infer introduces.
-      // One worker thread still need to prepare the requests
-      // in sequence, intuitively, it seems like the concurrency level
-      // may not be as stable as using multiple worker threads. Maybe having
-      // multiple worker threads and each handles some number of requests?
-
-      // One worker thread is sufficient for async mode
-      if (threads_.size() == 0) {
+      // Preparing and reaping every request from one thread limits the
+      // load a fast model can be given, so the concurrency is spread
+      // over the async worker threads, each keeping its share of the
+      // requests in flight through its own context.
+      while (threads_.size() < async_thread_count_) {
         // Launch new thread for inferencing
+        std::shared_ptr<nic::InferContext> ctx;
+        nic::Error err = CreateWorkerContext(&ctx);
+        if (!err.IsOk()) {
+          return err;
+        }
         threads_status_.emplace_back(
           new nic::Error(ni::RequestStatusCode::SUCCESS));
-        threads_context_stat_.emplace_back(
-          new nic::InferContext::Stat());
+        size_t new_thread_index = threads_.size();
         threads_.emplace_back(
           &ConcurrencyManager::AsyncInfer, this,
-          threads_status_.back(), threads_context_stat_.back(),
-          request_timestamps_, pause_index_);
+          threads_status_.back(), ctx, CreateTimestampRing(), pause_index_,
+          new_thread_index);
       }
     }
 
@@ -310,6 +493,51 @@ public:
     std::cout
       << "Request concurrency: " << concurrent_request_count << std::endl;
 
+    return
+      MeasureUntilStable(
+        status_summary,
+        "concurrency " + std::to_string(concurrent_request_count));
+  }
+
+  // StepRate will send requests at 'request_rate' requests per second,
+  // with the time between requests following the distribution given at
+  // creation, regardless of when earlier requests complete. It measures
+  // as Step() does and summarize the most recent measurement into
+  // 'status_summary', with the latency of each request measured from
+  // the time it was due to be sent. Can only be called once.
+  nic::Error StepRate(PerfStatus& status_summary, const double request_rate)
+  {
+    status_summary.concurrency = 0;
+    status_summary.target_request_rate = request_rate;
+
+    if (threads_.size() == 0) {
+      std::shared_ptr<nic::InferContext> ctx;
+      nic::Error err = CreateWorkerContext(&ctx);
+      if (!err.IsOk()) {
+        return err;
+      }
+      threads_status_.emplace_back(
+        new nic::Error(ni::RequestStatusCode::SUCCESS));
+      threads_.emplace_back(
+        &ConcurrencyManager::RateInfer, this,
+        threads_status_.back(), ctx, request_rate);
+    }
+
+    std::cout
+      << "Request rate: " << request_rate << " requests/sec" << std::endl;
+
+    std::ostringstream load;
+    load << "request rate " << request_rate << " requests/sec";
+    return MeasureUntilStable(status_summary, load.str());
+  }
+
+private:
+  // Measure in every 'measurement_window' msec until the throughput is
+  // stable and summarize the most recent measurement into
+  // 'status_summary'. 'load' describes the load level for messages.
+  nic::Error MeasureUntilStable(
+    PerfStatus& status_summary, const std::string& load)
+  {
     // Start measurement
     nic::Error err(ni::RequestStatusCode::SUCCESS);
 
@@ -384,33 +612,232 @@ public:
     } else if (!stable) {
       std::cerr
         << "Failed to obtain stable measurement within "
-        << max_measurement_count_ << " measurement windows for concurrency "
-        << concurrent_request_count << ". Please try to "
+        << max_measurement_count_ << " measurement windows for "
+        << load << ". Please try to "
         << "increase the time window." << std::endl;
     }
 
     return err;
   }
 
-private:
-  using TimestampVector =
-    std::vector<std::pair<struct timespec, struct timespec>>;
-
   ConcurrencyManager(
     const bool verbose, const bool profile, const int32_t batch_size,
     const double stable_offset,
     const int32_t measurement_window_ms, const size_t max_measurement_count,
-    const bool async, const std::string& model_name, const int model_version,
+    const bool async, const size_t async_thread_count,
+    const bool shared_context, const bool streaming,
+    const RequestDistribution request_distribution, const size_t burst_size,
+    const size_t max_outstanding_requests,
+    const std::string& model_name, const int model_version,
     const std::string& url, const ProtocolType protocol)
     : verbose_(verbose), profile_(profile), batch_size_(batch_size),
       stable_offset_(stable_offset),
       measurement_window_ms_(measurement_window_ms),
       max_measurement_count_(max_measurement_count),
-      async_(async), model_name_(model_name), model_version_(model_version),
-      url_(url), protocol_(protocol)
+      async_(async), async_thread_count_(async_thread_count),
+      shared_context_(shared_context), streaming_(streaming),
+      request_distribution_(request_distribution), burst_size_(burst_size),
+      max_outstanding_requests_(max_outstanding_requests),
+      model_name_(model_name), model_version_(model_version),
+      url_(url), protocol_(protocol), rate_error_reported_(false),
+      sent_request_count_(0),
+      cumulative_send_delay_ns_(0), outstanding_request_count_(0)
   {
   }
 
+  // Create a context for inference of the specified model, prepared
+  // for 'batch_size_' batches with all outputs requested.
+  nic::Error
+  CreateContext(std::unique_ptr<nic::InferContext>* ctx)
+  {
+    nic::Error err;
+    if (protocol_ == ProtocolType::HTTP) {
+      err = nic::InferHttpContext::Create(
+        ctx, url_, model_name_, model_version_, false);
+    } else {
+      err = nic::InferGrpcContext::Create(
+        ctx, url_, model_name_, model_version_, false, streaming_);
+    }
+    if (!err.IsOk()) {
+      return err;
+    }
+
+    if (batch_size_ > (*ctx)->MaxBatchSize()) {
+      return
+        nic::Error(
+          ni::RequestStatusCode::INVALID_ARG,
+          "expecting batch size <= " + std::to_string((*ctx)->MaxBatchSize()) +
+          " for model '" + (*ctx)->ModelName() + "'");
+    }
+
+    // Prepare context for 'batch_size' batches. Request that all
+    // outputs be returned.
+    std::unique_ptr<nic::InferContext::Options> options;
+    err = nic::InferContext::Options::Create(&options);
+    if (!err.IsOk()) {
+      return err;
+    }
+
+    options->SetBatchSize(batch_size_);
+    for (const auto& output : (*ctx)->Outputs()) {
+      options->AddRawResult(output);
+    }
+
+    return (*ctx)->SetRunOptions(*options);
+  }
+
+  // Create the context of a worker thread, which is kept for the
+  // measurement to read its statistic.
+  nic::Error
+  CreateWorkerContext(std::shared_ptr<nic::InferContext>* ctx)
+  {
+    std::unique_ptr<nic::InferContext> new_ctx;
+    nic::Error err = CreateContext(&new_ctx);
+    if (err.IsOk()) {
+      ctx->reset(new_ctx.release());
+      threads_ctx_.push_back(*ctx);
+    }
+
+    return err;
+  }
+
+  // Number of requests kept in flight by async worker thread
+  // 'thread_index' for a concurrency of 'concurrency'.
+  size_t
+  AsyncThreadConcurrency(const size_t concurrency, const size_t thread_index)
+  {
+    return
+      (concurrency / async_thread_count_) +
+      ((thread_index < (concurrency % async_thread_count_)) ? 1 : 0);
+  }
+
+  // Set all inputs of 'ctx' to the random values in 'input_buf', which
+  // is created large enough to provide the largest input.
+  nic::Error
+  InitializeInputs(nic::InferContext* ctx, std::vector<uint8_t>* input_buf)
+  {
+    size_t max_input_byte_size = 0;
+    for (const auto& input : ctx->Inputs()) {
+      max_input_byte_size = std::max(max_input_byte_size, input->ByteSize());
+    }
+
+    input_buf->resize(max_input_byte_size);
+    for (size_t i = 0; i < input_buf->size(); ++i) {
+      (*input_buf)[i] = rand();
+    }
+
+    for (const auto& input : ctx->Inputs()) {
+      nic::Error err = input->Reset();
+      if (!err.IsOk()) {
+        return err;
+      }
+
+      for (size_t i = 0; i < batch_size_; ++i) {
+        err = input->SetRaw(&(*input_buf)[0], input->ByteSize());
+        if (!err.IsOk()) {
+          return err;
+        }
+      }
+    }
+
+    return nic::Error::Success;
+  }
+
+  // CPU time used so far by each thread of the process, keyed by thread
+  // id. The client library sends and receives the requests on its own
+  // threads, so those are included along with the worker threads.
+  std::map<std::string, uint64_t>
+  ThreadCpuTimes()
+  {
+    std::map<std::string, uint64_t> cpu_times;
+    DIR* dir = opendir("/proc/self/task");
+    if (dir == nullptr) {
+      return cpu_times;
+    }
+
+    const uint64_t ns_per_tick = ni::NANOS_PER_SECOND / sysconf(_SC_CLK_TCK);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      const std::string tid(entry->d_name);
+      if (tid[0] == '.') {
+        continue;
+      }
+
+      // The user and system time are the 12th and 13th fields after the
+      // command name, which is in parentheses and may contain spaces.
+      std::ifstream ifs("/proc/self/task/" + tid + "/stat");
+      std::string stat(
+        (std::istreambuf_iterator<char>(ifs)),
+        std::istreambuf_iterator<char>());
+      const size_t pos = stat.rfind(')');
+      if (pos == std::string::npos) {
+        continue;
+      }
+      std::istringstream fields(stat.substr(pos + 1));
+      std::string field;
+      uint64_t utime = 0, stime = 0;
+      for (size_t i = 0; (i < 13) && (fields >> field); ++i) {
+        if (i == 11) {
+          utime = std::stoull(field);
+        } else if (i == 12) {
+          stime = std::stoull(field);
+        }
+      }
+      cpu_times[tid] = (utime + stime) * ns_per_tick;
+    }
+    closedir(dir);
+
+    return cpu_times;
+  }
+
+  // Record a request that started at 'start_time' and completed at
+  // 'end_time' in 'ring', to be drained by the measuring thread. If there
+  // is no ring or it is full, the latency is recorded directly.
+  void
+  RecordLatency(
+    TimestampRing* ring,
+    const struct timespec& start_time, const struct timespec& end_time)
+  {
+    uint64_t request_start_ns =
+      start_time.tv_sec * ni::NANOS_PER_SECOND + start_time.tv_nsec;
+    uint64_t request_end_ns =
+      end_time.tv_sec * ni::NANOS_PER_SECOND + end_time.tv_nsec;
+    if ((ring == nullptr) || !ring->Push(request_start_ns, request_end_ns)) {
+      if (request_start_ns <= request_end_ns) {
+        request_latency_.Record(request_end_ns - request_start_ns);
+      }
+    }
+  }
+
+  // Create the ring for a new worker thread to record its requests in.
+  std::shared_ptr<TimestampRing>
+  CreateTimestampRing()
+  {
+    threads_ring_.emplace_back(new TimestampRing(kTimestampRingSize));
+    return threads_ring_.back();
+  }
+
+  // Move the latencies recorded in the rings of the worker threads into
+  // 'request_latency_'.
+  void
+  DrainTimestampRings()
+  {
+    for (auto& ring : threads_ring_) {
+      ring->Drain(&request_latency_);
+    }
+  }
+
+  // Set the status of the rate worker thread to the first error reported
+  // by it or its callbacks.
+  void
+  ReportRateError(std::shared_ptr<nic::Error> err, const nic::Error& error)
+  {
+    bool reported = false;
+    if (rate_error_reported_.compare_exchange_strong(reported, true)) {
+      *err = error;
+    }
+  }
+
   nic::Error
   StartProfile()
   {
@@ -479,8 +906,21 @@ private:
   nic::Error
   GetAccumulatedContextStat(nic::InferContext::Stat* contexts_stat)
   {
-    std::lock_guard<std::mutex> lk(status_report_mutex_);
-    for (auto& context_stat : threads_context_stat_) {
+    // The shared context already accumulates the requests of all
+    // worker threads.
+    if (shared_ctx_) {
+      return shared_ctx_->GetStat(contexts_stat);
+    }
+
+    // The context statistic is read from each worker context, which
+    // only locks that context against its own thread.
+    for (auto& ctx : threads_ctx_) {
+      nic::InferContext::Stat stat;
+      nic::Error err = ctx->GetStat(&stat);
+      if (!err.IsOk()) {
+        return err;
+      }
+      const nic::InferContext::Stat* context_stat = &stat;
       contexts_stat->completed_request_count +=
         context_stat->completed_request_count;
       contexts_stat->cumulative_total_request_time_ns +=
@@ -489,6 +929,12 @@ private:
         context_stat->cumulative_send_time_ns;
       contexts_stat->cumulative_receive_time_ns +=
         context_stat->cumulative_receive_time_ns;
+      contexts_stat->reused_connection_count +=
+        context_stat->reused_connection_count;
+      contexts_stat->new_connection_count +=
+        context_stat->new_connection_count;
+      contexts_stat->request_time_histogram.Merge(
+        context_stat->request_time_histogram);
     }
     return nic::Error::Success;
   }
@@ -498,83 +944,21 @@ private:
     PerfStatus& summary,
     const ni::ModelStatus& start_status, const ni::ModelStatus& end_status,
     const nic::InferContext::Stat& start_stat,
-    const nic::InferContext::Stat& end_stat)
+    const nic::InferContext::Stat& end_stat,
+    const nic::LatencyHistogram& start_latency,
+    const nic::LatencyHistogram& end_latency, const uint64_t duration_ns)
   {
     nic::Error err(ni::RequestStatusCode::SUCCESS);
 
     //===============
     // Summarizing statistic measured by client
 
-    // Get the requests in the shared vector
-    TimestampVector current_timestamps;
-    status_report_mutex_.lock();
-    request_timestamps_->swap(current_timestamps);
-    status_report_mutex_.unlock();
-
-    // finding the start time of the first request
-    // and the end time of the last request in the timestamp queue
-    uint64_t first_request_start_ns = 0;
-    uint64_t last_request_end_ns = 0;
-    for (auto& timestamp : current_timestamps) {
-      uint64_t request_start_time =
-        timestamp.first.tv_sec * ni::NANOS_PER_SECOND +
-        timestamp.first.tv_nsec;
-      uint64_t request_end_time =
-        timestamp.second.tv_sec * ni::NANOS_PER_SECOND +
-        timestamp.second.tv_nsec;
-      if ((first_request_start_ns > request_start_time) ||
-            (first_request_start_ns == 0)) {
-        first_request_start_ns = request_start_time;
-      }
-      if ((last_request_end_ns < request_end_time) ||
-            (last_request_end_ns == 0)) {
-        last_request_end_ns = request_end_time;
-      }
-    }
-
-    // Define the measurement window [client_start_ns, client_end_ns) to be
-    // in the middle of the queue
-    uint64_t measurement_window_ns = measurement_window_ms_ * 1000 * 1000;
-    uint64_t offset = first_request_start_ns + measurement_window_ns;
-    offset =
-      (offset > last_request_end_ns) ? 0 : (last_request_end_ns - offset) / 2;
-
-    uint64_t client_start_ns = first_request_start_ns + offset;
-    uint64_t client_end_ns = client_start_ns + measurement_window_ns;
-    uint64_t client_duration_ns = client_end_ns - client_start_ns;
-
-    // Get measurement from requests that fall within the time interval
-    size_t valid_timestamp_count = 0;
-    uint64_t min_latency_ns = 0;
-    uint64_t max_latency_ns = 0;
-    uint64_t tol_latency_ns = 0;
-    uint64_t tol_square_latency_us = 0;
-    for (auto& timestamp : current_timestamps){
-      uint64_t request_start_ns =
-        timestamp.first.tv_sec * ni::NANOS_PER_SECOND +
-        timestamp.first.tv_nsec;
-      uint64_t request_end_ns =
-        timestamp.second.tv_sec * ni::NANOS_PER_SECOND +
-        timestamp.second.tv_nsec;
-
-      if (request_start_ns <= request_end_ns) {
-        // Only counting requests that end within the time interval
-        if ((request_end_ns >= client_start_ns) &&
-              (request_end_ns <= client_end_ns)) {
-          uint64_t request_latency = request_end_ns - request_start_ns;
-          if ((request_latency < min_latency_ns) || (min_latency_ns == 0))
-            min_latency_ns = request_latency;
-          if ((request_latency > max_latency_ns) || (max_latency_ns == 0))
-            max_latency_ns = request_latency;
-          tol_latency_ns += request_latency;
-          tol_square_latency_us +=
-            (request_latency * request_latency) / (1000 * 1000);
-          valid_timestamp_count++;
-        }
-      }
-    }
+    // The latencies of the requests completed during the measurement
+    nic::LatencyHistogram latency(end_latency);
+    latency.Subtract(start_latency);
 
-    if (valid_timestamp_count == 0) {
+    const uint64_t valid_request_count = latency.Count();
+    if ((valid_request_count == 0) || (duration_ns == 0)) {
       return nic::Error(
         ni::RequestStatusCode::INTERNAL,
         "No valid requests recorded within time interval." \
@@ -582,26 +966,21 @@ private:
     }
 
     summary.batch_size = batch_size_;
-    summary.client_request_count = valid_timestamp_count;
-    summary.client_duration_ns = client_duration_ns;
+    summary.client_request_count = valid_request_count;
+    summary.client_duration_ns = duration_ns;
     float client_duration_sec =
       (float)summary.client_duration_ns / ni::NANOS_PER_SECOND;
     summary.client_infer_per_sec =
-      (int)(valid_timestamp_count * summary.batch_size / client_duration_sec);
-    summary.client_min_latency_ns = min_latency_ns;
-    summary.client_max_latency_ns = max_latency_ns;
-    summary.client_avg_latency_ns =
-      tol_latency_ns / valid_timestamp_count;
-
-    // calculate standard deviation
-    uint64_t expected_square_latency_us =
-      tol_square_latency_us / valid_timestamp_count;
-    uint64_t square_avg_latency_us =
-      (summary.client_avg_latency_ns * summary.client_avg_latency_ns) /
-      (1000 * 1000);
-    uint64_t var_us = (expected_square_latency_us > square_avg_latency_us) ?
-      (expected_square_latency_us - square_avg_latency_us) : 0;
-    summary.std_us = (uint64_t)(sqrt(var_us));
+      (int)(valid_request_count * summary.batch_size / client_duration_sec);
+    summary.client_min_latency_ns = latency.Min();
+    summary.client_max_latency_ns = latency.Max();
+    summary.client_avg_latency_ns = latency.Mean();
+    summary.std_us = latency.StdDev() / 1000;
+    summary.client_p50_latency_ns = latency.ValueAtPercentile(50);
+    summary.client_p90_latency_ns = latency.ValueAtPercentile(90);
+    summary.client_p95_latency_ns = latency.ValueAtPercentile(95);
+    summary.client_p99_latency_ns = latency.ValueAtPercentile(99);
+    summary.client_p999_latency_ns = latency.ValueAtPercentile(99.9);
 
     size_t completed_count =
       end_stat.completed_request_count - start_stat.completed_request_count;
@@ -618,6 +997,10 @@ private:
       summary.client_avg_send_time_ns = send_time_ns / completed_count;
       summary.client_avg_receive_time_ns = receive_time_ns / completed_count;
     }
+    summary.client_reused_connection_count =
+      end_stat.reused_connection_count - start_stat.reused_connection_count;
+    summary.client_new_connection_count =
+      end_stat.new_connection_count - start_stat.new_connection_count;
 
     //===============
     // Summarizing statistic measured by client
@@ -681,78 +1064,22 @@ private:
   void
   Infer(
     std::shared_ptr<nic::Error> err,
-    std::shared_ptr<nic::InferContext::Stat> stat,
-    std::shared_ptr<TimestampVector> timestamp,
+    std::shared_ptr<nic::InferContext> own_ctx,
+    std::shared_ptr<TimestampRing> ring,
     std::shared_ptr<size_t> pause_index, const size_t thread_index)
   {
-    // Create the context for inference of the specified model.
-    std::unique_ptr<nic::InferContext> ctx;
-    if (protocol_ == ProtocolType::HTTP) {
-      *err = nic::InferHttpContext::Create(
-        &ctx, url_, model_name_, model_version_, false);
-    } else {
-      *err = nic::InferGrpcContext::Create(
-        &ctx, url_, model_name_, model_version_, false);
-    }
-    if (!err->IsOk()) {
-      return;
-    }
-
-    if (batch_size_ > ctx->MaxBatchSize()) {
-      *err =
-        nic::Error(
-          ni::RequestStatusCode::INVALID_ARG,
-          "expecting batch size <= " + std::to_string(ctx->MaxBatchSize()) +
-          " for model '" + ctx->ModelName() + "'");
-      return;
-    }
-
-    // Prepare context for 'batch_size' batches. Request that all
-    // outputs be returned.
-    std::unique_ptr<nic::InferContext::Options> options;
-    *err = nic::InferContext::Options::Create(&options);
-    if (!err->IsOk()) {
-      return;
-    }
-
-    options->SetBatchSize(batch_size_);
-    for (const auto& output : ctx->Outputs()) {
-      options->AddRawResult(output);
-    }
+    // Use the context of the thread, unless the threads share one.
+    nic::InferContext* ctx = shared_ctx_ ? shared_ctx_.get() : own_ctx.get();
 
-    *err = ctx->SetRunOptions(*options);
+    // Initialize inputs to use random values from a buffer we (re)use
+    // for all input values.
+    std::vector<uint8_t> input_buf;
+    *err = InitializeInputs(ctx, &input_buf);
     if (!err->IsOk()) {
+      ReleaseSharedContext();
       return;
     }
 
-    // Create a randomly initialized buffer that is large enough to
-    // provide the largest needed input. We (re)use this buffer for all
-    // input values.
-    size_t max_input_byte_size = 0;
-    for (const auto& input : ctx->Inputs()) {
-      max_input_byte_size = std::max(max_input_byte_size, input->ByteSize());
-    }
-
-    std::vector<uint8_t> input_buf(max_input_byte_size);
-    for (size_t i = 0; i < input_buf.size(); ++i) {
-      input_buf[i] = rand();
-    }
-
-    // Initialize inputs to use random values...
-    for (const auto& input : ctx->Inputs()) {
-      *err = input->Reset();
-      if (!err->IsOk()) {
-        return;
-      }
-
-      for (size_t i = 0; i < batch_size_; ++i) {
-        *err = input->SetRaw(&input_buf[0], input->ByteSize());
-        if (!err->IsOk()) {
-          return;
-        }
-      }
-    }
-
     // run inferencing until receiving exit signal to maintain server load.
     do {
       // Run inference to get output
@@ -769,16 +1096,11 @@ private:
       clock_gettime(CLOCK_MONOTONIC, &end_time);
 
       if (!err->IsOk()) {
+        ReleaseSharedContext();
         return;
       }
 
-      // Add the request timestamp to shared vector with proper locking
-      status_report_mutex_.lock();
-      // Critical section
-      request_timestamps_->emplace_back(std::make_pair(start_time, end_time));
-      // Update its InferContext statistic to shared Stat pointer
-      ctx->GetStat(stat.get());
-      status_report_mutex_.unlock();
+      RecordLatency(ring.get(), start_time, end_time);
 
       // Wait if the thread should be paused
       if (thread_index >= *pause_index) {
@@ -791,88 +1113,38 @@ private:
       }
       // Stop inferencing if an early exit has been signaled.
     } while (!early_exit);
+    ReleaseSharedContext();
     if (verbose_) {
       std::cout
         << "Thread [" << thread_index << "] received exit signal" << std::endl;
     }
   }
 
+  // Have the shared context, if any, forget the inputs of the calling
+  // worker thread, which refer to the input buffer of the thread.
+  void ReleaseSharedContext()
+  {
+    if (shared_ctx_) {
+      shared_ctx_->ReleaseThread();
+    }
+  }
+
   // Function for worker threads
   void
   AsyncInfer(
     std::shared_ptr<nic::Error> err,
-    std::shared_ptr<nic::InferContext::Stat> stat,
-    std::shared_ptr<TimestampVector> timestamp,
-    std::shared_ptr<size_t> pause_index)
+    std::shared_ptr<nic::InferContext> ctx,
+    std::shared_ptr<TimestampRing> ring,
+    std::shared_ptr<size_t> pause_index, const size_t thread_index)
   {
-    // Create the context for inference of the specified model.
-    std::unique_ptr<nic::InferContext> ctx;
-    if (protocol_ == ProtocolType::HTTP) {
-      *err = nic::InferHttpContext::Create(
-        &ctx, url_, model_name_, model_version_, false);
-    } else {
-      *err = nic::InferGrpcContext::Create(
-        &ctx, url_, model_name_, model_version_, false);
-    }
+    // Initialize inputs to use random values from a buffer we (re)use
+    // for all input values.
+    std::vector<uint8_t> input_buf;
+    *err = InitializeInputs(ctx.get(), &input_buf);
     if (!err->IsOk()) {
       return;
     }
 
-    if (batch_size_ > ctx->MaxBatchSize()) {
-      *err =
-        nic::Error(
-          ni::RequestStatusCode::INVALID_ARG,
-          "expecting batch size <= " + std::to_string(ctx->MaxBatchSize()) +
-          " for model '" + ctx->ModelName() + "'");
-      return;
-    }
-
-    // Prepare context for 'batch_size' batches. Request that all
-    // outputs be returned.
-    std::unique_ptr<nic::InferContext::Options> options;
-    *err = nic::InferContext::Options::Create(&options);
-    if (!err->IsOk()) {
-      return;
-    }
-
-    options->SetBatchSize(batch_size_);
-    for (const auto& output : ctx->Outputs()) {
-      options->AddRawResult(output);
-    }
-
-    *err = ctx->SetRunOptions(*options);
-    if (!err->IsOk()) {
-      return;
-    }
-
-    // Create a randomly initialized buffer that is large enough to
-    // provide the largest needed input. We (re)use this buffer for all
-    // input values.
-    size_t max_input_byte_size = 0;
-    for (const auto& input : ctx->Inputs()) {
-      max_input_byte_size = std::max(max_input_byte_size, input->ByteSize());
-    }
-
-    std::vector<uint8_t> input_buf(max_input_byte_size);
-    for (size_t i = 0; i < input_buf.size(); ++i) {
-      input_buf[i] = rand();
-    }
-
-    // Initialize inputs to use random values...
-    for (const auto& input : ctx->Inputs()) {
-      *err = input->Reset();
-      if (!err->IsOk()) {
-        return;
-      }
-
-      for (size_t i = 0; i < batch_size_; ++i) {
-        *err = input->SetRaw(&input_buf[0], input->ByteSize());
-        if (!err->IsOk()) {
-          return;
-        }
-      }
-    }
-
     std::map<uint64_t, struct timespec> requests_start_time;
     // run inferencing until receiving exit signal to maintain server load.
     do {
@@ -880,9 +1152,26 @@ private:
       std::vector<std::unique_ptr<nic::InferContext::Result>> results;
       std::shared_ptr<nic::InferContext::Request> request;
 
+      // Wait while the thread has no share of the concurrency level (here
+      // is '*pause_index') and no request left to complete
+      if (requests_start_time.empty() &&
+          (AsyncThreadConcurrency(*pause_index, thread_index) == 0)) {
+        std::unique_lock<std::mutex> lk(wake_mutex_);
+        wake_signal_.wait(
+          lk,
+          [this, thread_index, pause_index] {
+            return
+              early_exit ||
+              (AsyncThreadConcurrency(*pause_index, thread_index) != 0);
+          });
+        continue;
+      }
+
       // Create async requests such that the number of ongoing requests
-      // matches the concurrency level (here is '*pause_index')
-      while (requests_start_time.size() < *pause_index) {
+      // matches the share of the thread in the concurrency level
+      const size_t concurrency =
+        AsyncThreadConcurrency(*pause_index, thread_index);
+      while (requests_start_time.size() < concurrency) {
         struct timespec start_time;
         clock_gettime(CLOCK_MONOTONIC, &start_time);
         *err = ctx->AsyncRun(&request);
@@ -892,15 +1181,11 @@ private:
         requests_start_time.emplace(request->Id(), start_time);
       }
 
-      if (requests_start_time.size() < *pause_index) {
-        std::cerr << "This message shouldn't be printed twice in a row" << std::endl;
-      }
-
       // Get any request that is completed and
       // record the end time of the request
       while (true) {
         nic::Error tmp_err;
-        if (requests_start_time.size() >= *pause_index) {
+        if (requests_start_time.size() >= concurrency) {
           tmp_err = ctx->GetReadyAsyncRequest(&request, true);
         } else {
           // Don't wait if worker needs to maintain concurrency level
@@ -928,20 +1213,146 @@ private:
         struct timespec start_time = itr->second;
         requests_start_time.erase(itr);
 
-        // Add the request timestamp to shared vector with proper locking
-        status_report_mutex_.lock();
-        // Critical section
-        request_timestamps_->emplace_back(std::make_pair(start_time, end_time));
-        // Update its InferContext statistic to shared Stat pointer
-        ctx->GetStat(stat.get());
-        status_report_mutex_.unlock();
+        RecordLatency(ring.get(), start_time, end_time);
       }
 
       // Stop inferencing if an early exit has been signaled.
     } while (!early_exit);
     if (verbose_) {
       std::cout
-        << "Async worker thread received exit signal" << std::endl;
+        << "Async worker thread [" << thread_index << "] received exit signal"
+        << std::endl;
+    }
+  }
+
+  // Function for the worker thread sending requests at a rate
+  void
+  RateInfer(
+    std::shared_ptr<nic::Error> err,
+    std::shared_ptr<nic::InferContext> ctx, const double request_rate)
+  {
+    // Initialize inputs to use random values from a buffer we (re)use
+    // for all input values.
+    std::vector<uint8_t> input_buf;
+    *err = InitializeInputs(ctx.get(), &input_buf);
+    if (!err->IsOk()) {
+      return;
+    }
+
+    // The requests of a burst are due at the same time and the bursts
+    // are spread to keep the overall rate.
+    const size_t burst_size =
+      (request_distribution_ == RequestDistribution::BURSTY) ? burst_size_ : 1;
+    const double interval_ns = burst_size * ni::NANOS_PER_SECOND / request_rate;
+    std::mt19937_64 rng(std::random_device{}());
+    std::exponential_distribution<double> poisson_interval(1 / interval_ns);
+
+    // The schedule is kept as an offset from the start so that rounding
+    // doesn't accumulate.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const uint64_t start_ns = now.tv_sec * ni::NANOS_PER_SECOND + now.tv_nsec;
+    double due_offset_ns = 0;
+    size_t burst_idx = 0;
+
+    // Send requests until receiving exit signal, at the time they are
+    // due or as soon as possible if the worker fell behind.
+    while (!early_exit) {
+      const uint64_t due_ns = start_ns + (uint64_t)due_offset_ns;
+      struct timespec due_time;
+      due_time.tv_sec = due_ns / ni::NANOS_PER_SECOND;
+      due_time.tv_nsec = due_ns % ni::NANOS_PER_SECOND;
+      while (!early_exit) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const uint64_t wake_ns =
+          now.tv_sec * ni::NANOS_PER_SECOND + now.tv_nsec + kRateSleepSliceNs;
+        if (wake_ns >= due_ns) {
+          clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due_time, NULL);
+          break;
+        }
+        struct timespec wake_time;
+        wake_time.tv_sec = wake_ns / ni::NANOS_PER_SECOND;
+        wake_time.tv_nsec = wake_ns % ni::NANOS_PER_SECOND;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_time, NULL);
+      }
+
+      // Requests due while at the limit of outstanding requests are sent
+      // late, their latency is still measured from when they were due.
+      {
+        std::unique_lock<std::mutex> lk(wake_mutex_);
+        if (max_outstanding_requests_ != 0) {
+          wake_signal_.wait(
+            lk,
+            [this] {
+              return
+                early_exit ||
+                (outstanding_request_count_ < max_outstanding_requests_);
+            });
+        }
+        if (early_exit) {
+          break;
+        }
+        outstanding_request_count_++;
+      }
+
+      nic::Error send_err =
+        ctx->AsyncRun(
+          [this, err, due_time](
+            const std::shared_ptr<nic::InferContext::Request>& request,
+            std::vector<std::unique_ptr<nic::InferContext::Result>>* results,
+            const nic::Error& request_err) {
+            // Record the end time of the request
+            struct timespec end_time;
+            clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+            // The callbacks may run on several threads of the client
+            // library, which can't share a single-producer ring.
+            if (request_err.IsOk()) {
+              RecordLatency(nullptr, due_time, end_time);
+            } else {
+              ReportRateError(err, request_err);
+            }
+
+            // Notify with the lock held, the rate worker returns and
+            // the manager may be destroyed once the count drops to 0.
+            std::lock_guard<std::mutex> lk(wake_mutex_);
+            outstanding_request_count_--;
+            wake_signal_.notify_all();
+          });
+      if (!send_err.IsOk()) {
+        {
+          std::lock_guard<std::mutex> lk(wake_mutex_);
+          outstanding_request_count_--;
+        }
+        ReportRateError(err, send_err);
+        break;
+      }
+
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      const uint64_t send_ns = now.tv_sec * ni::NANOS_PER_SECOND + now.tv_nsec;
+      cumulative_send_delay_ns_ += (send_ns > due_ns) ? (send_ns - due_ns) : 0;
+      sent_request_count_++;
+
+      // Time until the next request is due
+      if (request_distribution_ == RequestDistribution::POISSON) {
+        due_offset_ns += poisson_interval(rng);
+      } else if (++burst_idx >= burst_size) {
+        burst_idx = 0;
+        due_offset_ns += interval_ns;
+      }
+    }
+
+    // The requests in flight read their inputs from 'input_buf' and
+    // their callbacks use the manager, wait for them before returning.
+    {
+      std::unique_lock<std::mutex> lk(wake_mutex_);
+      wake_signal_.wait(
+        lk, [this] { return outstanding_request_count_ == 0; });
+    }
+
+    if (verbose_) {
+      std::cout
+        << "Rate worker thread received exit signal" << std::endl;
     }
   }
 
@@ -967,13 +1378,44 @@ private:
       }
     }
 
+    // Record the CPU time used by the whole client process over the
+    // same period as the context statistic so that it can be reported
+    // per completed request.
+    struct timespec start_cpu_time, end_cpu_time;
+    struct timespec start_wall_time, end_wall_time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start_cpu_time);
+    clock_gettime(CLOCK_MONOTONIC, &start_wall_time);
+    const std::map<std::string, uint64_t> start_thread_cpu_ns =
+      ThreadCpuTimes();
     err = GetAccumulatedContextStat(&start_stat);
-
-    // Wait for specified time interval in msec
-    std::this_thread::sleep_for(
-      std::chrono::milliseconds((uint64_t)(measurement_window_ms_ * 1.2)));
+    DrainTimestampRings();
+    const nic::LatencyHistogram start_latency(request_latency_);
+    const uint64_t start_sent_count = sent_request_count_;
+    const uint64_t start_send_delay_ns = cumulative_send_delay_ns_;
+
+    // Wait for specified time interval in msec, draining the rings
+    // meanwhile so that the worker threads seldom find them full.
+    const auto window_end =
+      std::chrono::steady_clock::now() +
+      std::chrono::milliseconds((uint64_t)(measurement_window_ms_ * 1.2));
+    for (auto now = std::chrono::steady_clock::now(); now < window_end;
+         now = std::chrono::steady_clock::now()) {
+      std::this_thread::sleep_for(
+        std::min<std::chrono::steady_clock::duration>(
+          window_end - now,
+          std::chrono::milliseconds(kTimestampRingDrainIntervalMs)));
+      DrainTimestampRings();
+    }
 
     err = GetAccumulatedContextStat(&end_stat);
+    DrainTimestampRings();
+    const nic::LatencyHistogram end_latency(request_latency_);
+    const uint64_t end_sent_count = sent_request_count_;
+    const uint64_t end_send_delay_ns = cumulative_send_delay_ns_;
+    const std::map<std::string, uint64_t> end_thread_cpu_ns =
+      ThreadCpuTimes();
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end_cpu_time);
+    clock_gettime(CLOCK_MONOTONIC, &end_wall_time);
 
     // Stop profiling on the server if requested.
     if (profile_) {
@@ -990,11 +1432,56 @@ private:
       return err;
     }
 
+    uint64_t cpu_time_ns =
+      (end_cpu_time.tv_sec * ni::NANOS_PER_SECOND + end_cpu_time.tv_nsec) -
+      (start_cpu_time.tv_sec * ni::NANOS_PER_SECOND + start_cpu_time.tv_nsec);
+    uint64_t wall_time_ns =
+      (end_wall_time.tv_sec * ni::NANOS_PER_SECOND + end_wall_time.tv_nsec) -
+      (start_wall_time.tv_sec * ni::NANOS_PER_SECOND + start_wall_time.tv_nsec);
+
     err = Summarize(
-      status_summary, start_status, end_status, start_stat, end_stat);
+      status_summary, start_status, end_status, start_stat, end_stat,
+      start_latency, end_latency, wall_time_ns);
     if (!err.IsOk()) {
       return err;
     }
+    size_t completed_count =
+      end_stat.completed_request_count - start_stat.completed_request_count;
+    status_summary.client_avg_cpu_time_ns =
+      (completed_count != 0) ? (cpu_time_ns / completed_count) : 0;
+    status_summary.client_cpu_utilization =
+      (wall_time_ns != 0) ? ((double)cpu_time_ns / wall_time_ns) : 0;
+
+    // The client limits the throughput once one of its threads or all
+    // the cores are (nearly) always busy.
+    status_summary.client_max_thread_utilization = 0;
+    for (const auto& end_cpu : end_thread_cpu_ns) {
+      const auto start_cpu = start_thread_cpu_ns.find(end_cpu.first);
+      const uint64_t start_cpu_ns =
+        (start_cpu != start_thread_cpu_ns.end()) ? start_cpu->second : 0;
+      if ((wall_time_ns != 0) && (end_cpu.second > start_cpu_ns)) {
+        status_summary.client_max_thread_utilization = std::max(
+          status_summary.client_max_thread_utilization,
+          (double)(end_cpu.second - start_cpu_ns) / wall_time_ns);
+      }
+    }
+    const size_t core_count = std::max(std::thread::hardware_concurrency(), 1u);
+    status_summary.client_cpu_bound =
+      (status_summary.client_max_thread_utilization >= 0.9) ||
+      (status_summary.client_cpu_utilization >= 0.9 * core_count);
+
+    // The requests sent at a rate complete in the window of the summary,
+    // those sent are counted over the whole measurement.
+    const uint64_t sent_count = end_sent_count - start_sent_count;
+    status_summary.client_request_rate =
+      (double)status_summary.client_request_count * ni::NANOS_PER_SECOND /
+      status_summary.client_duration_ns;
+    status_summary.client_send_rate =
+      (wall_time_ns != 0) ?
+        ((double)sent_count * ni::NANOS_PER_SECOND / wall_time_ns) : 0;
+    status_summary.client_avg_send_delay_ns =
+      (sent_count != 0) ?
+        ((end_send_delay_ns - start_send_delay_ns) / sent_count) : 0;
 
     return nic::Error(ni::RequestStatusCode::SUCCESS);
   }
@@ -1006,15 +1493,28 @@ private:
   uint64_t measurement_window_ms_;
   size_t max_measurement_count_;
   bool async_;
+  size_t async_thread_count_;
+  bool shared_context_;
+  bool streaming_;
+  RequestDistribution request_distribution_;
+  size_t burst_size_;
+  size_t max_outstanding_requests_;
   std::string model_name_;
   int model_version_;
   std::string url_;
   ProtocolType protocol_;
 
+  // Thread-safe context used by all worker threads if
+  // 'shared_context_', must outlive them.
+  std::unique_ptr<nic::InferContext> shared_ctx_;
+
   // Note: early_exit signal is kept global
   std::vector<std::thread> threads_;
   std::vector<std::shared_ptr<nic::Error>> threads_status_;
-  std::vector<std::shared_ptr<nic::InferContext::Stat>> threads_context_stat_;
+  // Context of each worker thread, unless they share 'shared_ctx_'
+  std::vector<std::shared_ptr<nic::InferContext>> threads_ctx_;
+  // Ring of each worker thread that records its requests
+  std::vector<std::shared_ptr<TimestampRing>> threads_ring_;
 
   // pause_index_ tells threads (with idx >= pause_index_) to pause sending
   // requests such that load level can decrease without terminating threads.
@@ -1023,12 +1523,21 @@ private:
   std::condition_variable wake_signal_;
   std::mutex wake_mutex_;
 
-  // Pointer to a vector of request timestamps <start_time, end_time>
-  // Request latency will be end_time - start_time
-  std::shared_ptr<TimestampVector> request_timestamps_;
-  // Mutex to avoid race condition on adding elements into the timestamp vector
-  // and on updating context statistic.
-  std::mutex status_report_mutex_;
+  // Latencies of all requests completed, drained from the rings of the
+  // worker threads or, if a ring is full, recorded by the worker threads
+  // without locking. A measurement subtracts the latencies recorded
+  // before it started from those recorded when it ends.
+  nic::LatencyHistogram request_latency_;
+  // Set once the rate worker thread status holds an error
+  std::atomic<bool> rate_error_reported_;
+
+  // Number of requests sent at a rate and the sum of the time between
+  // when they were due and when they were sent.
+  std::atomic<uint64_t> sent_request_count_;
+  std::atomic<uint64_t> cumulative_send_delay_ns_;
+  // Number of requests sent at a rate that haven't completed, guarded
+  // by 'wake_mutex_'.
+  size_t outstanding_request_count_;
 };
 
 ProtocolType
@@ -1051,6 +1560,29 @@ ParseProtocol(const std::string& str)
   return ProtocolType::HTTP;
 }
 
+RequestDistribution
+ParseRequestDistribution(const std::string& str)
+{
+  std::string distribution(str);
+  std::transform(
+    distribution.begin(), distribution.end(), distribution.begin(),
+    ::tolower);
+  if (distribution == "constant") {
+    return RequestDistribution::CONSTANT;
+  } else if (distribution == "poisson") {
+    return RequestDistribution::POISSON;
+  } else if (distribution == "bursty") {
+    return RequestDistribution::BURSTY;
+  }
+
+  std::cerr
+    << "unexpected request distribution \"" << str
+    << "\", expecting constant, poisson or bursty" << std::endl;
+  exit(1);
+
+  return RequestDistribution::CONSTANT;
+}
+
 nic::Error
 Report(
   const PerfStatus& summary, const size_t concurrent_request_count,
@@ -1110,16 +1642,57 @@ Report(
         std::to_string(avg_response_wait_time_us) + " usec + receive " +
         std::to_string(avg_receive_time_us) + " usec)";
     }
+    client_library_detail +=
+      "\n    Connections: " +
+      std::to_string(summary.client_reused_connection_count) + " reused, " +
+      std::to_string(summary.client_new_connection_count) + " new";
+  }
+
+  std::string request_rate_detail;
+  if (summary.target_request_rate > 0) {
+    std::ostringstream rate;
+    rate
+      << std::fixed << std::setprecision(1)
+      << "    Request rate: " << summary.client_request_rate
+      << " requests/sec (target " << summary.target_request_rate
+      << ", sent " << summary.client_send_rate << ")" << std::endl
+      << "    Avg send delay: " << (summary.client_avg_send_delay_ns / 1000)
+      << " usec" << std::endl;
+    request_rate_detail = rate.str();
+  }
+
+  std::string cpu_bound_detail;
+  if (summary.client_cpu_bound) {
+    std::ostringstream cpu_bound;
+    cpu_bound
+      << std::fixed << std::setprecision(1)
+      << "    Warning: client is CPU-bound (busiest client thread "
+      << (summary.client_max_thread_utilization * 100)
+      << "% busy), throughput may be limited by the client rather than"
+      << " the server" << std::endl;
+    cpu_bound_detail = cpu_bound.str();
   }
 
   std::cout
     << "  Client: " << std::endl
     << "    Request count: " << summary.client_request_count << std::endl
+    << request_rate_detail
     << "    Throughput: " << summary.client_infer_per_sec
     << " infer/sec" << std::endl
     << "    Avg latency: " << avg_latency_us << " usec"
     << " (standard deviation " << std_us << " usec)" << std::endl
+    << "    Latency percentiles: p50 "
+    << (summary.client_p50_latency_ns / 1000) << " usec, p90 "
+    << (summary.client_p90_latency_ns / 1000) << " usec, p95 "
+    << (summary.client_p95_latency_ns / 1000) << " usec, p99 "
+    << (summary.client_p99_latency_ns / 1000) << " usec, p99.9 "
+    << (summary.client_p999_latency_ns / 1000) << " usec" << std::endl
     << client_library_detail << std::endl
+    << "    Avg client CPU: " << (summary.client_avg_cpu_time_ns / 1000)
+    << " usec per request (" << std::fixed << std::setprecision(1)
+    << (summary.client_cpu_utilization * 100) << "% of one core)"
+    << std::defaultfloat << std::endl
+    << cpu_bound_detail
     << "  Server: " << std::endl
     << "    Request count: " << cnt << std::endl
     << "    Avg request latency: " << cumm_avg_us << " usec"
@@ -1131,6 +1704,255 @@ Report(
   return nic::Error(ni::RequestStatusCode::SUCCESS);
 }
 
+// The latency compared against the latency threshold, the client average
+// latency or, if 'latency_percentile' is not 0, the client latency at
+// that percentile.
+uint64_t
+ThresholdLatency(const PerfStatus& summary, const double latency_percentile)
+{
+  if (latency_percentile == 50) {
+    return summary.client_p50_latency_ns;
+  } else if (latency_percentile == 90) {
+    return summary.client_p90_latency_ns;
+  } else if (latency_percentile == 95) {
+    return summary.client_p95_latency_ns;
+  } else if (latency_percentile == 99) {
+    return summary.client_p99_latency_ns;
+  } else if (latency_percentile == 99.9) {
+    return summary.client_p999_latency_ns;
+  }
+
+  return summary.client_avg_latency_ns;
+}
+
+// Find the knee of the latency vs. throughput curve of 'summary',
+// sorted by increasing concurrency, as the point furthest above the
+// line from the first to the last point once both axes are scaled to
+// [0, 1], that is where latency starts growing faster than throughput.
+// @return the index of the knee in 'summary', or -1 if there are too
+// few points to tell.
+int
+FindKnee(
+  const std::vector<PerfStatus>& summary, const double latency_percentile)
+{
+  if (summary.size() < 3) {
+    return -1;
+  }
+
+  double min_ips = summary[0].client_infer_per_sec;
+  double max_ips = min_ips;
+  double min_latency = ThresholdLatency(summary[0], latency_percentile);
+  double max_latency = min_latency;
+  for (const auto& status : summary) {
+    const double latency = ThresholdLatency(status, latency_percentile);
+    min_ips = std::min(min_ips, (double)status.client_infer_per_sec);
+    max_ips = std::max(max_ips, (double)status.client_infer_per_sec);
+    min_latency = std::min(min_latency, latency);
+    max_latency = std::max(max_latency, latency);
+  }
+  if ((max_ips == min_ips) || (max_latency == min_latency)) {
+    return -1;
+  }
+
+  int knee = -1;
+  double max_distance = 0;
+  for (size_t i = 0; i < summary.size(); ++i) {
+    const double ips =
+      (summary[i].client_infer_per_sec - min_ips) / (max_ips - min_ips);
+    const double latency =
+      (ThresholdLatency(summary[i], latency_percentile) - min_latency) /
+      (max_latency - min_latency);
+    if (ips - latency > max_distance) {
+      max_distance = ips - latency;
+      knee = i;
+    }
+  }
+
+  return knee;
+}
+
+// Search for the highest concurrency with a latency below
+// 'latency_threshold_ms'. The concurrency is doubled from
+// 'start_concurrency' until the latency reaches the threshold or the
+// concurrency reaches 'max_concurrency' (if not 0), and the range
+// between the highest concurrency below the threshold and the lowest at
+// or above it is then bisected. No new measurement is started once
+// 'max_search_time_s' (if not 0) has elapsed. Each measurement is
+// reported and added to 'summary', which is returned sorted by
+// increasing concurrency.
+nic::Error
+SearchConcurrency(
+  ConcurrencyManager* manager, std::vector<PerfStatus>* summary,
+  const size_t start_concurrency, const size_t max_concurrency,
+  const uint64_t latency_threshold_ms, const double latency_percentile,
+  const uint64_t max_search_time_s, const ProtocolType protocol,
+  const bool verbose)
+{
+  const uint64_t latency_threshold_ns = latency_threshold_ms * 1000 * 1000;
+  const auto deadline =
+    std::chrono::steady_clock::now() +
+    std::chrono::seconds(max_search_time_s);
+
+  // Highest concurrency measured below the threshold and lowest
+  // measured at or above it, 0 if none.
+  size_t below = 0;
+  size_t above = 0;
+  size_t concurrency = start_concurrency;
+  while (!early_exit) {
+    if ((max_search_time_s != 0) &&
+        (std::chrono::steady_clock::now() >= deadline)) {
+      std::cout
+        << "Search stopped after " << max_search_time_s << " sec"
+        << std::endl << std::endl;
+      break;
+    }
+
+    PerfStatus status_summary;
+    nic::Error err = manager->Step(status_summary, concurrency);
+    if (err.IsOk()) {
+      err = Report(status_summary, concurrency, protocol, verbose);
+    }
+    if (!err.IsOk()) {
+      return err;
+    }
+    summary->push_back(status_summary);
+
+    if (ThresholdLatency(status_summary, latency_percentile) <
+        latency_threshold_ns) {
+      below = concurrency;
+    } else {
+      above = concurrency;
+    }
+
+    if (above == 0) {
+      if ((max_concurrency != 0) && (concurrency >= max_concurrency)) {
+        break;
+      }
+      concurrency *= 2;
+      if (max_concurrency != 0) {
+        concurrency = std::min(concurrency, max_concurrency);
+      }
+    } else {
+      if (above - below <= 1) {
+        break;
+      }
+      concurrency = below + (above - below) / 2;
+    }
+  }
+
+  std::sort(
+    summary->begin(), summary->end(),
+    [] (const PerfStatus& a, const PerfStatus& b) -> bool {
+          return a.concurrency < b.concurrency;
+        });
+
+  // Report the highest concurrency and the highest throughput below the
+  // threshold, the latter may be at a lower concurrency.
+  const PerfStatus* highest = nullptr;
+  const PerfStatus* best = nullptr;
+  for (const auto& status : *summary) {
+    if (ThresholdLatency(status, latency_percentile) < latency_threshold_ns) {
+      highest = &status;
+      if ((best == nullptr) ||
+          (status.client_infer_per_sec > best->client_infer_per_sec)) {
+        best = &status;
+      }
+    }
+  }
+
+  if (highest == nullptr) {
+    std::cout
+      << "No concurrency measured has latency below the threshold"
+      << std::endl;
+  } else {
+    std::cout
+      << "Highest concurrency below latency threshold: "
+      << highest->concurrency << ", " << highest->client_infer_per_sec
+      << " infer/sec, latency "
+      << (ThresholdLatency(*highest, latency_percentile) / 1000) << " usec"
+      << std::endl
+      << "Highest throughput below latency threshold: "
+      << best->client_infer_per_sec << " infer/sec at concurrency "
+      << best->concurrency << ", latency "
+      << (ThresholdLatency(*best, latency_percentile) / 1000) << " usec"
+      << std::endl;
+  }
+
+  const int knee = FindKnee(*summary, latency_percentile);
+  if (knee >= 0) {
+    const PerfStatus& status = (*summary)[knee];
+    std::cout
+      << "Knee of latency vs. throughput: concurrency " << status.concurrency
+      << ", " << status.client_infer_per_sec << " infer/sec, latency "
+      << (ThresholdLatency(status, latency_percentile) / 1000) << " usec"
+      << std::endl;
+  }
+  std::cout << std::endl;
+
+  return nic::Error::Success;
+}
+
+// Measure the average time to create an inference context for the
+// model, first with the model configuration fetched from the server
+// for every context and then with it taken from the model
+// configuration cache. The first context of each is not measured, it
+// sets up the connection and fills the cache.
+nic::Error
+MeasureContextCreation(
+  const std::string& url, const ProtocolType protocol,
+  const std::string& model_name, const int model_version,
+  const bool streaming, const size_t context_count)
+{
+  uint64_t avg_ns[2];
+  for (const bool cached : { false, true }) {
+    nic::ModelConfigCache::SetTTL(
+      cached ? std::numeric_limits<uint32_t>::max() : 0);
+    nic::ModelConfigCache::InvalidateAll();
+
+    struct timespec start_time;
+    for (size_t i = 0; (i <= context_count) && !early_exit; i++) {
+      if (i == 1) {
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+      }
+
+      std::unique_ptr<nic::InferContext> ctx;
+      nic::Error err;
+      if (protocol == ProtocolType::HTTP) {
+        err = nic::InferHttpContext::Create(
+          &ctx, url, model_name, model_version, false);
+      } else {
+        err = nic::InferGrpcContext::Create(
+          &ctx, url, model_name, model_version, false, streaming);
+      }
+      if (!err.IsOk()) {
+        return err;
+      }
+    }
+    if (early_exit) {
+      return
+        nic::Error(ni::RequestStatusCode::INTERNAL, "Received exit signal.");
+    }
+
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    avg_ns[cached] =
+      ((end_time.tv_sec - start_time.tv_sec) * ni::NANOS_PER_SECOND +
+       end_time.tv_nsec - start_time.tv_nsec) / context_count;
+  }
+
+  std::cout
+    << "*** Context Creation ***" << std::endl
+    << "  Contexts created: " << context_count << std::endl
+    << "  Without model configuration cache: " << (avg_ns[0] / 1000)
+    << " usec per context" << std::endl
+    << "  With model configuration cache: " << (avg_ns[1] / 1000)
+    << " usec per context (delta "
+    << (int64_t(avg_ns[1] / 1000) - int64_t(avg_ns[0] / 1000)) << " usec)"
+    << std::endl;
+
+  return nic::Error::Success;
+}
+
 void
 Usage(char** argv, const std::string& msg = std::string())
 {
@@ -1146,7 +1968,14 @@ Usage(char** argv, const std::string& msg = std::string())
   std::cerr << "\t-t <number of concurrent requests>" << std::endl;
   std::cerr << "\t-d" << std::endl;
   std::cerr << "\t-a" << std::endl;
+  std::cerr << "\t-g" << std::endl;
+  std::cerr << "\t-k <number of gRPC channels>" << std::endl;
+  std::cerr << "\t-w <number of async worker threads>" << std::endl;
+  std::cerr << "\t-e" << std::endl;
   std::cerr << "\t-l <latency threshold (in msec)>" << std::endl;
+  std::cerr << "\t-S" << std::endl;
+  std::cerr << "\t-P <latency percentile>" << std::endl;
+  std::cerr << "\t-T <maximum search time (in sec)>" << std::endl;
   std::cerr << "\t-c <maximum concurrency>" << std::endl;
   std::cerr << "\t-s <deviation threshold for stable measurement"
     << " (in percentage)>" << std::endl;
@@ -1157,17 +1986,56 @@ Usage(char** argv, const std::string& msg = std::string())
   std::cerr << "\t-m <model name>" << std::endl;
   std::cerr << "\t-x <model version>" << std::endl;
   std::cerr << "\t-u <URL for inference service>" << std::endl;
+  std::cerr << "\t-U <Unix domain socket path to compare with>" << std::endl;
   std::cerr << "\t-i <Protocol used to communicate with inference service>"
     << std::endl;
+  std::cerr << "\t-R <request rate (in requests/sec)>" << std::endl;
+  std::cerr << "\t-D <request distribution>" << std::endl;
+  std::cerr << "\t-B <burst size>" << std::endl;
+  std::cerr << "\t-C <number of contexts to create>" << std::endl;
   std::cerr << std::endl;
   std::cerr
     << "The -d flag enables dynamic concurrent request count where the number"
     << " of concurrent requests will increase linearly until the request"
     << " latency is above the threshold set (see -l)." << std::endl;
+  std::cerr
+    << "The -S flag enables search mode where the number of concurrent"
+    << " requests is doubled until the request latency is above the threshold"
+    << " set (see -l), and then bisected to find the highest number of"
+    << " concurrent requests with a latency below the threshold. The knee of"
+    << " the latency vs. throughput curve measured is also reported."
+    << std::endl;
   std::cerr
     << "The -a flag changes the way to maintain concurrency level from"
     << " sending synchronous requests to sending asynchrnous requests."
     << std::endl;
+  std::cerr
+    << "For -w, it indicates the number of worker threads, each with its own"
+    << " inference context, that the concurrent requests are spread over if"
+    << " -a flag is set. Use more threads if the report warns that the"
+    << " client is CPU-bound. Default is 1." << std::endl;
+  std::cerr
+    << "The -g flag makes all threads sending synchronous requests share one"
+    << " thread-safe inference context instead of each thread using its own."
+    << " It has no effect if -a flag is set." << std::endl;
+  std::cerr
+    << "For -k, it indicates the number of gRPC channels, each with its own"
+    << " connection, that the inference contexts are spread over. It has no"
+    << " effect unless -i is gRPC. Default is 1." << std::endl;
+  std::cerr
+    << "The -e flag makes each inference context send its requests over one"
+    << " gRPC StreamInfer stream instead of a unary call per request. It has no"
+    << " effect unless -i is gRPC." << std::endl;
+  std::cerr
+    << "For -u, it indicates the URL of the inference service, host and port"
+    << " or, for a server on the same host, a Unix domain socket given as"
+    << " unix:///<path> for HTTP and unix:<path> for gRPC. Default is"
+    << " localhost:8000." << std::endl;
+  std::cerr
+    << "For -U, it indicates a Unix domain socket of the server given by -u."
+    << " The measurement is taken over the TCP URL of -u and then over the"
+    << " socket, and the latency and throughput of the two are compared. It"
+    << " cannot be used with -d or -S." << std::endl;
   std::cerr
     << "For -t, it indicates the number of starting concurrent requests if -d"
     << " flag is set." << std::endl;
@@ -1194,7 +2062,16 @@ Usage(char** argv, const std::string& msg = std::string())
     << " if the measurement is still unstable after the maximum number of"
     << " measuremnts." << std::endl;
   std::cerr
-    << "For -l, it has no effect unless -d flag is set." << std::endl;
+    << "For -l, it has no effect unless -d or -S flag is set." << std::endl;
+  std::cerr
+    << "For -P, it indicates the latency percentile compared against the"
+    << " latency threshold: 50, 90, 95, 99 or 99.9. Default is to compare the"
+    << " average latency." << std::endl;
+  std::cerr
+    << "For -T, it indicates the time after which search mode stops starting"
+    << " new measurements and reports the best result found so far. Default"
+    << " is 0 to indicate that no limit is set on the search time."
+    << std::endl;
   std::cerr
     << "The -n flag enables profiling for the duration of the run" << std::endl;
   std::cerr
@@ -1203,6 +2080,25 @@ Usage(char** argv, const std::string& msg = std::string())
   std::cerr
     << "For -i, available protocols are gRPC and HTTP. Default is HTTP."
     << std::endl;
+  std::cerr
+    << "For -R, it indicates the rate the requests are sent at regardless of"
+    << " when earlier requests complete, instead of maintaining a number of"
+    << " concurrent requests. The latency of a request is measured from the"
+    << " time it was due to be sent. It cannot be used with -d. If -c is also"
+    << " set, it limits the number of requests in flight, requests due at"
+    << " the limit are sent late." << std::endl;
+  std::cerr
+    << "For -D, it indicates the distribution of the time between requests"
+    << " sent at a rate: constant, poisson or bursty. Bursty sends requests"
+    << " in bursts of -B requests at a time, with constant time between the"
+    << " bursts. Default is constant." << std::endl;
+  std::cerr
+    << "For -B, it indicates the number of requests sent at a time if -D is"
+    << " bursty. Default is 8." << std::endl;
+  std::cerr
+    << "For -C, it indicates the number of inference contexts to create to"
+    << " measure the time it takes with and without the model configuration"
+    << " cache, instead of measuring inferences." << std::endl;
 
   exit(1);
 }
@@ -1215,8 +2111,15 @@ main(int argc, char** argv)
   bool verbose = false;
   bool profile = false;
   bool dynamic_concurrency_mode = false;
+  bool search_mode = false;
   bool profiling_asynchronous_infer = false;
+  int32_t async_thread_count = 1;
+  bool shared_context = false;
+  bool streaming = false;
+  int32_t grpc_channel_count = 1;
   uint64_t latency_threshold_ms = 0;
+  double latency_percentile = 0;
+  uint64_t max_search_time_s = 0;
   int32_t batch_size = 1;
   int32_t concurrent_request_count = 1;
   size_t max_concurrency = 0;
@@ -1226,12 +2129,19 @@ main(int argc, char** argv)
   std::string model_name;
   int model_version = -1;
   std::string url("localhost:8000");
+  std::string unix_socket_path;
   std::string filename("");
   ProtocolType protocol = ProtocolType::HTTP;
+  double request_rate = 0;
+  RequestDistribution request_distribution = RequestDistribution::CONSTANT;
+  int32_t burst_size = 8;
+  size_t context_count = 0;
 
   // Parse commandline...
   int opt;
-  while ((opt = getopt(argc, argv, "vndac:u:m:x:b:t:p:i:l:r:s:f:")) != -1) {
+  while ((opt = getopt(
+            argc, argv,
+            "vndSagec:u:U:m:x:b:t:p:i:l:P:T:r:s:f:k:w:R:D:B:C:")) != -1) {
     switch (opt) {
       case 'v':
         verbose = true;
@@ -1242,9 +2152,15 @@ main(int argc, char** argv)
       case 'd':
         dynamic_concurrency_mode = true;
         break;
+      case 'S':
+        search_mode = true;
+        break;
       case 'u':
         url = optarg;
         break;
+      case 'U':
+        unix_socket_path = optarg;
+        break;
       case 'm':
         model_name = optarg;
         break;
@@ -1266,6 +2182,12 @@ main(int argc, char** argv)
       case 'l':
         latency_threshold_ms = atoi(optarg);
         break;
+      case 'P':
+        latency_percentile = atof(optarg);
+        break;
+      case 'T':
+        max_search_time_s = atoi(optarg);
+        break;
       case 'c':
         max_concurrency = atoi(optarg);
         break;
@@ -1281,6 +2203,30 @@ main(int argc, char** argv)
       case 'a':
         profiling_asynchronous_infer = true;
         break;
+      case 'g':
+        shared_context = true;
+        break;
+      case 'e':
+        streaming = true;
+        break;
+      case 'k':
+        grpc_channel_count = atoi(optarg);
+        break;
+      case 'w':
+        async_thread_count = atoi(optarg);
+        break;
+      case 'R':
+        request_rate = atof(optarg);
+        break;
+      case 'D':
+        request_distribution = ParseRequestDistribution(optarg);
+        break;
+      case 'B':
+        burst_size = atoi(optarg);
+        break;
+      case 'C':
+        context_count = atoi(optarg);
+        break;
       case '?':
         Usage(argv);
         break;
@@ -1288,6 +2234,20 @@ main(int argc, char** argv)
   }
 
   if (model_name.empty()) { Usage(argv, "-m flag must be specified"); }
+
+  // Context creation is measured on its own, none of the options of
+  // the inference measurement apply.
+  if (context_count > 0) {
+    signal(SIGINT, SignalHandler);
+    nic::Error err = MeasureContextCreation(
+      url, protocol, model_name, model_version, streaming, context_count);
+    if (!err.IsOk()) {
+      std::cerr << err << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
   if (batch_size <= 0) { Usage(argv, "batch size must be > 0"); }
   if (measurement_window_ms <= 0) {
     Usage(argv, "measurement window must be > 0 in msec");
@@ -1298,16 +2258,64 @@ main(int argc, char** argv)
   if (dynamic_concurrency_mode && latency_threshold_ms < 0) {
     Usage(argv, "latency threshold must be >= 0 for dynamic concurrency mode");
   }
+  if (search_mode && (latency_threshold_ms == 0)) {
+    Usage(argv, "latency threshold must be > 0 for search mode");
+  }
+  if (search_mode && dynamic_concurrency_mode) {
+    Usage(argv, "search mode can't be used with dynamic concurrency mode");
+  }
+  if ((latency_percentile != 0) && (latency_percentile != 50) &&
+      (latency_percentile != 90) && (latency_percentile != 95) &&
+      (latency_percentile != 99) && (latency_percentile != 99.9)) {
+    Usage(argv, "latency percentile must be one of 50, 90, 95, 99 or 99.9");
+  }
+  if (grpc_channel_count <= 0) {
+    Usage(argv, "gRPC channel count must be > 0");
+  }
+  if (async_thread_count <= 0) {
+    Usage(argv, "async worker thread count must be > 0");
+  }
+  if (request_rate < 0) {
+    Usage(argv, "request rate must be > 0");
+  }
+  if ((request_rate > 0) && dynamic_concurrency_mode) {
+    Usage(argv, "request rate can't be used with dynamic concurrency mode");
+  }
+  if ((request_rate > 0) && search_mode) {
+    Usage(argv, "request rate can't be used with search mode");
+  }
+  if (burst_size <= 0) {
+    Usage(argv, "burst size must be > 0");
+  }
+  if (!unix_socket_path.empty() && (dynamic_concurrency_mode || search_mode)) {
+    Usage(argv, "-U can't be used with dynamic concurrency or search mode");
+  }
+  if (!unix_socket_path.empty() && (url.compare(0, 5, "unix:") == 0)) {
+    Usage(argv, "-U requires -u to be a TCP URL");
+  }
 
   // trap SIGINT to allow threads to exit gracefully
   signal(SIGINT, SignalHandler);
 
+  // The model configuration doesn't change over the run, so only the
+  // first context created needs to get it from the server.
+  nic::ModelConfigCache::SetTTL(std::numeric_limits<uint32_t>::max());
+
+  // Spread the worker contexts evenly over the channels. The status
+  // contexts used for the server side stats come and go, so balance on
+  // the live contexts rather than cycling.
+  nic::GrpcChannelPool::SetChannelCount(grpc_channel_count);
+  nic::GrpcChannelPool::SetSelectionPolicy(
+    nic::GrpcChannelPool::LEAST_LOAD);
+
   nic::Error err(ni::RequestStatusCode::SUCCESS);
   std::unique_ptr<ConcurrencyManager> manager;
   err = ConcurrencyManager::Create(
     &manager, verbose, profile, batch_size, stable_offset,
     measurement_window_ms, max_measurement_count,
-    profiling_asynchronous_infer,
+    profiling_asynchronous_infer, async_thread_count, shared_context,
+    streaming, request_distribution, burst_size,
+    (request_rate > 0) ? max_concurrency : 0,
     model_name, model_version, url, protocol);
   if (!err.IsOk()) {
     std::cerr << err << std::endl;
@@ -1319,20 +2327,67 @@ main(int argc, char** argv)
     << "*** Measurement Settings ***" << std::endl
     << "  Batch size: " << batch_size << std::endl
     << "  Measurement window: " << measurement_window_ms << " msec" << std::endl;
-  if (dynamic_concurrency_mode) {
+  if (profiling_asynchronous_infer && (request_rate == 0)) {
+    std::cout
+      << "  Async worker threads: " << async_thread_count << std::endl;
+  }
+  if (protocol == ProtocolType::GRPC) {
+    std::cout << "  gRPC channels: " << grpc_channel_count << std::endl;
+    std::cout
+      << "  gRPC requests: " << (streaming ? "streaming" : "unary")
+      << std::endl;
+  }
+  if (!unix_socket_path.empty()) {
     std::cout
-      << "  Latency limit: " << latency_threshold_ms << " msec" << std::endl;
+      << "  Transports: TCP (" << url << ") vs. Unix domain socket ("
+      << unix_socket_path << ")" << std::endl;
+  }
+  if (request_rate > 0) {
+    const char* distribution_names[] = { "constant", "poisson", "bursty" };
+    std::cout
+      << "  Request distribution: "
+      << distribution_names[request_distribution];
+    if (request_distribution == RequestDistribution::BURSTY) {
+      std::cout << " (" << burst_size << " requests per burst)";
+    }
+    std::cout << std::endl;
+    if (max_concurrency != 0) {
+      std::cout
+        << "  Outstanding request limit: " << max_concurrency
+        << " requests" << std::endl;
+    }
+  }
+  if (dynamic_concurrency_mode || search_mode) {
+    std::cout << "  Latency limit: " << latency_threshold_ms << " msec";
+    if (latency_percentile != 0) {
+      std::cout << " (p" << latency_percentile << " latency)";
+    }
+    std::cout << std::endl;
     if (max_concurrency != 0) {
       std::cout
         << "  Concurrency limit: " << max_concurrency
         << " concurrent requests" << std::endl;
     }
+    if (search_mode && (max_search_time_s != 0)) {
+      std::cout
+        << "  Search time limit: " << max_search_time_s << " sec" << std::endl;
+    }
   }
   std::cout << std::endl;
 
   PerfStatus status_summary;
   std::vector<PerfStatus> summary;
-  if (!dynamic_concurrency_mode) {
+  if (request_rate > 0) {
+    err = manager->StepRate(status_summary, request_rate);
+    if (err.IsOk()) {
+      err = Report(status_summary, 0, protocol, verbose);
+    }
+  } else if (search_mode) {
+    err = SearchConcurrency(
+      manager.get(), &summary, concurrent_request_count, max_concurrency,
+      latency_threshold_ms, latency_percentile, max_search_time_s, protocol,
+      verbose);
+  } else if (!dynamic_concurrency_mode) {
     err = manager->Step(status_summary, concurrent_request_count);
     if (err.IsOk()) {
       err = Report(status_summary, concurrent_request_count, protocol, verbose);
@@ -1344,9 +2399,9 @@ main(int argc, char** argv)
       if (err.IsOk()) {
         err = Report(status_summary, count, protocol, verbose);
         summary.push_back(status_summary);
-        uint64_t avg_latency_ms =
-          status_summary.client_avg_latency_ns / (1000 * 1000);
-        if ((avg_latency_ms >= latency_threshold_ms) || !err.IsOk()) {
+        uint64_t latency_ms =
+          ThresholdLatency(status_summary, latency_percentile) / (1000 * 1000);
+        if ((latency_ms >= latency_threshold_ms) || !err.IsOk()) {
           std::cerr << err << std::endl;
           break;
         }
@@ -1359,6 +2414,60 @@ main(int argc, char** argv)
     std::cerr << err << std::endl;
     return 1;
   }
+
+  // Take the same measurement over the Unix domain socket and compare
+  // it with the one over TCP.
+  if (!unix_socket_path.empty()) {
+    const PerfStatus tcp_summary = status_summary;
+
+    // The manager stops its threads by setting 'early_exit', clear it
+    // for the next one. Had the run been interrupted, the measurement
+    // would have failed above.
+    manager.reset();
+    early_exit = false;
+
+    const std::string socket_url =
+      std::string((protocol == ProtocolType::HTTP) ? "unix://" : "unix:") +
+      unix_socket_path;
+    err = ConcurrencyManager::Create(
+      &manager, verbose, profile, batch_size, stable_offset,
+      measurement_window_ms, max_measurement_count,
+      profiling_asynchronous_infer, async_thread_count, shared_context,
+      streaming, request_distribution, burst_size,
+      (request_rate > 0) ? max_concurrency : 0,
+      model_name, model_version, socket_url, protocol);
+    if (err.IsOk()) {
+      std::cout << "Over Unix domain socket:" << std::endl;
+      if (request_rate > 0) {
+        err = manager->StepRate(status_summary, request_rate);
+      } else {
+        err = manager->Step(status_summary, concurrent_request_count);
+      }
+    }
+    if (err.IsOk()) {
+      err = Report(
+        status_summary, (request_rate > 0) ? 0 : concurrent_request_count,
+        protocol, verbose);
+    }
+    if (!err.IsOk()) {
+      std::cerr << err << std::endl;
+      return 1;
+    }
+
+    const int64_t tcp_latency_us = tcp_summary.client_avg_latency_ns / 1000;
+    const int64_t uds_latency_us = status_summary.client_avg_latency_ns / 1000;
+    std::cout
+      << "Unix domain socket vs. TCP: latency " << uds_latency_us
+      << " usec vs. " << tcp_latency_us << " usec (delta " << std::showpos
+      << (uds_latency_us - tcp_latency_us) << " usec, " << std::fixed
+      << std::setprecision(1)
+      << ((tcp_latency_us > 0) ?
+            100.0 * (uds_latency_us - tcp_latency_us) / tcp_latency_us : 0.0)
+      << std::noshowpos << std::defaultfloat << "%), throughput "
+      << status_summary.client_infer_per_sec << " infer/sec vs. "
+      << tcp_summary.client_infer_per_sec << " infer/sec" << std::endl;
+  }
+
   if (summary.size()) {
     std::ofstream ofs(filename, std::ofstream::out);
     // Can print more depending on verbose, but it seems too much information
@@ -1368,7 +2477,8 @@ main(int argc, char** argv)
       ofs
         << "Concurrency,Inferences/Second,Client Send,"
         << "Network+Server Send/Recv,Server Queue,"
-        << "Server Compute,Client Recv"
+        << "Server Compute,Client Recv,"
+        << "p50 latency,p90 latency,p95 latency,p99 latency,p99.9 latency"
         << std::endl;
     }
 
@@ -1403,7 +2513,12 @@ main(int argc, char** argv)
           << (avg_network_misc_ns / 1000) << ","
           << (avg_queue_ns / 1000) << ","
           << (avg_compute_ns / 1000) << ","
-          << (status.client_avg_receive_time_ns / 1000) << std::endl;
+          << (status.client_avg_receive_time_ns / 1000) << ","
+          << (status.client_p50_latency_ns / 1000) << ","
+          << (status.client_p90_latency_ns / 1000) << ","
+          << (status.client_p95_latency_ns / 1000) << ","
+          << (status.client_p99_latency_ns / 1000) << ","
+          << (status.client_p999_latency_ns / 1000) << std::endl;
       }
     }
     ofs.close();
@@ -26,10 +26,28 @@
 
 #include "src/clients/c++/request.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <pthread.h>
+#include <sched.h>
+#include <tuple>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <curl/curl.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <grpcpp/impl/codegen/proto_utils.h>
 #include "src/core/constants.h"
 
 namespace nvidia { namespace inferenceserver { namespace client {
@@ -68,962 +86,3097 @@ static CurlGlobal curl_global;
 
 //==============================================================================
 
-// Use map to keep track of gRPC channels. <key, value> : <url, Channel*>
-// If context is created on url that has established Channel, then reuse it.
-std::map<std::string, std::shared_ptr<grpc::Channel>> grpc_channel_map_;
-std::shared_ptr<grpc::Channel> GetChannel(const std::string& url)
-{
-  const auto& channel_itr = grpc_channel_map_.find(url);
-  if (channel_itr != grpc_channel_map_.end()) {
-    return channel_itr->second;
-  } else {
-    grpc::ChannelArguments arguments;
-    arguments.SetMaxSendMessageSize(MAX_GRPC_MESSAGE_SIZE);
-    arguments.SetMaxReceiveMessageSize(MAX_GRPC_MESSAGE_SIZE);
-    std::shared_ptr<grpc::Channel> channel = grpc::CreateCustomChannel(
-      url, grpc::InsecureChannelCredentials(), arguments);
-    grpc_channel_map_.insert(std::make_pair(url, channel));
-    return channel;
-  }
-}
+namespace {
 
-//==============================================================================
+// Written at the start of the file created by ModelConfigCache::Save()
+// so that Load() can reject other files.
+const std::string kModelConfigCacheMagic("NVMODELCONFIGCACHE1");
 
-const Error Error::Success(RequestStatusCode::SUCCESS);
+struct ModelConfigCacheEntry {
+  ModelConfig config_;
+  std::chrono::steady_clock::time_point insert_time_;
+};
 
-Error::Error(RequestStatusCode code, const std::string& msg)
-  : code_(code), msg_(msg), request_id_(0)
-{
-}
+using ModelConfigCacheKey = std::tuple<std::string, std::string, int>;
 
-Error::Error(RequestStatusCode code)
-  : code_(code), request_id_(0)
-{
-}
+struct ModelConfigCacheState {
+  std::mutex mutex_;
+  std::chrono::milliseconds ttl_{0};
+  std::map<ModelConfigCacheKey, ModelConfigCacheEntry> entries_;
+};
 
-Error::Error(const RequestStatus& status)
-  : Error(status.code(), status.msg())
+ModelConfigCacheState&
+GetModelConfigCacheState()
 {
-  server_id_ = status.server_id();
-  request_id_ = status.request_id();
+  static ModelConfigCacheState state;
+  return state;
 }
 
-std::ostream&
-operator<<(std::ostream& out, const Error& err)
+bool
+IsExpired(
+  const ModelConfigCacheEntry& entry, std::chrono::milliseconds ttl,
+  std::chrono::steady_clock::time_point now)
 {
-  out
-    << "[" << err.server_id_ << " " << err.request_id_ << "] "
-    << RequestStatusCode_Name(err.code_);
-  if (!err.msg_.empty()) {
-    out << " - " << err.msg_;
-  }
-  return out;
+  return (now - entry.insert_time_) >= ttl;
 }
 
-//==============================================================================
+} // namespace
 
-ServerHealthContext::ServerHealthContext(bool verbose)
-  : verbose_(verbose)
+Error
+ModelConfigCache::SetTTL(uint64_t ttl_ms)
 {
+  ModelConfigCacheState& state = GetModelConfigCacheState();
+  std::lock_guard<std::mutex> lock(state.mutex_);
+  state.ttl_ = std::chrono::milliseconds(ttl_ms);
+  return Error::Success;
 }
 
-//==============================================================================
-
-ServerStatusContext::ServerStatusContext(bool verbose)
-  : verbose_(verbose)
+Error
+ModelConfigCache::Lookup(
+  const std::string& server_url, const std::string& model_name,
+  int model_version, ModelConfig* config)
 {
-}
-
-//==============================================================================
-
-class OptionsImpl : public InferContext::Options {
-public:
-  OptionsImpl();
-  ~OptionsImpl() = default;
-
-  size_t BatchSize() const override { return batch_size_; }
-  void SetBatchSize(size_t batch_size) override { batch_size_ = batch_size; }
-
-  Error AddRawResult(
-    const std::shared_ptr<InferContext::Output>& output) override;
-  Error AddClassResult(
-    const std::shared_ptr<InferContext::Output>& output, uint64_t k) override;
-
-  // Options for an output
-  struct OutputOptions {
-    OutputOptions(InferContext::Result::ResultFormat f, uint64_t n=0)
-      : result_format(f), u64(n) { }
-    InferContext::Result::ResultFormat result_format;
-    uint64_t u64;
-  };
-
-  using OutputOptionsPair =
-    std::pair<std::shared_ptr<InferContext::Output>, OutputOptions>;
-
-  const std::vector<OutputOptionsPair>& Outputs() const { return outputs_; }
-
-private:
-  size_t batch_size_;
-  std::vector<OutputOptionsPair> outputs_;
-};
+  ModelConfigCacheState& state = GetModelConfigCacheState();
+  std::lock_guard<std::mutex> lock(state.mutex_);
+  const auto itr = state.entries_.find(
+    std::make_tuple(server_url, model_name, model_version));
+  if (itr == state.entries_.end()) {
+    return Error(
+      RequestStatusCode::UNAVAILABLE,
+      "no cached configuration for \"" + model_name + "\"");
+  }
+  if (IsExpired(itr->second, state.ttl_, std::chrono::steady_clock::now())) {
+    state.entries_.erase(itr);
+    return Error(
+      RequestStatusCode::UNAVAILABLE,
+      "cached configuration for \"" + model_name + "\" has expired");
+  }
 
-OptionsImpl::OptionsImpl()
-  : batch_size_(0)
-{
+  *config = itr->second.config_;
+  return Error::Success;
 }
 
 Error
-OptionsImpl::AddRawResult(const std::shared_ptr<InferContext::Output>& output)
+ModelConfigCache::Insert(
+  const std::string& server_url, const std::string& model_name,
+  int model_version, const ModelConfig& config)
 {
-  outputs_.emplace_back(
-    std::make_pair(
-      output, OutputOptions(InferContext::Result::ResultFormat::RAW)));
+  ModelConfigCacheState& state = GetModelConfigCacheState();
+  std::lock_guard<std::mutex> lock(state.mutex_);
+  ModelConfigCacheEntry& entry =
+    state.entries_[std::make_tuple(server_url, model_name, model_version)];
+  entry.config_ = config;
+  entry.insert_time_ = std::chrono::steady_clock::now();
   return Error::Success;
 }
 
 Error
-OptionsImpl::AddClassResult(
-  const std::shared_ptr<InferContext::Output>& output, uint64_t k)
+ModelConfigCache::Invalidate(
+  const std::string& server_url, const std::string& model_name,
+  int model_version)
 {
-  outputs_.emplace_back(
-    std::make_pair(
-      output, OutputOptions(InferContext::Result::ResultFormat::CLASS, k)));
+  ModelConfigCacheState& state = GetModelConfigCacheState();
+  std::lock_guard<std::mutex> lock(state.mutex_);
+  state.entries_.erase(std::make_tuple(server_url, model_name, model_version));
   return Error::Success;
 }
 
 Error
-InferContext::Options::Create(std::unique_ptr<InferContext::Options>* options)
+ModelConfigCache::InvalidateAll()
 {
-  options->reset(new OptionsImpl());
+  ModelConfigCacheState& state = GetModelConfigCacheState();
+  std::lock_guard<std::mutex> lock(state.mutex_);
+  state.entries_.clear();
   return Error::Success;
 }
 
-//==============================================================================
+Error
+ModelConfigCache::Save(const std::string& filename)
+{
+  // Each entry is written as the length-delimited server URL, model
+  // name and serialized ModelConfig, and the zigzag-encoded version.
+  std::string buffer;
+  {
+    google::protobuf::io::StringOutputStream output_stream(&buffer);
+    google::protobuf::io::CodedOutputStream coded_stream(&output_stream);
+    coded_stream.WriteRaw(
+      kModelConfigCacheMagic.data(), kModelConfigCacheMagic.size());
+
+    ModelConfigCacheState& state = GetModelConfigCacheState();
+    std::lock_guard<std::mutex> lock(state.mutex_);
+    const auto now = std::chrono::steady_clock::now();
+    for (const auto& pr : state.entries_) {
+      if (IsExpired(pr.second, state.ttl_, now)) {
+        continue;
+      }
 
-class InputImpl : public InferContext::Input {
-public:
-  InputImpl(const ModelInput& mio);
-  InputImpl(const InputImpl& obj);
-  ~InputImpl() = default;
+      const std::string& server_url = std::get<0>(pr.first);
+      const std::string& model_name = std::get<1>(pr.first);
+      const std::string config = pr.second.config_.SerializeAsString();
+      coded_stream.WriteVarint32(server_url.size());
+      coded_stream.WriteString(server_url);
+      coded_stream.WriteVarint32(model_name.size());
+      coded_stream.WriteString(model_name);
+      coded_stream.WriteVarint32(
+        google::protobuf::internal::WireFormatLite::ZigZagEncode32(
+          std::get<2>(pr.first)));
+      coded_stream.WriteVarint32(config.size());
+      coded_stream.WriteString(config);
+    }
+  }
 
-  const std::string& Name() const override { return mio_.name(); }
-  size_t ByteSize() const override { return byte_size_; }
-  DataType DType() const override { return mio_.data_type(); }
-  ModelInput::Format Format() const override { return mio_.format(); }
-  const DimsList& Dims() const override { return mio_.dims(); }
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.write(buffer.data(), buffer.size())) {
+    return Error(
+      RequestStatusCode::INTERNAL, "failed to write \"" + filename + "\"");
+  }
 
-  void SetBatchSize(size_t batch_size) { batch_size_ = batch_size; }
+  return Error::Success;
+}
 
-  Error Reset() override;
-  Error SetRaw(const std::vector<uint8_t>& input) override;
-  Error SetRaw(const uint8_t* input, size_t input_byte_size) override;
+Error
+ModelConfigCache::Load(const std::string& filename)
+{
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    return Error(
+      RequestStatusCode::NOT_FOUND, "failed to open \"" + filename + "\"");
+  }
+  const std::string buffer(
+    (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  google::protobuf::io::CodedInputStream coded_stream(
+    reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size());
+  std::string magic;
+  if (!coded_stream.ReadString(&magic, kModelConfigCacheMagic.size()) ||
+      (magic != kModelConfigCacheMagic)) {
+    return Error(
+      RequestStatusCode::INVALID_ARG,
+      "\"" + filename + "\" is not a model configuration cache file");
+  }
 
-  // Copy into 'buf' up to 'size' bytes of this input's data. Return
-  // the actual amount copied in 'input_bytes' and if the end of input
-  // is reached in 'end_of_input'
-  Error GetNext(
-    uint8_t* buf, size_t size, size_t* input_bytes, bool* end_of_input);
+  // Parse every entry before adding any, so that a truncated file
+  // doesn't leave the cache half loaded.
+  std::vector<std::pair<ModelConfigCacheKey, ModelConfig>> loaded;
+  while (coded_stream.BytesUntilLimit() != 0) {
+    uint32_t size, zigzag_version;
+    std::string server_url, model_name, config;
+    ModelConfig model_config;
+    if (!coded_stream.ReadVarint32(&size) ||
+        !coded_stream.ReadString(&server_url, size) ||
+        !coded_stream.ReadVarint32(&size) ||
+        !coded_stream.ReadString(&model_name, size) ||
+        !coded_stream.ReadVarint32(&zigzag_version) ||
+        !coded_stream.ReadVarint32(&size) ||
+        !coded_stream.ReadString(&config, size) ||
+        !model_config.ParseFromString(config)) {
+      return Error(
+        RequestStatusCode::INVALID_ARG,
+        "failed to parse \"" + filename + "\"");
+    }
 
-  // Copy the pointer of the raw buffer at 'batch_idx' into 'buf'
-  Error GetRaw(size_t batch_idx, const uint8_t** buf) const;
+    loaded.emplace_back(
+      std::make_tuple(
+        server_url, model_name,
+        google::protobuf::internal::WireFormatLite::ZigZagDecode32(
+          zigzag_version)),
+      std::move(model_config));
+  }
 
-  // Prepare to send this input as part of a request.
-  Error PrepareForRequest();
+  ModelConfigCacheState& state = GetModelConfigCacheState();
+  std::lock_guard<std::mutex> lock(state.mutex_);
+  const auto now = std::chrono::steady_clock::now();
+  for (auto& pr : loaded) {
+    ModelConfigCacheEntry& entry = state.entries_[pr.first];
+    entry.config_.Swap(&pr.second);
+    entry.insert_time_ = now;
+  }
 
-private:
-  const ModelInput mio_;
-  const size_t byte_size_;
-  size_t batch_size_;
-  std::vector<const uint8_t*> bufs_;
-  size_t bufs_idx_, buf_pos_;
-};
+  return Error::Success;
+}
 
-InputImpl::InputImpl(const ModelInput& mio)
-  : mio_(mio), byte_size_(GetSize(mio)),
-    batch_size_(0), bufs_idx_(0), buf_pos_(0)
+//==============================================================================
+
+LatencyHistogram::LatencyHistogram()
 {
+  Reset();
 }
 
-InputImpl::InputImpl(const InputImpl& obj)
-  : mio_(obj.mio_), byte_size_(obj.byte_size_),
-    batch_size_(obj.batch_size_), bufs_idx_(0), buf_pos_(0)
+LatencyHistogram::LatencyHistogram(const LatencyHistogram& other)
 {
-  // Set raw inputs
-  for (size_t batch_idx = 0; batch_idx < batch_size_; batch_idx++) {
-    const uint8_t* data_ptr;
-    obj.GetRaw(batch_idx, &data_ptr);
-    SetRaw(data_ptr, byte_size_);
-  }
+  *this = other;
 }
 
-Error
-InputImpl::SetRaw(const uint8_t* input, size_t input_byte_size)
+LatencyHistogram&
+LatencyHistogram::operator=(const LatencyHistogram& other)
 {
-  if (input_byte_size != byte_size_) {
-    bufs_.clear();
-    return
-      Error(
-        RequestStatusCode::INVALID_ARG,
-        "invalid size " + std::to_string(input_byte_size) +
-        " bytes for input '" + Name() + "', expects " +
-        std::to_string(byte_size_) + " bytes");
-  }
-
-  if (bufs_.size() >= batch_size_) {
-    bufs_.clear();
-    return
-      Error(
-        RequestStatusCode::INVALID_ARG,
-        "expecting " + std::to_string(batch_size_) +
-        " invocations of SetRaw for input '" + Name() +
-        "', one per batch entry");
+  if (this != &other) {
+    count_.store(
+      other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    sum_ns_.store(
+      other.sum_ns_.load(std::memory_order_relaxed),
+      std::memory_order_relaxed);
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      buckets_[i].store(
+        other.buckets_[i].load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+    }
   }
 
-  bufs_.push_back(input);
-  return Error::Success;
+  return *this;
 }
 
-Error
-InputImpl::SetRaw(const std::vector<uint8_t>& input)
+void
+LatencyHistogram::Record(uint64_t value_ns)
 {
-  return SetRaw(&input[0], input.size());
+  buckets_[BucketIndex(value_ns)].fetch_add(1, std::memory_order_relaxed);
+  sum_ns_.fetch_add(value_ns, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
 }
 
-Error
-InputImpl::GetNext(
-  uint8_t* buf, size_t size, size_t* input_bytes, bool* end_of_input)
+void
+LatencyHistogram::Merge(const LatencyHistogram& other)
 {
-  size_t total_size = 0;
-
-  while ((bufs_idx_ < bufs_.size()) && (size > 0)) {
-    const size_t csz = std::min(byte_size_ - buf_pos_, size);
-    if (csz > 0) {
-      const uint8_t* input_ptr = bufs_[bufs_idx_] + buf_pos_;
-      std::copy(input_ptr, input_ptr + csz, buf);
-      buf_pos_ += csz;
-      buf += csz;
-      size -= csz;
-      total_size += csz;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    const uint64_t cnt = other.buckets_[i].load(std::memory_order_relaxed);
+    if (cnt != 0) {
+      buckets_[i].fetch_add(cnt, std::memory_order_relaxed);
     }
+  }
+  sum_ns_.fetch_add(
+    other.sum_ns_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  count_.fetch_add(
+    other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
 
-    if (buf_pos_ == byte_size_) {
-      bufs_idx_++;
-      buf_pos_ = 0;
+void
+LatencyHistogram::Subtract(const LatencyHistogram& other)
+{
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    const uint64_t cnt = other.buckets_[i].load(std::memory_order_relaxed);
+    if (cnt != 0) {
+      buckets_[i].fetch_sub(cnt, std::memory_order_relaxed);
     }
   }
-
-  *input_bytes = total_size;
-  *end_of_input = (bufs_idx_ >= bufs_.size());
-  return Error::Success;
+  sum_ns_.fetch_sub(
+    other.sum_ns_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  count_.fetch_sub(
+    other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
 }
 
-Error
-InputImpl::GetRaw(
-  size_t batch_idx, const uint8_t** buf) const
+void
+LatencyHistogram::Reset()
 {
-  if (batch_idx >= batch_size_) {
-    return
-      Error(
-        RequestStatusCode::INVALID_ARG,
-        "unexpected batch entry " + std::to_string(batch_idx) +
-        " requested for input '" + Name() +
-        "', batch size is " + std::to_string(batch_size_));
+  count_.store(0, std::memory_order_relaxed);
+  sum_ns_.store(0, std::memory_order_relaxed);
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    buckets_[i].store(0, std::memory_order_relaxed);
   }
+}
 
-  *buf = bufs_[batch_idx];
-  return Error::Success;
+uint64_t
+LatencyHistogram::Count() const
+{
+  return count_.load(std::memory_order_relaxed);
 }
 
-Error
-InputImpl::Reset()
+uint64_t
+LatencyHistogram::Mean() const
 {
-  bufs_.clear();
-  bufs_idx_ = 0;
-  buf_pos_ = 0;
-  return Error::Success;
+  const uint64_t cnt = Count();
+  return (cnt == 0) ? 0 : (sum_ns_.load(std::memory_order_relaxed) / cnt);
 }
 
-Error
-InputImpl::PrepareForRequest()
+uint64_t
+LatencyHistogram::StdDev() const
 {
-  if (bufs_.size() != batch_size_) {
-    return
-      Error(
-        RequestStatusCode::INVALID_ARG,
-        "expecting " + std::to_string(batch_size_) +
-        " invocations of SetRaw for input '" + Name() +
-        "', have " + std::to_string(bufs_.size()));
+  const double mean = Mean();
+  uint64_t total = 0;
+  double square_sum = 0;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    const uint64_t cnt = buckets_[i].load(std::memory_order_relaxed);
+    if (cnt != 0) {
+      const double mid = (BucketLowest(i) + BucketHighest(i)) / 2.0;
+      square_sum += cnt * (mid - mean) * (mid - mean);
+      total += cnt;
+    }
   }
 
-  // Reset position so request sends entire input.
-  bufs_idx_ = 0;
-  buf_pos_ = 0;
-  return Error::Success;
+  return (total == 0) ? 0 : (uint64_t)std::sqrt(square_sum / total);
 }
 
-//==============================================================================
+uint64_t
+LatencyHistogram::Min() const
+{
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    if (buckets_[i].load(std::memory_order_relaxed) != 0) {
+      return BucketLowest(i);
+    }
+  }
 
-class OutputImpl : public InferContext::Output {
-public:
-  OutputImpl(const ModelOutput& mio);
-  ~OutputImpl() = default;
+  return 0;
+}
 
-  const std::string& Name() const override { return mio_.name(); }
-  size_t ByteSize() const override { return byte_size_; }
-  DataType DType() const override { return mio_.data_type(); }
-  const DimsList& Dims() const override { return mio_.dims(); }
+uint64_t
+LatencyHistogram::Max() const
+{
+  for (size_t i = kBucketCount; i > 0; --i) {
+    if (buckets_[i - 1].load(std::memory_order_relaxed) != 0) {
+      return BucketHighest(i - 1);
+    }
+  }
 
-  InferContext::Result::ResultFormat ResultFormat() const {
-    return result_format_;
+  return 0;
+}
+
+uint64_t
+LatencyHistogram::ValueAtPercentile(double percentile) const
+{
+  // Count the buckets rather than using 'count_' so that the rank is
+  // within the values seen even while values are being recorded.
+  uint64_t total = 0;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    total += buckets_[i].load(std::memory_order_relaxed);
   }
-  void SetResultFormat(InferContext::Result::ResultFormat result_format) {
-    result_format_ = result_format;
+  if (total == 0) {
+    return 0;
   }
 
-  private:
-  const ModelOutput mio_;
-  const size_t byte_size_;
-  InferContext::Result::ResultFormat result_format_;
-};
+  percentile = std::min(std::max(percentile, 0.0), 100.0);
+  const uint64_t rank =
+    std::max((uint64_t)std::ceil(percentile / 100 * total), (uint64_t)1);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      return BucketHighest(i);
+    }
+  }
 
-OutputImpl::OutputImpl(const ModelOutput& mio)
-  : mio_(mio), byte_size_(GetSize(mio)),
-    result_format_(InferContext::Result::ResultFormat::RAW)
-{
+  return Max();
 }
 
-//==============================================================================
-
-class ResultImpl : public InferContext::Result {
-public:
-  ResultImpl(
-    const std::shared_ptr<InferContext::Output>& output, uint64_t batch_size,
-    InferContext::Result::ResultFormat result_format);
-  ~ResultImpl() = default;
+size_t
+LatencyHistogram::BucketIndex(uint64_t value_ns)
+{
+  const uint64_t sub_bucket_count = 1 << kSubBucketBits;
+  if (value_ns < sub_bucket_count) {
+    return value_ns;
+  }
+  if (value_ns >= (1ULL << kValueBits)) {
+    return kBucketCount - 1;
+  }
 
-  const std::string& ModelName() const override { return model_name_; }
-  uint32_t ModelVersion() const override { return model_version_; }
+  // The highest bit set selects the power of two and the bits below it
+  // the bucket within that power of two.
+  const size_t shift =
+    (63 - __builtin_clzll(value_ns)) - (kSubBucketBits - 1);
+  return
+    sub_bucket_count + (shift - 1) * (sub_bucket_count / 2) +
+    ((value_ns >> shift) - (sub_bucket_count / 2));
+}
 
-  const std::shared_ptr<InferContext::Output> GetOutput() const override {
-    return output_;
+uint64_t
+LatencyHistogram::BucketLowest(size_t idx)
+{
+  const size_t sub_bucket_count = 1 << kSubBucketBits;
+  if (idx < sub_bucket_count) {
+    return idx;
   }
 
-  Error GetRaw(
-    size_t batch_idx, const std::vector<uint8_t>** buf) const override;
-  Error GetRawAtCursor(
-    size_t batch_idx, const uint8_t** buf, size_t adv_byte_size) override;
-  Error GetClassCount(size_t batch_idx, size_t* cnt) const override;
-  Error GetClassAtCursor(size_t batch_idx, ClassResult* result) override;
-  Error ResetCursors() override;
-  Error ResetCursor(size_t batch_idx) override;
+  const size_t half_count = sub_bucket_count / 2;
+  const size_t shift = (idx - sub_bucket_count) / half_count + 1;
+  return
+    (uint64_t)((idx - sub_bucket_count) % half_count + half_count) << shift;
+}
 
-  // Get the result format for this result.
-  InferContext::Result::ResultFormat ResultFormat() const {
-    return result_format_;
+uint64_t
+LatencyHistogram::BucketHighest(size_t idx)
+{
+  const size_t sub_bucket_count = 1 << kSubBucketBits;
+  if (idx < sub_bucket_count) {
+    return idx;
   }
 
-  // Set information about the model that produced this result.
-  void SetModel(const std::string& name, const uint32_t version) {
-    model_name_ = name;
-    model_version_ = version;
-  }
+  const size_t shift = (idx - sub_bucket_count) / (sub_bucket_count / 2) + 1;
+  return BucketLowest(idx) + (1ULL << shift) - 1;
+}
 
-  // Set results for a CLASS format result.
-  void SetClassResult(const InferResponseHeader::Output& result) {
-    class_result_ = result;
-  }
+//==============================================================================
 
-  // For RAW format result, copy into the output up to 'size' bytes of
-  // output data from 'buf'. Return the actual amount copied in
-  // 'result_bytes'.
-  Error SetNextRawResult(
-    const uint8_t* buf, size_t size, size_t* result_bytes);
+namespace {
 
-private:
-  const std::shared_ptr<InferContext::Output> output_;
-  const size_t byte_size_;
-  const size_t batch_size_;
-  const InferContext::Result::ResultFormat result_format_;
+// Channel argument that differs between the channels of a URL, so
+// that gRPC doesn't share one connection among them.
+const char kGrpcChannelIndexArg[] = "nvidia.inferenceserver.channel_index";
 
-  std::vector<std::vector<uint8_t>> bufs_;
-  size_t bufs_idx_;
-  std::vector<size_t> bufs_pos_;
+struct GrpcChannelSlot {
+  std::shared_ptr<grpc::Channel> channel_;
 
-  std::string model_name_;
-  uint32_t model_version_;
+  // Number of channel references handed out and not yet released.
+  std::shared_ptr<std::atomic<size_t>> load_;
+};
 
-  InferResponseHeader::Output class_result_;
-  std::vector<size_t> class_pos_;
+struct GrpcUrlChannels {
+  std::vector<GrpcChannelSlot> slots_;
+  size_t next_ = 0;
 };
 
-ResultImpl::ResultImpl(
-  const std::shared_ptr<InferContext::Output>& output, uint64_t batch_size,
-  InferContext::Result::ResultFormat result_format)
-  : output_(output), byte_size_(output->ByteSize()),
-    batch_size_(batch_size), result_format_(result_format),
-    bufs_(batch_size), bufs_idx_(0), bufs_pos_(batch_size),
-    class_pos_(batch_size)
+struct GrpcChannelPoolState {
+  std::mutex mutex_;
+  size_t channel_count_ = 1;
+  GrpcChannelPool::SelectionPolicy policy_ = GrpcChannelPool::ROUND_ROBIN;
+  std::map<std::string, GrpcUrlChannels> channels_;
+};
+
+GrpcChannelPoolState&
+GetGrpcChannelPoolState()
 {
+  static GrpcChannelPoolState state;
+  return state;
 }
 
+} // namespace
+
 Error
-ResultImpl::GetRaw(
-  size_t batch_idx, const std::vector<uint8_t>** buf) const
+GrpcChannelPool::SetChannelCount(size_t count)
 {
-  if (result_format_ != InferContext::Result::ResultFormat::RAW) {
-    return
-      Error(
-        RequestStatusCode::UNSUPPORTED,
-        "raw result not available for non-RAW output '" +
-        output_->Name() + "'");
-  }
-
-  if (batch_idx >= batch_size_) {
-    return
-      Error(
-        RequestStatusCode::INVALID_ARG,
-        "unexpected batch entry " + std::to_string(batch_idx) +
-        " requested for output '" + output_->Name() +
-        "', batch size is " + std::to_string(batch_size_));
+  if (count == 0) {
+    return Error(
+      RequestStatusCode::INVALID_ARG, "channel count must be > 0");
   }
 
-  *buf = &bufs_[batch_idx];
+  GrpcChannelPoolState& state = GetGrpcChannelPoolState();
+  std::lock_guard<std::mutex> lock(state.mutex_);
+  state.channel_count_ = count;
   return Error::Success;
 }
 
 Error
-ResultImpl::GetRawAtCursor(
-  size_t batch_idx, const uint8_t** buf, size_t adv_byte_size)
+GrpcChannelPool::SetSelectionPolicy(SelectionPolicy policy)
 {
-  if (result_format_ != InferContext::Result::ResultFormat::RAW) {
-    return
-      Error(
-        RequestStatusCode::UNSUPPORTED,
-        "raw result not available for non-RAW output '" +
-        output_->Name() + "'");
-  }
+  GrpcChannelPoolState& state = GetGrpcChannelPoolState();
+  std::lock_guard<std::mutex> lock(state.mutex_);
+  state.policy_ = policy;
+  return Error::Success;
+}
 
-  if (batch_idx >= batch_size_) {
-    return
-      Error(
-        RequestStatusCode::INVALID_ARG,
-        "unexpected batch entry " + std::to_string(batch_idx) +
-        "requested for output '" + output_->Name() +
-        "', batch size is " + std::to_string(batch_size_));
+// Get a channel to 'url' from the channel pool. The channel counts
+// towards the load of its slot until the returned pointer and all
+// its copies are released.
+std::shared_ptr<grpc::Channel> GetChannel(const std::string& url)
+{
+  GrpcChannelPoolState& state = GetGrpcChannelPoolState();
+  std::lock_guard<std::mutex> lock(state.mutex_);
+  GrpcUrlChannels& url_channels = state.channels_[url];
+
+  // Only the first 'channel_count_' slots are used, the ones past it
+  // are left for the contexts already holding them.
+  size_t idx = 0;
+  if (state.policy_ == GrpcChannelPool::ROUND_ROBIN) {
+    idx = url_channels.next_++ % state.channel_count_;
+  } else {
+    size_t min_load = std::numeric_limits<size_t>::max();
+    for (size_t i = 0; i < state.channel_count_; ++i) {
+      // A slot not created yet has no load
+      if (i >= url_channels.slots_.size()) {
+        idx = i;
+        break;
+      }
+      const size_t load = url_channels.slots_[i].load_->load();
+      if (load < min_load) {
+        min_load = load;
+        idx = i;
+      }
+    }
   }
 
-  if ((bufs_pos_[batch_idx] + adv_byte_size) > byte_size_) {
-    return
-      Error(
-        RequestStatusCode::UNSUPPORTED,
-        "attempt to read beyond end of result for output output '" +
-        output_->Name() + "'");
+  while (url_channels.slots_.size() <= idx) {
+    grpc::ChannelArguments arguments;
+    arguments.SetMaxSendMessageSize(MAX_GRPC_MESSAGE_SIZE);
+    arguments.SetMaxReceiveMessageSize(MAX_GRPC_MESSAGE_SIZE);
+    arguments.SetInt(kGrpcChannelIndexArg, url_channels.slots_.size());
+    GrpcChannelSlot slot;
+    slot.channel_ = grpc::CreateCustomChannel(
+      url, grpc::InsecureChannelCredentials(), arguments);
+    slot.load_ = std::make_shared<std::atomic<size_t>>(0);
+    url_channels.slots_.emplace_back(std::move(slot));
   }
 
-  *buf = &bufs_[batch_idx][bufs_pos_[batch_idx]];
-  bufs_pos_[batch_idx] += adv_byte_size;
-  return Error::Success;
+  // Hand out an alias of the channel whose deleter releases the load.
+  const GrpcChannelSlot& slot = url_channels.slots_[idx];
+  std::shared_ptr<std::atomic<size_t>> load = slot.load_;
+  std::shared_ptr<grpc::Channel> channel = slot.channel_;
+  load->fetch_add(1);
+  grpc::Channel* raw_channel = channel.get();
+  return std::shared_ptr<grpc::Channel>(
+    raw_channel, [channel, load](grpc::Channel*) { load->fetch_sub(1); });
 }
 
-Error
-ResultImpl::GetClassCount(size_t batch_idx, size_t* cnt) const
-{
-  if (result_format_ != InferContext::Result::ResultFormat::CLASS) {
-    return
-      Error(
-        RequestStatusCode::UNSUPPORTED,
-        "class result not available for non-CLASS output '" +
-        output_->Name() + "'");
-  }
+// Full name of the Infer method of GRPCService, for calling it through
+// a generic stub.
+const char kInferGrpcMethod[] = "/nvidia.inferenceserver.GRPCService/Infer";
 
-  // Number of classifications should equal expected batch size but
-  // check both to be careful and to protext class_pos_ accesses.
-  if ((batch_idx >= (size_t)class_result_.batch_classes().size()) ||
-      (batch_idx >= batch_size_)) {
-    return
-      Error(
-        RequestStatusCode::INVALID_ARG,
-        "unexpected batch entry " + std::to_string(batch_idx) +
-        "requested for output '" + output_->Name() +
-        "', batch size is " + std::to_string(batch_size_));
-  }
+// Full name of the StreamInfer method of GRPCService.
+const char kStreamInferGrpcMethod[] =
+  "/nvidia.inferenceserver.GRPCService/StreamInfer";
 
-  const InferResponseHeader::Output::Classes& classes =
-    class_result_.batch_classes(batch_idx);
+// Alignment of the buffers holding RAW results.
+const size_t kRawResultAlignment = 64;
 
-  *cnt = classes.cls().size();
-  return Error::Success;
-}
+namespace {
 
-Error
-ResultImpl::GetClassAtCursor(
-  size_t batch_idx, InferContext::Result::ClassResult* result)
+const char kBase64Chars[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Encode 'data' in base64, with padding.
+std::string
+Base64Encode(const std::string& data)
 {
-  if (result_format_ != InferContext::Result::ResultFormat::CLASS) {
-    return
-      Error(
-        RequestStatusCode::UNSUPPORTED,
-        "class result not available for non-CLASS output '" +
-        output_->Name() + "'");
+  std::string encoded;
+  encoded.reserve(((data.size() + 2) / 3) * 4);
+
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(data.data());
+  size_t idx = 0;
+  for (; idx + 2 < data.size(); idx += 3) {
+    const uint32_t v = (in[idx] << 16) | (in[idx + 1] << 8) | in[idx + 2];
+    encoded.push_back(kBase64Chars[(v >> 18) & 0x3f]);
+    encoded.push_back(kBase64Chars[(v >> 12) & 0x3f]);
+    encoded.push_back(kBase64Chars[(v >> 6) & 0x3f]);
+    encoded.push_back(kBase64Chars[v & 0x3f]);
   }
 
-  // Number of classifications should equal expected batch size but
-  // check both to be careful and to protext class_pos_ accesses.
-  if ((batch_idx >= (size_t)class_result_.batch_classes().size()) ||
-      (batch_idx >= batch_size_)) {
-    return
-      Error(
-        RequestStatusCode::INVALID_ARG,
-        "unexpected batch entry " + std::to_string(batch_idx) +
-        "requested for output '" + output_->Name() +
-        "', batch size is " + std::to_string(batch_size_));
+  const size_t remaining = data.size() - idx;
+  if (remaining > 0) {
+    uint32_t v = in[idx] << 16;
+    if (remaining > 1) {
+      v |= in[idx + 1] << 8;
+    }
+    encoded.push_back(kBase64Chars[(v >> 18) & 0x3f]);
+    encoded.push_back(kBase64Chars[(v >> 12) & 0x3f]);
+    encoded.push_back((remaining > 1) ? kBase64Chars[(v >> 6) & 0x3f] : '=');
+    encoded.push_back('=');
   }
 
-  const InferResponseHeader::Output::Classes& classes =
-    class_result_.batch_classes(batch_idx);
+  return encoded;
+}
 
-  if (class_pos_[batch_idx] >= (size_t)classes.cls().size()) {
-    return
-      Error(
-        RequestStatusCode::UNSUPPORTED,
-        "attempt to read beyond end of result for output output '" +
-        output_->Name() + "'");
+// Decode the base64 'data' of 'size' bytes into 'decoded'. Whitespace
+// is skipped and decoding stops at the padding. Return false if 'data'
+// holds any other character not in the base64 alphabet.
+bool
+Base64Decode(const char* data, size_t size, std::string* decoded)
+{
+  static const std::vector<int8_t> values = [] {
+    std::vector<int8_t> v(256, -1);
+    for (size_t idx = 0; idx < sizeof(kBase64Chars) - 1; idx++) {
+      v[static_cast<uint8_t>(kBase64Chars[idx])] = idx;
+    }
+    return v;
+  }();
+
+  decoded->clear();
+  decoded->reserve((size / 4) * 3);
+
+  uint32_t bits = 0;
+  int bit_count = 0;
+  for (size_t idx = 0; idx < size; idx++) {
+    const char c = data[idx];
+    if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n')) {
+      continue;
+    }
+    if (c == '=') {
+      break;
+    }
+
+    const int8_t value = values[static_cast<uint8_t>(c)];
+    if (value < 0) {
+      return false;
+    }
+
+    bits = (bits << 6) | value;
+    bit_count += 6;
+    if (bit_count >= 8) {
+      bit_count -= 8;
+      decoded->push_back(static_cast<char>((bits >> bit_count) & 0xff));
+    }
   }
 
-  const InferResponseHeader::Output::Class& cls =
-    classes.cls(class_pos_[batch_idx]);
+  return true;
+}
 
-  result->idx = cls.idx();
-  result->value = cls.value();
-  result->label = cls.label();
+// Prefix of an HTTP server URL naming a Unix domain socket.
+const char kUnixSocketUrlPrefix[] = "unix://";
 
-  class_pos_[batch_idx]++;
-  return Error::Success;
+// Return the path of the Unix domain socket to connect to for the
+// HTTP 'server_url', or an empty string if it is not a "unix://<path>"
+// URL.
+std::string
+UnixSocketPath(const std::string& server_url)
+{
+  const size_t prefix_len = sizeof(kUnixSocketUrlPrefix) - 1;
+  if (server_url.compare(0, prefix_len, kUnixSocketUrlPrefix) == 0) {
+    return server_url.substr(prefix_len);
+  }
+
+  return std::string();
 }
 
-Error
-ResultImpl::ResetCursors()
+// Return the host and port part of the URLs requested from the HTTP
+// 'server_url'. Over a Unix domain socket the host is only sent in the
+// Host header.
+std::string
+HttpServerUrl(const std::string& server_url)
 {
-  std::fill(bufs_pos_.begin(), bufs_pos_.end(), 0);
-  std::fill(class_pos_.begin(), class_pos_.end(), 0);
-  return Error::Success;
+  return UnixSocketPath(server_url).empty() ? server_url : "localhost";
 }
 
-Error
-ResultImpl::ResetCursor(size_t batch_idx)
+// Have 'curl' connect to the Unix domain socket 'socket_path', if set.
+void
+SetUnixSocketPath(CURL* curl, const std::string& socket_path)
 {
-  if (batch_idx >= batch_size_) {
-    return
-      Error(
-        RequestStatusCode::INVALID_ARG,
-        "unexpected batch entry " + std::to_string(batch_idx) +
-        "requested for output '" + output_->Name() +
-        "', batch size is " + std::to_string(batch_size_));
+  if (!socket_path.empty()) {
+    curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, socket_path.c_str());
   }
-
-  bufs_pos_[batch_idx] = 0;
-  class_pos_[batch_idx] = 0;
-  return Error::Success;
 }
 
+// Create in 'list' the HTTP request header of an inference request
+// described by 'header', in binary if 'binary' or in text format
+// otherwise. The status is asked for in binary either way, the server
+// then replies with the binary header if it supports it.
 Error
-ResultImpl::SetNextRawResult(
-  const uint8_t* buf, size_t size, size_t* result_bytes)
+CreateInferRequestHeaderList(
+  const InferRequestHeader& header, bool binary, struct curl_slist** list)
 {
-  size_t total_size = 0;
-
-  while ((bufs_idx_ < bufs_.size()) && (size > 0)) {
-    const size_t csz = std::min(byte_size_ - bufs_pos_[bufs_idx_], size);
-    if (csz > 0) {
-      std::copy(buf, buf + csz, std::back_inserter(bufs_[bufs_idx_]));
-      bufs_pos_[bufs_idx_] += csz;
-      buf += csz;
-      size -= csz;
-      total_size += csz;
+  std::string infer_request_str;
+  if (binary) {
+    std::string infer_request_bytes;
+    if (!header.SerializeToString(&infer_request_bytes)) {
+      return
+        Error(
+          RequestStatusCode::INTERNAL, "failed to serialize request header");
     }
+    infer_request_str =
+      std::string(kInferRequestBinaryHTTPHeader) + ":" +
+      Base64Encode(infer_request_bytes);
+  } else {
+    infer_request_str =
+      std::string(kInferRequestHTTPHeader) + ":" + header.ShortDebugString();
+  }
 
-    if (bufs_pos_[bufs_idx_] == byte_size_) {
-      bufs_idx_++;
-    }
+  const std::string encoding_str =
+    std::string(kHeaderEncodingHTTPHeader) + ": " + kBinaryHeaderEncoding;
+
+  *list = curl_slist_append(NULL, "Expect:");
+  *list = curl_slist_append(*list, "Content-Type: application/octet-stream");
+  *list = curl_slist_append(*list, encoding_str.c_str());
+  *list = curl_slist_append(*list, infer_request_str.c_str());
+  if (*list == NULL) {
+    return
+      Error(RequestStatusCode::INTERNAL, "failed to create HTTP header list");
   }
 
-  *result_bytes = total_size;
   return Error::Success;
 }
 
+} // namespace
+
+//==============================================================================
+
+const Error Error::Success(RequestStatusCode::SUCCESS);
+
+Error::Error(RequestStatusCode code, const std::string& msg)
+  : code_(code), msg_(msg), request_id_(0)
+{
+}
+
+Error::Error(RequestStatusCode code)
+  : code_(code), request_id_(0)
+{
+}
+
+Error::Error(const RequestStatus& status)
+  : Error(status.code(), status.msg())
+{
+  server_id_ = status.server_id();
+  request_id_ = status.request_id();
+}
+
+std::ostream&
+operator<<(std::ostream& out, const Error& err)
+{
+  out
+    << "[" << err.server_id_ << " " << err.request_id_ << "] "
+    << RequestStatusCode_Name(err.code_);
+  if (!err.msg_.empty()) {
+    out << " - " << err.msg_;
+  }
+  return out;
+}
+
+//==============================================================================
+
+ServerHealthContext::ServerHealthContext(bool verbose)
+  : verbose_(verbose)
+{
+}
+
+//==============================================================================
+
+ServerStatusContext::ServerStatusContext(bool verbose)
+  : verbose_(verbose)
+{
+}
+
+//==============================================================================
+
+class SharedMemoryMapping {
+public:
+  // Map 'byte_size' bytes at 'offset' of the POSIX shared memory
+  // object 'shm_key'.
+  static Error Create(
+    const std::string& shm_key, size_t offset, size_t byte_size,
+    std::shared_ptr<SharedMemoryMapping>* mapping);
+
+  ~SharedMemoryMapping();
+
+  const std::string& ShmKey() const { return shm_key_; }
+  uint8_t* Data() const { return base_ + offset_; }
+  size_t ByteSize() const { return byte_size_; }
+
+private:
+  SharedMemoryMapping(
+    const std::string& shm_key, uint8_t* base, size_t offset,
+    size_t byte_size);
+
+  const std::string shm_key_;
+
+  // The object is mapped from its start so that 'offset_' doesn't
+  // need to be page aligned.
+  uint8_t* const base_;
+  const size_t offset_;
+  const size_t byte_size_;
+};
+
+Error
+SharedMemoryMapping::Create(
+  const std::string& shm_key, size_t offset, size_t byte_size,
+  std::shared_ptr<SharedMemoryMapping>* mapping)
+{
+  int fd = shm_open(shm_key.c_str(), O_RDWR, 0);
+  if (fd == -1) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "unable to open shared memory object '" + shm_key + "': " +
+        strerror(errno));
+  }
+
+  struct stat shm_stat;
+  if (fstat(fd, &shm_stat) == -1) {
+    const int err = errno;
+    close(fd);
+    return
+      Error(
+        RequestStatusCode::INTERNAL,
+        "unable to get size of shared memory object '" + shm_key + "': " +
+        strerror(err));
+  }
+
+  if ((byte_size == 0) || (offset + byte_size < offset) ||
+      ((offset + byte_size) > static_cast<size_t>(shm_stat.st_size))) {
+    close(fd);
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "invalid region of " + std::to_string(byte_size) + " bytes at " +
+        std::to_string(offset) + " for shared memory object '" + shm_key +
+        "' of " + std::to_string(shm_stat.st_size) + " bytes");
+  }
+
+  void* base =
+    mmap(NULL, offset + byte_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int err = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    return
+      Error(
+        RequestStatusCode::INTERNAL,
+        "unable to map shared memory object '" + shm_key + "': " +
+        strerror(err));
+  }
+
+  mapping->reset(
+    new SharedMemoryMapping(
+      shm_key, reinterpret_cast<uint8_t*>(base), offset, byte_size));
+  return Error::Success;
+}
+
+SharedMemoryMapping::SharedMemoryMapping(
+  const std::string& shm_key, uint8_t* base, size_t offset, size_t byte_size)
+  : shm_key_(shm_key), base_(base), offset_(offset), byte_size_(byte_size)
+{
+}
+
+SharedMemoryMapping::~SharedMemoryMapping()
+{
+  munmap(base_, offset_ + byte_size_);
+}
+
+//==============================================================================
+
+class OptionsImpl : public InferContext::Options {
+public:
+  OptionsImpl();
+  ~OptionsImpl() = default;
+
+  size_t BatchSize() const override { return batch_size_; }
+  void SetBatchSize(size_t batch_size) override { batch_size_ = batch_size; }
+
+  Error AddRawResult(
+    const std::shared_ptr<InferContext::Output>& output) override;
+  Error AddClassResult(
+    const std::shared_ptr<InferContext::Output>& output, uint64_t k) override;
+  Error AddSharedMemoryResult(
+    const std::shared_ptr<InferContext::Output>& output,
+    const std::string& name, size_t offset, size_t byte_size) override;
+
+  // Options for an output. The result is written to the shared memory
+  // region 'shm_name' if not empty.
+  struct OutputOptions {
+    OutputOptions(InferContext::Result::ResultFormat f, uint64_t n=0)
+      : result_format(f), u64(n), shm_offset(0), shm_byte_size(0) { }
+    InferContext::Result::ResultFormat result_format;
+    uint64_t u64;
+    std::string shm_name;
+    size_t shm_offset;
+    size_t shm_byte_size;
+  };
+
+  using OutputOptionsPair =
+    std::pair<std::shared_ptr<InferContext::Output>, OutputOptions>;
+
+  const std::vector<OutputOptionsPair>& Outputs() const { return outputs_; }
+
+private:
+  size_t batch_size_;
+  std::vector<OutputOptionsPair> outputs_;
+};
+
+OptionsImpl::OptionsImpl()
+  : batch_size_(0)
+{
+}
+
+Error
+OptionsImpl::AddRawResult(const std::shared_ptr<InferContext::Output>& output)
+{
+  outputs_.emplace_back(
+    std::make_pair(
+      output, OutputOptions(InferContext::Result::ResultFormat::RAW)));
+  return Error::Success;
+}
+
+Error
+OptionsImpl::AddClassResult(
+  const std::shared_ptr<InferContext::Output>& output, uint64_t k)
+{
+  outputs_.emplace_back(
+    std::make_pair(
+      output, OutputOptions(InferContext::Result::ResultFormat::CLASS, k)));
+  return Error::Success;
+}
+
+Error
+OptionsImpl::AddSharedMemoryResult(
+  const std::shared_ptr<InferContext::Output>& output,
+  const std::string& name, size_t offset, size_t byte_size)
+{
+  OutputOptions ooptions(InferContext::Result::ResultFormat::RAW);
+  ooptions.shm_name = name;
+  ooptions.shm_offset = offset;
+  ooptions.shm_byte_size = byte_size;
+  outputs_.emplace_back(std::make_pair(output, ooptions));
+  return Error::Success;
+}
+
+Error
+InferContext::Options::Create(std::unique_ptr<InferContext::Options>* options)
+{
+  options->reset(new OptionsImpl());
+  return Error::Success;
+}
+
+//==============================================================================
+
+class RunTemplateImpl : public InferContext::RunTemplate {
+public:
+  RunTemplateImpl(const InferContext* ctx, const OptionsImpl& options);
+  ~RunTemplateImpl();
+
+  size_t BatchSize() const override { return options_.BatchSize(); }
+
+private:
+  friend class InferContext;
+  friend class InferHttpContext;
+  friend class InferGrpcContext;
+
+  // The context that prepared the template.
+  const InferContext* const ctx_;
+
+  // Copy of the options the template is prepared from.
+  const OptionsImpl options_;
+
+  // InferRequestHeader protobuf describing the request
+  InferRequestHeader infer_request_;
+
+  // Total size of all inputs, in bytes.
+  uint64_t total_input_byte_size_;
+
+  // For HTTP, the URL and the lists of the HTTP request header, with
+  // the InferRequestHeader in text format or binary, shared by all
+  // requests sent with the template.
+  std::string http_url_;
+  struct curl_slist* http_header_list_;
+  struct curl_slist* http_binary_header_list_;
+
+  // For gRPC, the serialized InferRequest fields other than the raw
+  // input and the request id.
+  std::string grpc_header_;
+
+  // For each output of 'options_', the mapping of the shared memory
+  // region the result is written to, or nullptr.
+  std::vector<std::shared_ptr<SharedMemoryMapping>> shared_memory_results_;
+};
+
+RunTemplateImpl::RunTemplateImpl(
+  const InferContext* ctx, const OptionsImpl& options)
+  : ctx_(ctx), options_(options), total_input_byte_size_(0),
+    http_header_list_(NULL), http_binary_header_list_(NULL)
+{
+}
+
+RunTemplateImpl::~RunTemplateImpl()
+{
+  curl_slist_free_all(http_header_list_);
+  curl_slist_free_all(http_binary_header_list_);
+}
+
 //==============================================================================
 
-InferContext::RequestTimers::RequestTimers()
+class InputImpl : public InferContext::Input {
+public:
+  InputImpl(const ModelInput& mio);
+  InputImpl(const InputImpl& obj);
+  ~InputImpl() = default;
+
+  const std::string& Name() const override { return mio_.name(); }
+  size_t ByteSize() const override { return byte_size_; }
+  DataType DType() const override { return mio_.data_type(); }
+  ModelInput::Format Format() const override { return mio_.format(); }
+  const DimsList& Dims() const override { return mio_.dims(); }
+
+  void SetBatchSize(size_t batch_size) { batch_size_ = batch_size; }
+
+  Error Reset() override;
+  Error SetRaw(const std::vector<uint8_t>& input) override;
+  Error SetRaw(const uint8_t* input, size_t input_byte_size) override;
+  Error SetRawBatch(const uint8_t* input, size_t input_byte_size) override;
+  Error SetRawBatch(
+    const uint8_t* input, size_t input_byte_size,
+    size_t batch_stride) override;
+  Error SetSharedMemory(
+    const std::string& name, size_t offset, size_t byte_size) override;
+
+  // The shared memory region the input is read from, 'SharedMemoryName()'
+  // is empty if the input is sent with the request.
+  const std::string& SharedMemoryName() const { return shm_name_; }
+  size_t SharedMemoryOffset() const { return shm_offset_; }
+  size_t SharedMemoryByteSize() const { return shm_byte_size_; }
+
+  // Copy into 'buf' up to 'size' bytes of this input's data. Return
+  // the actual amount copied in 'input_bytes' and if the end of input
+  // is reached in 'end_of_input'
+  Error GetNext(
+    uint8_t* buf, size_t size, size_t* input_bytes, bool* end_of_input);
+
+  // Copy the pointer of the raw buffer at 'batch_idx' into 'buf'
+  Error GetRaw(size_t batch_idx, const uint8_t** buf) const;
+
+  // Prepare to send this input as part of a request.
+  Error PrepareForRequest();
+
+  // Return the data of all batch entries if they are contiguous,
+  // nullptr otherwise. Only valid after PrepareForRequest().
+  const uint8_t* ContiguousBatch() const { return contiguous_batch_; }
+
+private:
+  // @return the data of the batch entry at 'batch_idx'.
+  const uint8_t* EntryData(size_t batch_idx) const;
+
+  const ModelInput mio_;
+  const size_t byte_size_;
+  size_t batch_size_;
+
+  // The batch entries are either set one by one in 'bufs_' or as one
+  // array of 'batch_buf_byte_size_' bytes at 'batch_buf_'.
+  std::vector<const uint8_t*> bufs_;
+  const uint8_t* batch_buf_;
+  size_t batch_buf_byte_size_;
+  size_t batch_stride_;
+
+  // Or all entries are in a shared memory region.
+  std::string shm_name_;
+  size_t shm_offset_;
+  size_t shm_byte_size_;
+
+  const uint8_t* contiguous_batch_;
+  size_t bufs_idx_, buf_pos_;
+};
+
+InputImpl::InputImpl(const ModelInput& mio)
+  : mio_(mio), byte_size_(GetSize(mio)),
+    batch_size_(0), batch_buf_(nullptr), batch_buf_byte_size_(0),
+    batch_stride_(0), shm_offset_(0), shm_byte_size_(0),
+    contiguous_batch_(nullptr), bufs_idx_(0), buf_pos_(0)
+{
+}
+
+InputImpl::InputImpl(const InputImpl& obj)
+  : mio_(obj.mio_), byte_size_(obj.byte_size_),
+    batch_size_(obj.batch_size_), bufs_(obj.bufs_),
+    batch_buf_(obj.batch_buf_), batch_buf_byte_size_(obj.batch_buf_byte_size_),
+    batch_stride_(obj.batch_stride_), shm_name_(obj.shm_name_),
+    shm_offset_(obj.shm_offset_), shm_byte_size_(obj.shm_byte_size_),
+    contiguous_batch_(nullptr), bufs_idx_(0), buf_pos_(0)
+{
+}
+
+const uint8_t*
+InputImpl::EntryData(size_t batch_idx) const
+{
+  if (batch_buf_ != nullptr) {
+    return batch_buf_ + (batch_idx * batch_stride_);
+  }
+
+  return bufs_[batch_idx];
+}
+
+Error
+InputImpl::SetRaw(const uint8_t* input, size_t input_byte_size)
+{
+  if (input_byte_size != byte_size_) {
+    bufs_.clear();
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "invalid size " + std::to_string(input_byte_size) +
+        " bytes for input '" + Name() + "', expects " +
+        std::to_string(byte_size_) + " bytes");
+  }
+
+  if (batch_buf_ != nullptr) {
+    Reset();
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "tensor values for input '" + Name() +
+        "' already set by SetRawBatch");
+  }
+
+  if (!shm_name_.empty()) {
+    Reset();
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "tensor values for input '" + Name() +
+        "' already set by SetSharedMemory");
+  }
+
+  if (bufs_.size() >= batch_size_) {
+    bufs_.clear();
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "expecting " + std::to_string(batch_size_) +
+        " invocations of SetRaw for input '" + Name() +
+        "', one per batch entry");
+  }
+
+  bufs_.push_back(input);
+  return Error::Success;
+}
+
+Error
+InputImpl::SetRaw(const std::vector<uint8_t>& input)
+{
+  return SetRaw(&input[0], input.size());
+}
+
+Error
+InputImpl::SetRawBatch(const uint8_t* input, size_t input_byte_size)
+{
+  if (input_byte_size != (byte_size_ * batch_size_)) {
+    Reset();
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "invalid size " + std::to_string(input_byte_size) +
+        " bytes for batch of input '" + Name() + "', expects " +
+        std::to_string(byte_size_ * batch_size_) + " bytes");
+  }
+
+  return SetRawBatch(input, input_byte_size, byte_size_);
+}
+
+Error
+InputImpl::SetRawBatch(
+  const uint8_t* input, size_t input_byte_size, size_t batch_stride)
+{
+  if (!bufs_.empty() || (batch_buf_ != nullptr) || !shm_name_.empty()) {
+    Reset();
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "tensor values for input '" + Name() +
+        "' already set, SetRawBatch must follow Reset");
+  }
+
+  if (batch_stride < byte_size_) {
+    Reset();
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "invalid stride " + std::to_string(batch_stride) +
+        " bytes for input '" + Name() + "', expects at least " +
+        std::to_string(byte_size_) + " bytes");
+  }
+
+  const size_t expected_byte_size =
+    (batch_size_ == 0) ? 0 : ((batch_size_ - 1) * batch_stride) + byte_size_;
+  if (input_byte_size < expected_byte_size) {
+    Reset();
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "invalid size " + std::to_string(input_byte_size) +
+        " bytes for batch of input '" + Name() + "', expects at least " +
+        std::to_string(expected_byte_size) + " bytes");
+  }
+
+  batch_buf_ = input;
+  batch_buf_byte_size_ = input_byte_size;
+  batch_stride_ = batch_stride;
+  return Error::Success;
+}
+
+Error
+InputImpl::SetSharedMemory(
+  const std::string& name, size_t offset, size_t byte_size)
+{
+  if (!bufs_.empty() || (batch_buf_ != nullptr) || !shm_name_.empty()) {
+    Reset();
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "tensor values for input '" + Name() +
+        "' already set, SetSharedMemory must follow Reset");
+  }
+
+  if (name.empty()) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "no shared memory region given for input '" + Name() + "'");
+  }
+
+  shm_name_ = name;
+  shm_offset_ = offset;
+  shm_byte_size_ = byte_size;
+  return Error::Success;
+}
+
+Error
+InputImpl::GetNext(
+  uint8_t* buf, size_t size, size_t* input_bytes, bool* end_of_input)
+{
+  // Nothing is sent for an input in shared memory.
+  if (!shm_name_.empty()) {
+    *input_bytes = 0;
+    *end_of_input = true;
+    return Error::Success;
+  }
+
+  // Contiguous batch is copied as one block.
+  if (contiguous_batch_ != nullptr) {
+    const size_t total_byte_size = byte_size_ * batch_size_;
+    const size_t csz = std::min(total_byte_size - buf_pos_, size);
+    memcpy(buf, contiguous_batch_ + buf_pos_, csz);
+    buf_pos_ += csz;
+
+    *input_bytes = csz;
+    *end_of_input = (buf_pos_ >= total_byte_size);
+    return Error::Success;
+  }
+
+  size_t total_size = 0;
+
+  const size_t entry_cnt = (batch_buf_ != nullptr) ? batch_size_ : bufs_.size();
+  while ((bufs_idx_ < entry_cnt) && (size > 0)) {
+    const size_t csz = std::min(byte_size_ - buf_pos_, size);
+    if (csz > 0) {
+      const uint8_t* input_ptr = EntryData(bufs_idx_) + buf_pos_;
+      std::copy(input_ptr, input_ptr + csz, buf);
+      buf_pos_ += csz;
+      buf += csz;
+      size -= csz;
+      total_size += csz;
+    }
+
+    if (buf_pos_ == byte_size_) {
+      bufs_idx_++;
+      buf_pos_ = 0;
+    }
+  }
+
+  *input_bytes = total_size;
+  *end_of_input = (bufs_idx_ >= entry_cnt);
+  return Error::Success;
+}
+
+Error
+InputImpl::GetRaw(
+  size_t batch_idx, const uint8_t** buf) const
+{
+  if (batch_idx >= batch_size_) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "unexpected batch entry " + std::to_string(batch_idx) +
+        " requested for input '" + Name() +
+        "', batch size is " + std::to_string(batch_size_));
+  }
+
+  if (!shm_name_.empty()) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "tensor values for input '" + Name() + "' are in shared memory");
+  }
+
+  *buf = EntryData(batch_idx);
+  return Error::Success;
+}
+
+Error
+InputImpl::Reset()
+{
+  bufs_.clear();
+  batch_buf_ = nullptr;
+  batch_buf_byte_size_ = 0;
+  batch_stride_ = 0;
+  shm_name_.clear();
+  shm_offset_ = 0;
+  shm_byte_size_ = 0;
+  contiguous_batch_ = nullptr;
+  bufs_idx_ = 0;
+  buf_pos_ = 0;
+  return Error::Success;
+}
+
+Error
+InputImpl::PrepareForRequest()
+{
+  contiguous_batch_ = nullptr;
+
+  if (!shm_name_.empty()) {
+    // The batch size may have changed since SetSharedMemory
+    if (shm_byte_size_ != (byte_size_ * batch_size_)) {
+      return
+        Error(
+          RequestStatusCode::INVALID_ARG,
+          "invalid size " + std::to_string(shm_byte_size_) +
+          " bytes in shared memory for batch of input '" + Name() +
+          "', expects " + std::to_string(byte_size_ * batch_size_) +
+          " bytes");
+    }
+  } else if (batch_buf_ != nullptr) {
+    // The batch size may have changed since SetRawBatch
+    const size_t expected_byte_size =
+      (batch_size_ == 0) ? 0 : ((batch_size_ - 1) * batch_stride_) + byte_size_;
+    if (batch_buf_byte_size_ < expected_byte_size) {
+      return
+        Error(
+          RequestStatusCode::INVALID_ARG,
+          "batch of input '" + Name() + "' holds " +
+          std::to_string(batch_buf_byte_size_) + " bytes, expecting " +
+          std::to_string(expected_byte_size) + " bytes");
+    }
+
+    if (batch_stride_ == byte_size_) {
+      contiguous_batch_ = batch_buf_;
+    }
+  } else {
+    if (bufs_.size() != batch_size_) {
+      return
+        Error(
+          RequestStatusCode::INVALID_ARG,
+          "expecting " + std::to_string(batch_size_) +
+          " invocations of SetRaw for input '" + Name() +
+          "', have " + std::to_string(bufs_.size()));
+    }
+
+    // Entries set one by one may still be adjacent in memory
+    bool contiguous = !bufs_.empty();
+    for (size_t idx = 1; contiguous && (idx < bufs_.size()); idx++) {
+      contiguous = (bufs_[idx] == (bufs_[0] + (idx * byte_size_)));
+    }
+    if (contiguous) {
+      contiguous_batch_ = bufs_[0];
+    }
+  }
+
+  // Reset position so request sends entire input.
+  bufs_idx_ = 0;
+  buf_pos_ = 0;
+  return Error::Success;
+}
+
+//==============================================================================
+
+class OutputImpl : public InferContext::Output {
+public:
+  OutputImpl(const ModelOutput& mio);
+  ~OutputImpl() = default;
+
+  const std::string& Name() const override { return mio_.name(); }
+  size_t ByteSize() const override { return byte_size_; }
+  DataType DType() const override { return mio_.data_type(); }
+  const DimsList& Dims() const override { return mio_.dims(); }
+
+  InferContext::Result::ResultFormat ResultFormat() const {
+    return result_format_;
+  }
+  void SetResultFormat(InferContext::Result::ResultFormat result_format) {
+    result_format_ = result_format;
+  }
+
+  // True if the result is written to shared memory.
+  bool InSharedMemory() const { return in_shared_memory_; }
+  void SetInSharedMemory(bool in_shared_memory) {
+    in_shared_memory_ = in_shared_memory;
+  }
+
+  private:
+  const ModelOutput mio_;
+  const size_t byte_size_;
+  InferContext::Result::ResultFormat result_format_;
+  bool in_shared_memory_;
+};
+
+OutputImpl::OutputImpl(const ModelOutput& mio)
+  : mio_(mio), byte_size_(GetSize(mio)),
+    result_format_(InferContext::Result::ResultFormat::RAW),
+    in_shared_memory_(false)
+{
+}
+
+//==============================================================================
+
+class ResultImpl : public InferContext::Result {
+public:
+  ResultImpl(
+    const std::shared_ptr<InferContext::Output>& output, uint64_t batch_size,
+    InferContext::Result::ResultFormat result_format);
+  ~ResultImpl() = default;
+
+  const std::string& ModelName() const override { return model_name_; }
+  uint32_t ModelVersion() const override { return model_version_; }
+
+  const std::shared_ptr<InferContext::Output> GetOutput() const override {
+    return output_;
+  }
+
+  Error GetRaw(
+    size_t batch_idx, const std::vector<uint8_t>** buf) const override;
+  Error GetRaw(
+    size_t batch_idx, const uint8_t** buf, size_t* byte_size) const override;
+  Error GetRawBatch(const uint8_t** buf, size_t* byte_size) const override;
+  Error GetRawAtCursor(
+    size_t batch_idx, const uint8_t** buf, size_t adv_byte_size) override;
+  Error GetClassCount(size_t batch_idx, size_t* cnt) const override;
+  Error GetClassAtCursor(size_t batch_idx, ClassResult* result) override;
+  Error ResetCursors() override;
+  Error ResetCursor(size_t batch_idx) override;
+
+  // Get the result format for this result.
+  InferContext::Result::ResultFormat ResultFormat() const {
+    return result_format_;
+  }
+
+  // Set information about the model that produced this result.
+  void SetModel(const std::string& name, const uint32_t version) {
+    model_name_ = name;
+    model_version_ = version;
+  }
+
+  // Set results for a CLASS format result.
+  void SetClassResult(const InferResponseHeader::Output& result) {
+    class_result_ = result;
+  }
+
+  // For RAW format result, copy into the output up to 'size' bytes of
+  // output data from 'buf'. Return the actual amount copied in
+  // 'result_bytes'.
+  Error SetNextRawResult(
+    const uint8_t* buf, size_t size, size_t* result_bytes);
+
+  // For RAW format result, write the output data to 'buf' instead of
+  // a buffer allocated for this result. 'buf' is owned by the caller
+  // and must be able to hold the whole output.
+  void SetRawResultBuffer(uint8_t* buf) {
+    raw_data_ = buf;
+    raw_bound_ = true;
+  }
+
+  // For RAW format result, reference the output data of all batch
+  // entries at 'buf' instead of copying it, unless the result is
+  // bound to a caller-owned buffer in which case the data is copied
+  // there. 'size' must be the size of the whole output. 'owner' holds
+  // the storage of 'buf' and is kept alive as long as the result.
+  Error SetRawResultReference(
+    const std::shared_ptr<const void>& owner, const uint8_t* buf,
+    size_t size);
+
+private:
+  Error ValidateRawRequest(size_t batch_idx) const;
+
+  // @return the raw result data of 'batch_idx' and its size.
+  const uint8_t* RawData(size_t batch_idx) const;
+  size_t RawByteSize(size_t batch_idx) const;
+
+  const std::shared_ptr<InferContext::Output> output_;
+  const size_t byte_size_;
+  const size_t batch_size_;
+  const InferContext::Result::ResultFormat result_format_;
+
+  // The RAW result of the whole batch is stored contiguously at
+  // 'raw_data_', which is either a buffer allocated for this result,
+  // a caller-owned buffer if 'raw_bound_' or a reference into the
+  // response. 'raw_owner_' holds that storage if not owned by the
+  // caller and 'raw_size_' is the number of bytes available.
+  std::shared_ptr<const void> raw_owner_;
+  uint8_t* raw_data_;
+  bool raw_bound_;
+  size_t raw_size_;
+  std::vector<size_t> bufs_pos_;
+
+  // Per batch entry copies of the RAW result, only filled on demand
+  // by the vector variant of GetRaw().
+  mutable std::vector<std::vector<uint8_t>> bufs_;
+
+  std::string model_name_;
+  uint32_t model_version_;
+
+  InferResponseHeader::Output class_result_;
+  std::vector<size_t> class_pos_;
+};
+
+ResultImpl::ResultImpl(
+  const std::shared_ptr<InferContext::Output>& output, uint64_t batch_size,
+  InferContext::Result::ResultFormat result_format)
+  : output_(output), byte_size_(output->ByteSize()),
+    batch_size_(batch_size), result_format_(result_format),
+    raw_data_(nullptr), raw_bound_(false), raw_size_(0),
+    bufs_pos_(batch_size),
+    bufs_(batch_size), class_pos_(batch_size)
+{
+}
+
+const uint8_t*
+ResultImpl::RawData(size_t batch_idx) const
+{
+  return raw_data_ + (batch_idx * byte_size_);
+}
+
+size_t
+ResultImpl::RawByteSize(size_t batch_idx) const
+{
+  const size_t offset = batch_idx * byte_size_;
+  if (raw_size_ <= offset) {
+    return 0;
+  }
+
+  return std::min(raw_size_ - offset, byte_size_);
+}
+
+Error
+ResultImpl::ValidateRawRequest(size_t batch_idx) const
+{
+  if (result_format_ != InferContext::Result::ResultFormat::RAW) {
+    return
+      Error(
+        RequestStatusCode::UNSUPPORTED,
+        "raw result not available for non-RAW output '" +
+        output_->Name() + "'");
+  }
+
+  if (batch_idx >= batch_size_) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "unexpected batch entry " + std::to_string(batch_idx) +
+        " requested for output '" + output_->Name() +
+        "', batch size is " + std::to_string(batch_size_));
+  }
+
+  return Error::Success;
+}
+
+Error
+ResultImpl::GetRaw(
+  size_t batch_idx, const std::vector<uint8_t>** buf) const
+{
+  Error err = ValidateRawRequest(batch_idx);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  // The result is not stored as vectors, copy the data the first time
+  // it is requested as one.
+  const size_t byte_size = RawByteSize(batch_idx);
+  if (bufs_[batch_idx].size() != byte_size) {
+    const uint8_t* data = RawData(batch_idx);
+    bufs_[batch_idx].assign(data, data + byte_size);
+  }
+
+  *buf = &bufs_[batch_idx];
+  return Error::Success;
+}
+
+Error
+ResultImpl::GetRaw(
+  size_t batch_idx, const uint8_t** buf, size_t* byte_size) const
+{
+  Error err = ValidateRawRequest(batch_idx);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  *buf = RawData(batch_idx);
+  *byte_size = RawByteSize(batch_idx);
+  return Error::Success;
+}
+
+Error
+ResultImpl::GetRawBatch(const uint8_t** buf, size_t* byte_size) const
+{
+  if (result_format_ != InferContext::Result::ResultFormat::RAW) {
+    return
+      Error(
+        RequestStatusCode::UNSUPPORTED,
+        "raw result not available for non-RAW output '" +
+        output_->Name() + "'");
+  }
+
+  *buf = raw_data_;
+  *byte_size = raw_size_;
+  return Error::Success;
+}
+
+Error
+ResultImpl::GetRawAtCursor(
+  size_t batch_idx, const uint8_t** buf, size_t adv_byte_size)
+{
+  Error err = ValidateRawRequest(batch_idx);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  if ((bufs_pos_[batch_idx] + adv_byte_size) > RawByteSize(batch_idx)) {
+    return
+      Error(
+        RequestStatusCode::UNSUPPORTED,
+        "attempt to read beyond end of result for output output '" +
+        output_->Name() + "'");
+  }
+
+  *buf = RawData(batch_idx) + bufs_pos_[batch_idx];
+  bufs_pos_[batch_idx] += adv_byte_size;
+  return Error::Success;
+}
+
+Error
+ResultImpl::GetClassCount(size_t batch_idx, size_t* cnt) const
+{
+  if (result_format_ != InferContext::Result::ResultFormat::CLASS) {
+    return
+      Error(
+        RequestStatusCode::UNSUPPORTED,
+        "class result not available for non-CLASS output '" +
+        output_->Name() + "'");
+  }
+
+  // Number of classifications should equal expected batch size but
+  // check both to be careful and to protext class_pos_ accesses.
+  if ((batch_idx >= (size_t)class_result_.batch_classes().size()) ||
+      (batch_idx >= batch_size_)) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "unexpected batch entry " + std::to_string(batch_idx) +
+        "requested for output '" + output_->Name() +
+        "', batch size is " + std::to_string(batch_size_));
+  }
+
+  const InferResponseHeader::Output::Classes& classes =
+    class_result_.batch_classes(batch_idx);
+
+  *cnt = classes.cls().size();
+  return Error::Success;
+}
+
+Error
+ResultImpl::GetClassAtCursor(
+  size_t batch_idx, InferContext::Result::ClassResult* result)
+{
+  if (result_format_ != InferContext::Result::ResultFormat::CLASS) {
+    return
+      Error(
+        RequestStatusCode::UNSUPPORTED,
+        "class result not available for non-CLASS output '" +
+        output_->Name() + "'");
+  }
+
+  // Number of classifications should equal expected batch size but
+  // check both to be careful and to protext class_pos_ accesses.
+  if ((batch_idx >= (size_t)class_result_.batch_classes().size()) ||
+      (batch_idx >= batch_size_)) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "unexpected batch entry " + std::to_string(batch_idx) +
+        "requested for output '" + output_->Name() +
+        "', batch size is " + std::to_string(batch_size_));
+  }
+
+  const InferResponseHeader::Output::Classes& classes =
+    class_result_.batch_classes(batch_idx);
+
+  if (class_pos_[batch_idx] >= (size_t)classes.cls().size()) {
+    return
+      Error(
+        RequestStatusCode::UNSUPPORTED,
+        "attempt to read beyond end of result for output output '" +
+        output_->Name() + "'");
+  }
+
+  const InferResponseHeader::Output::Class& cls =
+    classes.cls(class_pos_[batch_idx]);
+
+  result->idx = cls.idx();
+  result->value = cls.value();
+  result->label = cls.label();
+
+  class_pos_[batch_idx]++;
+  return Error::Success;
+}
+
+Error
+ResultImpl::ResetCursors()
+{
+  std::fill(bufs_pos_.begin(), bufs_pos_.end(), 0);
+  std::fill(class_pos_.begin(), class_pos_.end(), 0);
+  return Error::Success;
+}
+
+Error
+ResultImpl::ResetCursor(size_t batch_idx)
+{
+  if (batch_idx >= batch_size_) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "unexpected batch entry " + std::to_string(batch_idx) +
+        "requested for output '" + output_->Name() +
+        "', batch size is " + std::to_string(batch_size_));
+  }
+
+  bufs_pos_[batch_idx] = 0;
+  class_pos_[batch_idx] = 0;
+  return Error::Success;
+}
+
+Error
+ResultImpl::SetNextRawResult(
+  const uint8_t* buf, size_t size, size_t* result_bytes)
+{
+  const size_t total_byte_size = byte_size_ * batch_size_;
+
+  // Allocate the storage for the whole batch on the first chunk of
+  // output data.
+  if ((raw_data_ == nullptr) && (total_byte_size > 0)) {
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, kRawResultAlignment, total_byte_size) != 0) {
+      return
+        Error(
+          RequestStatusCode::INTERNAL,
+          "failed to allocate " + std::to_string(total_byte_size) +
+          " bytes for output '" + output_->Name() + "'");
+    }
+
+    raw_owner_.reset(ptr, free);
+    raw_data_ = reinterpret_cast<uint8_t*>(ptr);
+  }
+
+  const size_t csz = std::min(total_byte_size - raw_size_, size);
+  if (csz > 0) {
+    memcpy(raw_data_ + raw_size_, buf, csz);
+    raw_size_ += csz;
+  }
+
+  *result_bytes = csz;
+  return Error::Success;
+}
+
+Error
+ResultImpl::SetRawResultReference(
+  const std::shared_ptr<const void>& owner, const uint8_t* buf, size_t size)
+{
+  if (size != (byte_size_ * batch_size_)) {
+    return
+      Error(
+        RequestStatusCode::INVALID,
+        "expected " + std::to_string(byte_size_ * batch_size_) +
+        " bytes for output '" + output_->Name() + "', got " +
+        std::to_string(size));
+  }
+
+  if (raw_bound_) {
+    memcpy(raw_data_, buf, size);
+  } else {
+    raw_owner_ = owner;
+    raw_data_ = const_cast<uint8_t*>(buf);
+  }
+
+  raw_size_ = size;
+  return Error::Success;
+}
+
+//==============================================================================
+
+InferContext::RequestTimers::RequestTimers()
+{
+  Reset();
+}
+
+Error
+InferContext::RequestTimers::Reset()
+{
+  request_start_.tv_sec = 0;
+  request_end_.tv_sec = 0;
+  send_start_.tv_sec = 0;
+  send_end_.tv_sec = 0;
+  receive_start_.tv_sec = 0;
+  receive_end_.tv_sec = 0;
+  request_start_.tv_nsec = 0;
+  request_end_.tv_nsec = 0;
+  send_start_.tv_nsec = 0;
+  send_end_.tv_nsec = 0;
+  receive_start_.tv_nsec = 0;
+  receive_end_.tv_nsec = 0;
+  return Error::Success;
+}
+
+Error
+InferContext::RequestTimers::Record(Kind kind)
+{
+  switch (kind) {
+    case Kind::REQUEST_START:
+      clock_gettime(CLOCK_MONOTONIC, &request_start_);
+      break;
+    case Kind::REQUEST_END:
+      clock_gettime(CLOCK_MONOTONIC, &request_end_);
+      break;
+    case Kind::SEND_START:
+      clock_gettime(CLOCK_MONOTONIC, &send_start_);
+      break;
+    case Kind::SEND_END:
+      clock_gettime(CLOCK_MONOTONIC, &send_end_);
+      break;
+    case Kind::RECEIVE_START:
+      clock_gettime(CLOCK_MONOTONIC, &receive_start_);
+      break;
+    case Kind::RECEIVE_END:
+      clock_gettime(CLOCK_MONOTONIC, &receive_end_);
+      break;
+  }
+  return Error::Success;
+}
+
+//==============================================================================
+
+class RequestImpl : public InferContext::Request {
+public:
+  virtual ~RequestImpl() = default;
+
+  uint64_t Id() const { return id_; };
+
+  // Initialize 'requested_results_' according to 'batch_size' and
+  // 'requested_outs' as the placeholder for the results
+  Error InitializeRequestedResults(
+    const std::vector<std::shared_ptr<InferContext::Output>>& requested_outs,
+    const size_t batch_size);
+
+  // Return the results of the request. 'ready_' should always be checked
+  // before calling GetResults() to ensure the request has been completed.
+  virtual Error GetResults(
+    std::vector<std::unique_ptr<InferContext::Result>>* results) = 0;
+
+protected:
+  RequestImpl(const uint64_t id);
+
+  // Helper function called after inference to set non-RAW results in
+  // 'requested_results_'.
+  Error PostRunProcessing(
+    std::vector<std::unique_ptr<InferContext::Result>>& results,
+    const InferResponseHeader& infer_response);
+
+  friend class InferContext;
+
+  // Identifier seen by user
+  uint64_t id_;
+
+  // Internal identifier for asynchronous call
+  uintptr_t run_index_;
+
+  // Indicating if the request has been completed.
+  bool ready_;
+
+  // Condition variable for threads waiting on this request alone,
+  // used with the context's 'mutex_'.
+  std::condition_variable waiter_cv_;
+
+  // Position in the context's ready queue once 'ready_', the end of
+  // the queue once returned by GetReadyAsyncRequest().
+  std::list<std::shared_ptr<InferContext::Request>>::iterator ready_itr_;
+
+  // Function to invoke on completion, if set the request is not
+  // queued for GetReadyAsyncRequest().
+  InferContext::OnCompleteFn callback_;
+
+  // The timer for infer request.
+  InferContext::RequestTimers timer_;
+
+  // Results being collected for the requested outputs from inference
+  // server response.
+  std::vector<std::unique_ptr<InferContext::Result>> requested_results_;
+
+  // Current positions within output vectors when processing response.
+  size_t result_pos_idx_;
+
+  // The template the request is sent with, its header must stay valid
+  // until the request completes.
+  std::shared_ptr<const RunTemplateImpl> run_template_;
+};
+
+RequestImpl::RequestImpl(const uint64_t id)
+    : id_(id), ready_(false), result_pos_idx_(0)
+{
+}
+
+Error
+RequestImpl::InitializeRequestedResults(
+  const std::vector<std::shared_ptr<InferContext::Output>>& requested_outs,
+  const size_t batch_size)
+{
+  // Initialize the results vector to collect the requested results.
+  requested_results_.clear();
+  for (const auto& io : requested_outs) {
+    std::unique_ptr<ResultImpl>
+      rp(
+        new ResultImpl(
+          io, batch_size,
+          reinterpret_cast<OutputImpl*>(io.get())->ResultFormat()));
+    requested_results_.emplace_back(std::move(rp));
+  }
+  return Error::Success;
+}
+
+Error
+RequestImpl::PostRunProcessing(
+  std::vector<std::unique_ptr<InferContext::Result>>& results,
+  const InferResponseHeader& infer_response)
+{
+  // At this point, the RAW requested results have their result values
+  // set. Now need to initialize non-RAW results.
+  for (auto& rr : results) {
+    ResultImpl* r = reinterpret_cast<ResultImpl*>(rr.get());
+    r->SetModel(infer_response.model_name(), infer_response.model_version());
+    switch (r->ResultFormat()) {
+      case InferContext::Result::ResultFormat::RAW:
+        r->ResetCursors();
+        break;
+
+      case InferContext::Result::ResultFormat::CLASS: {
+        for (const auto& ir : infer_response.output()) {
+          if (ir.name() == r->GetOutput()->Name()) {
+            r->SetClassResult(ir);
+            break;
+          }
+        }
+        break;
+      }
+    }
+  }
+  return Error::Success;
+}
+
+//==============================================================================
+
+InferContext::InferContext(
+  const std::string& model_name, int model_version, bool verbose)
+  : model_name_(model_name), model_version_(model_version),
+    verbose_(verbose), total_input_byte_size_(0), batch_size_(0),
+    async_request_id_(0), pending_async_request_count_(0),
+    thread_safe_(false), completed_request_count_(0),
+    cumulative_total_request_time_ns_(0), cumulative_send_time_ns_(0),
+    cumulative_receive_time_ns_(0), reused_connection_count_(0),
+    new_connection_count_(0), worker_(), exiting_(true)
+{
+}
+
+Error
+InferContext::InitializeModel(const ModelConfig& config)
+{
+  max_batch_size_ =
+    static_cast<uint64_t>(std::max(0, config.max_batch_size()));
+  config_ = config;
+
+  // Create inputs and outputs
+  for (const auto& io : config.input()) {
+    inputs_.emplace_back(std::make_shared<InputImpl>(io));
+  }
+  for (const auto& io : config.output()) {
+    outputs_.emplace_back(std::make_shared<OutputImpl>(io));
+  }
+
+  return Error::Success;
+}
+
+Error
+InferContext::GetInput(
+  const std::string& name, std::shared_ptr<Input>* input) const
+{
+  for (const auto& io : CallerInputs()) {
+    if (io->Name() == name) {
+      *input = io;
+      return Error::Success;
+    }
+  }
+
+  return
+    Error(
+      RequestStatusCode::INVALID_ARG,
+      "unknown input '" + name + "' for '" + model_name_ + "'");
+}
+
+Error
+InferContext::GetOutput(
+  const std::string& name, std::shared_ptr<Output>* output) const
+{
+  for (const auto& io : outputs_) {
+    if (io->Name() == name) {
+      *output = io;
+      return Error::Success;
+    }
+  }
+
+  return
+    Error(
+      RequestStatusCode::INVALID_ARG,
+      "unknown output '" + name + "' for '" + model_name_ + "'");
+}
+
+Error
+InferContext::SetRunOptions(const InferContext::Options& options)
+{
+  std::shared_ptr<RunTemplate> run_template;
+  Error err = PrepareRunTemplate(options, &run_template);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  return SetRunTemplate(run_template);
+}
+
+Error
+InferContext::PrepareRunTemplate(
+  const InferContext::Options& boptions,
+  std::shared_ptr<RunTemplate>* run_template)
+{
+  const OptionsImpl& options = reinterpret_cast<const OptionsImpl&>(boptions);
+
+  if (options.BatchSize() > max_batch_size_) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "run batch size " + std::to_string(options.BatchSize()) +
+        " exceeds maximum batch size " + std::to_string(max_batch_size_) +
+        " allowed for model '" + model_name_ + "'");
+  }
+
+  std::shared_ptr<RunTemplateImpl> tmpl =
+    std::make_shared<RunTemplateImpl>(this, options);
+  const size_t batch_size = options.BatchSize();
+
+  // Create the InferRequestHeader protobuf. This protobuf will be
+  // used for all requests sent with the template.
+  InferRequestHeader& infer_request = tmpl->infer_request_;
+  infer_request.set_batch_size(batch_size);
+
+  for (const auto& io : inputs_) {
+    tmpl->total_input_byte_size_ += io->ByteSize() * batch_size;
+
+    auto rinput = infer_request.add_input();
+    rinput->set_name(io->Name());
+    rinput->set_byte_size(io->ByteSize());
+  }
+
+  for (const auto& p : options.Outputs()) {
+    const std::shared_ptr<Output>& output = p.first;
+    const OptionsImpl::OutputOptions& ooptions = p.second;
+
+    auto routput = infer_request.add_output();
+    routput->set_name(output->Name());
+    routput->set_byte_size(output->ByteSize());
+    if (ooptions.result_format == Result::ResultFormat::CLASS) {
+      routput->mutable_cls()->set_count(ooptions.u64);
+    }
+
+    // The mapping is kept by the template so that results written to
+    // the region stay valid after the region is unregistered.
+    std::shared_ptr<SharedMemoryMapping> mapping;
+    if (!ooptions.shm_name.empty()) {
+      const size_t expected_byte_size = output->ByteSize() * batch_size;
+      if (ooptions.shm_byte_size < expected_byte_size) {
+        return
+          Error(
+            RequestStatusCode::INVALID_ARG,
+            "shared memory of " + std::to_string(ooptions.shm_byte_size) +
+            " bytes given for output '" + output->Name() +
+            "', expecting " + std::to_string(expected_byte_size) + " bytes");
+      }
+
+      Error err =
+        GetSharedMemoryMapping(
+          ooptions.shm_name, ooptions.shm_offset, ooptions.shm_byte_size,
+          &mapping);
+      if (!err.IsOk()) {
+        return err;
+      }
+
+      auto shm = routput->mutable_shared_memory();
+      shm->set_name(ooptions.shm_name);
+      shm->set_offset(ooptions.shm_offset);
+      shm->set_byte_size(ooptions.shm_byte_size);
+    }
+    tmpl->shared_memory_results_.emplace_back(std::move(mapping));
+  }
+
+  Error err = PrepareProtocolTemplate(tmpl.get());
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  *run_template = std::move(tmpl);
+  return Error::Success;
+}
+
+Error
+InferContext::SetRunTemplate(const std::shared_ptr<RunTemplate>& run_template)
+{
+  std::shared_ptr<const RunTemplateImpl> tmpl =
+    std::static_pointer_cast<const RunTemplateImpl>(run_template);
+  if ((tmpl == nullptr) || (tmpl->ctx_ != this)) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "run template was not prepared by this context");
+  }
+
+  const OptionsImpl& options = tmpl->options_;
+  batch_size_ = options.BatchSize();
+  total_input_byte_size_ = tmpl->total_input_byte_size_;
+
+  for (const auto& io : inputs_) {
+    reinterpret_cast<InputImpl*>(io.get())->SetBatchSize(batch_size_);
+  }
+
+  requested_outputs_.clear();
+
+  {
+    std::lock_guard<std::mutex> lock(thread_mutex_);
+    for (const auto& ti : thread_inputs_) {
+      for (const auto& io : ti.second) {
+        reinterpret_cast<InputImpl*>(io.get())->SetBatchSize(batch_size_);
+      }
+    }
+    output_buffers_.clear();
+  }
+
+  for (const auto& p : options.Outputs()) {
+    const std::shared_ptr<Output>& output = p.first;
+    const OptionsImpl::OutputOptions& ooptions = p.second;
+
+    OutputImpl* routput = reinterpret_cast<OutputImpl*>(output.get());
+    routput->SetResultFormat(ooptions.result_format);
+    routput->SetInSharedMemory(!ooptions.shm_name.empty());
+    requested_outputs_.emplace_back(output);
+  }
+
+  run_template_ = std::move(tmpl);
+  return Error::Success;
+}
+
+Error
+InferContext::SetOutputBuffer(
+  const std::shared_ptr<Output>& output, uint8_t* buf, size_t byte_size,
+  DataType dtype)
+{
+  bool requested = false;
+  for (const auto& ro : requested_outputs_) {
+    if (ro == output) {
+      requested = true;
+      break;
+    }
+  }
+
+  if (!requested ||
+      (reinterpret_cast<OutputImpl*>(output.get())->ResultFormat() !=
+       Result::ResultFormat::RAW)) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "output '" + output->Name() + "' is not requested as RAW result");
+  }
+
+  if (reinterpret_cast<OutputImpl*>(output.get())->InSharedMemory()) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "output '" + output->Name() + "' is requested in shared memory");
+  }
+
+  if (dtype != output->DType()) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "buffer of type " + DataType_Name(dtype) + " given for output '" +
+        output->Name() + "' of type " + DataType_Name(output->DType()));
+  }
+
+  const size_t expected_byte_size = output->ByteSize() * batch_size_;
+  if (byte_size < expected_byte_size) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "buffer of " + std::to_string(byte_size) + " bytes given for output '" +
+        output->Name() + "', expecting " +
+        std::to_string(expected_byte_size) + " bytes");
+  }
+
+  std::lock_guard<std::mutex> lock(thread_mutex_);
+  output_buffers_[CallerKey()][output.get()] = buf;
+  return Error::Success;
+}
+
+void
+InferContext::BindOutputBuffers(const std::shared_ptr<Request>& request)
+{
+  std::map<const Output*, uint8_t*> buffers;
+  {
+    std::lock_guard<std::mutex> lock(thread_mutex_);
+    if (output_buffers_.empty()) {
+      return;
+    }
+
+    auto itr = output_buffers_.find(CallerKey());
+    if (itr == output_buffers_.end()) {
+      return;
+    }
+    buffers.swap(itr->second);
+    output_buffers_.erase(itr);
+  }
+
+  RequestImpl* r = reinterpret_cast<RequestImpl*>(request.get());
+  for (auto& rr : r->requested_results_) {
+    auto it = buffers.find(rr->GetOutput().get());
+    if (it != buffers.end()) {
+      reinterpret_cast<ResultImpl*>(rr.get())->SetRawResultBuffer(it->second);
+    }
+  }
+}
+
+Error
+InferContext::RegisterSharedMemory(
+  const std::string& name, const std::string& shm_key, size_t offset,
+  size_t byte_size)
+{
+  if (name.empty()) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "shared memory region must have a name");
+  }
+
+  // Only the lookups are kept waiting for the map, not for the server.
+  std::lock_guard<std::mutex> control_lock(shared_memory_control_mutex_);
+  {
+    std::lock_guard<std::mutex> lock(shared_memory_mutex_);
+    if (shared_memory_regions_.find(name) != shared_memory_regions_.end()) {
+      return
+        Error(
+          RequestStatusCode::INVALID_ARG,
+          "shared memory region '" + name + "' is already registered");
+    }
+  }
+
+  std::shared_ptr<SharedMemoryMapping> mapping;
+  Error err = SharedMemoryMapping::Create(shm_key, offset, byte_size, &mapping);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  SharedMemoryControl control;
+  control.set_type(SharedMemoryControl::REGISTER);
+  control.set_name(name);
+  control.set_shm_key(shm_key);
+  control.set_offset(offset);
+  control.set_byte_size(byte_size);
+  err = SendSharedMemoryControl(control);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  std::lock_guard<std::mutex> lock(shared_memory_mutex_);
+  shared_memory_regions_.emplace(name, std::move(mapping));
+  return Error::Success;
+}
+
+Error
+InferContext::UnregisterSharedMemory(const std::string& name)
+{
+  std::lock_guard<std::mutex> control_lock(shared_memory_control_mutex_);
+  {
+    std::lock_guard<std::mutex> lock(shared_memory_mutex_);
+    if (shared_memory_regions_.find(name) == shared_memory_regions_.end()) {
+      return
+        Error(
+          RequestStatusCode::NOT_FOUND,
+          "shared memory region '" + name + "' is not registered");
+    }
+  }
+
+  SharedMemoryControl control;
+  control.set_type(SharedMemoryControl::UNREGISTER);
+  control.set_name(name);
+  Error err = SendSharedMemoryControl(control);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  // Requests still using the region keep its mapping alive.
+  std::lock_guard<std::mutex> lock(shared_memory_mutex_);
+  shared_memory_regions_.erase(name);
+  return Error::Success;
+}
+
+Error
+InferContext::GetSharedMemory(
+  const std::string& name, uint8_t** addr, size_t* byte_size) const
+{
+  std::lock_guard<std::mutex> lock(shared_memory_mutex_);
+  auto itr = shared_memory_regions_.find(name);
+  if (itr == shared_memory_regions_.end()) {
+    return
+      Error(
+        RequestStatusCode::NOT_FOUND,
+        "shared memory region '" + name + "' is not registered");
+  }
+
+  *addr = itr->second->Data();
+  *byte_size = itr->second->ByteSize();
+  return Error::Success;
+}
+
+Error
+InferContext::GetSharedMemoryMapping(
+  const std::string& name, size_t offset, size_t byte_size,
+  std::shared_ptr<SharedMemoryMapping>* mapping) const
+{
+  std::lock_guard<std::mutex> lock(shared_memory_mutex_);
+  auto itr = shared_memory_regions_.find(name);
+  if (itr == shared_memory_regions_.end()) {
+    return
+      Error(
+        RequestStatusCode::NOT_FOUND,
+        "shared memory region '" + name + "' is not registered");
+  }
+
+  const size_t region_byte_size = itr->second->ByteSize();
+  if ((offset > region_byte_size) || (byte_size > region_byte_size - offset)) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        std::to_string(byte_size) + " bytes at " + std::to_string(offset) +
+        " exceed shared memory region '" + name + "' of " +
+        std::to_string(region_byte_size) + " bytes");
+  }
+
+  *mapping = itr->second;
+  return Error::Success;
+}
+
+Error
+InferContext::SharedMemoryRequestHeader(
+  const std::vector<std::shared_ptr<Input>>& inputs,
+  std::unique_ptr<InferRequestHeader>* header,
+  uint64_t* input_byte_size) const
+{
+  header->reset();
+  *input_byte_size = total_input_byte_size_;
+
+  for (size_t idx = 0; idx < inputs.size(); idx++) {
+    const InputImpl* io = reinterpret_cast<const InputImpl*>(inputs[idx].get());
+    if (io->SharedMemoryName().empty()) {
+      continue;
+    }
+
+    std::shared_ptr<SharedMemoryMapping> mapping;
+    Error err =
+      GetSharedMemoryMapping(
+        io->SharedMemoryName(), io->SharedMemoryOffset(),
+        io->SharedMemoryByteSize(), &mapping);
+    if (!err.IsOk()) {
+      return err;
+    }
+
+    if (*header == nullptr) {
+      header->reset(new InferRequestHeader(run_template_->infer_request_));
+    }
+
+    auto shm = (*header)->mutable_input(idx)->mutable_shared_memory();
+    shm->set_name(io->SharedMemoryName());
+    shm->set_offset(io->SharedMemoryOffset());
+    shm->set_byte_size(io->SharedMemoryByteSize());
+    *input_byte_size -= io->SharedMemoryByteSize();
+  }
+
+  return Error::Success;
+}
+
+Error
+InferContext::BindSharedMemoryResults(const std::shared_ptr<Request>& request)
+{
+  RequestImpl* r = reinterpret_cast<RequestImpl*>(request.get());
+  const RunTemplateImpl& tmpl = *r->run_template_;
+  for (size_t idx = 0; idx < tmpl.shared_memory_results_.size(); idx++) {
+    const std::shared_ptr<SharedMemoryMapping>& mapping =
+      tmpl.shared_memory_results_[idx];
+    if (mapping == nullptr) {
+      continue;
+    }
+
+    const OptionsImpl::OutputOptions& ooptions =
+      tmpl.options_.Outputs()[idx].second;
+    ResultImpl* result =
+      reinterpret_cast<ResultImpl*>(r->requested_results_[idx].get());
+    Error err =
+      result->SetRawResultReference(
+        mapping, mapping->Data() + ooptions.shm_offset,
+        result->GetOutput()->ByteSize() * tmpl.options_.BatchSize());
+    if (!err.IsOk()) {
+      return err;
+    }
+  }
+
+  return Error::Success;
+}
+
+Error
+InferContext::SetThreadSafeMode(bool enable)
+{
+  std::lock_guard<std::mutex> lock(thread_mutex_);
+  thread_safe_ = enable;
+  thread_inputs_.clear();
+  output_buffers_.clear();
+  return Error::Success;
+}
+
+Error
+InferContext::ReleaseThread()
 {
-  Reset();
+  std::lock_guard<std::mutex> lock(thread_mutex_);
+  if (!thread_safe_) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "ReleaseThread is only supported in thread-safe mode");
+  }
+
+  thread_inputs_.erase(std::this_thread::get_id());
+  output_buffers_.erase(std::this_thread::get_id());
+  return Error::Success;
+}
+
+const std::vector<std::shared_ptr<InferContext::Input>>&
+InferContext::CallerInputs() const
+{
+  if (!thread_safe_) {
+    return inputs_;
+  }
+
+  std::lock_guard<std::mutex> lock(thread_mutex_);
+  auto itr = thread_inputs_.find(std::this_thread::get_id());
+  if (itr == thread_inputs_.end()) {
+    std::vector<std::shared_ptr<Input>> inputs;
+    for (const auto& io : inputs_) {
+      InputImpl* input = reinterpret_cast<InputImpl*>(io.get());
+      inputs.emplace_back(std::make_shared<InputImpl>(*input));
+    }
+    itr =
+      thread_inputs_.emplace(std::this_thread::get_id(), std::move(inputs))
+        .first;
+  }
+
+  // Only the calling thread itself removes its entry (see
+  // ReleaseThread()) so the reference stays valid.
+  return itr->second;
+}
+
+std::thread::id
+InferContext::CallerKey() const
+{
+  return thread_safe_ ? std::this_thread::get_id() : std::thread::id();
+}
+
+void
+InferContext::StartWorker()
+{
+  // exiting_ is true either when destructor is called or the worker
+  // thread is not actually created.
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (exiting_) {
+    exiting_ = false;
+    worker_ = std::thread(&InferContext::AsyncTransfer, this);
+  }
 }
 
 Error
-InferContext::RequestTimers::Reset()
+InferContext::SetCallbackExecutor(const CallbackExecutor& executor)
 {
-  request_start_.tv_sec = 0;
-  request_end_.tv_sec = 0;
-  send_start_.tv_sec = 0;
-  send_end_.tv_sec = 0;
-  receive_start_.tv_sec = 0;
-  receive_end_.tv_sec = 0;
-  request_start_.tv_nsec = 0;
-  request_end_.tv_nsec = 0;
-  send_start_.tv_nsec = 0;
-  send_end_.tv_nsec = 0;
-  receive_start_.tv_nsec = 0;
-  receive_end_.tv_nsec = 0;
+  std::atomic_store(
+    &callback_executor_,
+    executor ?
+    std::make_shared<const CallbackExecutor>(executor) :
+    std::shared_ptr<const CallbackExecutor>());
   return Error::Success;
 }
 
 Error
-InferContext::RequestTimers::Record(Kind kind)
+InferContext::GetStat(Stat* stat)
 {
-  switch (kind) {
-    case Kind::REQUEST_START:
-      clock_gettime(CLOCK_MONOTONIC, &request_start_);
-      break;
-    case Kind::REQUEST_END:
-      clock_gettime(CLOCK_MONOTONIC, &request_end_);
-      break;
-    case Kind::SEND_START:
-      clock_gettime(CLOCK_MONOTONIC, &send_start_);
-      break;
-    case Kind::SEND_END:
-      clock_gettime(CLOCK_MONOTONIC, &send_end_);
-      break;
-    case Kind::RECEIVE_START:
-      clock_gettime(CLOCK_MONOTONIC, &receive_start_);
-      break;
-    case Kind::RECEIVE_END:
-      clock_gettime(CLOCK_MONOTONIC, &receive_end_);
-      break;
+  stat->completed_request_count = completed_request_count_;
+  stat->cumulative_total_request_time_ns = cumulative_total_request_time_ns_;
+  stat->cumulative_send_time_ns = cumulative_send_time_ns_;
+  stat->cumulative_receive_time_ns = cumulative_receive_time_ns_;
+  stat->reused_connection_count = reused_connection_count_;
+  stat->new_connection_count = new_connection_count_;
+  stat->request_time_histogram = request_time_histogram_;
+  return Error::Success;
+}
+
+Error InferContext::UpdateStat(const RequestTimers& timer)
+{
+  uint64_t request_start_ns =
+    timer.request_start_.tv_sec * NANOS_PER_SECOND +
+    timer.request_start_.tv_nsec;
+  uint64_t request_end_ns =
+    timer.request_end_.tv_sec * NANOS_PER_SECOND +
+    timer.request_end_.tv_nsec;
+  uint64_t send_start_ns =
+    timer.send_start_.tv_sec * NANOS_PER_SECOND +
+    timer.send_start_.tv_nsec;
+  uint64_t send_end_ns =
+    timer.send_end_.tv_sec * NANOS_PER_SECOND +
+    timer.send_end_.tv_nsec;
+  uint64_t receive_start_ns =
+    timer.receive_start_.tv_sec * NANOS_PER_SECOND +
+    timer.receive_start_.tv_nsec;
+  uint64_t receive_end_ns =
+    timer.receive_end_.tv_sec * NANOS_PER_SECOND +
+    timer.receive_end_.tv_nsec;
+  if ((request_start_ns >= request_end_ns) ||
+        (send_start_ns > send_end_ns) || (receive_start_ns > receive_end_ns)) {
+    return Error(RequestStatusCode::INVALID_ARG, "Timer not set correctly.");
   }
+
+  uint64_t request_time_ns = request_end_ns - request_start_ns;
+  uint64_t send_time_ns = send_end_ns - send_start_ns;
+  uint64_t receive_time_ns = receive_end_ns - receive_start_ns;
+
+  request_time_histogram_.Record(request_time_ns);
+  cumulative_total_request_time_ns_ += request_time_ns;
+  cumulative_send_time_ns_ += send_time_ns;
+  cumulative_receive_time_ns_ += receive_time_ns;
+  completed_request_count_++;
   return Error::Success;
 }
 
-//==============================================================================
+Error
+InferContext::GetReadyAsyncRequest(
+    std::shared_ptr<Request>* request, bool wait)
+{
+  Error err;
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (ongoing_async_requests_.size() == 0) {
+    return Error(
+      RequestStatusCode::UNAVAILABLE,
+      "No asynchronous requests have been sent");
+  }
 
-class RequestImpl : public InferContext::Request {
-public:
-  virtual ~RequestImpl() = default;
+  ready_cv_.wait(lock,
+    [&err, request, this, wait] {
+      // Take the request off the queue so that each waiter woken by a
+      // completion gets a different request.
+      if (!this->ready_async_requests_.empty()) {
+        *request = this->ready_async_requests_.front();
+        reinterpret_cast<RequestImpl*>(request->get())->ready_itr_ =
+          this->ready_async_requests_.end();
+        this->ready_async_requests_.pop_front();
+        err = Error::Success;
+        return true;
+      }
 
-  uint64_t Id() const { return id_; };
+      // Another thread may have retrieved the last requests
+      if (!wait || this->ongoing_async_requests_.empty()) {
+        err = Error(RequestStatusCode::UNAVAILABLE, "No completed request.");
+        return true;
+      } else {
+        return false;
+      }
+    });
 
-  // Initialize 'requested_results_' according to 'batch_size' and
-  // 'requested_outs' as the placeholder for the results
-  Error InitializeRequestedResults(
-    const std::vector<std::shared_ptr<InferContext::Output>>& requested_outs,
-    const size_t batch_size);
+  lock.unlock();
+  return err;
+}
 
-  // Return the results of the request. 'ready_' should always be checked
-  // before calling GetResults() to ensure the request has been completed.
-  virtual Error GetResults(
-    std::vector<std::unique_ptr<InferContext::Result>>* results) = 0;
+Error
+InferContext::IsRequestReady(
+  const std::shared_ptr<Request>& async_request, bool wait)
+{
+  std::shared_ptr<RequestImpl> request =
+    std::static_pointer_cast<RequestImpl>(async_request);
 
-protected:
-  RequestImpl(const uint64_t id);
+  Error err = Error::Success;
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (ongoing_async_requests_.size() == 0) {
+    return Error(
+      RequestStatusCode::INVALID_ARG,
+      "No asynchronous requests have been sent");
+  }
 
-  // Helper function called after inference to set non-RAW results in
-  // 'requested_results_'.
-  Error PostRunProcessing(
-    std::vector<std::unique_ptr<InferContext::Result>>& results,
-    const InferResponseHeader& infer_response);
+  auto itr = ongoing_async_requests_.find(request->run_index_);
+  if ((itr == ongoing_async_requests_.end()) || (itr->second != request)) {
+    return Error(
+      RequestStatusCode::INVALID_ARG, "No matched asynchronous request found.");
+  }
 
-  friend class InferContext;
+  if (wait) {
+    request->waiter_cv_.wait(lock, [&request] { return request->ready_; });
+  } else if (!request->ready_) {
+    return Error(RequestStatusCode::UNAVAILABLE, "Request is not ready.");
+  }
 
-  // Identifier seen by user
-  uint64_t id_;
+  // Another thread may have retrieved the request while waiting
+  itr = ongoing_async_requests_.find(request->run_index_);
+  if ((itr == ongoing_async_requests_.end()) || (itr->second != request)) {
+    return Error(
+      RequestStatusCode::INVALID_ARG,
+      "Asynchronous request results already retrieved.");
+  }
 
-  // Internal identifier for asynchronous call
-  uintptr_t run_index_;
+  if (request->ready_itr_ != ready_async_requests_.end()) {
+    ready_async_requests_.erase(request->ready_itr_);
+  }
+  ongoing_async_requests_.erase(itr);
+  const bool none_left = ongoing_async_requests_.empty();
+  lock.unlock();
 
-  // Indicating if the request has been completed.
-  bool ready_;
+  // Wake up other threads waiting in GetReadyAsyncRequest() for
+  // requests that won't come.
+  if (none_left) {
+    ready_cv_.notify_all();
+  }
+  return Error::Success;
+}
 
-  // The timer for infer request.
-  InferContext::RequestTimers timer_;
+void
+InferContext::MarkRequestReady(std::shared_ptr<Request> request)
+{
+  RequestImpl* r = reinterpret_cast<RequestImpl*>(request.get());
+  r->ready_ = true;
+  pending_async_request_count_--;
 
-  // Results being collected for the requested outputs from inference
-  // server response.
-  std::vector<std::unique_ptr<InferContext::Result>> requested_results_;
+  if (r->callback_) {
+    ongoing_async_requests_.erase(r->run_index_);
+    callback_requests_.emplace_back(std::move(request));
+  } else {
+    r->ready_itr_ =
+      ready_async_requests_.insert(ready_async_requests_.end(), request);
+    // One completion satisfies at most one thread waiting for any
+    // request, the thread waiting for this one has its own condition.
+    r->waiter_cv_.notify_all();
+    ready_cv_.notify_one();
+  }
+}
 
-  // Current positions within output vectors when processing response.
-  size_t result_pos_idx_;
+void
+InferContext::RunCompletionCallbacks()
+{
+  std::vector<std::shared_ptr<Request>> requests;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (callback_requests_.empty()) {
+      return;
+    }
+    requests.swap(callback_requests_);
+  }
+
+  const std::shared_ptr<const CallbackExecutor> executor =
+    std::atomic_load(&callback_executor_);
+  for (const auto& request : requests) {
+    RunCompletionCallback(request, executor);
+  }
+}
+
+void
+InferContext::RunCompletionCallback(
+  const std::shared_ptr<Request>& request,
+  const std::shared_ptr<const CallbackExecutor>& executor)
+{
+  std::function<void()> task = [this, request] {
+    std::vector<std::unique_ptr<Result>> results;
+    Error err = FinishAsyncRequest(request, &results);
+    reinterpret_cast<RequestImpl*>(request.get())->callback_(
+      request, &results, err);
+  };
+
+  if (executor) {
+    (*executor)(std::move(task));
+  } else {
+    task();
+  }
+}
+
+//==============================================================================
+
+// Result of one batch entry of a batched request, used as a result
+// with a batch size of one. The entries of the same batch can be
+// accessed by different threads since they only touch the per-entry
+// state of the batch result.
+class BatchEntryResult : public InferContext::Result {
+public:
+  BatchEntryResult(
+    const std::shared_ptr<InferContext::Result>& batch_result,
+    size_t batch_idx);
+
+  const std::string& ModelName() const override {
+    return batch_result_->ModelName();
+  }
+  uint32_t ModelVersion() const override {
+    return batch_result_->ModelVersion();
+  }
+  const std::shared_ptr<InferContext::Output> GetOutput() const override {
+    return batch_result_->GetOutput();
+  }
+
+  Error GetRaw(
+    size_t batch_idx, const std::vector<uint8_t>** buf) const override;
+  Error GetRaw(
+    size_t batch_idx, const uint8_t** buf, size_t* byte_size) const override;
+  Error GetRawBatch(const uint8_t** buf, size_t* byte_size) const override;
+  Error GetRawAtCursor(
+    size_t batch_idx, const uint8_t** buf, size_t adv_byte_size) override;
+  Error GetClassCount(size_t batch_idx, size_t* cnt) const override;
+  Error GetClassAtCursor(size_t batch_idx, ClassResult* result) override;
+  Error ResetCursors() override;
+  Error ResetCursor(size_t batch_idx) override;
+
+private:
+  Error ValidateBatchIdx(size_t batch_idx) const;
+
+  const std::shared_ptr<InferContext::Result> batch_result_;
+  const size_t batch_idx_;
 };
 
-RequestImpl::RequestImpl(const uint64_t id)
-    : id_(id), ready_(false), result_pos_idx_(0)
+BatchEntryResult::BatchEntryResult(
+  const std::shared_ptr<InferContext::Result>& batch_result, size_t batch_idx)
+  : batch_result_(batch_result), batch_idx_(batch_idx)
 {
 }
 
 Error
-RequestImpl::InitializeRequestedResults(
-  const std::vector<std::shared_ptr<InferContext::Output>>& requested_outs,
-  const size_t batch_size)
+BatchEntryResult::ValidateBatchIdx(size_t batch_idx) const
 {
-  // Initialize the results vector to collect the requested results.
-  requested_results_.clear();
-  for (const auto& io : requested_outs) {
-    std::unique_ptr<ResultImpl>
-      rp(
-        new ResultImpl(
-          io, batch_size,
-          reinterpret_cast<OutputImpl*>(io.get())->ResultFormat()));
-    requested_results_.emplace_back(std::move(rp));
+  if (batch_idx != 0) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "unexpected batch entry " + std::to_string(batch_idx) +
+        " requested for output '" + GetOutput()->Name() +
+        "', batch size is 1");
   }
+
   return Error::Success;
 }
 
 Error
-RequestImpl::PostRunProcessing(
-  std::vector<std::unique_ptr<InferContext::Result>>& results,
-  const InferResponseHeader& infer_response)
+BatchEntryResult::GetRaw(
+  size_t batch_idx, const std::vector<uint8_t>** buf) const
+{
+  Error err = ValidateBatchIdx(batch_idx);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  return batch_result_->GetRaw(batch_idx_, buf);
+}
+
+Error
+BatchEntryResult::GetRaw(
+  size_t batch_idx, const uint8_t** buf, size_t* byte_size) const
+{
+  Error err = ValidateBatchIdx(batch_idx);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  return batch_result_->GetRaw(batch_idx_, buf, byte_size);
+}
+
+Error
+BatchEntryResult::GetRawBatch(const uint8_t** buf, size_t* byte_size) const
 {
-  // At this point, the RAW requested results have their result values
-  // set. Now need to initialize non-RAW results.
-  for (auto& rr : results) {
-    ResultImpl* r = reinterpret_cast<ResultImpl*>(rr.get());
-    r->SetModel(infer_response.model_name(), infer_response.model_version());
-    switch (r->ResultFormat()) {
-      case InferContext::Result::ResultFormat::RAW:
-        r->ResetCursors();
-        break;
+  return batch_result_->GetRaw(batch_idx_, buf, byte_size);
+}
 
-      case InferContext::Result::ResultFormat::CLASS: {
-        for (const auto& ir : infer_response.output()) {
-          if (ir.name() == r->GetOutput()->Name()) {
-            r->SetClassResult(ir);
-            break;
-          }
-        }
-        break;
-      }
-    }
+Error
+BatchEntryResult::GetRawAtCursor(
+  size_t batch_idx, const uint8_t** buf, size_t adv_byte_size)
+{
+  Error err = ValidateBatchIdx(batch_idx);
+  if (!err.IsOk()) {
+    return err;
   }
-  return Error::Success;
-}
 
-//==============================================================================
+  return batch_result_->GetRawAtCursor(batch_idx_, buf, adv_byte_size);
+}
 
-InferContext::InferContext(
-  const std::string& model_name, int model_version, bool verbose)
-  : model_name_(model_name), model_version_(model_version),
-    verbose_(verbose), total_input_byte_size_(0), batch_size_(0),
-    async_request_id_(0), worker_(), exiting_(true)
+Error
+BatchEntryResult::GetClassCount(size_t batch_idx, size_t* cnt) const
 {
+  Error err = ValidateBatchIdx(batch_idx);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  return batch_result_->GetClassCount(batch_idx_, cnt);
 }
 
 Error
-InferContext::GetInput(
-  const std::string& name, std::shared_ptr<Input>* input) const
+BatchEntryResult::GetClassAtCursor(size_t batch_idx, ClassResult* result)
 {
-  for (const auto& io : inputs_) {
-    if (io->Name() == name) {
-      *input = io;
-      return Error::Success;
-    }
+  Error err = ValidateBatchIdx(batch_idx);
+  if (!err.IsOk()) {
+    return err;
   }
 
-  return
-    Error(
-      RequestStatusCode::INVALID_ARG,
-      "unknown input '" + name + "' for '" + model_name_ + "'");
+  return batch_result_->GetClassAtCursor(batch_idx_, result);
 }
 
 Error
-InferContext::GetOutput(
-  const std::string& name, std::shared_ptr<Output>* output) const
+BatchEntryResult::ResetCursors()
 {
-  for (const auto& io : outputs_) {
-    if (io->Name() == name) {
-      *output = io;
-      return Error::Success;
-    }
+  return batch_result_->ResetCursor(batch_idx_);
+}
+
+Error
+BatchEntryResult::ResetCursor(size_t batch_idx)
+{
+  Error err = ValidateBatchIdx(batch_idx);
+  if (!err.IsOk()) {
+    return err;
   }
 
-  return
-    Error(
-      RequestStatusCode::INVALID_ARG,
-      "unknown output '" + name + "' for '" + model_name_ + "'");
+  return batch_result_->ResetCursor(batch_idx_);
 }
 
+//==============================================================================
+
 Error
-InferContext::SetRunOptions(const InferContext::Options& boptions)
+InferBatcher::Create(
+  std::unique_ptr<InferBatcher>* batcher, std::unique_ptr<InferContext> ctx)
 {
-  const OptionsImpl& options = reinterpret_cast<const OptionsImpl&>(boptions);
+  if (!ctx) {
+    return Error(RequestStatusCode::INVALID_ARG, "no context given");
+  }
 
-  if (options.BatchSize() > max_batch_size_) {
+  if (ctx->MaxBatchSize() == 0) {
     return
       Error(
         RequestStatusCode::INVALID_ARG,
-        "run batch size " + std::to_string(options.BatchSize()) +
-        " exceeds maximum batch size " + std::to_string(max_batch_size_) +
-        " allowed for model '" + model_name_ + "'");
+        "model '" + ctx->ModelName() + "' does not support batching");
   }
 
-  batch_size_ = options.BatchSize();
-  total_input_byte_size_ = 0;
-
-  // Create the InferRequestHeader protobuf. This protobuf will be
-  // used for all subsequent requests.
-  infer_request_.Clear();
-
-  infer_request_.set_batch_size(batch_size_);
-
-  for (const auto& io : inputs_) {
-    reinterpret_cast<InputImpl*>(io.get())->SetBatchSize(batch_size_);
-    total_input_byte_size_ += io->ByteSize() * batch_size_;
+  batcher->reset(new InferBatcher(std::move(ctx)));
+  return Error::Success;
+}
 
-    auto rinput = infer_request_.add_input();
-    rinput->set_name(io->Name());
-    rinput->set_byte_size(io->ByteSize());
+InferBatcher::InferBatcher(std::unique_ptr<InferContext> ctx)
+  : ctx_(std::move(ctx)), flush_batch_size_(0), max_queue_delay_(0),
+    ctx_batch_size_(0), inflight_batch_count_(0), exiting_(false)
+{
+  // Same policy as the dynamic batcher of the server: send at the
+  // largest preferred batch size, or at the maximum batch size if
+  // none is given.
+  const ModelConfig& config = ctx_->Config();
+  if (config.has_dynamic_batching()) {
+    for (const auto bs : config.dynamic_batching().preferred_batch_size()) {
+      flush_batch_size_ = std::max(flush_batch_size_, (size_t)std::max(0, bs));
+    }
+    max_queue_delay_ =
+      std::chrono::microseconds(
+        std::max(0, config.dynamic_batching().max_queue_delay_microseconds()));
   }
 
-  requested_outputs_.clear();
-
-  for (const auto& p : options.Outputs()) {
-    const std::shared_ptr<Output>& output = p.first;
-    const OptionsImpl::OutputOptions& ooptions = p.second;
+  if ((flush_batch_size_ == 0) || (flush_batch_size_ > ctx_->MaxBatchSize())) {
+    flush_batch_size_ = ctx_->MaxBatchSize();
+  }
 
-    reinterpret_cast<OutputImpl*>(output.get())->
-      SetResultFormat(ooptions.result_format);
-    requested_outputs_.emplace_back(output);
+  dispatcher_ = std::thread(&InferBatcher::Dispatch, this);
+}
 
-    auto routput = infer_request_.add_output();
-    routput->set_name(output->Name());
-    routput->set_byte_size(output->ByteSize());
-    if (ooptions.result_format == Result::ResultFormat::CLASS) {
-      routput->mutable_cls()->set_count(ooptions.u64);
-    }
+InferBatcher::~InferBatcher()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exiting_ = true;
   }
+  cv_.notify_all();
+  dispatcher_.join();
 
-  return Error::Success;
+  // The samples queued have been sent, wait for them so that their
+  // callbacks are invoked before the context is destroyed.
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return this->inflight_batch_count_ == 0; });
 }
 
 Error
-InferContext::GetStat(Stat* stat)
+InferBatcher::Run(
+  const std::vector<const uint8_t*>& inputs,
+  std::vector<std::unique_ptr<InferContext::Result>>* results)
 {
-  stat->completed_request_count = context_stat_.completed_request_count;
-  stat->cumulative_total_request_time_ns =
-    context_stat_.cumulative_total_request_time_ns;
-  stat->cumulative_send_time_ns = context_stat_.cumulative_send_time_ns;
-  stat->cumulative_receive_time_ns = context_stat_.cumulative_receive_time_ns;
-  return Error::Success;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+  Error run_err;
+
+  Error err = AsyncRun(
+    inputs,
+    [&mutex, &cv, &done, &run_err, results](
+      std::vector<std::unique_ptr<InferContext::Result>>* sample_results,
+      const Error& sample_err) {
+      // Notify while holding the lock, the waiter may return and
+      // destroy 'cv' as soon as it can see 'done'.
+      std::lock_guard<std::mutex> lock(mutex);
+      results->swap(*sample_results);
+      run_err = sample_err;
+      done = true;
+      cv.notify_one();
+    });
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [&done] { return done; });
+  return run_err;
 }
 
-Error InferContext::UpdateStat(const RequestTimers& timer)
+Error
+InferBatcher::AsyncRun(
+  const std::vector<const uint8_t*>& inputs, OnCompleteFn callback)
 {
-  uint64_t request_start_ns =
-    timer.request_start_.tv_sec * NANOS_PER_SECOND +
-    timer.request_start_.tv_nsec;
-  uint64_t request_end_ns =
-    timer.request_end_.tv_sec * NANOS_PER_SECOND +
-    timer.request_end_.tv_nsec;
-  uint64_t send_start_ns =
-    timer.send_start_.tv_sec * NANOS_PER_SECOND +
-    timer.send_start_.tv_nsec;
-  uint64_t send_end_ns =
-    timer.send_end_.tv_sec * NANOS_PER_SECOND +
-    timer.send_end_.tv_nsec;
-  uint64_t receive_start_ns =
-    timer.receive_start_.tv_sec * NANOS_PER_SECOND +
-    timer.receive_start_.tv_nsec;
-  uint64_t receive_end_ns =
-    timer.receive_end_.tv_sec * NANOS_PER_SECOND +
-    timer.receive_end_.tv_nsec;
-  if ((request_start_ns >= request_end_ns) ||
-        (send_start_ns > send_end_ns) || (receive_start_ns > receive_end_ns)) {
-    return Error(RequestStatusCode::INVALID_ARG, "Timer not set correctly.");
+  if (inputs.size() != ctx_->Inputs().size()) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "expecting " + std::to_string(ctx_->Inputs().size()) +
+        " inputs for model '" + ctx_->ModelName() + "', got " +
+        std::to_string(inputs.size()));
   }
 
-  uint64_t request_time_ns = request_end_ns - request_start_ns;
-  uint64_t send_time_ns = send_end_ns - send_start_ns;
-  uint64_t receive_time_ns = receive_end_ns - receive_start_ns;
+  if (!callback) {
+    return Error(RequestStatusCode::INVALID_ARG, "no callback given");
+  }
+
+  bool notify;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (exiting_) {
+      return Error(RequestStatusCode::UNAVAILABLE, "batcher is exiting");
+    }
+
+    Sample sample;
+    sample.inputs_ = inputs;
+    sample.callback_ = std::move(callback);
+    sample.submit_time_ = std::chrono::steady_clock::now();
+    queue_.emplace_back(std::move(sample));
+
+    // The batcher thread only needs to be woken up to start waiting
+    // for a new batch or once the batch is full.
+    notify = (queue_.size() == 1) || (queue_.size() == flush_batch_size_);
+  }
 
-  context_stat_.completed_request_count++;
-  context_stat_.cumulative_total_request_time_ns += request_time_ns;
-  context_stat_.cumulative_send_time_ns += send_time_ns;
-  context_stat_.cumulative_receive_time_ns += receive_time_ns;
+  if (notify) {
+    cv_.notify_all();
+  }
   return Error::Success;
 }
 
-Error
-InferContext::GetReadyAsyncRequest(
-    std::shared_ptr<Request>* request, bool wait)
+void
+InferBatcher::Dispatch()
 {
-  if (ongoing_async_requests_.size() == 0) {
-    return Error(
-      RequestStatusCode::UNAVAILABLE,
-      "No asynchronous requests have been sent");
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return this->exiting_ || !this->queue_.empty(); });
+    if (queue_.empty()) {
+      break;
+    }
+
+    // Wait for more samples until the batch is full or the oldest
+    // sample has waited long enough.
+    if (!exiting_ && (queue_.size() < flush_batch_size_) &&
+        (max_queue_delay_.count() > 0)) {
+      cv_.wait_until(
+        lock, queue_.front().submit_time_ + max_queue_delay_,
+        [this] {
+          return this->exiting_ ||
+            (this->queue_.size() >= this->flush_batch_size_);
+        });
+    }
+
+    const size_t batch_size = std::min(queue_.size(), flush_batch_size_);
+    std::shared_ptr<std::vector<Sample>> samples =
+      std::make_shared<std::vector<Sample>>(
+        std::make_move_iterator(queue_.begin()),
+        std::make_move_iterator(queue_.begin() + batch_size));
+    queue_.erase(queue_.begin(), queue_.begin() + batch_size);
+    inflight_batch_count_++;
+
+    lock.unlock();
+    SendBatch(samples);
+    lock.lock();
   }
+}
 
+void
+InferBatcher::SendBatch(const std::shared_ptr<std::vector<Sample>>& samples)
+{
+  const size_t batch_size = samples->size();
   Error err;
-  std::unique_lock<std::mutex> lock(mutex_);
-  cv_.wait(lock,
-    [&err, request, this, wait] {
-      for (auto& ongoing_async_request : this->ongoing_async_requests_) {
-        if (std::static_pointer_cast<RequestImpl>(
-              ongoing_async_request.second)->ready_) {
-          *request = ongoing_async_request.second;
-          err = Error::Success;
-          return true;
+
+  // Only the batch size changes between batches, the template of each
+  // batch size is prepared once.
+  if (batch_size != ctx_batch_size_) {
+    if (run_templates_.size() <= batch_size) {
+      run_templates_.resize(batch_size + 1);
+    }
+    std::shared_ptr<InferContext::RunTemplate>& run_template =
+      run_templates_[batch_size];
+    if (run_template == nullptr) {
+      std::unique_ptr<InferContext::Options> options;
+      err = InferContext::Options::Create(&options);
+      if (err.IsOk()) {
+        options->SetBatchSize(batch_size);
+        for (const auto& output : ctx_->Outputs()) {
+          options->AddRawResult(output);
         }
+        err = ctx_->PrepareRunTemplate(*options, &run_template);
       }
+    }
+    if (err.IsOk()) {
+      err = ctx_->SetRunTemplate(run_template);
+    }
+    ctx_batch_size_ = err.IsOk() ? batch_size : 0;
+  }
 
-      if (!wait) {
-        err = Error(RequestStatusCode::UNAVAILABLE, "No completed request.");
-        return true;
-      } else {
-        return false;
-      }
-    });
+  // The batch entries reference the tensor values of the samples.
+  for (size_t idx = 0; err.IsOk() && (idx < ctx_->Inputs().size()); idx++) {
+    const std::shared_ptr<InferContext::Input>& input = ctx_->Inputs()[idx];
+    err = input->Reset();
+    for (size_t sidx = 0; err.IsOk() && (sidx < batch_size); sidx++) {
+      err = input->SetRaw((*samples)[sidx].inputs_[idx], input->ByteSize());
+    }
+  }
 
-  lock.unlock();
-  return err;
-}
+  if (err.IsOk()) {
+    err = ctx_->AsyncRun(
+      [this, samples](
+        const std::shared_ptr<InferContext::Request>& request,
+        std::vector<std::unique_ptr<InferContext::Result>>* results,
+        const Error& err) {
+        CompleteBatch(*samples, results, err);
 
-Error
-InferContext::IsRequestReady(
-  const std::shared_ptr<Request>& async_request, bool wait)
-{
-  if (ongoing_async_requests_.size() == 0) {
-    return Error(
-      RequestStatusCode::INVALID_ARG,
-      "No asynchronous requests have been sent");
+        std::lock_guard<std::mutex> lock(mutex_);
+        inflight_batch_count_--;
+        cv_.notify_all();
+      });
   }
 
-  std::shared_ptr<RequestImpl> request =
-    std::static_pointer_cast<RequestImpl>(async_request);
+  if (!err.IsOk()) {
+    CompleteBatch(*samples, nullptr, err);
 
-  auto itr = ongoing_async_requests_.find(request->run_index_);
-  if (itr == ongoing_async_requests_.end()) {
-    return Error(
-      RequestStatusCode::INVALID_ARG, "No matched asynchronous request found.");
+    std::lock_guard<std::mutex> lock(mutex_);
+    inflight_batch_count_--;
+    cv_.notify_all();
   }
+}
 
-  Error err = Error::Success;
-  std::unique_lock<std::mutex> lock(mutex_);
-  cv_.wait(lock,
-    [&err, &request, wait] {
-      if (!request->ready_) {
-        if (wait) {
-          return false;
-        } else {
-          err = Error(RequestStatusCode::UNAVAILABLE, "Request is not ready.");
-        }
-      }
-      return true;
-    });
-  
-  if (!err.IsOk()) {
-    lock.unlock();
-    return err;
-  } else {
-    ongoing_async_requests_.erase(itr->first);
+void
+InferBatcher::CompleteBatch(
+  const std::vector<Sample>& samples,
+  std::vector<std::unique_ptr<InferContext::Result>>* results,
+  const Error& err)
+{
+  // Each sample gets a view of its batch entry, the batch results are
+  // kept alive by the views.
+  std::vector<std::shared_ptr<InferContext::Result>> batch_results;
+  if (err.IsOk() && (results != nullptr)) {
+    for (auto& result : *results) {
+      batch_results.emplace_back(std::move(result));
+    }
+  }
+
+  for (size_t idx = 0; idx < samples.size(); idx++) {
+    std::vector<std::unique_ptr<InferContext::Result>> sample_results;
+    for (const auto& result : batch_results) {
+      sample_results.emplace_back(new BatchEntryResult(result, idx));
+    }
+    samples[idx].callback_(&sample_results, err);
   }
-  lock.unlock();
-  return Error::Success;
 }
 
 //==============================================================================
@@ -1060,7 +3213,9 @@ ServerHealthHttpContext::Create(
 
 ServerHealthHttpContext::ServerHealthHttpContext(
   const std::string& server_url, bool verbose)
-  : ServerHealthContext(verbose), url_(server_url + "/" + kHealthRESTEndpoint)
+  : ServerHealthContext(verbose),
+    url_(HttpServerUrl(server_url) + "/" + kHealthRESTEndpoint),
+    unix_socket_path_(UnixSocketPath(server_url))
 {
 }
 
@@ -1078,6 +3233,7 @@ ServerHealthHttpContext::GetHealth(const std::string& url, bool* health)
   }
 
   curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  SetUnixSocketPath(curl, unix_socket_path_);
   curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
   if (verbose_) {
     curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
@@ -1141,14 +3297,19 @@ ServerStatusHttpContext::Create(
 
 ServerStatusHttpContext::ServerStatusHttpContext(
   const std::string& server_url, bool verbose)
-  : ServerStatusContext(verbose), url_(server_url + "/" + kStatusRESTEndpoint)
+  : ServerStatusContext(verbose),
+    url_(HttpServerUrl(server_url) + "/" + kStatusRESTEndpoint),
+    unix_socket_path_(UnixSocketPath(server_url))
 {
 }
 
 ServerStatusHttpContext::ServerStatusHttpContext(
   const std::string& server_url, const std::string& model_name, bool verbose)
   : ServerStatusContext(verbose),
-    url_(server_url + "/" + kStatusRESTEndpoint + "/" + model_name)
+    url_(
+      HttpServerUrl(server_url) + "/" + kStatusRESTEndpoint + "/" +
+      model_name),
+    unix_socket_path_(UnixSocketPath(server_url))
 {
 }
 
@@ -1172,6 +3333,7 @@ ServerStatusHttpContext::GetServerStatus(ServerStatus* server_status)
   // Want binary representation of the status.
   std::string full_url = url_ + "?format=binary";
   curl_easy_setopt(curl, CURLOPT_URL, full_url.c_str());
+  SetUnixSocketPath(curl, unix_socket_path_);
   curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
   if (verbose_) {
     curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
@@ -1273,7 +3435,7 @@ ServerStatusHttpContext::ResponseHandler(
 class HttpRequestImpl : public RequestImpl {
 public:
   HttpRequestImpl(
-    const uint64_t id,
+    const uint64_t id, CURL* easy_handle,
     const std::vector<std::shared_ptr<InferContext::Input>> inputs);
 
   ~HttpRequestImpl();
@@ -1300,19 +3462,24 @@ public:
 private:
   friend class InferHttpContext;
 
-  // Pointer to easy handle that is processing the request
+  // Pointer to easy handle that is processing the request. The request
+  // owns the handle until it is returned to the context for reuse.
   CURL* easy_handle_;
 
-  // Pointer to the list of the HTTP request header, keep it such that it will
-  // be valid during the transfer and can be freed once transfer is completed.
-  struct curl_slist * header_list_;
-
   // Status code for the HTTP request.
   CURLcode http_status_;
 
   // RequestStatus received in server response.
   RequestStatus request_status_;
 
+  // True if 'request_status_' was received in binary, or in text.
+  bool binary_status_;
+  bool text_status_;
+
+  // The list of the HTTP request header if the request doesn't use the
+  // one of its template.
+  struct curl_slist* header_list_;
+
   // Buffer that accumulates the serialized InferResponseHeader at the
   // end of the body.
   std::string infer_response_buffer_;
@@ -1327,10 +3494,11 @@ private:
 };
 
 HttpRequestImpl::HttpRequestImpl(
-  const uint64_t id,
+  const uint64_t id, CURL* easy_handle,
   const std::vector<std::shared_ptr<InferContext::Input>> inputs)
-    : RequestImpl(id), easy_handle_(curl_easy_init()), header_list_(NULL),
-      inputs_(inputs), input_pos_idx_(0)
+    : RequestImpl(id), easy_handle_(easy_handle), binary_status_(false),
+      text_status_(false), header_list_(NULL), inputs_(inputs),
+      input_pos_idx_(0)
 {
   if (easy_handle_ != NULL) {
     run_index_ = reinterpret_cast<uintptr_t>(easy_handle_);
@@ -1342,6 +3510,8 @@ HttpRequestImpl::~HttpRequestImpl()
   if (easy_handle_ != NULL) {
     curl_easy_cleanup(easy_handle_);
   }
+
+  curl_slist_free_all(header_list_);
 }
 
 Error
@@ -1356,7 +3526,10 @@ HttpRequestImpl::InitializeRequest(
   request_status_.Clear();
 
   for (auto& io : inputs_) {
-    reinterpret_cast<InputImpl*>(io.get())->PrepareForRequest();
+    Error err = reinterpret_cast<InputImpl*>(io.get())->PrepareForRequest();
+    if (!err.IsOk()) {
+      return err;
+    }
   }
 
   input_pos_idx_ = 0;
@@ -1446,7 +3619,6 @@ HttpRequestImpl::GetResults(
   InferResponseHeader infer_response;
 
   if (http_status_ != CURLE_OK) {
-    curl_slist_free_all(header_list_);
     requested_results_.clear();
     return
       Error(
@@ -1458,8 +3630,6 @@ HttpRequestImpl::GetResults(
   int64_t http_code;
   curl_easy_getinfo(easy_handle_, CURLINFO_RESPONSE_CODE, &http_code);
 
-  curl_slist_free_all(header_list_);
-
   // Should have a request status, if not then create an error status.
   if (request_status_.code() == RequestStatusCode::INVALID) {
     request_status_.Clear();
@@ -1503,42 +3673,40 @@ InferHttpContext::Create(
   InferHttpContext* ctx_ptr = 
     new InferHttpContext(server_url, model_name, model_version, verbose);
 
-  // Get status of the model and create the inputs and outputs.
-  std::unique_ptr<ServerStatusContext> sctx;
-  Error err =
-    ServerStatusHttpContext::Create(
-      &sctx, server_url, model_name, verbose);
-  if (err.IsOk()) {
-    ServerStatus server_status;
-    err = sctx->GetServerStatus(&server_status);
-    if (err.IsOk()) {
-      const auto& itr = server_status.model_status().find(model_name);
-      if (itr == server_status.model_status().end()) {
-        err =
-          Error(
-            RequestStatusCode::INTERNAL,
-            "unable to find status information for \"" + model_name + "\"");
-      } else {
-        const ModelConfig& model_info = itr->second.config();
-
-        ctx_ptr->max_batch_size_ =
-          static_cast<uint64_t>(std::max(0, model_info.max_batch_size()));
-
-        // Create inputs and outputs
-        for (const auto& io : model_info.input()) {
-          ctx_ptr->inputs_.emplace_back(std::make_shared<InputImpl>(io));
-        }
-        for (const auto& io : model_info.output()) {
-          ctx_ptr->outputs_.emplace_back(std::make_shared<OutputImpl>(io));
+  // Get the configuration of the model, from the cache if possible,
+  // and create the inputs and outputs.
+  ModelConfig model_info;
+  Error err = ModelConfigCache::Lookup(
+    server_url, model_name, model_version, &model_info);
+  if (err.IsOk()) {
+    err = ctx_ptr->InitializeModel(model_info);
+  } else {
+    std::unique_ptr<ServerStatusContext> sctx;
+    err =
+      ServerStatusHttpContext::Create(
+        &sctx, server_url, model_name, verbose);
+    if (err.IsOk()) {
+      ServerStatus server_status;
+      err = sctx->GetServerStatus(&server_status);
+      if (err.IsOk()) {
+        const auto& itr = server_status.model_status().find(model_name);
+        if (itr == server_status.model_status().end()) {
+          err =
+            Error(
+              RequestStatusCode::INTERNAL,
+              "unable to find status information for \"" + model_name +
+              "\"");
+        } else {
+          err = ctx_ptr->InitializeModel(itr->second.config());
+          if (err.IsOk()) {
+            err = ModelConfigCache::Insert(
+              server_url, model_name, model_version, itr->second.config());
+          }
         }
       }
     }
   }
 
-  // Create request context for synchronous request.
-  ctx_ptr->sync_request_.reset(
-    static_cast<Request*>(new HttpRequestImpl(0, ctx_ptr->inputs_)));
-
   if (err.IsOk()) {
     ctx->reset(static_cast<InferContext*>(ctx_ptr));
   } else {
@@ -1552,14 +3720,20 @@ InferHttpContext::InferHttpContext(
   const std::string& server_url, const std::string& model_name,
   int model_version, bool verbose)
   : InferContext(model_name, model_version, verbose),
-    multi_handle_(curl_multi_init())
+    multi_handle_(curl_multi_init()),
+    unix_socket_path_(UnixSocketPath(server_url)), easy_handle_count_(0),
+    binary_headers_(false)
 {
   // Process url for HTTP request
   // URL doesn't contain the version portion if using the latest version.
-  url_ = server_url + "/" + kInferRESTEndpoint + "/" + model_name;
+  url_ =
+    HttpServerUrl(server_url) + "/" + kInferRESTEndpoint + "/" + model_name;
   if (model_version_ >= 0) {
     url_ += "/" + std::to_string(model_version_);
   }
+
+  shared_memory_url_ =
+    HttpServerUrl(server_url) + "/" + kSharedMemoryRESTEndpoint;
 }
 
 InferHttpContext::~InferHttpContext()
@@ -1569,6 +3743,7 @@ InferHttpContext::~InferHttpContext()
   // (it is default constructed thread before the first AsyncRun() call)
   if (worker_.joinable()) {
     cv_.notify_all();
+    curl_multi_wakeup(multi_handle_);
     worker_.join();
   }
 
@@ -1581,21 +3756,32 @@ InferHttpContext::~InferHttpContext()
     }
     curl_multi_cleanup(multi_handle_);
   }
+
+  for (CURL* easy_handle : easy_handle_pool_) {
+    curl_easy_cleanup(easy_handle);
+  }
 }
 
 Error
 InferHttpContext::Run(std::vector<std::unique_ptr<Result>>* results)
 {
-  std::shared_ptr<HttpRequestImpl> sync_request = 
-    std::static_pointer_cast<HttpRequestImpl>(sync_request_);
-
   if (!curl_global.Status().IsOk()) {
     return curl_global.Status();
   }
 
-  Error err = PreRunProcessing(sync_request_);
+  // Each call has its own request so that calls can run concurrently,
+  // the easy handle (and its connection) comes from the same pool as
+  // for asynchronous requests. The inputs are used in place as the
+  // call completes before returning.
+  std::shared_ptr<HttpRequestImpl> sync_request =
+    std::make_shared<HttpRequestImpl>(
+      async_request_id_++, AcquireEasyHandle(), CallerInputs());
+  std::shared_ptr<Request> request = sync_request;
 
+  Error err = PreRunProcessing(request);
   if (!err.IsOk()) {
+    ReleaseEasyHandle(sync_request->easy_handle_);
+    sync_request->easy_handle_ = NULL;
     return err;
   }
 
@@ -1611,32 +3797,56 @@ InferHttpContext::Run(std::vector<std::unique_ptr<Result>>* results)
   if (!err.IsOk()) {
     std::cerr << "Failed to update context stat: " << err << std::endl;
   }
-  return sync_request->GetResults(results);
+  UpdateConnectionStat(sync_request->easy_handle_);
+  if (sync_request->binary_status_) {
+    binary_headers_ = true;
+  } else if (sync_request->text_status_) {
+    // The server behind the URL may have been replaced by one that
+    // doesn't accept binary headers.
+    binary_headers_ = false;
+  }
+  err = sync_request->GetResults(results);
+
+  ReleaseEasyHandle(sync_request->easy_handle_);
+  sync_request->easy_handle_ = NULL;
+  return err;
 }
 
 Error
 InferHttpContext::AsyncRun(std::shared_ptr<Request>* async_request)
+{
+  return StartAsyncRun(async_request, nullptr);
+}
+
+Error
+InferHttpContext::AsyncRun(OnCompleteFn callback)
+{
+  std::shared_ptr<Request> async_request;
+  return StartAsyncRun(&async_request, std::move(callback));
+}
+
+Error
+InferHttpContext::StartAsyncRun(
+  std::shared_ptr<Request>* async_request, OnCompleteFn callback)
 {
   if (!multi_handle_) {
     return Error(
       RequestStatusCode::INTERNAL, "failed to start HTTP asynchronous client");
-  } else if (exiting_) {
-    // abusing variable here, exiting_ is true either when destructor is called
-    // or the worker thread is not acutally created.
-    exiting_ = false;
-    worker_ = std::thread(&InferHttpContext::AsyncTransfer, this);
   }
 
+  StartWorker();
+
   // Make a copy of the current inputs
   std::vector<std::shared_ptr<Input>> inputs;
-  for (const auto& io : inputs_) {
+  for (const auto& io : CallerInputs()) {
     InputImpl* input = reinterpret_cast<InputImpl*>(io.get());
     inputs.emplace_back(std::make_shared<InputImpl>(*input));
   }
 
   HttpRequestImpl* current_context =
-    new HttpRequestImpl(async_request_id_++, inputs);
+    new HttpRequestImpl(async_request_id_++, AcquireEasyHandle(), inputs);
   async_request->reset(static_cast<Request*>(current_context));
+  current_context->callback_ = std::move(callback);
 
   if (!current_context->easy_handle_) {
     return
@@ -1644,6 +3854,11 @@ InferHttpContext::AsyncRun(std::shared_ptr<Request>* async_request)
   }
 
   Error err = PreRunProcessing(*async_request);
+  if (!err.IsOk()) {
+    ReleaseEasyHandle(current_context->easy_handle_);
+    current_context->easy_handle_ = NULL;
+    return err;
+  }
 
   {
     std::lock_guard<std::mutex> lock(mutex_);
@@ -1659,13 +3874,18 @@ InferHttpContext::AsyncRun(std::shared_ptr<Request>* async_request)
         "Failed to insert new asynchronous request context.");
     }
 
-    curl_multi_add_handle(multi_handle_, current_context->easy_handle_);
+    // The worker thread adds the handle to 'multi_handle_'.
+    new_async_requests_.push_back(current_context->easy_handle_);
+    pending_async_request_count_++;
     current_context->timer_.Reset();
     current_context->timer_.Record(RequestTimers::Kind::REQUEST_START);
     current_context->timer_.Record(RequestTimers::Kind::SEND_START);
   }
 
-  cv_.notify_all();
+  // Wake up the worker thread whether it is waiting for work or
+  // waiting on the sockets of the requests in flight.
+  cv_.notify_one();
+  curl_multi_wakeup(multi_handle_);
   return Error(RequestStatusCode::SUCCESS);
 }
 
@@ -1678,19 +3898,89 @@ InferHttpContext::GetAsyncRunResults(
   if (!err.IsOk()) {
     return err;
   }
+
+  return FinishAsyncRequest(async_request, results);
+}
+
+Error
+InferHttpContext::FinishAsyncRequest(
+  const std::shared_ptr<Request>& request,
+  std::vector<std::unique_ptr<Result>>* results)
+{
   std::shared_ptr<HttpRequestImpl> http_request =
-    std::static_pointer_cast<HttpRequestImpl>(async_request);
+    std::static_pointer_cast<HttpRequestImpl>(request);
 
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    curl_multi_remove_handle(multi_handle_, http_request->easy_handle_);
-  }
-  
-  err = UpdateStat(http_request->timer_);
+  // The easy handle has already been removed from 'multi_handle_' by
+  // the worker thread when the transfer completed.
+  Error err = UpdateStat(http_request->timer_);
   if (!err.IsOk()) {
     std::cerr << "Failed to update context stat: " << err << std::endl;
   }
-  return http_request->GetResults(results);
+  UpdateConnectionStat(http_request->easy_handle_);
+  if (http_request->binary_status_) {
+    binary_headers_ = true;
+  } else if (http_request->text_status_) {
+    binary_headers_ = false;
+  }
+
+  err = http_request->GetResults(results);
+
+  // The request doesn't need the easy handle once the results are
+  // retrieved, keep it (and its connection) for another request.
+  ReleaseEasyHandle(http_request->easy_handle_);
+  http_request->easy_handle_ = NULL;
+
+  return err;
+}
+
+CURL*
+InferHttpContext::AcquireEasyHandle()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (easy_handle_pool_.empty()) {
+    CURL* easy_handle = curl_easy_init();
+    if (easy_handle != NULL) {
+      easy_handle_count_++;
+    }
+    return easy_handle;
+  }
+
+  CURL* easy_handle = easy_handle_pool_.back();
+  easy_handle_pool_.pop_back();
+  return easy_handle;
+}
+
+void
+InferHttpContext::ReleaseEasyHandle(CURL* easy_handle)
+{
+  if (easy_handle == NULL) {
+    return;
+  }
+
+  // Reset the options set for the previous request, the live
+  // connections and caches of the handle are kept.
+  curl_easy_reset(easy_handle);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  easy_handle_pool_.push_back(easy_handle);
+}
+
+void
+InferHttpContext::UpdateConnectionStat(CURL* easy_handle)
+{
+  // Must use long with curl_easy_getinfo
+  long num_connects = 0;
+  if (curl_easy_getinfo(
+        easy_handle, CURLINFO_NUM_CONNECTS, &num_connects) != CURLE_OK) {
+    return;
+  }
+
+  if (num_connects == 0) {
+    reused_connection_count_++;
+  } else {
+    new_connection_count_ += num_connects;
+  }
 }
 
 size_t
@@ -1719,7 +4009,28 @@ InferHttpContext::ResponseHeaderHandler(
   char* buf = reinterpret_cast<char*>(contents);
   size_t byte_size = size * nmemb;
 
-  size_t idx = strlen(kStatusHTTPHeader);
+  // RequestProvider() is not called if all inputs are in shared memory.
+  if (request->timer_.send_end_.tv_sec == 0) {
+    request->timer_.Record(RequestTimers::Kind::SEND_END);
+  }
+
+  // The binary header must be checked first as the text header name
+  // is a prefix of it.
+  size_t idx = strlen(kStatusBinaryHTTPHeader);
+  if ((idx < byte_size) &&
+      !strncasecmp(buf, kStatusBinaryHTTPHeader, idx) && (buf[idx] == ':')) {
+    std::string hdr;
+    if (Base64Decode(buf + idx + 1, byte_size - idx - 1, &hdr) &&
+        request->request_status_.ParseFromString(hdr)) {
+      request->binary_status_ = true;
+    } else {
+      request->request_status_.Clear();
+    }
+
+    return byte_size;
+  }
+
+  idx = strlen(kStatusHTTPHeader);
   if ((idx < byte_size) &&
       !strncasecmp(buf, kStatusHTTPHeader, idx)) {
     while ((idx < byte_size) && (buf[idx] != ':')) {
@@ -1728,8 +4039,10 @@ InferHttpContext::ResponseHeaderHandler(
 
     if (idx < byte_size) {
       std::string hdr(buf + idx + 1, byte_size - idx - 1);
-      if (!google::protobuf::TextFormat::ParseFromString(
+      if (google::protobuf::TextFormat::ParseFromString(
           hdr, &request->request_status_)) {
+        request->text_status_ = true;
+      } else {
         request->request_status_.Clear();
       }
     }
@@ -1766,16 +4079,51 @@ InferHttpContext::PreRunProcessing(std::shared_ptr<Request>& request)
   std::shared_ptr<HttpRequestImpl> http_request = 
     std::static_pointer_cast<HttpRequestImpl>(request);
 
-  http_request->InitializeRequest(requested_outputs_, batch_size_);
-  
+  if (run_template_ == nullptr) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "run options must be set before running an inference");
+  }
+  http_request->run_template_ = run_template_;
+
+  Error err = http_request->InitializeRequest(requested_outputs_, batch_size_);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  BindOutputBuffers(request);
+  err = BindSharedMemoryResults(request);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  // Inputs in shared memory need a header of their own.
+  std::unique_ptr<InferRequestHeader> shm_header;
+  uint64_t input_byte_size;
+  err =
+    SharedMemoryRequestHeader(
+      http_request->inputs_, &shm_header, &input_byte_size);
+  if (!err.IsOk()) {
+    return err;
+  }
+  if (shm_header != nullptr) {
+    err =
+      CreateInferRequestHeaderList(
+        *shm_header, binary_headers_, &http_request->header_list_);
+    if (!err.IsOk()) {
+      return err;
+    }
+  }
+
   CURL* curl = http_request->easy_handle_;
   if (!curl) {
     return
       Error(RequestStatusCode::INTERNAL, "failed to initialize HTTP client");
   }
 
-  std::string full_url = url_ + "?format=binary";
-  curl_easy_setopt(curl, CURLOPT_URL, full_url.c_str());
+  curl_easy_setopt(curl, CURLOPT_URL, run_template_->http_url_.c_str());
+  SetUnixSocketPath(curl, unix_socket_path_);
   curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
   curl_easy_setopt(curl, CURLOPT_POST, 1L);
   curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
@@ -1797,29 +4145,114 @@ InferHttpContext::PreRunProcessing(std::shared_ptr<Request>& request)
 
   // set the expected POST size. If you want to POST large amounts of
   // data, consider CURLOPT_POSTFIELDSIZE_LARGE
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, total_input_byte_size_);
-
-  // Headers to specify input and output tensors
-  infer_request_str_.clear();
-  infer_request_str_ =
-    std::string(kInferRequestHTTPHeader) + ":" +
-    infer_request_.ShortDebugString();
-  struct curl_slist *list = NULL;
-  list = curl_slist_append(list, "Expect:");
-  list = curl_slist_append(list, "Content-Type: application/octet-stream");
-  list = curl_slist_append(list, infer_request_str_.c_str());
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, input_byte_size);
 
-  // The list should be freed after the request
-  http_request->header_list_ = list;
+  // Headers to specify input and output tensors, the list is kept
+  // valid by the template of the request. The header is sent in binary
+  // once the server has shown that it supports it.
+  if (http_request->header_list_ != NULL) {
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_request->header_list_);
+  } else {
+    curl_easy_setopt(
+      curl, CURLOPT_HTTPHEADER,
+      binary_headers_ ?
+        run_template_->http_binary_header_list_ :
+        run_template_->http_header_list_);
+  }
 
   return Error::Success;
 }
 
+Error
+InferHttpContext::PrepareProtocolTemplate(RunTemplateImpl* run_template)
+{
+  run_template->http_url_ = url_ + "?format=binary";
+
+  Error err =
+    CreateInferRequestHeaderList(
+      run_template->infer_request_, false /* binary */,
+      &run_template->http_header_list_);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  return
+    CreateInferRequestHeaderList(
+      run_template->infer_request_, true /* binary */,
+      &run_template->http_binary_header_list_);
+}
+
+Error
+InferHttpContext::SendSharedMemoryControl(const SharedMemoryControl& control)
+{
+  if (!curl_global.Status().IsOk()) {
+    return curl_global.Status();
+  }
+
+  // The control is sent as a request without inputs so that its status
+  // is handled as for an inference request.
+  HttpRequestImpl request(
+    0, AcquireEasyHandle(), std::vector<std::shared_ptr<Input>>());
+  CURL* curl = request.easy_handle_;
+  if (!curl) {
+    return
+      Error(RequestStatusCode::INTERNAL, "failed to initialize HTTP client");
+  }
+
+  const std::string control_str =
+    std::string(kSharedMemoryControlHTTPHeader) + ":" +
+    control.ShortDebugString();
+  struct curl_slist* list = curl_slist_append(NULL, "Expect:");
+  list = curl_slist_append(list, control_str.c_str());
+
+  curl_easy_setopt(curl, CURLOPT_URL, shared_memory_url_.c_str());
+  SetUnixSocketPath(curl, unix_socket_path_);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, "");
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, 0L);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+  if (verbose_) {
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+  }
+
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, ResponseHeaderHandler);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &request);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ResponseHandler);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &request);
+
+  CURLcode res = curl_easy_perform(curl);
+  curl_slist_free_all(list);
+  ReleaseEasyHandle(curl);
+  request.easy_handle_ = NULL;
+  if (res != CURLE_OK) {
+    return
+      Error(
+        RequestStatusCode::INTERNAL, "HTTP client failed: " +
+        std::string(curl_easy_strerror(res)));
+  }
+
+  // Should have a request status, if not then create an error status.
+  if (request.request_status_.code() == RequestStatusCode::INVALID) {
+    request.request_status_.Clear();
+    request.request_status_.set_code(RequestStatusCode::INTERNAL);
+    request.request_status_.set_msg(
+      "shared memory control did not return status");
+  }
+
+  return Error(request.request_status_);
+}
+
 void
 InferHttpContext::AsyncTransfer()
 {
+  // Upper bound on how long to block in curl_multi_poll(). libcurl
+  // shortens it as needed for its own timers and AsyncRun() wakes the
+  // poll up early, so this only bounds how long a missed wakeup can
+  // stall the transfer.
+  const int max_poll_timeout_ms = 1000;
+
   int place_holder = 0;
+  int running_handles = 0;
   CURLMsg* msg = NULL;
   do {
     bool has_completed = false;
@@ -1827,19 +4260,29 @@ InferHttpContext::AsyncTransfer()
     std::unique_lock<std::mutex> lock(mutex_);
     cv_.wait(lock,
       [this] {
-        if (this->exiting_) {
-          return true;
-        }
         // wake up if at least one request is not ready
-        for (auto& ongoing_async_request : this->ongoing_async_requests_) {
-          if (std::static_pointer_cast<HttpRequestImpl>(
-              ongoing_async_request.second)->ready_ == false) {
-            return true;
-          }
-        }
-        return false;
+        return this->exiting_ || (this->pending_async_request_count_ > 0);
       });
-    curl_multi_perform(multi_handle_, &place_holder);
+
+    if (!new_async_requests_.empty()) {
+      // By default libcurl only caches connections for 4x the number of
+      // handles currently added to the multi handle, so connections are
+      // closed as requests complete. Keep one for each pooled handle.
+      curl_multi_setopt(
+        multi_handle_, CURLMOPT_MAXCONNECTS, (long)easy_handle_count_);
+      for (CURL* easy_handle : new_async_requests_) {
+        curl_multi_add_handle(multi_handle_, easy_handle);
+      }
+      new_async_requests_.clear();
+    }
+
+    // The requests being transferred are kept alive by
+    // 'ongoing_async_requests_' until they are ready, so the transfer
+    // itself doesn't need to block AsyncRun() in other threads.
+    lock.unlock();
+    curl_multi_perform(multi_handle_, &running_handles);
+    lock.lock();
+
     while ((msg = curl_multi_info_read(multi_handle_, &place_holder))) {
       // update request status
       uintptr_t identifier = reinterpret_cast<uintptr_t>(msg->easy_handle);
@@ -1863,13 +4306,21 @@ InferHttpContext::AsyncTransfer()
         http_request->timer_.Record(RequestTimers::Kind::REQUEST_END);
       }
       http_request->http_status_ = msg->data.result;
-      http_request->ready_ = true;
+      MarkRequestReady(itr->second);
       has_completed = true;
+      // 'msg' is invalid once the handle is removed, do it last.
+      curl_multi_remove_handle(multi_handle_, msg->easy_handle);
     }
     lock.unlock();
-    // if it has completed tasks, send signal in case the main thread is waiting
     if (has_completed) {
-      cv_.notify_all();
+      RunCompletionCallbacks();
+    }
+
+    // Block until there is activity on the sockets of the requests in
+    // flight, a libcurl timer expires or AsyncRun() wakes us up. If
+    // nothing is in flight go back to waiting on 'cv_' instead.
+    if (!exiting_ && (running_handles > 0)) {
+      curl_multi_poll(multi_handle_, NULL, 0, max_poll_timeout_ms, NULL);
     }
   } while (!exiting_);
 }
@@ -1889,7 +4340,9 @@ ProfileHttpContext::Create(
 
 ProfileHttpContext::ProfileHttpContext(
   const std::string& server_url, bool verbose)
-  : ProfileContext(verbose), url_(server_url + "/" + kProfileRESTEndpoint)
+  : ProfileContext(verbose),
+    url_(HttpServerUrl(server_url) + "/" + kProfileRESTEndpoint),
+    unix_socket_path_(UnixSocketPath(server_url))
 {
 }
 
@@ -1911,6 +4364,7 @@ ProfileHttpContext::SendCommand(const std::string& cmd_str)
   // Want binary representation of the status.
   std::string full_url = url_ + "?cmd=" + cmd_str;
   curl_easy_setopt(curl, CURLOPT_URL, full_url.c_str());
+  SetUnixSocketPath(curl, unix_socket_path_);
   curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
   if (verbose_) {
     curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
@@ -2074,69 +4528,304 @@ ServerStatusGrpcContext::ServerStatusGrpcContext(
 {
 }
 
-Error
-ServerStatusGrpcContext::GetServerStatus(ServerStatus* server_status)
+Error
+ServerStatusGrpcContext::GetServerStatus(ServerStatus* server_status)
+{
+  server_status->Clear();
+
+  Error grpc_status;
+
+  StatusRequest request;
+  StatusResponse response;
+  grpc::ClientContext context;
+
+  request.set_model_name(model_name_);
+  grpc::Status status = stub_->Status(&context, request, &response);
+  if (status.ok()) {
+    server_status->Swap(response.mutable_server_status());
+    grpc_status = Error(response.request_status());
+  } else {
+    // Something wrong with the gRPC conncection
+    grpc_status = Error(RequestStatusCode::INTERNAL, "gRPC client failed: " +
+      std::to_string(status.error_code()) + ": " + status.error_message());
+  }
+
+  // Log server status if request is SUCCESS and verbose is true.
+  if (grpc_status.Code() == RequestStatusCode::SUCCESS && verbose_) {
+    std::cout << server_status->DebugString() << std::endl;
+  }
+  return grpc_status;
+}
+
+//==============================================================================
+
+// The messages of a request and its response are allocated on the
+// arena of the slot, and a synchronous request waits for its call on
+// the completion queue of the slot. The slot is reused once the
+// request and the results referencing the response are released, so
+// that after the first few requests the arena has grown to fit them
+// and serializing and parsing the messages doesn't allocate memory.
+class GrpcRequestSlot {
+public:
+  explicit GrpcRequestSlot(std::weak_ptr<GrpcRequestSlotPool> pool);
+  ~GrpcRequestSlot();
+
+  google::protobuf::Arena* Arena() { return arena_.get(); }
+  grpc::CompletionQueue* CompletionQueue() { return &completion_queue_; }
+  std::vector<grpc::Slice>* Slices() { return &slices_; }
+
+  // Release the messages of the previous request. If they didn't fit
+  // in the initial block of the arena, the block is grown to fit them,
+  // up to 'kMaxInitialBlockSize'.
+  void Reset();
+
+private:
+  static constexpr size_t kMinInitialBlockSize = 4 * 1024;
+  static constexpr size_t kMaxInitialBlockSize = 1024 * 1024;
+
+  std::unique_ptr<char[]> initial_block_;
+  size_t initial_block_size_;
+  std::unique_ptr<google::protobuf::Arena> arena_;
+  grpc::CompletionQueue completion_queue_;
+
+  // Slices of the serialized request, kept to reuse their storage.
+  std::vector<grpc::Slice> slices_;
+
+  template <typename T> friend class GrpcRequestSlotLease;
+  friend class GrpcRequestSlotPool;
+
+  // The pool the slot returns to when it is released.
+  const std::weak_ptr<GrpcRequestSlotPool> pool_;
+
+  // Storage for the shared_ptr control block of the slot while it is
+  // in use, so that handing out the slot doesn't allocate memory.
+  static constexpr size_t kLeaseStorageSize = 64;
+  typename std::aligned_storage<kLeaseStorageSize>::type lease_storage_;
+};
+
+constexpr size_t GrpcRequestSlot::kMinInitialBlockSize;
+constexpr size_t GrpcRequestSlot::kMaxInitialBlockSize;
+constexpr size_t GrpcRequestSlot::kLeaseStorageSize;
+
+GrpcRequestSlot::GrpcRequestSlot(std::weak_ptr<GrpcRequestSlotPool> pool)
+  : initial_block_(new char[kMinInitialBlockSize]),
+    initial_block_size_(kMinInitialBlockSize),
+    arena_(
+      new google::protobuf::Arena(initial_block_.get(), initial_block_size_)),
+    pool_(std::move(pool))
+{
+}
+
+GrpcRequestSlot::~GrpcRequestSlot()
+{
+  completion_queue_.Shutdown();
+  void* tag;
+  bool ok;
+  while (completion_queue_.Next(&tag, &ok)) {
+  }
+}
+
+void
+GrpcRequestSlot::Reset()
+{
+  slices_.clear();
+  const size_t used = arena_->SpaceAllocated();
+  if ((used > initial_block_size_) && (used <= kMaxInitialBlockSize)) {
+    arena_.reset();
+    initial_block_size_ = used;
+    initial_block_.reset(new char[initial_block_size_]);
+    arena_.reset(
+      new google::protobuf::Arena(initial_block_.get(), initial_block_size_));
+  } else {
+    arena_->Reset();
+  }
+}
+
+// The slots not in use, kept for reuse. A slot in use is referred to
+// by a shared_ptr whose control block is placed in the slot by
+// GrpcRequestSlotLease, the slot returns to the pool when the control
+// block is deallocated, that is once the request and all results
+// referencing it are released. The pool keeps at most as many idle
+// slots as are in use, but no less than 'kMinIdleSlots', the others
+// are freed. Slots outliving the pool are freed when released.
+class GrpcRequestSlotPool
+  : public std::enable_shared_from_this<GrpcRequestSlotPool> {
+public:
+  GrpcRequestSlotPool() : used_count_(0) {}
+  ~GrpcRequestSlotPool();
+
+  // Get a slot that is not in use, creating one if there is none.
+  std::shared_ptr<GrpcRequestSlot> Acquire();
+
+  // Return 'slot' to its pool, or free it.
+  static void Release(GrpcRequestSlot* slot);
+
+private:
+  static constexpr size_t kMinIdleSlots = 16;
+
+  std::mutex mutex_;
+  std::vector<GrpcRequestSlot*> idle_slots_;
+  size_t used_count_;
+};
+
+constexpr size_t GrpcRequestSlotPool::kMinIdleSlots;
+
+// Allocator placing the control block of the shared_ptr to a slot in
+// the slot itself, the slot is released when the control block is
+// deallocated.
+template <typename T>
+class GrpcRequestSlotLease {
+public:
+  typedef T value_type;
+
+  explicit GrpcRequestSlotLease(GrpcRequestSlot* slot) : slot_(slot) {}
+  template <typename U>
+  GrpcRequestSlotLease(const GrpcRequestSlotLease<U>& other)
+    : slot_(other.slot_) {}
+
+  T* allocate(size_t n)
+  {
+    if ((n * sizeof(T) <= GrpcRequestSlot::kLeaseStorageSize) &&
+        (alignof(T) <= alignof(decltype(slot_->lease_storage_)))) {
+      return reinterpret_cast<T*>(&slot_->lease_storage_);
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n)
+  {
+    if (reinterpret_cast<void*>(p) !=
+        reinterpret_cast<void*>(&slot_->lease_storage_)) {
+      ::operator delete(p);
+    }
+    GrpcRequestSlotPool::Release(slot_);
+  }
+
+  template <typename U>
+  bool operator==(const GrpcRequestSlotLease<U>& other) const
+  {
+    return slot_ == other.slot_;
+  }
+  template <typename U>
+  bool operator!=(const GrpcRequestSlotLease<U>& other) const
+  {
+    return slot_ != other.slot_;
+  }
+
+private:
+  template <typename U> friend class GrpcRequestSlotLease;
+
+  GrpcRequestSlot* slot_;
+};
+
+GrpcRequestSlotPool::~GrpcRequestSlotPool()
+{
+  for (GrpcRequestSlot* slot : idle_slots_) {
+    delete slot;
+  }
+}
+
+std::shared_ptr<GrpcRequestSlot>
+GrpcRequestSlotPool::Acquire()
 {
-  server_status->Clear();
-
-  Error grpc_status;
-
-  StatusRequest request;
-  StatusResponse response;
-  grpc::ClientContext context;
+  GrpcRequestSlot* slot = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    used_count_++;
+    if (!idle_slots_.empty()) {
+      slot = idle_slots_.back();
+      idle_slots_.pop_back();
+    }
+  }
 
-  request.set_model_name(model_name_);
-  grpc::Status status = stub_->Status(&context, request, &response);
-  if (status.ok()) {
-    server_status->Swap(response.mutable_server_status());
-    grpc_status = Error(response.request_status());
+  if (slot == nullptr) {
+    slot = new GrpcRequestSlot(shared_from_this());
   } else {
-    // Something wrong with the gRPC conncection
-    grpc_status = Error(RequestStatusCode::INTERNAL, "gRPC client failed: " +
-      std::to_string(status.error_code()) + ": " + status.error_message());
+    slot->Reset();
   }
 
-  // Log server status if request is SUCCESS and verbose is true.
-  if (grpc_status.Code() == RequestStatusCode::SUCCESS && verbose_) {
-    std::cout << server_status->DebugString() << std::endl;
+  // The slot is not deleted by the shared_ptr but released by its
+  // allocator.
+  return std::shared_ptr<GrpcRequestSlot>(
+    slot, [](GrpcRequestSlot*) {}, GrpcRequestSlotLease<GrpcRequestSlot>(slot));
+}
+
+void
+GrpcRequestSlotPool::Release(GrpcRequestSlot* slot)
+{
+  std::shared_ptr<GrpcRequestSlotPool> pool = slot->pool_.lock();
+  if (pool != nullptr) {
+    std::lock_guard<std::mutex> lock(pool->mutex_);
+    pool->used_count_--;
+    if (pool->idle_slots_.size() <
+        std::max(kMinIdleSlots, pool->used_count_)) {
+      pool->idle_slots_.push_back(slot);
+      return;
+    }
   }
-  return grpc_status;
+
+  delete slot;
 }
 
 //==============================================================================
 
 class GrpcRequestImpl : public RequestImpl {
 public:
-  GrpcRequestImpl(const uint64_t id, const uintptr_t run_index);
+  GrpcRequestImpl(
+    const uint64_t id, const uintptr_t run_index,
+    std::shared_ptr<GrpcRequestSlot> slot);
 
   // @see RequestImpl.GetResults()
   Error GetResults(
     std::vector<std::unique_ptr<InferContext::Result>>* results) override;
 
 private:
-  // Unmarshall and process 'grpc_response_' into 'requested_results'
-  Error SetRawResult();
+  // Process 'response' into 'requested_results'. The RAW results
+  // reference the raw output in 'response', which is kept alive by
+  // them.
+  Error SetRawResult(const std::shared_ptr<InferResponse>& response);
 
   friend class InferGrpcContext;
+
+  // Whether the request is sent by Run() over the stream, in which
+  // case it isn't queued as ready but Run() waits on it.
+  bool sync_;
+
+  // Keeps the request alive while its call is in a completion queue,
+  // the request is the tag of the call.
+  std::shared_ptr<InferContext::Request> self_;
+
+  // The slot holding the messages of the request.
+  std::shared_ptr<GrpcRequestSlot> slot_;
   
   // Variables for gRPC call
   grpc::ClientContext grpc_context_;
   grpc::Status grpc_status_;
-  InferResponse grpc_response_;
+  grpc::ByteBuffer grpc_response_buffer_;
+
+  // The response, if it was unmarshalled from the stream.
+  std::shared_ptr<InferResponse> grpc_response_;
+
+  // Serialized InferRequest for gRPC call. It is made of the serialized
+  // request header followed by the raw input slices, which reference
+  // the input buffers set by the user instead of copying them.
+  grpc::ByteBuffer grpc_request_buffer_;
 };
 
-GrpcRequestImpl::GrpcRequestImpl(const uint64_t id, const uintptr_t run_index)
-    : RequestImpl(id)
+GrpcRequestImpl::GrpcRequestImpl(
+  const uint64_t id, const uintptr_t run_index,
+  std::shared_ptr<GrpcRequestSlot> slot)
+    : RequestImpl(id), sync_(false), slot_(std::move(slot))
 {
   run_index_ = run_index;
 }
 
 Error
-GrpcRequestImpl::SetRawResult()
+GrpcRequestImpl::SetRawResult(const std::shared_ptr<InferResponse>& response)
 {
   result_pos_idx_ = 0;
-  for (std::string output : grpc_response_.raw_output()) {
-    const uint8_t* buf = reinterpret_cast<uint8_t*>(&output[0]);
+  for (const std::string& output : response->raw_output()) {
+    const uint8_t* buf = reinterpret_cast<const uint8_t*>(output.data());
     size_t size = output.size();
     size_t result_bytes = 0;
 
@@ -2148,10 +4837,11 @@ GrpcRequestImpl::SetRawResult()
 
       // Only try to read raw result for RAW
       if (io->ResultFormat() == InferContext::Result::ResultFormat::RAW) {
-        Error err = io->SetNextRawResult(buf, size, &result_bytes);
+        Error err = io->SetRawResultReference(response, buf, size);
         if (!err.IsOk()) {
           return err;
         }
+        result_bytes = size;
       }
     }
 
@@ -2171,14 +4861,27 @@ GrpcRequestImpl::GetResults(
   std::vector<std::unique_ptr<InferContext::Result>>* results)
 {
   results->clear();
-  InferResponseHeader infer_response;
+
+  // Infer is called through the generic stub so the response has to be
+  // unmarshalled here, into the arena of the slot. The response shares
+  // the ownership of the slot as the results may outlive this request.
+  // Responses from the stream are already unmarshalled to match them
+  // with their request.
+  std::shared_ptr<InferResponse> response = grpc_response_;
+  if (grpc_status_.ok() && (response == nullptr)) {
+    response = std::shared_ptr<InferResponse>(
+      slot_,
+      google::protobuf::Arena::CreateMessage<InferResponse>(slot_->Arena()));
+    grpc_status_ =
+      grpc::SerializationTraits<InferResponse>::Deserialize(
+        &grpc_response_buffer_, response.get());
+  }
 
   Error err(RequestStatusCode::SUCCESS);
   if (grpc_status_.ok()) {
-    infer_response.Swap(grpc_response_.mutable_meta_data());
-    err = Error(grpc_response_.request_status());
+    err = Error(response->request_status());
     if (err.IsOk()) {
-      Error set_err = SetRawResult();
+      Error set_err = SetRawResult(response);
       if (!set_err.IsOk()) {
         return set_err;
       }
@@ -2192,7 +4895,7 @@ GrpcRequestImpl::GetResults(
 
   // Only continue to process result if gRPC status is SUCCESS
   if (err.Code() == RequestStatusCode::SUCCESS) {
-    PostRunProcessing(requested_results_, infer_response);
+    PostRunProcessing(requested_results_, response->meta_data());
     results->swap(requested_results_);
   }
 
@@ -2204,42 +4907,49 @@ GrpcRequestImpl::GetResults(
 Error
 InferGrpcContext::Create(
   std::unique_ptr<InferContext>* ctx, const std::string& server_url,
-  const std::string& model_name, int model_version, bool verbose)
+  const std::string& model_name, int model_version, bool verbose,
+  bool streaming, size_t completion_queue_count, bool pin_pollers)
 {
-  InferGrpcContext* ctx_ptr =
-      new InferGrpcContext(server_url, model_name, model_version, verbose);
-
-  // Create request context for synchronous request.
-  ctx_ptr->sync_request_.reset(
-    static_cast<Request*>(new GrpcRequestImpl(0, 0)));
+  if (completion_queue_count == 0) {
+    ctx->reset();
+    return Error(
+      RequestStatusCode::INVALID_ARG, "completion queue count must be > 0");
+  }
 
-  // Get status of the model and create the inputs and outputs.
-  std::unique_ptr<ServerStatusContext> sctx;
-  Error err =
-    ServerStatusGrpcContext::Create(
-      &sctx, server_url, model_name, verbose);
+  InferGrpcContext* ctx_ptr =
+      new InferGrpcContext(
+        server_url, model_name, model_version, verbose, streaming,
+        completion_queue_count, pin_pollers);
+
+  // Get the configuration of the model, from the cache if possible,
+  // and create the inputs and outputs.
+  ModelConfig model_info;
+  Error err = ModelConfigCache::Lookup(
+    server_url, model_name, model_version, &model_info);
   if (err.IsOk()) {
-    ServerStatus server_status;
-    err = sctx->GetServerStatus(&server_status);
+    err = ctx_ptr->InitializeModel(model_info);
+  } else {
+    std::unique_ptr<ServerStatusContext> sctx;
+    err =
+      ServerStatusGrpcContext::Create(
+        &sctx, server_url, model_name, verbose);
     if (err.IsOk()) {
-      const auto& itr = server_status.model_status().find(model_name);
-      if (itr == server_status.model_status().end()) {
-        err =
-          Error(
-            RequestStatusCode::INTERNAL,
-            "unable to find status information for \"" + model_name + "\"");
-      } else {
-        const ModelConfig& model_info = itr->second.config();
-
-        ctx_ptr->max_batch_size_ =
-          static_cast<uint64_t>(std::max(0, model_info.max_batch_size()));
-
-        // Create inputs and outputs
-        for (const auto& io : model_info.input()) {
-          ctx_ptr->inputs_.emplace_back(std::make_shared<InputImpl>(io));
-        }
-        for (const auto& io : model_info.output()) {
-          ctx_ptr->outputs_.emplace_back(std::make_shared<OutputImpl>(io));
+      ServerStatus server_status;
+      err = sctx->GetServerStatus(&server_status);
+      if (err.IsOk()) {
+        const auto& itr = server_status.model_status().find(model_name);
+        if (itr == server_status.model_status().end()) {
+          err =
+            Error(
+              RequestStatusCode::INTERNAL,
+              "unable to find status information for \"" + model_name +
+              "\"");
+        } else {
+          err = ctx_ptr->InitializeModel(itr->second.config());
+          if (err.IsOk()) {
+            err = ModelConfigCache::Insert(
+              server_url, model_name, model_version, itr->second.config());
+          }
         }
       }
     }
@@ -2256,15 +4966,31 @@ InferGrpcContext::Create(
 
 InferGrpcContext::InferGrpcContext(
   const std::string& server_url, const std::string& model_name,
-  int model_version, bool verbose)
+  int model_version, bool verbose, bool streaming,
+  size_t completion_queue_count, bool pin_pollers)
   : InferContext(model_name, model_version, verbose),
-    stub_(GRPCService::NewStub(GetChannel(server_url)))
+    streaming_(streaming),
+    completion_queues_(streaming ? 0 : completion_queue_count),
+    next_completion_queue_(0), pin_pollers_(pin_pollers),
+    pollers_exiting_(false), stream_started_(false), stream_closed_(false),
+    stream_write_pending_(false),
+    request_slot_pool_(std::make_shared<GrpcRequestSlotPool>()),
+    channel_(GetChannel(server_url)),
+    stub_(GRPCService::NewStub(channel_)),
+    generic_stub_(new grpc::GenericStub(channel_))
 {
 }
 
 InferGrpcContext::~InferGrpcContext()
 {
   exiting_ = true;
+  // Cancel the stream so that the worker thread gets its last event.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stream_context_ != nullptr) {
+      stream_context_->TryCancel();
+    }
+  }
   // thread not joinable if AsyncRun() is not called
   // (it is default constructed thread before the first AsyncRun() call)
   if (worker_.joinable()) {
@@ -2272,6 +4998,18 @@ InferGrpcContext::~InferGrpcContext()
     worker_.join();
   }
 
+  // Let the pollers drain their queues, the requests still in flight
+  // are released without being completed.
+  pollers_exiting_ = true;
+  for (auto& pollers_cq : completion_queues_) {
+    if (pollers_cq != nullptr) {
+      pollers_cq->Shutdown();
+    }
+  }
+  for (auto& poller : pollers_) {
+    poller.join();
+  }
+
   // Close complete queue and drain its content
   async_request_completion_queue_.Shutdown();
   bool has_next = true;
@@ -2285,28 +5023,63 @@ InferGrpcContext::~InferGrpcContext()
 Error
 InferGrpcContext::Run(std::vector<std::unique_ptr<Result>>* results)
 {
-  grpc::ClientContext context;
+  if (streaming_) {
+    std::shared_ptr<Request> request;
+    Error err = StartAsyncRun(&request, nullptr, true /* sync */);
+    if (!err.IsOk()) {
+      return err;
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      GrpcRequestImpl* grpc_request =
+        reinterpret_cast<GrpcRequestImpl*>(request.get());
+      grpc_request->waiter_cv_.wait(
+        lock, [grpc_request] { return grpc_request->ready_; });
+    }
+
+    return FinishAsyncRequest(request, results);
+  }
+
+  // Each call has its own request and slot, with the completion queue
+  // of the call, so that calls can run concurrently.
+  std::shared_ptr<GrpcRequestImpl> sync_request =
+    std::make_shared<GrpcRequestImpl>(
+      async_request_id_++, 0, AcquireRequestSlot());
+  std::shared_ptr<Request> request = sync_request;
+  grpc::CompletionQueue* completion_queue =
+    sync_request->slot_->CompletionQueue();
 
-  std::shared_ptr<GrpcRequestImpl> sync_request = 
-    std::static_pointer_cast<GrpcRequestImpl>(sync_request_);
-  sync_request->InitializeRequestedResults(requested_outputs_, batch_size_);
-  
   sync_request->timer_.Reset();
   // Use send timer to measure time for marshalling infer request
   sync_request->timer_.Record(RequestTimers::Kind::SEND_START);
-  PreRunProcessing(sync_request_);
+  Error err = PreRunProcessing(request);
+  if (!err.IsOk()) {
+    return err;
+  }
   sync_request->timer_.Record(RequestTimers::Kind::SEND_END);
 
   sync_request->timer_.Record(RequestTimers::Kind::REQUEST_START);
-  sync_request->grpc_status_ =
-    stub_->Infer(&context, request_, &sync_request->grpc_response_);
+  std::unique_ptr<grpc::GenericClientAsyncResponseReader> rpc(
+    generic_stub_->PrepareUnaryCall(
+      &sync_request->grpc_context_, kInferGrpcMethod,
+      sync_request->grpc_request_buffer_, completion_queue));
+  rpc->StartCall();
+  rpc->Finish(
+    &sync_request->grpc_response_buffer_, &sync_request->grpc_status_,
+    (void*)sync_request.get());
+
+  // The queue is only used by this call, so the next event is for it.
+  void* tag;
+  bool ok;
+  completion_queue->Next(&tag, &ok);
   sync_request->timer_.Record(RequestTimers::Kind::REQUEST_END);
 
   sync_request->timer_.Record(RequestTimers::Kind::RECEIVE_START);
   Error request_status = sync_request->GetResults(results);
   sync_request->timer_.Record(RequestTimers::Kind::RECEIVE_END);
 
-  Error err = UpdateStat(sync_request->timer_);
+  err = UpdateStat(sync_request->timer_);
   if (!err.IsOk()) {
     std::cerr << "Failed to update context stat: " << err << std::endl;
   }
@@ -2317,50 +5090,112 @@ InferGrpcContext::Run(std::vector<std::unique_ptr<Result>>* results)
 Error
 InferGrpcContext::AsyncRun(std::shared_ptr<Request>* async_request)
 {
-  if (exiting_) {
-    exiting_ = false;
-    worker_ = std::thread(&InferGrpcContext::AsyncTransfer, this);
-  }
-  uintptr_t run_index;
-  if (reusable_slot_.empty()) {
-    run_index = ongoing_async_requests_.size();
+  return StartAsyncRun(async_request, nullptr);
+}
+
+Error
+InferGrpcContext::AsyncRun(OnCompleteFn callback)
+{
+  std::shared_ptr<Request> async_request;
+  return StartAsyncRun(&async_request, std::move(callback));
+}
+
+Error
+InferGrpcContext::StartAsyncRun(
+  std::shared_ptr<Request>* async_request, OnCompleteFn callback, bool sync)
+{
+  if (streaming_) {
+    Error err = OpenStream();
+    if (!err.IsOk()) {
+      return err;
+    }
   } else {
-    run_index = reusable_slot_.back();
-    reusable_slot_.pop_back();
+    std::call_once(
+      pollers_started_, [this] {
+        for (size_t idx = 0; idx < completion_queues_.size(); idx++) {
+          completion_queues_[idx].reset(new grpc::CompletionQueue());
+          pollers_.emplace_back(&InferGrpcContext::Poll, this, idx);
+        }
+      });
   }
 
-  GrpcRequestImpl* current_context =
-    new GrpcRequestImpl(async_request_id_++, run_index);
-  async_request->reset(static_cast<Request*>(current_context));
+  // Requests sent with a callback are completed by the pollers without
+  // being tracked in 'ongoing_async_requests_'.
+  const bool tracked = streaming_ || !callback;
 
-  auto insert_result = ongoing_async_requests_.emplace(
-      std::make_pair(run_index, *async_request));
+  // The request id is unique within the context so it is also used to
+  // identify the request in 'ongoing_async_requests_'. Requests sent
+  // with a callback leave the map on completion, before their results
+  // are processed, so the number of entries can't be used for that.
+  const uint64_t id = async_request_id_++;
+  const uintptr_t run_index = id;
 
-  if (!insert_result.second) {
-    return Error(
-      RequestStatusCode::INTERNAL,
-      "Failed to insert new asynchronous request context.");
+  std::shared_ptr<GrpcRequestImpl> current_context =
+    std::make_shared<GrpcRequestImpl>(id, run_index, AcquireRequestSlot());
+  *async_request = current_context;
+  current_context->callback_ = std::move(callback);
+  current_context->sync_ = sync;
+
+  if (tracked) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto insert_result = ongoing_async_requests_.emplace(
+        std::make_pair(run_index, *async_request));
+
+    if (!insert_result.second) {
+      return Error(
+        RequestStatusCode::INTERNAL,
+        "Failed to insert new asynchronous request context.");
+    }
+
+    pending_async_request_count_++;
   }
 
   current_context->timer_.Reset();
   current_context->timer_.Record(RequestTimers::Kind::SEND_START);
-  PreRunProcessing(*async_request);
+  Error err = PreRunProcessing(*async_request);
+  if (!err.IsOk()) {
+    if (tracked) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ongoing_async_requests_.erase(run_index);
+      pending_async_request_count_--;
+    }
+    return err;
+  }
   current_context->timer_.Record(RequestTimers::Kind::SEND_END);
 
   current_context->timer_.Record(RequestTimers::Kind::REQUEST_START);
-  std::unique_ptr<grpc::ClientAsyncResponseReader<InferResponse>> rpc(
-    stub_->PrepareAsyncInfer(
-      &current_context->grpc_context_, request_,
-      &async_request_completion_queue_));
+  if (streaming_) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stream_closed_) {
+      ongoing_async_requests_.erase(run_index);
+      pending_async_request_count_--;
+      return Error(
+        RequestStatusCode::UNAVAILABLE, "gRPC stream closed: " +
+        std::to_string(stream_status_.error_code()) + ": " +
+        stream_status_.error_message());
+    }
+    stream_write_queue_.push_back(current_context->grpc_request_buffer_);
+    WriteNextStreamRequest();
+    return Error::Success;
+  }
+
+  grpc::CompletionQueue* completion_queue =
+    completion_queues_[
+      next_completion_queue_++ % completion_queues_.size()].get();
+  current_context->self_ = *async_request;
+  std::unique_ptr<grpc::GenericClientAsyncResponseReader> rpc(
+    generic_stub_->PrepareUnaryCall(
+      &current_context->grpc_context_, kInferGrpcMethod,
+      current_context->grpc_request_buffer_, completion_queue));
 
   rpc->StartCall();
   
   rpc->Finish(
-    &current_context->grpc_response_,
+    &current_context->grpc_response_buffer_,
     &current_context->grpc_status_,
-    (void*)run_index);
+    (void*)current_context.get());
 
-  cv_.notify_all();
   return Error(RequestStatusCode::SUCCESS);
 }
 
@@ -2374,103 +5209,414 @@ InferGrpcContext::GetAsyncRunResults(
     return err;
   }
 
+  return FinishAsyncRequest(async_request, results);
+}
+
+Error
+InferGrpcContext::FinishAsyncRequest(
+  const std::shared_ptr<Request>& request,
+  std::vector<std::unique_ptr<Result>>* results)
+{
   std::shared_ptr<GrpcRequestImpl> grpc_request =
-    std::static_pointer_cast<GrpcRequestImpl>(async_request);
+    std::static_pointer_cast<GrpcRequestImpl>(request);
   
-  reusable_slot_.push_back(grpc_request->run_index_);
   grpc_request->timer_.Record(RequestTimers::Kind::RECEIVE_START);
   Error request_status = grpc_request->GetResults(results);
   grpc_request->timer_.Record(RequestTimers::Kind::RECEIVE_END);
-  err = UpdateStat(grpc_request->timer_);
+  Error err = UpdateStat(grpc_request->timer_);
   if (!err.IsOk()) {
     std::cerr << "Failed to update context stat: " << err << std::endl;
   }
   return request_status;
 }
 
+std::shared_ptr<GrpcRequestSlot>
+InferGrpcContext::AcquireRequestSlot()
+{
+  return request_slot_pool_->Acquire();
+}
+
+Error
+InferGrpcContext::PrepareProtocolTemplate(RunTemplateImpl* run_template)
+{
+  InferRequest request_header;
+  request_header.set_model_name(model_name_);
+  request_header.set_version(std::to_string(model_version_));
+  request_header.mutable_meta_data()->CopyFrom(run_template->infer_request_);
+  if (!request_header.SerializeToString(&run_template->grpc_header_)) {
+    return
+      Error(RequestStatusCode::INTERNAL, "failed to serialize request header");
+  }
+
+  return Error::Success;
+}
+
+Error
+InferGrpcContext::SendSharedMemoryControl(const SharedMemoryControl& control)
+{
+  SharedMemoryControlRequest request;
+  SharedMemoryControlResponse response;
+  grpc::ClientContext context;
+
+  request.mutable_control()->CopyFrom(control);
+  grpc::Status status =
+    stub_->SharedMemoryControl(&context, request, &response);
+  if (!status.ok()) {
+    return
+      Error(
+        RequestStatusCode::INTERNAL, "gRPC client failed: " +
+        std::to_string(status.error_code()) + ": " + status.error_message());
+  }
+
+  return Error(response.request_status());
+}
+
 Error
 InferGrpcContext::PreRunProcessing(std::shared_ptr<Request>& request)
 {
   std::shared_ptr<GrpcRequestImpl> grpc_request = 
     std::static_pointer_cast<GrpcRequestImpl>(request);
+
+  if (run_template_ == nullptr) {
+    return
+      Error(
+        RequestStatusCode::INVALID_ARG,
+        "run options must be set before running an inference");
+  }
+  grpc_request->run_template_ = run_template_;
+
   grpc_request->InitializeRequestedResults(requested_outputs_, batch_size_);
+  BindOutputBuffers(request);
+  Error err = BindSharedMemoryResults(request);
+  if (!err.IsOk()) {
+    return err;
+  }
 
-  for (auto& io : inputs_) {
-    reinterpret_cast<InputImpl*>(io.get())->PrepareForRequest();
+  const std::vector<std::shared_ptr<Input>>& inputs = CallerInputs();
+  for (auto& io : inputs) {
+    err = reinterpret_cast<InputImpl*>(io.get())->PrepareForRequest();
+    if (!err.IsOk()) {
+      return err;
+    }
+  }
+
+  std::unique_ptr<InferRequestHeader> shm_header;
+  uint64_t input_byte_size;
+  err = SharedMemoryRequestHeader(inputs, &shm_header, &input_byte_size);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  // Build the serialized InferRequest by hand to avoid copying the raw
+  // input into the message and then again when serializing it. The
+  // header fields are serialized once by the template and referenced
+  // in place, the request id is appended for the stream, and each
+  // input is appended as a length-delimited 'raw_input' field whose
+  // value is the batch entries of the input, referenced in place. The
+  // input buffers must be kept valid until the request completes.
+  using google::protobuf::io::CodedOutputStream;
+  using google::protobuf::internal::WireFormatLite;
+
+  // The field keys are written to the arena, it outlives the call. A
+  // key with a varint is at most 15 bytes.
+  google::protobuf::Arena* arena = grpc_request->slot_->Arena();
+  std::vector<grpc::Slice>& request_slices = *grpc_request->slot_->Slices();
+  const std::string* header = &run_template_->grpc_header_;
+
+  // Inputs in shared memory need a header of their own, it is
+  // serialized to the arena.
+  if (shm_header != nullptr) {
+    InferRequest* request_header =
+      google::protobuf::Arena::CreateMessage<InferRequest>(arena);
+    request_header->set_model_name(model_name_);
+    request_header->set_version(std::to_string(model_version_));
+    request_header->mutable_meta_data()->Swap(shm_header.get());
+    std::string* shm_header_bytes =
+      google::protobuf::Arena::Create<std::string>(arena);
+    if (!request_header->SerializeToString(shm_header_bytes)) {
+      return
+        Error(
+          RequestStatusCode::INTERNAL, "failed to serialize request header");
+    }
+    header = shm_header_bytes;
   }
 
-  request_.Clear();
-  request_.set_model_name(model_name_);
-  request_.set_version(std::to_string(model_version_));
-  request_.mutable_meta_data()->MergeFrom(infer_request_);
+  request_slices.emplace_back(
+    header->data(), header->size(), grpc::Slice::STATIC_SLICE);
+  if (streaming_) {
+    uint8_t* key = google::protobuf::Arena::CreateArray<uint8_t>(arena, 15);
+    uint8_t* key_end =
+      WireFormatLite::WriteUInt64ToArray(
+        InferRequest::kIdFieldNumber, grpc_request->Id(), key);
+    request_slices.emplace_back(
+      key, key_end - key, grpc::Slice::STATIC_SLICE);
+  }
+
+  const uint32_t raw_input_tag =
+    WireFormatLite::MakeTag(
+      InferRequest::kRawInputFieldNumber,
+      WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
 
   size_t input_pos_idx = 0;
-  while (input_pos_idx < inputs_.size()) {
+  while (input_pos_idx < inputs.size()) {
     InputImpl* io =
-      reinterpret_cast<InputImpl*>(inputs_[input_pos_idx].get());
-    std::string* new_input = request_.add_raw_input();
-    // Append all batches of one input together
-    for (size_t batch_idx = 0; batch_idx < batch_size_; batch_idx++) {
-      const uint8_t* data_ptr;
-      io->GetRaw(batch_idx, &data_ptr);
-      new_input->append(
-        reinterpret_cast<const char*>(data_ptr), io->ByteSize());
+      reinterpret_cast<InputImpl*>(inputs[input_pos_idx].get());
+    const bool in_shared_memory = !io->SharedMemoryName().empty();
+
+    // Field key and length of the value, all batches of one input are
+    // sent together. The value is empty for an input in shared memory.
+    uint8_t* key = google::protobuf::Arena::CreateArray<uint8_t>(arena, 15);
+    uint8_t* key_end = CodedOutputStream::WriteTagToArray(raw_input_tag, key);
+    key_end =
+      CodedOutputStream::WriteVarint64ToArray(
+        in_shared_memory ? 0 : batch_size_ * io->ByteSize(), key_end);
+    request_slices.emplace_back(
+      key, key_end - key, grpc::Slice::STATIC_SLICE);
+
+    const uint8_t* batch_ptr = io->ContiguousBatch();
+    if (in_shared_memory) {
+      // Nothing to send
+    } else if (batch_ptr != nullptr) {
+      request_slices.emplace_back(
+        batch_ptr, batch_size_ * io->ByteSize(), grpc::Slice::STATIC_SLICE);
+    } else {
+      for (size_t batch_idx = 0; batch_idx < batch_size_; batch_idx++) {
+        const uint8_t* data_ptr;
+        io->GetRaw(batch_idx, &data_ptr);
+        request_slices.emplace_back(
+          data_ptr, io->ByteSize(), grpc::Slice::STATIC_SLICE);
+      }
     }
     input_pos_idx++;
   }
+
+  grpc_request->grpc_request_buffer_ =
+    grpc::ByteBuffer(&request_slices[0], request_slices.size());
   return Error::Success;
 }
 
 void
 InferGrpcContext::AsyncTransfer()
 {
-  do {
-    // sleep if no work is available
-    std::unique_lock<std::mutex> lock(mutex_);
-    cv_.wait(lock,
-      [this] {
-        if (this->exiting_) {
-          return true;
-        }
-        // wake up if at least one request is not ready
-        for (auto& ongoing_async_request : this->ongoing_async_requests_) {
-          if (std::static_pointer_cast<GrpcRequestImpl>(
-              ongoing_async_request.second)->ready_ == false) {
-            return true;
-          }
+  // The worker thread only serves the stream, the asynchronous unary
+  // requests are completed by the pollers.
+  StreamTransfer();
+}
+
+void
+InferGrpcContext::Poll(size_t idx)
+{
+  if (pin_pollers_) {
+    // Pin to the i-th (modulo their number) of the cores the poller
+    // may run on, which it inherits from the thread creating it.
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    int cpu = -1;
+    if ((sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0) &&
+        (CPU_COUNT(&allowed) > 0)) {
+      size_t skip = idx % CPU_COUNT(&allowed);
+      for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && (skip-- == 0)) {
+          break;
         }
-        return false;
-      });
-    lock.unlock();
-    // gRPC async APIs are thread-safe https://github.com/grpc/grpc/issues/4486
-    if (!exiting_) {
-      size_t got;
-      bool ok = true;
-      bool status = async_request_completion_queue_.Next((void**)(&got), &ok);
-      {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (!ok) {
-          fprintf(stderr, "Unexpected not ok on client side.");
+      }
+    }
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if ((cpu >= 0) && (cpu < CPU_SETSIZE)) {
+      CPU_SET(cpu, &cpuset);
+    }
+    if ((CPU_COUNT(&cpuset) == 0) ||
+        (pthread_setaffinity_np(
+           pthread_self(), sizeof(cpu_set_t), &cpuset) != 0)) {
+      fprintf(stderr, "Failed to pin completion queue poller %zu.\n", idx);
+    }
+  }
+
+  grpc::CompletionQueue* completion_queue = completion_queues_[idx].get();
+  void* tag;
+  bool ok;
+  while (completion_queue->Next(&tag, &ok)) {
+    GrpcRequestImpl* grpc_request = static_cast<GrpcRequestImpl*>(tag);
+    std::shared_ptr<Request> request = std::move(grpc_request->self_);
+    if (pollers_exiting_) {
+      continue;
+    }
+
+    grpc_request->timer_.Record(RequestTimers::Kind::REQUEST_END);
+    if (grpc_request->callback_) {
+      grpc_request->ready_ = true;
+      RunCompletionCallback(request, std::atomic_load(&callback_executor_));
+    } else {
+      std::lock_guard<std::mutex> lock(mutex_);
+      MarkRequestReady(std::move(request));
+    }
+  }
+}
+
+Error
+InferGrpcContext::OpenStream()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stream_closed_) {
+      return Error(
+        RequestStatusCode::UNAVAILABLE, "gRPC stream closed: " +
+        std::to_string(stream_status_.error_code()) + ": " +
+        stream_status_.error_message());
+    }
+    if (stream_ != nullptr) {
+      return Error::Success;
+    }
+
+    stream_context_.reset(new grpc::ClientContext());
+    stream_ = generic_stub_->PrepareCall(
+      stream_context_.get(), kStreamInferGrpcMethod,
+      &async_request_completion_queue_);
+    stream_->StartCall((void*)STREAM_START);
+  }
+
+  StartWorker();
+  return Error::Success;
+}
+
+void
+InferGrpcContext::WriteNextStreamRequest()
+{
+  if (stream_started_ && !stream_closed_ && !stream_write_pending_ &&
+      !stream_write_queue_.empty()) {
+    stream_write_pending_ = true;
+    stream_->Write(stream_write_queue_.front(), (void*)STREAM_WRITE);
+  }
+}
+
+void
+InferGrpcContext::FailStreamRequests()
+{
+  const grpc::Status status =
+    stream_status_.ok() ?
+    grpc::Status(grpc::StatusCode::UNAVAILABLE, "stream ended") :
+    stream_status_;
+
+  std::vector<std::shared_ptr<Request>> failed;
+  for (const auto& pr : ongoing_async_requests_) {
+    if (!reinterpret_cast<GrpcRequestImpl*>(pr.second.get())->ready_) {
+      failed.push_back(pr.second);
+    }
+  }
+
+  for (auto& request : failed) {
+    GrpcRequestImpl* grpc_request =
+      reinterpret_cast<GrpcRequestImpl*>(request.get());
+    grpc_request->grpc_status_ = status;
+    grpc_request->timer_.Record(RequestTimers::Kind::REQUEST_END);
+    if (grpc_request->sync_) {
+      grpc_request->ready_ = true;
+      pending_async_request_count_--;
+      ongoing_async_requests_.erase(grpc_request->run_index_);
+      grpc_request->waiter_cv_.notify_all();
+    } else {
+      MarkRequestReady(std::move(request));
+    }
+  }
+
+  // The write in progress, if any, still uses the front request and
+  // pops it when it completes.
+  stream_write_queue_.erase(
+    stream_write_queue_.begin() + (stream_write_pending_ ? 1 : 0),
+    stream_write_queue_.end());
+}
+
+void
+InferGrpcContext::StreamTransfer()
+{
+  void* tag;
+  bool ok;
+  while (async_request_completion_queue_.Next(&tag, &ok)) {
+    const StreamTag stream_tag =
+      static_cast<StreamTag>(reinterpret_cast<uintptr_t>(tag));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stream_tag == STREAM_FINISH) {
+        stream_closed_ = true;
+        // Requests still in flight when the context is destroyed are
+        // not completed.
+        if (exiting_) {
+          return;
         }
-        if (!status) {
-          fprintf(stderr, "Completion queue is closed.");
+        // Keep the reason the client ended the stream with, if any.
+        if (stream_status_.ok()) {
+          stream_status_ = stream_finish_status_;
         }
-        auto itr = ongoing_async_requests_.find(got);
-        if (itr == ongoing_async_requests_.end()) {
-          fprintf(stderr, "Unexpected error: received completed request that" \
-            " is not in the list of asynchronous requests.\n");
-          continue;
+        FailStreamRequests();
+      } else if (!ok) {
+        // The stream is broken, get its status. Finish must only be
+        // called once, after the pending read has failed.
+        if (stream_tag == STREAM_WRITE) {
+          stream_write_pending_ = false;
+        } else {
+          stream_->Finish(&stream_finish_status_, (void*)STREAM_FINISH);
         }
+        continue;
+      } else if (stream_tag == STREAM_START) {
+        stream_started_ = true;
+        stream_->Read(&stream_read_buffer_, (void*)STREAM_READ);
+        WriteNextStreamRequest();
+        continue;
+      } else if (stream_tag == STREAM_WRITE) {
+        stream_write_pending_ = false;
+        stream_write_queue_.pop_front();
+        WriteNextStreamRequest();
+        continue;
+      } else {
+        std::shared_ptr<InferResponse> response =
+          std::make_shared<InferResponse>();
+        grpc::Status status =
+          grpc::SerializationTraits<InferResponse>::Deserialize(
+            &stream_read_buffer_, response.get());
+        stream_->Read(&stream_read_buffer_, (void*)STREAM_READ);
+        if (!status.ok()) {
+          // The request the response answers is unknown, so fail all
+          // requests on the stream and end it. The pending read fails
+          // once the stream is cancelled.
+          stream_status_ =
+            grpc::Status(
+              grpc::StatusCode::INTERNAL,
+              "failed to parse response from stream");
+          stream_closed_ = true;
+          FailStreamRequests();
+          stream_context_->TryCancel();
+        } else {
+          auto itr = ongoing_async_requests_.find(response->id());
+          if ((itr == ongoing_async_requests_.end()) ||
+              reinterpret_cast<GrpcRequestImpl*>(itr->second.get())->ready_) {
+            fprintf(stderr, "Unexpected error: received response for request" \
+              " that is not in the list of asynchronous requests.\n");
+            continue;
+          }
 
-        std::shared_ptr<GrpcRequestImpl> grpc_request =
-          std::static_pointer_cast<GrpcRequestImpl>(itr->second);
-        grpc_request->timer_.Record(RequestTimers::Kind::REQUEST_END);
-        grpc_request->ready_ = true;
+          std::shared_ptr<GrpcRequestImpl> grpc_request =
+            std::static_pointer_cast<GrpcRequestImpl>(itr->second);
+          grpc_request->grpc_response_ = std::move(response);
+          grpc_request->timer_.Record(RequestTimers::Kind::REQUEST_END);
+          if (grpc_request->sync_) {
+            grpc_request->ready_ = true;
+            pending_async_request_count_--;
+            ongoing_async_requests_.erase(itr);
+            grpc_request->waiter_cv_.notify_all();
+          } else {
+            MarkRequestReady(itr->second);
+          }
+        }
       }
-      // send signal in case the main thread is waiting
-      cv_.notify_all();
     }
-  } while (!exiting_);
+    RunCompletionCallbacks();
+
+    if (stream_tag == STREAM_FINISH) {
+      return;
+    }
+  }
 }
 
 //==============================================================================
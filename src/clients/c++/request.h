@@ -25,9 +25,16 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
 #include <grpc++/grpc++.h>
+#include <grpc++/generic/generic_stub.h>
 //#include <grpcpp/grpcpp.h>
+#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -180,6 +187,172 @@ protected:
   const bool verbose_;
 };
 
+//==============================================================================
+// ModelConfigCache
+//
+// Process-wide cache of the model configurations fetched by
+// InferHttpContext::Create() and InferGrpcContext::Create(), so that
+// creating a context for a model that has been seen before doesn't
+// need a status request to the inference server. Entries are keyed by
+// server URL, model name and model version and expire once older than
+// the time-to-live. The time-to-live is zero by default, that is the
+// cache is not used until SetTTL() is called. The cache can be saved
+// to a file and loaded back, so that a process can create its contexts
+// without any status request. For example:
+//
+//   ModelConfigCache::SetTTL(60 * 1000);
+//   ModelConfigCache::Load("/var/cache/model_configs");
+//   ...
+//   InferGrpcContext::Create(&ctx, "localhost:8001", "resnet50");
+//
+// Thread-safety:
+//   All ModelConfigCache methods are thread-safe.
+//
+class ModelConfigCache {
+public:
+  // Set the time-to-live of the entries, it applies to the entries
+  // already in the cache as well.
+  // @param ttl_ms - the time-to-live in msec, 0 to not use the cache
+  // @return Error object indicating success or failure
+  static Error SetTTL(uint64_t ttl_ms);
+
+  // Get the configuration of a model from the cache.
+  // @param server_url - inference server name and port
+  // @param model_name - name of the model
+  // @param model_version - version of the model, -1 for the latest
+  // @param config - returns the configuration of the model
+  // @return Error object indicating success or failure. UNAVAILABLE
+  // is returned if there is no entry or it has expired.
+  static Error Lookup(
+    const std::string& server_url, const std::string& model_name,
+    int model_version, ModelConfig* config);
+
+  // Add or replace the configuration of a model in the cache.
+  // @param server_url - inference server name and port
+  // @param model_name - name of the model
+  // @param model_version - version of the model, -1 for the latest
+  // @param config - the configuration of the model
+  // @return Error object indicating success or failure
+  static Error Insert(
+    const std::string& server_url, const std::string& model_name,
+    int model_version, const ModelConfig& config);
+
+  // Remove the configuration of a model from the cache, for example
+  // once the model has been reloaded on the server.
+  // @param server_url - inference server name and port
+  // @param model_name - name of the model
+  // @param model_version - version of the model, -1 for the latest
+  // @return Error object indicating success or failure
+  static Error Invalidate(
+    const std::string& server_url, const std::string& model_name,
+    int model_version);
+
+  // Remove all entries from the cache.
+  // @return Error object indicating success or failure
+  static Error InvalidateAll();
+
+  // Write the entries that have not expired to a file.
+  // @param filename - the file to write
+  // @return Error object indicating success or failure
+  static Error Save(const std::string& filename);
+
+  // Add the entries written by Save() to the cache. Their age starts
+  // at zero when loaded.
+  // @param filename - the file to read
+  // @return Error object indicating success or failure
+  static Error Load(const std::string& filename);
+};
+
+//==============================================================================
+// LatencyHistogram
+//
+// Histogram of latencies in nanoseconds, with the log-linear buckets of
+// an HDR histogram: values up to 127 have a bucket each and larger
+// values are grouped so that a bucket is at most 1/64 of its values
+// wide, which keeps two significant digits over the whole range. Values
+// of 2^36 nsec (about 68 sec) and above are counted in the last bucket.
+// The histogram can be merged with, and a previous snapshot subtracted
+// from, another, so that latencies recorded by several threads or over
+// a period can be combined. For example:
+//
+//   LatencyHistogram start = context_histogram;
+//   ...
+//   LatencyHistogram window = context_histogram;
+//   window.Subtract(start);
+//   uint64_t p99_ns = window.ValueAtPercentile(99);
+//
+// Thread-safety:
+//   Record(), Merge() and Subtract() only use atomic operations, so
+//   threads can record into the same histogram and read or merge it
+//   without locking. A histogram read while values are being recorded
+//   may not include all of the values recorded concurrently.
+//
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+  LatencyHistogram(const LatencyHistogram& other);
+  LatencyHistogram& operator=(const LatencyHistogram& other);
+
+  // Record one latency.
+  // @param value_ns - the latency in nsec
+  void Record(uint64_t value_ns);
+
+  // Add the values recorded in another histogram.
+  // @param other - the histogram to add
+  void Merge(const LatencyHistogram& other);
+
+  // Remove the values recorded in an earlier copy of this histogram.
+  // @param other - the earlier copy
+  void Subtract(const LatencyHistogram& other);
+
+  // Remove all values.
+  void Reset();
+
+  // @return the number of values recorded.
+  uint64_t Count() const;
+
+  // @return the mean of the values recorded, 0 if there are none.
+  uint64_t Mean() const;
+
+  // @return the standard deviation of the values recorded, computed
+  // from the buckets.
+  uint64_t StdDev() const;
+
+  // @return the lowest value the smallest value recorded may have had.
+  uint64_t Min() const;
+
+  // @return the highest value the largest value recorded may have had.
+  uint64_t Max() const;
+
+  // @param percentile - the percentile, between 0 and 100
+  // @return the highest value the value at 'percentile' may have had,
+  // 0 if there are no values.
+  uint64_t ValueAtPercentile(double percentile) const;
+
+private:
+  // Values below 2^kSubBucketBits have a bucket each, every further
+  // power of two is split in 2^(kSubBucketBits - 1) buckets.
+  static const size_t kSubBucketBits = 7;
+  static const size_t kValueBits = 36;
+  static const size_t kBucketCount =
+    (1 << kSubBucketBits) +
+    (kValueBits - kSubBucketBits) * (1 << (kSubBucketBits - 1));
+
+  static size_t BucketIndex(uint64_t value_ns);
+  static uint64_t BucketLowest(size_t idx);
+  static uint64_t BucketHighest(size_t idx);
+
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_ns_;
+  std::atomic<uint64_t> buckets_[kBucketCount];
+};
+
+// The request settings generated for some InferContext options.
+class RunTemplateImpl;
+
+// A shared memory region mapped into this process.
+class SharedMemoryMapping;
+
 //==============================================================================
 // InferContext
 //
@@ -213,23 +386,47 @@ protected:
 //   ctx->Run(&results3);  // run using options1
 //   ...
 //
-// Note that the Run() calls are not thread-safe but a new Run() can
-// be invoked as soon as the previous completes. The returned result
-// objects are owned by the caller and may be retained and accessed
-// even after the InferContext object is destroyed.
+// SetRunOptions() encodes the request header for the options each
+// time it is called. When switching between a few sets of options,
+// for example between batch sizes, prepare a RunTemplate for each set
+// once with PrepareRunTemplate() and switch with SetRunTemplate():
 //
-// Also note that AsyncRun() and GetAsyncRunStatus() calls are not thread-safe.
-// What's more, calling one method while the other one is running will result in
-// undefined behavior given that they will modify the shared data internally.
+//   std::shared_ptr<RunTemplate> template0, template1;
+//   ctx->PrepareRunTemplate(*options0, &template0);
+//   ctx->PrepareRunTemplate(*options1, &template1);
+//   ctx->SetRunTemplate(template0);
+//   ctx->Run(&results4);  // run using options0
+//   ctx->SetRunTemplate(template1);
+//   ctx->Run(&results5);  // run using options1
+//   ...
+//
+// Note that by default the Run() calls are not thread-safe but a new
+// Run() can be invoked as soon as the previous completes. The
+// returned result objects are owned by the caller and may be retained
+// and accessed even after the InferContext object is destroyed.
 //
-// For more parallelism multiple InferContext objects can access the
-// same inference server with no serialization requirements across
-// those objects.
+// Also note that by default AsyncRun() and GetAsyncRunStatus() calls
+// are not thread-safe. What's more, calling one method while the
+// other one is running will result in undefined behavior given that
+// they will modify the shared data internally.
+//
+// For more parallelism either enable the thread-safe mode (see
+// SetThreadSafeMode()) and share one InferContext object between
+// threads, or have multiple InferContext objects access the same
+// inference server with no serialization requirements across those
+// objects. A shared context queries the model status, runs the
+// asynchronous worker thread and, for HTTP, keeps the connections
+// only once for all threads.
 //
 // Thread-safety:
 //   InferContext::Create methods are thread-safe.
-//   All other InferContext methods, and nested class methods are not
-//   thread-safe.
+//   In thread-safe mode Inputs(), GetInput(), SetOutputBuffer(),
+//   Run(), AsyncRun(), GetAsyncRunResults(), GetReadyAsyncRequest(),
+//   GetStat(), ReleaseThread(), RegisterSharedMemory(),
+//   UnregisterSharedMemory() and GetSharedMemory() can be called
+//   concurrently, the Input objects are then per calling thread. All
+//   other InferContext methods must not run concurrently with any
+//   other method. Nested class methods are not thread-safe.
 //
 class InferContext {
 public:
@@ -258,16 +455,20 @@ public:
 
     // Prepare this input to receive new tensor values. Forget any
     // existing values that were set by previous calls to
-    // Input::SetRaw().
+    // Input::SetRaw() or Input::SetRawBatch().
     // @return Error object indicating success or failure
     virtual Error Reset() = 0;
 
     // Set tensor values for this input from a byte array. The array
-    // is not copied and so the it must not be modified or destroyed
+    // is not copied and so it must not be modified or destroyed
     // until this input is no longer needed (that is until the Run()
-    // call(s) that use the input have completed). For batched inputs
-    // this function must be called batch-size times to provide all
-    // tensor values for a batch of this input.
+    // call(s) that use the input have completed). The gRPC context
+    // sends the array without copying it, so for AsyncRun() it must
+    // stay valid until the request has completed, that is until
+    // GetAsyncRunResults() or the callback returns, not just until
+    // AsyncRun() returns. For batched inputs this function must be
+    // called batch-size times to provide all tensor values for a
+    // batch of this input.
     // @param input - pointer to the array holding tensor value
     // @param input_byte_size - size of the array in bytes, must match
     // the size expected by the input.
@@ -276,14 +477,58 @@ public:
       const uint8_t* input, size_t input_byte_size) = 0;
 
     // Set tensor values for this input from a byte vector. The vector
-    // is not copied and so the it must not be modified or destroyed
+    // is not copied and so it must not be modified or destroyed
     // until this input is no longer needed (that is until the Run()
-    // call(s) that use the input have completed). For batched inputs
-    // this function must be called batch-size times to provide all
-    // tensor values for a batch of this input.
+    // call(s) that use the input have completed). As for SetRaw()
+    // above, with AsyncRun() that is until the request has completed.
+    // For batched inputs this function must be called batch-size
+    // times to provide all tensor values for a batch of this input.
     // @param input - vector holding tensor values
     // @return Error object indicating success or failure
     virtual Error SetRaw(const std::vector<uint8_t>& input) = 0;
+
+    // Set tensor values of all batch entries for this input from one
+    // byte array holding the entries contiguously in order. The array
+    // is not copied and so it must not be modified or destroyed
+    // until this input is no longer needed, which with AsyncRun() is
+    // until the request has completed, not when AsyncRun() returns.
+    // Can be used instead of calling SetRaw() batch-size times, but
+    // not together with it.
+    // A contiguous batch is sent as one block.
+    // @param input - pointer to the array holding tensor values
+    // @param input_byte_size - size of the array in bytes, must be
+    // batch-size times the size expected by the input.
+    // @return Error object indicating success or failure
+    virtual Error SetRawBatch(
+      const uint8_t* input, size_t input_byte_size) = 0;
+
+    // Set tensor values of all batch entries for this input from one
+    // byte array where each batch entry starts 'batch_stride' bytes
+    // after the previous one. Otherwise the same as SetRawBatch()
+    // above.
+    // @param input - pointer to the array holding tensor values
+    // @param input_byte_size - size of the array in bytes, must hold
+    // batch-size entries at the given stride.
+    // @param batch_stride - distance in bytes between the start of two
+    // consecutive batch entries, must be at least the size expected
+    // by the input.
+    // @return Error object indicating success or failure
+    virtual Error SetRawBatch(
+      const uint8_t* input, size_t input_byte_size,
+      size_t batch_stride) = 0;
+
+    // Have the server read the tensor values of all batch entries for
+    // this input from a shared memory region registered with the
+    // context, instead of sending them with the request. The entries
+    // are contiguous in order. Can be used instead of SetRaw() or
+    // SetRawBatch(), but not together with them.
+    // @param name - the name the region was registered with
+    // @param offset - the offset of the values in the region, in bytes
+    // @param byte_size - the size of the values in bytes, must be
+    // batch-size times the size expected by the input.
+    // @return Error object indicating success or failure
+    virtual Error SetSharedMemory(
+      const std::string& name, size_t offset, size_t byte_size) = 0;
   };
 
   //==============
@@ -330,13 +575,35 @@ public:
     virtual const std::shared_ptr<Output> GetOutput() const = 0;
 
     // Get a reference to entire raw result data for a specific batch
-    // entry. Returns error if this result is not RAW format.
+    // entry. Returns error if this result is not RAW format. The
+    // result data is copied into the returned vector on first call,
+    // use the GetRaw() variant returning a pointer to access the data
+    // without copying.
     // @param batch_idx - return results for this entry the batch
     // @param buf - returns the vector of result bytes
     // @return Error object indicating success or failure
     virtual Error
       GetRaw(size_t batch_idx, const std::vector<uint8_t>** buf) const = 0;
 
+    // Get a reference to entire raw result data for a specific batch
+    // entry without copying it. The data is valid as long as this
+    // result object. Returns error if this result is not RAW format.
+    // @param batch_idx - return results for this entry the batch
+    // @param buf - returns pointer to the result bytes
+    // @param byte_size - returns the number of result bytes
+    // @return Error object indicating success or failure
+    virtual Error GetRaw(
+      size_t batch_idx, const uint8_t** buf, size_t* byte_size) const = 0;
+
+    // Get a reference to the raw result data of the whole batch. The
+    // batch entries are stored contiguously in order, each being
+    // Output::ByteSize() bytes. The data is valid as long as this
+    // result object. Returns error if this result is not RAW format.
+    // @param buf - returns pointer to the result bytes
+    // @param byte_size - returns the number of result bytes
+    // @return Error object indicating success or failure
+    virtual Error GetRawBatch(const uint8_t** buf, size_t* byte_size) const = 0;
+
     // Get a reference to raw result data for a specific batch entry
     // at the current "cursor" and advance the cursor by the specified
     // number of bytes. More typically use GetRawAtCursor<T>() method
@@ -428,6 +695,36 @@ public:
     // @return Error object indicating success or failure
     virtual Error AddClassResult(
       const std::shared_ptr<InferContext::Output>& output, uint64_t k) = 0;
+
+    // Add 'output' to the list of requested RAW results, written by
+    // the server to a shared memory region registered with the context
+    // instead of being sent with the response. The Result for the
+    // output references the values in the region, so they are
+    // overwritten by the next request using the same memory.
+    // @param output - the output
+    // @param name - the name the region was registered with
+    // @param offset - the offset of the values in the region, in bytes
+    // @param byte_size - the size available for the values, in bytes,
+    // must hold the output for the batch size
+    // @return Error object indicating success or failure
+    virtual Error AddSharedMemoryResult(
+      const std::shared_ptr<InferContext::Output>& output,
+      const std::string& name, size_t offset, size_t byte_size) = 0;
+  };
+
+  //==============
+  // RunTemplate
+  // The settings of the requests sent with some options, prepared once
+  // by PrepareRunTemplate(): the request header in the encoding of the
+  // protocol and, for HTTP, the URL and the HTTP header list. A
+  // RunTemplate is immutable and can only be used with the
+  // InferContext that prepared it.
+  class RunTemplate {
+  public:
+    virtual ~RunTemplate() = default;
+
+    // @return the batch size of the requests sent with the template.
+    virtual size_t BatchSize() const = 0;
   };
 
   //==============
@@ -467,10 +764,19 @@ public:
     // Time from receiving first byte of the response until the response
     // is completely received
     uint64_t cumulative_receive_time_ns;
+    // Number of requests sent on a connection kept open from a previous
+    // request and number of new connections opened to send requests.
+    // Only collected for HTTP protocol.
+    size_t reused_connection_count;
+    size_t new_connection_count;
+    // Distribution of the time from the request start until the
+    // response is completely received
+    LatencyHistogram request_time_histogram;
 
     Stat()
      : completed_request_count(0), cumulative_total_request_time_ns(0),
-       cumulative_send_time_ns(0), cumulative_receive_time_ns(0) {}
+       cumulative_send_time_ns(0), cumulative_receive_time_ns(0),
+       reused_connection_count(0), new_connection_count(0) {}
   };
 
   //==============
@@ -521,9 +827,14 @@ public:
   // @return the maximum batch size supported by the context.
   uint64_t MaxBatchSize() const { return max_batch_size_; }
 
-  // @return the inputs of the model.
+  // @return the configuration of the model, as reported by the
+  // inference server when the context was created.
+  const ModelConfig& Config() const { return config_; }
+
+  // @return the inputs of the model. In thread-safe mode these are
+  // the inputs of the calling thread.
   const std::vector<std::shared_ptr<Input>>& Inputs() const {
-    return inputs_;
+    return CallerInputs();
   }
 
   // @return the outputs of the model.
@@ -550,6 +861,93 @@ public:
   // @return Error object indicating success or failure
   Error SetRunOptions(const Options& options);
 
+  // Prepare a template of the requests sent with 'options', to be
+  // used later with SetRunTemplate(). Changing 'options' afterward
+  // doesn't change the template.
+  // @param options - the options
+  // @param run_template - returns the template
+  // @return Error object indicating success or failure
+  Error PrepareRunTemplate(
+    const Options& options, std::shared_ptr<RunTemplate>* run_template);
+
+  // Use the options 'run_template' was prepared from for all
+  // subsequent Run() invocations, like SetRunOptions() but without
+  // encoding the request header again.
+  // @param run_template - the template, prepared by this context
+  // @return Error object indicating success or failure
+  Error SetRunTemplate(const std::shared_ptr<RunTemplate>& run_template);
+
+  // Enable or disable the thread-safe mode, in which Run() and
+  // AsyncRun() can be called by multiple threads at the same time.
+  // Each thread then sees its own set of Input objects, created on
+  // first use from the inputs as they were when the mode was enabled,
+  // so that the tensor values set by one thread are only used for its
+  // own requests. Output buffers set with SetOutputBuffer() are also
+  // per thread. Must be called before the context is shared.
+  // @param enable - true to enable the thread-safe mode
+  // @return Error object indicating success or failure
+  Error SetThreadSafeMode(bool enable);
+
+  // In thread-safe mode forget the Input objects and output buffers
+  // of the calling thread. A thread should call this when it stops
+  // using the shared context, otherwise they are kept until the mode
+  // is changed and a later thread that gets the same std::thread::id
+  // sees the old tensor values. Input objects the thread obtained
+  // before must not be used afterwards, requests already sent are not
+  // affected.
+  // @return Error object indicating success or failure
+  Error ReleaseThread();
+
+  // Have the RAW result of 'output' for the next Run() or AsyncRun()
+  // written directly to caller-owned memory instead of memory owned
+  // by the Result object. The binding only applies to that one
+  // request and is cleared by SetRunOptions(). 'buf' must stay valid
+  // as long as the results of the request are in use.
+  // @param output - the output, must be requested as a RAW result by
+  // the current options
+  // @param buf - the memory to write the result to
+  // @param byte_size - the size of 'buf', in bytes, must be able to
+  // hold the output for the current batch size
+  // @param dtype - the data type expected in 'buf', must be the data
+  // type of the output
+  // @return Error object indicating success or failure
+  Error SetOutputBuffer(
+    const std::shared_ptr<Output>& output, uint8_t* buf, size_t byte_size,
+    DataType dtype);
+
+  // Register 'byte_size' bytes at 'offset' of the POSIX shared memory
+  // object 'shm_key' as the region 'name', with both this context and
+  // the server. Inputs and outputs can then be passed through the
+  // region instead of with the requests and responses, see
+  // Input::SetSharedMemory() and Options::AddSharedMemoryResult().
+  // Only for a server on the same host. The object must exist and be
+  // large enough.
+  // @param name - the name to reference the region by
+  // @param shm_key - the key of the shared memory object, as given to
+  // shm_open()
+  // @param offset - the offset of the region in the object, in bytes
+  // @param byte_size - the size of the region, in bytes
+  // @return Error object indicating success or failure
+  Error RegisterSharedMemory(
+    const std::string& name, const std::string& shm_key, size_t offset,
+    size_t byte_size);
+
+  // Unregister the region 'name' with this context and the server. The
+  // results referencing the region stay valid but are no longer
+  // written to.
+  // @param name - the name of the region
+  // @return Error object indicating success or failure
+  Error UnregisterSharedMemory(const std::string& name);
+
+  // Get the memory of a registered region in this process, to write
+  // inputs to and read outputs from.
+  // @param name - the name of the region
+  // @param addr - returns the start of the region
+  // @param byte_size - returns the size of the region, in bytes
+  // @return Error object indicating success or failure
+  Error GetSharedMemory(
+    const std::string& name, uint8_t** addr, size_t* byte_size) const;
+
   // Get the current statistic of the InferContext. 
   // @parm stat - returns Stat objects holding InferContext statistic.
   // @return Error object indicating success or failure
@@ -573,6 +971,42 @@ public:
   virtual Error AsyncRun(
     std::shared_ptr<Request>* async_request) = 0;
 
+  // Function called when an asynchronous request sent with a callback
+  // completes.
+  // @param request - the completed request
+  // @param results - the Result objects holding the inference results
+  // of the request, the callee may take ownership of them.
+  // @param err - Error object indicating success or failure of the
+  // request
+  using OnCompleteFn = std::function<
+    void(
+      const std::shared_ptr<Request>& request,
+      std::vector<std::unique_ptr<Result>>* results, const Error& err)>;
+
+  // Function used to run completion callbacks, it is given a task
+  // that must be run exactly once.
+  using CallbackExecutor = std::function<void(std::function<void()> task)>;
+
+  // Send an asynchronous request to the inference server like
+  // AsyncRun() above, but instead of retrieving the results with
+  // GetAsyncRunResults(), 'callback' is invoked with them once the
+  // request completes. The callback is run by the executor set with
+  // SetCallbackExecutor() or, by default, directly on the thread
+  // performing the transfer, in which case it should return quickly.
+  // The request is never returned by GetReadyAsyncRequest(). Callbacks
+  // of requests still in flight when the context is destroyed are not
+  // invoked.
+  // @param callback - the function to invoke when the request completes
+  // @return Error object indicating success or failure
+  virtual Error AsyncRun(OnCompleteFn callback) = 0;
+
+  // Set the executor used to run completion callbacks from now on.
+  // The executor must run all tasks before the context is destroyed.
+  // @param executor - the executor, or nullptr to run the callbacks on
+  // the thread performing the transfer.
+  // @return Error object indicating success or failure
+  Error SetCallbackExecutor(const CallbackExecutor& executor);
+
   // Get the result of the asynchronous request referenced by 'async_request'.
   // The Result objects holding the output values are returned in the same order
   // as the outputs are specified in the options when AsyncRun() was called.
@@ -589,7 +1023,8 @@ public:
 
   // Get any one completed asynchronous request.
   // The Request object will contain the request that is completed
-  // and waiting to give the result.
+  // and waiting to give the result. A request is returned only once,
+  // also when called by multiple threads.
   // @param request - returns Request objects holding completed request.
   // @param wait - if true, block until one request completes. Otherwise, return
   // immediately.
@@ -605,9 +1040,46 @@ protected:
   // Function for worker thread to proceed the data transfer for all requests
   virtual void AsyncTransfer() = 0;
 
+  // Create the inputs and outputs of the model described by 'config'.
+  Error InitializeModel(const ModelConfig& config);
+
+  // Helper function called by PrepareRunTemplate() to add the settings
+  // specific to the protocol to 'run_template'.
+  virtual Error PrepareProtocolTemplate(RunTemplateImpl* run_template) = 0;
+
+  // Helper function to send 'control' to the server.
+  virtual Error SendSharedMemoryControl(
+    const SharedMemoryControl& control) = 0;
+
+  // Get the mapping of the region 'name' and check that 'byte_size'
+  // bytes at 'offset' are in the region.
+  Error GetSharedMemoryMapping(
+    const std::string& name, size_t offset, size_t byte_size,
+    std::shared_ptr<SharedMemoryMapping>* mapping) const;
+
+  // Check the shared memory used by 'inputs' and, if any of them is in
+  // shared memory, return in 'header' the request header of the
+  // current options with the shared memory references of the inputs.
+  // 'header' is left empty otherwise. Return in 'input_byte_size' the
+  // size of the inputs sent with the request.
+  Error SharedMemoryRequestHeader(
+    const std::vector<std::shared_ptr<Input>>& inputs,
+    std::unique_ptr<InferRequestHeader>* header,
+    uint64_t* input_byte_size) const;
+
+  // Have the results of 'request' for outputs requested in shared
+  // memory reference the shared memory.
+  Error BindSharedMemoryResults(const std::shared_ptr<Request>& request);
+
   // Helper function called before inference to prepare 'request'
   virtual Error PreRunProcessing(std::shared_ptr<Request>& request) = 0;
 
+  // Helper function to retrieve the results of 'request' once it has
+  // been completed and removed from 'ongoing_async_requests_'.
+  virtual Error FinishAsyncRequest(
+    const std::shared_ptr<Request>& request,
+    std::vector<std::unique_ptr<Result>>* results) = 0;
+
   // Helper function called by GetAsyncRunResults() to check if the request
   // is ready. If the request is valid and wait == true,
   // the function will block until request is ready.
@@ -617,12 +1089,57 @@ protected:
   // Update the context stat with the given timer
   Error UpdateStat(const RequestTimers& timer);
 
+  // Mark 'request' as ready and queue it for GetReadyAsyncRequest(),
+  // or for RunCompletionCallbacks() if it was sent with a callback.
+  // Must be called with 'mutex_' held.
+  void MarkRequestReady(std::shared_ptr<Request> request);
+
+  // Invoke the callbacks of the requests queued by MarkRequestReady().
+  // Must be called by the worker thread without 'mutex_' held.
+  void RunCompletionCallbacks();
+
+  // Invoke the callback of the completed 'request' with 'executor', or
+  // directly if 'executor' is not set. Doesn't need 'mutex_'.
+  void RunCompletionCallback(
+    const std::shared_ptr<Request>& request,
+    const std::shared_ptr<const CallbackExecutor>& executor);
+
+  // Bind the buffers set by SetOutputBuffer() to the results of
+  // 'request', which must have been initialized for the current
+  // options. The buffers are not used for any later request.
+  void BindOutputBuffers(const std::shared_ptr<Request>& request);
+
+  // @return the inputs to use for a request sent by the calling
+  // thread, 'inputs_' unless in thread-safe mode.
+  const std::vector<std::shared_ptr<Input>>& CallerInputs() const;
+
+  // @return the key of the calling thread in 'thread_inputs_' and
+  // 'output_buffers_'.
+  std::thread::id CallerKey() const;
+
+  // Start the worker thread running AsyncTransfer() if it is not
+  // running yet.
+  void StartWorker();
+
   using AsyncReqMap = std::map<uintptr_t, std::shared_ptr<Request>>;
 
   // map to record ongoing asynchronous requests with pointer to easy handle
   // as key
   AsyncReqMap ongoing_async_requests_;
 
+  // Requests in 'ongoing_async_requests_' that are ready and not yet
+  // returned by GetReadyAsyncRequest(), in the order they completed.
+  std::list<std::shared_ptr<Request>> ready_async_requests_;
+
+  // Requests sent with a callback that are ready, they are no longer
+  // in 'ongoing_async_requests_'.
+  std::vector<std::shared_ptr<Request>> callback_requests_;
+
+  // Executor for completion callbacks, if not set the callbacks are
+  // run by the worker thread. Accessed with std::atomic_load() and
+  // std::atomic_store() so that it can be read without 'mutex_'.
+  std::shared_ptr<const CallbackExecutor> callback_executor_;
+
   // Model name
   const std::string model_name_;
 
@@ -635,6 +1152,9 @@ protected:
   // Maximum batch size supported by this context.
   uint64_t max_batch_size_;
 
+  // Configuration of the model
+  ModelConfig config_;
+
   // Total size of all inputs, in bytes (must be 64-bit integer
   // because used with curl_easy_setopt).
   uint64_t total_input_byte_size_;
@@ -643,24 +1163,57 @@ protected:
   uint64_t batch_size_;
 
   // Use to assign unique identifier for each asynchronous request
-  uint64_t async_request_id_;
+  std::atomic<uint64_t> async_request_id_;
+
+  // Number of requests in 'ongoing_async_requests_' that are not ready,
+  // the worker thread only has work to do while there are some.
+  size_t pending_async_request_count_;
 
   // The inputs and outputs
   std::vector<std::shared_ptr<Input>> inputs_;
   std::vector<std::shared_ptr<Output>> outputs_;
 
-  // Settings generated by current option
+  // If true Run() and AsyncRun() may be called concurrently.
+  bool thread_safe_;
+
+  // The inputs of each thread in thread-safe mode, copied from
+  // 'inputs_' when the thread first accesses them and removed by
+  // ReleaseThread().
+  mutable std::map<std::thread::id, std::vector<std::shared_ptr<Input>>>
+    thread_inputs_;
+
+  // Settings generated by current option, including the
   // InferRequestHeader protobuf describing the request
-  InferRequestHeader infer_request_;
+  std::shared_ptr<const RunTemplateImpl> run_template_;
 
   // Outputs requested for inference request
   std::vector<std::shared_ptr<Output>> requested_outputs_;
 
-  //Standalone request context used for synchronous request
-  std::shared_ptr<Request> sync_request_;
-
-  // The statistic of the current context
-  Stat context_stat_;
+  // The shared memory regions registered with the context, by name.
+  // Guarded by 'shared_memory_mutex_' as requests look up their
+  // regions while others are registered. Registering and unregistering
+  // are serialized by 'shared_memory_control_mutex_', which is held
+  // while waiting for the server.
+  std::map<std::string, std::shared_ptr<SharedMemoryMapping>>
+    shared_memory_regions_;
+  mutable std::mutex shared_memory_mutex_;
+  std::mutex shared_memory_control_mutex_;
+
+  // Caller-owned memory to write the RAW result of an output to for
+  // the next request of a thread, see CallerKey().
+  std::map<std::thread::id, std::map<const Output*, uint8_t*>>
+    output_buffers_;
+
+  // The statistic of the current context, kept in atomics so that
+  // the threads completing requests update it without a lock.
+  // GetStat() reads the counters one at a time.
+  std::atomic<size_t> completed_request_count_;
+  std::atomic<uint64_t> cumulative_total_request_time_ns_;
+  std::atomic<uint64_t> cumulative_send_time_ns_;
+  std::atomic<uint64_t> cumulative_receive_time_ns_;
+  std::atomic<size_t> reused_connection_count_;
+  std::atomic<size_t> new_connection_count_;
+  LatencyHistogram request_time_histogram_;
 
   // worker thread that will perform the asynchronous transfer
   std::thread worker_;
@@ -668,13 +1221,150 @@ protected:
   // Avoid race condition between main thread and worker thread
   std::mutex mutex_;
 
-  // Condition variable used for waiting on asynchronous request
+  // Protect 'thread_inputs_' and 'output_buffers_'
+  mutable std::mutex thread_mutex_;
+
+  // Condition variable used by the worker thread for waiting on
+  // asynchronous request to be sent
   std::condition_variable cv_;
 
+  // Condition variable used for waiting on any asynchronous request
+  // to complete, a thread waiting on a specific request waits on the
+  // request's own condition instead
+  std::condition_variable ready_cv_;
+
   // signal for worker thread to stop
   bool exiting_;
 };
 
+//==============================================================================
+// InferBatcher
+//
+// An InferBatcher object combines single-sample requests submitted by
+// any number of threads into batched requests on one InferContext,
+// the same way the dynamic batcher of the inference server combines
+// the requests that reach it (see ModelDynamicBatching). A batch is
+// sent as soon as the largest preferred batch size of the model is
+// reached or once its oldest sample waited for the maximum queue delay
+// of the model. Models without dynamic batching configuration are
+// batched up to their maximum batch size with no delay, that is the
+// samples submitted while the previous batch is being sent are sent
+// together. Each sample gets the results of its own batch entry. For
+// example:
+//
+//   std::unique_ptr<InferContext> ctx;
+//   InferGrpcContext::Create(&ctx, "localhost:8001", "resnet50");
+//   std::unique_ptr<InferBatcher> batcher;
+//   InferBatcher::Create(&batcher, std::move(ctx));
+//   ...
+//   // On any thread
+//   std::vector<std::unique_ptr<InferContext::Result>> results;
+//   batcher->Run({ image_data }, &results);
+//
+// Thread-safety:
+//   All InferBatcher methods are thread-safe. The InferContext is
+//   owned by the batcher and must not be used by the caller anymore.
+//
+class InferBatcher {
+public:
+  ~InferBatcher();
+
+  // Function called when a sample completes with the results of its
+  // batch entry, the callee may take ownership of them.
+  using OnCompleteFn = std::function<
+    void(std::vector<std::unique_ptr<InferContext::Result>>* results,
+      const Error& err)>;
+
+  // Create a batcher sending batched requests with 'ctx'. All outputs
+  // of the model are requested as RAW results.
+  // @param batcher - returns the new InferBatcher object
+  // @param ctx - the context to use, the model must support batching
+  // @return Error object indicating success or failure.
+  static Error Create(
+    std::unique_ptr<InferBatcher>* batcher, std::unique_ptr<InferContext> ctx);
+
+  // @return the context used by the batcher, for read-only access such
+  // as Inputs(), Outputs() or GetStat().
+  const InferContext& Context() const { return *ctx_; }
+
+  // Submit one sample and wait for its results. The Result objects
+  // are in the same order as the outputs of the model and hold a
+  // batch of one.
+  // @param inputs - pointer to the tensor value of each input, in the
+  // same order as the inputs of the context, each of the size
+  // expected by the input. The values are not copied.
+  // @param results - returns Result objects holding inference results.
+  // @return Error object indicating success or failure
+  Error Run(
+    const std::vector<const uint8_t*>& inputs,
+    std::vector<std::unique_ptr<InferContext::Result>>* results);
+
+  // Submit one sample without waiting, 'callback' is invoked with its
+  // results once its batch completes. The tensor values must not be
+  // modified or destroyed until then.
+  // @param inputs - pointer to the tensor value of each input, see Run()
+  // @param callback - the function to invoke when the sample completes
+  // @return Error object indicating success or failure
+  Error AsyncRun(
+    const std::vector<const uint8_t*>& inputs, OnCompleteFn callback);
+
+private:
+  // A submitted sample waiting to be sent
+  struct Sample {
+    std::vector<const uint8_t*> inputs_;
+    OnCompleteFn callback_;
+    std::chrono::steady_clock::time_point submit_time_;
+  };
+
+  InferBatcher(std::unique_ptr<InferContext> ctx);
+
+  // Function for the batcher thread, sends the batches.
+  void Dispatch();
+
+  // Send 'samples' as one batched request.
+  void SendBatch(const std::shared_ptr<std::vector<Sample>>& samples);
+
+  // Invoke the callback of each of 'samples' with its slice of
+  // 'results', or with 'err' if the batch failed.
+  void CompleteBatch(
+    const std::vector<Sample>& samples,
+    std::vector<std::unique_ptr<InferContext::Result>>* results,
+    const Error& err);
+
+  // The context sending the batched requests, only used by the
+  // batcher thread apart from the request completions.
+  std::unique_ptr<InferContext> ctx_;
+
+  // Batch size at which a batch is sent without waiting.
+  size_t flush_batch_size_;
+
+  // Longest time a sample waits for more samples to be batched with.
+  std::chrono::microseconds max_queue_delay_;
+
+  // Batch size of the current options of 'ctx_'.
+  size_t ctx_batch_size_;
+
+  // Run templates of 'ctx_' indexed by batch size, prepared when the
+  // batch size is first sent.
+  std::vector<std::shared_ptr<InferContext::RunTemplate>> run_templates_;
+
+  // Samples waiting to be sent, oldest first.
+  std::vector<Sample> queue_;
+
+  // Number of batches sent and not completed yet.
+  size_t inflight_batch_count_;
+
+  // Thread sending the batches
+  std::thread dispatcher_;
+
+  // Protect 'queue_', 'inflight_batch_count_' and 'exiting_'
+  std::mutex mutex_;
+  std::condition_variable cv_;
+
+  // signal for the batcher thread to stop
+  bool exiting_;
+};
+
 //==============================================================================
 // ProfileContext
 //
@@ -726,7 +1416,8 @@ class ServerHealthHttpContext : public ServerHealthContext {
 public:
   // Create context that returns health information.
   // @param ctx - returns the new ServerHealthHttpContext object
-  // @param server_url - inference server name and port
+  // @param server_url - inference server name and port, or
+  // unix://<path> of a Unix domain socket
   // @param verbose - if true generate verbose output when contacting
   // the inference server
   // @return Error object indicating success or failure.
@@ -746,6 +1437,9 @@ private:
 
   // URL for health endpoint on inference server.
   const std::string url_;
+
+  // Unix domain socket to connect to, if not empty.
+  const std::string unix_socket_path_;
 };
 
 //==============================================================================
@@ -760,7 +1454,8 @@ public:
   // Create context that returns information about server and all
   // models on the server using HTTP protocol.
   // @param ctx - returns the new ServerStatusHttpContext object
-  // @param server_url - inference server name and port
+  // @param server_url - inference server name and port, or
+  // unix://<path> of a Unix domain socket
   // @param verbose - if true generate verbose output when contacting
   // the inference server
   // @return Error object indicating success or failure.
@@ -771,7 +1466,8 @@ public:
   // Create context that returns information about server and one
   // model using HTTP protocol.
   // @param ctx - returns the new ServerStatusHttpContext object
-  // @param server_url - inference server name and port
+  // @param server_url - inference server name and port, or
+  // unix://<path> of a Unix domain socket
   // @param model-name - get information for this model
   // @param verbose - if true generate verbose output when contacting
   // the inference server
@@ -796,6 +1492,9 @@ private:
   // URL for status endpoint on inference server.
   const std::string url_;
 
+  // Unix domain socket to connect to, if not empty.
+  const std::string unix_socket_path_;
+
   // RequestStatus received in server response
   RequestStatus request_status_;
 
@@ -816,7 +1515,8 @@ public:
 
   // Create context that performs inference for a model using HTTP protocol.
   // @param ctx - returns the new InferHttpContext object
-  // @param server_url - inference server name and port
+  // @param server_url - inference server name and port, or
+  // unix://<path> of a Unix domain socket
   // @param model_name - name of the model to use for inference
   // @param model_version - version of the model to use for inference,
   // or -1 to indicate that the latest (i.e. highest version number)
@@ -836,6 +1536,9 @@ public:
   Error AsyncRun(
     std::shared_ptr<Request>* async_request) override;
 
+  // @see InferContext.AsyncRun()
+  Error AsyncRun(OnCompleteFn callback) override;
+
   // @see InferContext.GetAsyncRunResults()
   Error GetAsyncRunResults(
     std::vector<std::unique_ptr<Result>>* results,
@@ -852,20 +1555,69 @@ private:
   // @see InferContext.AsyncTransfer()
   void AsyncTransfer() override;
 
+  // @see InferContext.PrepareProtocolTemplate()
+  Error PrepareProtocolTemplate(RunTemplateImpl* run_template) override;
+
+  // @see InferContext.SendSharedMemoryControl()
+  Error SendSharedMemoryControl(const SharedMemoryControl& control) override;
+
   // @see InferContext.PreRunProcessing()
   Error PreRunProcessing(std::shared_ptr<Request>& request) override;
 
-  // curl multi handle for processing asynchronous requests
+  // @see InferContext.FinishAsyncRequest()
+  Error FinishAsyncRequest(
+    const std::shared_ptr<Request>& request,
+    std::vector<std::unique_ptr<Result>>* results) override;
+
+  // Send an asynchronous request, invoking 'callback' on completion if
+  // set.
+  Error StartAsyncRun(
+    std::shared_ptr<Request>* async_request, OnCompleteFn callback);
+
+  // Get an idle easy handle from 'easy_handle_pool_', or create a new
+  // one if none is available.
+  CURL* AcquireEasyHandle();
+
+  // Reset 'easy_handle' and return it to 'easy_handle_pool_' so that
+  // a later request can reuse it.
+  void ReleaseEasyHandle(CURL* easy_handle);
+
+  // Record in the context stat whether the request transferred on
+  // 'easy_handle' reused an existing connection.
+  void UpdateConnectionStat(CURL* easy_handle);
+
+  // curl multi handle for processing asynchronous requests. Only the
+  // worker thread (see AsyncTransfer()) operates on the multi handle,
+  // other threads may only wake it up with curl_multi_wakeup().
   CURLM* multi_handle_;
 
+  // Easy handles of the requests issued by AsyncRun() that have not
+  // yet been added to 'multi_handle_' by the worker thread.
+  std::vector<CURL*> new_async_requests_;
+
   // URL to POST to
   std::string url_;
 
-  // Serialized InferRequestHeader
-  std::string infer_request_str_;
+  // Unix domain socket to connect to, if not empty.
+  const std::string unix_socket_path_;
+
+  // URL to send shared memory controls to
+  std::string shared_memory_url_;
+
+  // Easy handles not used by any asynchronous request. The pool grows
+  // to the number of requests in flight and the handles are reused, so
+  // that their connections are kept alive across requests.
+  std::vector<CURL*> easy_handle_pool_;
+
+  // Total number of easy handles created for asynchronous requests,
+  // used to size the connection cache of 'multi_handle_'.
+  size_t easy_handle_count_;
 
-  // Keep an easy handle alive to reuse the connection
-  CURL* curl_;
+  // Whether the InferRequestHeader is sent in binary, set once the
+  // server has replied with a binary status and cleared again by a
+  // reply with a text status. Until then it is sent in text format,
+  // which all servers accept.
+  std::atomic<bool> binary_headers_;
 };
 
 //==============================================================================
@@ -879,7 +1631,8 @@ class ProfileHttpContext : public ProfileContext {
 public:
   // Create context that controls profiling on a server using HTTP protocol.
   // @param ctx - returns the new ProfileContext object
-  // @param server_url - inference server name and port
+  // @param server_url - inference server name and port, or
+  // unix://<path> of a Unix domain socket
   // @param verbose - if true generate verbose output when contacting
   // the inference server
   // @return Error object indicating success or failure.
@@ -896,10 +1649,50 @@ private:
   // URL for status endpoint on inference server.
   const std::string url_;
 
+  // Unix domain socket to connect to, if not empty.
+  const std::string unix_socket_path_;
+
   // RequestStatus received in server response
   RequestStatus request_status_;
 };
 
+//==============================================================================
+// GrpcChannelPool
+//
+// The gRPC contexts get their channel from a process-wide pool that
+// holds up to a given number of channels for each server URL. Each
+// channel is created with distinct channel arguments so that it opens
+// its own connection to the server, letting the traffic of different
+// contexts use separate connections. A context keeps the channel it
+// is given for its lifetime, so the channel count and the selection
+// policy only affect contexts created after they are set. By default
+// there is one channel per URL.
+//
+// Thread-safety:
+//   All GrpcChannelPool methods are thread-safe.
+//
+class GrpcChannelPool {
+public:
+  // The policy for choosing a channel for a new context.
+  enum SelectionPolicy {
+    // Cycle through the channels of the URL.
+    ROUND_ROBIN,
+
+    // Choose the channel used by the fewest live contexts.
+    LEAST_LOAD
+  };
+
+  // Set the number of channels per URL.
+  // @param count - the number of channels, must be > 0
+  // @return Error object indicating success or failure
+  static Error SetChannelCount(size_t count);
+
+  // Set the policy for choosing a channel for a new context.
+  // @param policy - the selection policy
+  // @return Error object indicating success or failure
+  static Error SetSelectionPolicy(SelectionPolicy policy);
+};
+
 //==============================================================================
 // ServerHealthGrpcContext
 //
@@ -911,7 +1704,8 @@ class ServerHealthGrpcContext : public ServerHealthContext {
 public:
   // Create context that returns health information about server.
   // @param ctx - returns the new ServerHealthGrpcContext object
-  // @param server_url - inference server name and port
+  // @param server_url - inference server name and port, or
+  // unix:<path> of a Unix domain socket
   // @param verbose - if true generate verbose output when contacting
   // the inference server
   // @return Error object indicating success or failure.
@@ -945,7 +1739,8 @@ public:
   // Create context that returns information about server and all
   // models on the server using gRPC protocol.
   // @param ctx - returns the new ServerStatusGrpcContext object
-  // @param server_url - inference server name and port
+  // @param server_url - inference server name and port, or
+  // unix:<path> of a Unix domain socket
   // @param verbose - if true generate verbose output when contacting
   // the inference server
   // @return Error object indicating success or failure.
@@ -956,7 +1751,8 @@ public:
   // Create context that returns information about server and one
   // model using gRPC protocol.
   // @param ctx - returns the new ServerStatusGrpcContext object
-  // @param server_url - inference server name and port
+  // @param server_url - inference server name and port, or
+  // unix:<path> of a Unix domain socket
   // @param model-name - get information for this model
   // @param verbose - if true generate verbose output when contacting
   // the inference server
@@ -982,6 +1778,10 @@ private:
   std::unique_ptr<GRPCService::Stub> stub_;
 };
 
+// Memory reused by the requests of an InferGrpcContext.
+class GrpcRequestSlot;
+class GrpcRequestSlotPool;
+
 //==============================================================================
 // InferGrpcContext
 //
@@ -995,18 +1795,34 @@ public:
 
   // Create context that performs inference for a model using gRPC protocol.
   // @param ctx - returns the new InferContext object
-  // @param server_url - inference server name and port
+  // @param server_url - inference server name and port, or
+  // unix:<path> of a Unix domain socket
   // @param model_name - name of the model to use for inference
   // @param model_version - version of the model to use for inference,
   // or -1 to indicate that the latest (i.e. highest version number)
   // version should be used
   // @param verbose - if true generate verbose output when contacting
   // the inference server
+  // @param streaming - if true send the requests over a single
+  // StreamInfer stream, opened by the first request, instead of making
+  // a unary Infer call for each. The requests are pipelined on the
+  // stream and their responses matched by request id. If the stream
+  // fails, the requests in flight fail with its status and so do all
+  // later requests, a new context must be created to open a new
+  // stream.
+  // @param completion_queue_count - the number of completion queues,
+  // each with its own thread completing the asynchronous requests
+  // assigned to it. The requests are assigned round-robin. Ignored if
+  // 'streaming' is true.
+  // @param pin_pollers - if true pin the thread of the i-th completion
+  // queue to the i-th core (modulo the number of cores) of the CPU
+  // affinity mask of the thread sending the first request
   // @return Error object indicating success or failure.
   static Error Create(
     std::unique_ptr<InferContext>* ctx, const std::string& server_url,
     const std::string& model_name, int model_version = -1,
-    bool verbose = false);
+    bool verbose = false, bool streaming = false,
+    size_t completion_queue_count = 1, bool pin_pollers = false);
 
   // @see InferContext.Run()
   Error Run(std::vector<std::unique_ptr<Result>>* results) override;
@@ -1015,6 +1831,9 @@ public:
   Error AsyncRun(
     std::shared_ptr<Request>* async_request) override;
 
+  // @see InferContext.AsyncRun()
+  Error AsyncRun(OnCompleteFn callback) override;
+
   // @see InferContext.GetAsyncRunResults()
   Error GetAsyncRunResults(
     std::vector<std::unique_ptr<Result>>* results,
@@ -1022,28 +1841,111 @@ public:
 
 private:
   InferGrpcContext(
-    const std::string&, const std::string&, int, bool);
+    const std::string&, const std::string&, int, bool, bool, size_t, bool);
+
+  // Tags of the operations on the StreamInfer stream in the
+  // completion queue.
+  enum StreamTag : uintptr_t {
+    STREAM_START = 1, STREAM_READ, STREAM_WRITE, STREAM_FINISH
+  };
 
   // @see InferContext.AsyncTransfer()
   void AsyncTransfer() override;
 
+  // Function for the poller thread of the 'idx'-th completion queue to
+  // complete the unary requests assigned to it.
+  void Poll(size_t idx);
+
+  // Open the StreamInfer stream if it is not open yet and start the
+  // worker thread handling it.
+  Error OpenStream();
+
+  // Function for worker thread to handle the events of the stream
+  // until it is finished.
+  void StreamTransfer();
+
+  // Write the next queued request to the stream if no write is in
+  // progress. Must be called with 'mutex_' held.
+  void WriteNextStreamRequest();
+
+  // Complete the requests in flight on the stream once it has failed.
+  // Must be called with 'mutex_' held.
+  void FailStreamRequests();
+
+  // @see InferContext.PrepareProtocolTemplate()
+  Error PrepareProtocolTemplate(RunTemplateImpl* run_template) override;
+
+  // @see InferContext.SendSharedMemoryControl()
+  Error SendSharedMemoryControl(const SharedMemoryControl& control) override;
+
   // @see InferContext.PreRunProcessing()
   Error PreRunProcessing(std::shared_ptr<Request>& request) override;
 
-  // additional vector contains 1-indexed key to available slots
-  // in async request map.
-  std::vector<uintptr_t> reusable_slot_;
+  // @see InferContext.FinishAsyncRequest()
+  Error FinishAsyncRequest(
+    const std::shared_ptr<Request>& request,
+    std::vector<std::unique_ptr<Result>>* results) override;
+
+  // Get a request slot that is not in use, creating one if needed.
+  std::shared_ptr<GrpcRequestSlot> AcquireRequestSlot();
+
+  // Send an asynchronous request, invoking 'callback' on completion if
+  // set. If 'sync' is true the request is for Run(), which waits for
+  // it to become ready.
+  Error StartAsyncRun(
+    std::shared_ptr<Request>* async_request, OnCompleteFn callback,
+    bool sync = false);
 
   // The producer-consumer queue used to communicate asynchronously with
   // the gRPC runtime.
   grpc::CompletionQueue async_request_completion_queue_;
 
+  // Whether the requests are sent over the StreamInfer stream.
+  const bool streaming_;
+
+  // The completion queues of the asynchronous unary requests and their
+  // poller threads, started by the first request. The pollers complete
+  // requests sent with a callback without taking 'mutex_', these
+  // requests are not in 'ongoing_async_requests_'.
+  std::vector<std::unique_ptr<grpc::CompletionQueue>> completion_queues_;
+  std::vector<std::thread> pollers_;
+  std::once_flag pollers_started_;
+  std::atomic<size_t> next_completion_queue_;
+  const bool pin_pollers_;
+  std::atomic<bool> pollers_exiting_;
+
+  // The StreamInfer stream and its state, all guarded by 'mutex_'.
+  // The serialized requests wait in 'stream_write_queue_' as only one
+  // write can be in progress at a time, the front one is being written
+  // if 'stream_write_pending_'.
+  std::unique_ptr<grpc::ClientContext> stream_context_;
+  std::unique_ptr<grpc::GenericClientAsyncReaderWriter> stream_;
+  bool stream_started_;
+  bool stream_closed_;
+  bool stream_write_pending_;
+  std::deque<grpc::ByteBuffer> stream_write_queue_;
+  grpc::ByteBuffer stream_read_buffer_;
+  grpc::Status stream_status_;
+
+  // The status Finish() reports for the stream, it becomes
+  // 'stream_status_' unless the client already ended the stream with
+  // an error of its own.
+  grpc::Status stream_finish_status_;
+
+  // The request slots of the context. A slot is in use while its
+  // request or the results of the request refer to it.
+  std::shared_ptr<GrpcRequestSlotPool> request_slot_pool_;
+
+  // The channel from GrpcChannelPool shared by both end points.
+  std::shared_ptr<grpc::Channel> channel_;
+
   // gRPC end point.
   std::unique_ptr<GRPCService::Stub> stub_; 
 
-  // request for gRPC call, one request object can be used for multiple calls
-  // since it can be overwritten as soon as the gRPC send finishes.
-  InferRequest request_;
+  // Generic gRPC end point, Infer is called through it so that the
+  // request can be sent as a serialized buffer without being converted
+  // to an InferRequest message.
+  std::unique_ptr<grpc::GenericStub> generic_stub_;
 };
 
 //==============================================================================
@@ -1057,7 +1959,8 @@ class ProfileGrpcContext : public ProfileContext {
 public:
   // Create context that controls profiling on a server using gRPC protocol.
   // @param ctx - returns the new ProfileContext object
-  // @param server_url - inference server name and port
+  // @param server_url - inference server name and port, or
+  // unix:<path> of a Unix domain socket
   // @param verbose - if true generate verbose output when contacting
   // the inference server
   // @return Error object indicating success or failure.
@@ -0,0 +1,217 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark of the heap allocations made by the client per inference
+// with InferGrpcContext, for synchronous and asynchronous runs. The
+// gRPC stand-in server runs in a child process so that only the
+// allocations of the client are counted. Usage:
+// allocation_benchmark [<requests to measure>]
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <iostream>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/grpc_stand_in.h"
+#include "src/clients/c++/test/test_util.h"
+
+namespace nic = nvidia::inferenceserver::client;
+namespace nict = nvidia::inferenceserver::client::test;
+
+//==============================================================================
+// Count the calls to malloc(), calloc() and realloc(), which also serve
+// operator new, and the bytes they allocate.
+//
+namespace {
+
+std::atomic<size_t> alloc_count(0);
+std::atomic<size_t> alloc_bytes(0);
+
+} // namespace
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void*
+malloc(size_t size)
+{
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void*
+calloc(size_t count, size_t size)
+{
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  alloc_bytes.fetch_add(count * size, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void*
+realloc(void* ptr, size_t size)
+{
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+} // extern "C"
+
+namespace {
+
+const size_t kElements = 16;
+const size_t kBatchSize = 8;
+
+// Start the stand-in server in a child process.
+// @param url - returns the URL of the server
+// @param pipe_fd - returns the pipe to close to stop the server
+// @return the process ID of the child.
+pid_t
+StartServer(std::string* url, int* pipe_fd)
+{
+  int to_parent[2];
+  int to_child[2];
+  FAIL_UNLESS(
+    (pipe(to_parent) == 0) && (pipe(to_child) == 0), "unable to create pipe");
+
+  const pid_t pid = fork();
+  FAIL_UNLESS(pid != -1, "unable to fork");
+  if (pid == 0) {
+    close(to_parent[0]);
+    close(to_child[1]);
+    std::unique_ptr<nict::GrpcStandIn> server;
+    nict::StandInOptions options;
+    options.elements = kElements;
+    FAIL_IF_ERR(
+      nict::GrpcStandIn::Create(&server, options), "unable to start server");
+    const std::string server_url = server->Url() + "\n";
+    FAIL_UNLESS(
+      write(to_parent[1], server_url.data(), server_url.size()) ==
+        ssize_t(server_url.size()),
+      "unable to send URL");
+
+    // Serve until the parent closes the pipe.
+    char c;
+    while (read(to_child[0], &c, 1) > 0) {
+    }
+    server.reset();
+    _exit(0);
+  }
+
+  close(to_parent[1]);
+  close(to_child[0]);
+  char c;
+  while ((read(to_parent[0], &c, 1) == 1) && (c != '\n')) {
+    url->push_back(c);
+  }
+  close(to_parent[0]);
+  FAIL_UNLESS(!url->empty(), "server failed to start");
+
+  *pipe_fd = to_child[1];
+  return pid;
+}
+
+void
+Report(const char* mode, size_t count, size_t bytes, int runs)
+{
+  std::cout << mode << double(count) / runs << " allocations/inference, "
+            << double(bytes) / runs << " bytes/inference" << std::endl;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  const int count = (argc > 1) ? atoi(argv[1]) : 2000;
+  const int in_flight = 16;
+
+  std::string url;
+  int pipe_fd;
+  const pid_t pid = StartServer(&url, &pipe_fd);
+
+  std::unique_ptr<nic::InferContext> ctx;
+  FAIL_IF_ERR(
+    nic::InferGrpcContext::Create(&ctx, url, "m"),
+    "unable to create context");
+  FAIL_IF_ERR(
+    nict::SetRawRunOptions(ctx.get(), kBatchSize), "unable to set options");
+  const std::vector<float> batch(kElements * kBatchSize, 2.0f);
+  FAIL_IF_ERR(nict::SetInput(ctx.get(), batch), "set input");
+
+  // Warm up so that the request slots and the connection exist.
+  nict::Results results;
+  for (int i = 0; i < 100; i++) {
+    FAIL_IF_ERR(ctx->Run(&results), "warm-up run");
+  }
+
+  size_t start_count = alloc_count;
+  size_t start_bytes = alloc_bytes;
+  for (int i = 0; i < count; i++) {
+    FAIL_IF_ERR(ctx->Run(&results), "run");
+    FAIL_UNLESS(nict::OutputEquals(results, 0, batch), "wrong result");
+  }
+  Report(
+    "sync Run: ", alloc_count - start_count, alloc_bytes - start_bytes,
+    count);
+
+  std::vector<std::shared_ptr<nic::InferContext::Request>> requests(
+    in_flight);
+  const int rounds = count / in_flight;
+  for (int r = 0; r <= rounds; r++) {
+    if (r == 1) {
+      // The first round is the warm-up.
+      start_count = alloc_count;
+      start_bytes = alloc_bytes;
+    }
+    for (auto& request : requests) {
+      FAIL_IF_ERR(ctx->AsyncRun(&request), "async run");
+    }
+    for (auto& request : requests) {
+      FAIL_IF_ERR(
+        ctx->GetAsyncRunResults(&results, request, true), "async results");
+      FAIL_UNLESS(nict::OutputEquals(results, 0, batch), "wrong result");
+    }
+  }
+  Report(
+    "AsyncRun: ", alloc_count - start_count, alloc_bytes - start_bytes,
+    rounds * in_flight);
+
+  ctx.reset();
+  close(pipe_fd);
+  int status;
+  FAIL_UNLESS(
+    (waitpid(pid, &status, 0) == pid) && WIFEXITED(status) &&
+      (WEXITSTATUS(status) == 0),
+    "server failed");
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
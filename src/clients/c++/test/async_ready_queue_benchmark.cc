@@ -0,0 +1,109 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark of many asynchronous requests in flight on one
+// InferHttpContext, retrieved in completion order with
+// GetReadyAsyncRequest(), against the HTTP stand-in server with a delay
+// per inference. Reports the wall and CPU time of the process, stand-in
+// included, per round of requests. Usage:
+// async_ready_queue_benchmark [<requests in flight> [<rounds>]]
+
+#include <iostream>
+#include <set>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/http_stand_in.h"
+#include "src/clients/c++/test/test_util.h"
+
+namespace nic = nvidia::inferenceserver::client;
+namespace nict = nvidia::inferenceserver::client::test;
+
+int
+main(int argc, char** argv)
+{
+  const size_t in_flight = (argc > 1) ? atoi(argv[1]) : 512;
+  const int rounds = (argc > 2) ? atoi(argv[2]) : 5;
+
+  nict::StandInOptions options;
+  options.delay_us = 20000;
+  std::unique_ptr<nict::HttpStandIn> server;
+  FAIL_IF_ERR(
+    nict::HttpStandIn::Create(&server, options), "unable to start server");
+
+  std::unique_ptr<nic::InferContext> ctx;
+  FAIL_IF_ERR(
+    nic::InferHttpContext::Create(&ctx, server->Url(), "m"),
+    "unable to create context");
+  FAIL_IF_ERR(nict::SetRawRunOptions(ctx.get(), 4), "unable to set options");
+  std::vector<float> batch(4 * options.elements);
+  for (size_t i = 0; i < batch.size(); i++) {
+    batch[i] = i;
+  }
+  FAIL_IF_ERR(nict::SetInput(ctx.get(), batch), "set input");
+
+  // The first round opens the connections and is not measured.
+  uint64_t start_ns = 0;
+  uint64_t start_cpu_ns = 0;
+  for (int round = 0; round <= rounds; round++) {
+    if (round == 1) {
+      start_ns = nict::NowNs();
+      start_cpu_ns = nict::ProcessCpuNs();
+    }
+
+    std::set<std::shared_ptr<nic::InferContext::Request>> requests;
+    for (size_t i = 0; i < in_flight; i++) {
+      std::shared_ptr<nic::InferContext::Request> request;
+      FAIL_IF_ERR(ctx->AsyncRun(&request), "async run");
+      requests.insert(request);
+    }
+
+    // Each request is returned once, whichever order they complete in.
+    while (!requests.empty()) {
+      std::shared_ptr<nic::InferContext::Request> request;
+      FAIL_IF_ERR(ctx->GetReadyAsyncRequest(&request, true), "ready request");
+      FAIL_UNLESS(requests.erase(request) == 1, "unexpected ready request");
+      nict::Results results;
+      FAIL_IF_ERR(
+        ctx->GetAsyncRunResults(&results, request, true), "async results");
+      FAIL_UNLESS(nict::OutputEquals(results, 0, batch), "wrong result");
+    }
+  }
+  const uint64_t elapsed_ns = nict::NowNs() - start_ns;
+  const uint64_t cpu_ns = nict::ProcessCpuNs() - start_cpu_ns;
+
+  nic::InferContext::Stat stat;
+  FAIL_IF_ERR(ctx->GetStat(&stat), "get stat");
+  FAIL_UNLESS(
+    stat.completed_request_count == (rounds + 1) * in_flight,
+    "wrong number of completed requests");
+
+  std::cout << in_flight << " requests in flight: "
+            << (elapsed_ns / 1e6 / rounds) << " msec/round, process CPU "
+            << (cpu_ns / 1e6 / rounds) << " msec/round, "
+            << server->ConnectionCount() << " connections" << std::endl;
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
@@ -0,0 +1,176 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark of the asynchronous requests of InferGrpcContext completed
+// with callbacks over 1, 2 and 4 completion queues, with the poller
+// threads pinned and not, against the gRPC stand-in server. Also checks
+// the requests retrieved with GetReadyAsyncRequest(), a callback
+// executor and destroying the context with requests in flight.
+// Usage: completion_queue_benchmark [<requests>]
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/grpc_stand_in.h"
+#include "src/clients/c++/test/test_util.h"
+
+namespace nic = nvidia::inferenceserver::client;
+namespace nict = nvidia::inferenceserver::client::test;
+
+namespace {
+
+// The number of requests kept in flight with callbacks.
+const int kWindow = 64;
+
+void
+Benchmark(
+  const std::string& url, size_t queue_count, bool pin_pollers, int count)
+{
+  std::unique_ptr<nic::InferContext> ctx;
+  FAIL_IF_ERR(
+    nic::InferGrpcContext::Create(
+      &ctx, url, "m", -1, false, false, queue_count, pin_pollers),
+    "unable to create context");
+  FAIL_IF_ERR(nict::SetRawRunOptions(ctx.get(), 1), "unable to set options");
+  const std::vector<float> sample(16, 3.0f);
+  FAIL_IF_ERR(nict::SetInput(ctx.get(), sample), "set input");
+
+  // Requests retrieved once ready.
+  const int ready_count = 20;
+  for (int i = 0; i < ready_count; i++) {
+    std::shared_ptr<nic::InferContext::Request> request;
+    FAIL_IF_ERR(ctx->AsyncRun(&request), "async run");
+  }
+  for (int i = 0; i < ready_count; i++) {
+    std::shared_ptr<nic::InferContext::Request> request;
+    FAIL_IF_ERR(ctx->GetReadyAsyncRequest(&request, true), "ready request");
+    nict::Results results;
+    FAIL_IF_ERR(
+      ctx->GetAsyncRunResults(&results, request, true), "async results");
+    FAIL_UNLESS(nict::OutputEquals(results, 0, sample), "wrong result");
+  }
+  std::shared_ptr<nic::InferContext::Request> request;
+  FAIL_UNLESS(
+    !ctx->GetReadyAsyncRequest(&request, true).IsOk(),
+    "ready request returned with none in flight");
+
+  // Requests completed with callbacks, 'kWindow' at a time.
+  std::atomic<int> completed(0);
+  std::atomic<int> failed(0);
+  std::atomic<int> in_flight(0);
+  auto callback = [&](
+                    const std::shared_ptr<nic::InferContext::Request>& request,
+                    nict::Results* results, const nic::Error& err) {
+    if (!err.IsOk() || !nict::OutputEquals(*results, 0, sample)) {
+      failed++;
+    }
+    in_flight--;
+    completed++;
+  };
+
+  const uint64_t start_ns = nict::NowNs();
+  for (int i = 0; i < count; i++) {
+    while (in_flight >= kWindow) {
+      std::this_thread::yield();
+    }
+    in_flight++;
+    FAIL_IF_ERR(ctx->AsyncRun(callback), "async run");
+  }
+  while (completed < count) {
+    std::this_thread::yield();
+  }
+  const uint64_t elapsed_ns = nict::NowNs() - start_ns;
+  FAIL_UNLESS(failed == 0, "callback failed");
+
+  nic::InferContext::Stat stat;
+  FAIL_IF_ERR(ctx->GetStat(&stat), "get stat");
+  FAIL_UNLESS(
+    stat.completed_request_count == size_t(count + ready_count),
+    "wrong number of completed requests");
+
+  // Callbacks run by an executor.
+  std::atomic<int> executed(0);
+  FAIL_IF_ERR(
+    ctx->SetCallbackExecutor([&executed](std::function<void()> task) {
+      executed++;
+      task();
+    }),
+    "set executor");
+  completed = 0;
+  for (int i = 0; i < 10; i++) {
+    in_flight++;
+    FAIL_IF_ERR(ctx->AsyncRun(callback), "async run");
+  }
+  while (completed < 10) {
+    std::this_thread::yield();
+  }
+  FAIL_UNLESS(executed == 10, "callbacks not run by the executor");
+
+  // Destroying the context releases the requests in flight.
+  for (int i = 0; i < 50; i++) {
+    FAIL_IF_ERR(
+      ctx->AsyncRun(
+        [](const std::shared_ptr<nic::InferContext::Request>& request,
+           nict::Results* results, const nic::Error& err) {}),
+      "async run");
+  }
+  ctx.reset();
+
+  std::cout << queue_count << " queue(s), "
+            << (pin_pollers ? "pinned:   " : "unpinned: ")
+            << (count * 1e9 / elapsed_ns) << " callbacks/sec" << std::endl;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  const int count = (argc > 1) ? atoi(argv[1]) : 5000;
+
+  std::unique_ptr<nict::GrpcStandIn> server;
+  FAIL_IF_ERR(
+    nict::GrpcStandIn::Create(&server, nict::StandInOptions()),
+    "unable to start server");
+
+  std::unique_ptr<nic::InferContext> ctx;
+  FAIL_UNLESS(
+    !nic::InferGrpcContext::Create(
+       &ctx, server->Url(), "m", -1, false, false, 0)
+       .IsOk(),
+    "context created without completion queues");
+
+  std::cout << std::thread::hardware_concurrency() << " cores" << std::endl;
+  for (const size_t queue_count : {1, 2, 4}) {
+    for (const bool pin_pollers : {false, true}) {
+      Benchmark(server->Url(), queue_count, pin_pollers, count);
+    }
+  }
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
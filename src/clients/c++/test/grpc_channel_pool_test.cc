@@ -0,0 +1,153 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Test of GrpcChannelPool against the gRPC stand-in server: the
+// contexts for a URL open as many connections as the channel count,
+// with either selection policy. Also measures the throughput of
+// threads each with its own context for 1 and 4 channels. Usage:
+// grpc_channel_pool_test [<threads> [<requests/thread>]]
+
+#include <iostream>
+#include <thread>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/grpc_stand_in.h"
+#include "src/clients/c++/test/test_util.h"
+
+namespace nic = nvidia::inferenceserver::client;
+namespace nict = nvidia::inferenceserver::client::test;
+
+namespace {
+
+std::unique_ptr<nic::InferContext>
+CreateContext(const std::string& url)
+{
+  std::unique_ptr<nic::InferContext> ctx;
+  FAIL_IF_ERR(
+    nic::InferGrpcContext::Create(&ctx, url, "m"),
+    "unable to create context");
+  FAIL_IF_ERR(nict::SetRawRunOptions(ctx.get(), 1), "unable to set options");
+  return ctx;
+}
+
+// Run a request on each of 8 contexts and check the number of
+// connections they used.
+void
+TestConnections(
+  size_t channel_count, nic::GrpcChannelPool::SelectionPolicy policy)
+{
+  FAIL_IF_ERR(
+    nic::GrpcChannelPool::SetChannelCount(channel_count),
+    "set channel count");
+  FAIL_IF_ERR(
+    nic::GrpcChannelPool::SetSelectionPolicy(policy), "set policy");
+
+  // A new server has a URL of its own, so the pool creates new
+  // channels for it.
+  nict::StandInOptions options;
+  std::unique_ptr<nict::GrpcStandIn> server;
+  FAIL_IF_ERR(
+    nict::GrpcStandIn::Create(&server, options), "unable to start server");
+
+  std::vector<std::unique_ptr<nic::InferContext>> contexts;
+  const std::vector<float> sample(options.elements, 1.0f);
+  for (int i = 0; i < 8; i++) {
+    contexts.push_back(CreateContext(server->Url()));
+    FAIL_IF_ERR(nict::SetInput(contexts.back().get(), sample), "set input");
+    nict::Results results;
+    FAIL_IF_ERR(contexts.back()->Run(&results), "run");
+    FAIL_UNLESS(nict::OutputEquals(results, 0, sample), "wrong result");
+  }
+
+  FAIL_UNLESS(
+    server->ConnectionCount() == channel_count,
+    "wrong number of connections");
+}
+
+// Measure 'thread_count' threads each running 'count' synchronous
+// requests on its own context.
+void
+MeasureThroughput(size_t channel_count, size_t thread_count, int count)
+{
+  FAIL_IF_ERR(
+    nic::GrpcChannelPool::SetChannelCount(channel_count),
+    "set channel count");
+  FAIL_IF_ERR(
+    nic::GrpcChannelPool::SetSelectionPolicy(
+      nic::GrpcChannelPool::LEAST_LOAD),
+    "set policy");
+
+  nict::StandInOptions options;
+  std::unique_ptr<nict::GrpcStandIn> server;
+  FAIL_IF_ERR(
+    nict::GrpcStandIn::Create(&server, options), "unable to start server");
+
+  std::vector<std::unique_ptr<nic::InferContext>> contexts;
+  for (size_t t = 0; t < thread_count; t++) {
+    contexts.push_back(CreateContext(server->Url()));
+  }
+
+  const std::vector<float> sample(options.elements, 1.0f);
+  const uint64_t start_ns = nict::NowNs();
+  std::vector<std::thread> threads;
+  for (auto& ctx : contexts) {
+    nic::InferContext* context = ctx.get();
+    threads.emplace_back([context, &sample, count] {
+      FAIL_IF_ERR(nict::SetInput(context, sample), "set input");
+      nict::Results results;
+      for (int i = 0; i < count; i++) {
+        FAIL_IF_ERR(context->Run(&results), "run");
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const uint64_t elapsed_ns = nict::NowNs() - start_ns;
+
+  std::cout << channel_count << " channel(s), " << thread_count
+            << " threads: " << (thread_count * count * 1e9 / elapsed_ns)
+            << " infer/sec over " << server->ConnectionCount()
+            << " connection(s)" << std::endl;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  const size_t thread_count = (argc > 1) ? atoi(argv[1]) : 16;
+  const int count = (argc > 2) ? atoi(argv[2]) : 500;
+
+  TestConnections(1, nic::GrpcChannelPool::LEAST_LOAD);
+  TestConnections(4, nic::GrpcChannelPool::ROUND_ROBIN);
+  TestConnections(4, nic::GrpcChannelPool::LEAST_LOAD);
+
+  MeasureThroughput(1, thread_count, count);
+  MeasureThroughput(4, thread_count, count);
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
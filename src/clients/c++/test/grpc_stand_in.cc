@@ -0,0 +1,386 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "src/clients/c++/test/grpc_stand_in.h"
+
+#include <grpcpp/impl/codegen/proto_utils.h>
+#include <chrono>
+#include <deque>
+#include "src/core/grpc_service.pb.h"
+
+namespace nvidia { namespace inferenceserver { namespace client {
+namespace test {
+
+namespace {
+
+const std::string kStatusMethod("/nvidia.inferenceserver.GRPCService/Status");
+const std::string kInferMethod("/nvidia.inferenceserver.GRPCService/Infer");
+const std::string kStreamInferMethod(
+  "/nvidia.inferenceserver.GRPCService/StreamInfer");
+const std::string kSharedMemoryControlMethod(
+  "/nvidia.inferenceserver.GRPCService/SharedMemoryControl");
+
+template <typename T>
+grpc::ByteBuffer
+Serialize(const T& message)
+{
+  grpc::ByteBuffer buffer;
+  bool own_buffer;
+  grpc::SerializationTraits<T>::Serialize(message, &buffer, &own_buffer);
+  return buffer;
+}
+
+} // namespace
+
+//==============================================================================
+
+// A call from the time it is requested from the server until it is
+// finished. Only the thread of the server touches it.
+struct GrpcStandIn::Call {
+  enum State { WAIT_CALL, READ, FINISH };
+
+  Call() : stream_(&context_), state_(WAIT_CALL), read_pending_(true),
+           writing_(false), read_done_(false), write_failed_(false)
+  {
+    read_tag_.call_ = this;
+    read_tag_.write_ = false;
+    write_tag_.call_ = this;
+    write_tag_.write_ = true;
+  }
+
+  grpc::GenericServerContext context_;
+  grpc::GenericServerAsyncReaderWriter stream_;
+  grpc::ByteBuffer request_;
+  State state_;
+
+  // The tags of the call, the write tag is used for the responses of
+  // a StreamInfer stream and the read tag for all else. An operation
+  // with the read tag is in progress if 'read_pending_'.
+  Tag read_tag_;
+  Tag write_tag_;
+  bool read_pending_;
+
+  // StreamInfer only. The responses waiting to be written, the front
+  // one is being written if 'writing_'. 'held_' is the response held
+  // back to reorder the responses.
+  std::deque<grpc::ByteBuffer> write_queue_;
+  std::unique_ptr<grpc::ByteBuffer> held_;
+  bool writing_;
+  bool read_done_;
+  bool write_failed_;
+};
+
+Error
+GrpcStandIn::Create(
+  std::unique_ptr<GrpcStandIn>* server, const StandInOptions& options)
+{
+  std::unique_ptr<GrpcStandIn> stand_in(new GrpcStandIn(options));
+
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort(
+    "127.0.0.1:0", grpc::InsecureServerCredentials(), &stand_in->port_);
+  if (!options.unix_socket_path.empty()) {
+    builder.AddListeningPort(
+      "unix:" + options.unix_socket_path, grpc::InsecureServerCredentials());
+  }
+  builder.RegisterAsyncGenericService(&stand_in->service_);
+  stand_in->cq_ = builder.AddCompletionQueue();
+  stand_in->server_ = builder.BuildAndStart();
+  if ((stand_in->server_ == nullptr) || (stand_in->port_ == 0)) {
+    return Error(
+      RequestStatusCode::INTERNAL, "failed to start gRPC stand-in server");
+  }
+
+  stand_in->RequestCall();
+  GrpcStandIn* raw = stand_in.get();
+  stand_in->worker_ = std::thread([raw] { raw->Serve(); });
+
+  *server = std::move(stand_in);
+  return Error::Success;
+}
+
+GrpcStandIn::GrpcStandIn(const StandInOptions& options)
+    : model_(options), reorder_(false), garble_(false),
+      stream_request_count_(0), connection_count_(0), port_(0),
+      shutting_down_(false)
+{
+}
+
+GrpcStandIn::~GrpcStandIn()
+{
+  Shutdown();
+}
+
+void
+GrpcStandIn::Shutdown()
+{
+  std::call_once(shutdown_, [this] {
+    // No operation may start once the completion queue is shut down,
+    // from here on the worker only collects the cancelled operations.
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutting_down_ = true;
+    }
+    if (server_ != nullptr) {
+      server_->Shutdown(std::chrono::system_clock::now());
+    }
+    if (cq_ != nullptr) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cq_->Shutdown();
+    }
+    if (worker_.joinable()) {
+      worker_.join();
+    }
+  });
+}
+
+void
+GrpcStandIn::RequestCall()
+{
+  Call* call = new Call();
+  service_.RequestCall(
+    &call->context_, &call->stream_, cq_.get(), cq_.get(), &call->read_tag_);
+}
+
+void
+GrpcStandIn::Serve()
+{
+  void* tag;
+  bool ok;
+  while (cq_->Next(&tag, &ok)) {
+    Tag* call_tag = static_cast<Tag*>(tag);
+    Call* call = call_tag->call_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (call_tag->write_) {
+      call->writing_ = false;
+    } else {
+      call->read_pending_ = false;
+    }
+
+    if (shutting_down_) {
+      if (!call->read_pending_ && !call->writing_) {
+        delete call;
+      }
+    } else if (call_tag->write_) {
+      OnWriteDone(call, ok);
+    } else {
+      OnEvent(call, ok);
+    }
+  }
+}
+
+void
+GrpcStandIn::OnEvent(Call* call, bool ok)
+{
+  switch (call->state_) {
+    case Call::WAIT_CALL:
+      if (!ok) {
+        // The server is shutting down.
+        delete call;
+        return;
+      }
+      RequestCall();
+      if (peers_.insert(call->context_.peer()).second) {
+        connection_count_++;
+      }
+      call->state_ = Call::READ;
+      call->read_pending_ = true;
+      call->stream_.Read(&call->request_, &call->read_tag_);
+      return;
+
+    case Call::READ:
+      if (call->context_.method() == kStreamInferMethod) {
+        OnStreamRequest(call, ok);
+        return;
+      }
+      if (!ok) {
+        delete call;
+        return;
+      }
+      break;
+
+    case Call::FINISH:
+      delete call;
+      return;
+  }
+
+  const std::string& method = call->context_.method();
+  call->state_ = Call::FINISH;
+  call->read_pending_ = true;
+  if (method == kInferMethod) {
+    call->stream_.WriteAndFinish(
+      Infer(&call->request_), grpc::WriteOptions(), grpc::Status::OK,
+      &call->read_tag_);
+  } else if (method == kStatusMethod) {
+    StatusRequest request;
+    grpc::SerializationTraits<StatusRequest>::Deserialize(
+      &call->request_, &request);
+    StatusResponse response;
+    ServerStatus* server_status = response.mutable_server_status();
+    server_status->set_id("stand-in");
+    server_status->set_ready_state(ServerReadyState::SERVER_READY);
+    if (request.model_name().empty() ||
+        (request.model_name() == model_.Name())) {
+      model_.GetStatus(
+        &(*server_status->mutable_model_status())[model_.Name()]);
+      response.mutable_request_status()->set_code(
+        RequestStatusCode::SUCCESS);
+    } else {
+      response.mutable_request_status()->set_code(
+        RequestStatusCode::NOT_FOUND);
+      response.mutable_request_status()->set_msg(
+        "no model \"" + request.model_name() + "\"");
+    }
+    call->stream_.WriteAndFinish(
+      Serialize(response), grpc::WriteOptions(), grpc::Status::OK,
+      &call->read_tag_);
+  } else if (method == kSharedMemoryControlMethod) {
+    SharedMemoryControlRequest request;
+    grpc::SerializationTraits<SharedMemoryControlRequest>::Deserialize(
+      &call->request_, &request);
+    SharedMemoryControlResponse response;
+    model_.ControlSharedMemory(
+      request.control(), response.mutable_request_status());
+    call->stream_.WriteAndFinish(
+      Serialize(response), grpc::WriteOptions(), grpc::Status::OK,
+      &call->read_tag_);
+  } else {
+    call->stream_.Finish(
+      grpc::Status(grpc::StatusCode::UNIMPLEMENTED, method),
+      &call->read_tag_);
+  }
+}
+
+void
+GrpcStandIn::OnStreamRequest(Call* call, bool ok)
+{
+  if (!ok) {
+    // The client has closed its side of the stream, write out the
+    // response held back, if any, before finishing.
+    call->read_done_ = true;
+    if (call->held_ != nullptr) {
+      call->write_queue_.push_back(*call->held_);
+      call->held_.reset();
+    }
+    if (call->write_failed_) {
+      call->write_queue_.clear();
+    }
+    if (!call->writing_) {
+      if (call->write_queue_.empty()) {
+        FinishStream(call);
+      } else {
+        call->writing_ = true;
+        call->stream_.Write(call->write_queue_.front(), &call->write_tag_);
+      }
+    }
+    return;
+  }
+
+  stream_request_count_++;
+  grpc::ByteBuffer response = Infer(&call->request_);
+  if (garble_) {
+    grpc::Slice slice(std::string("\xff\xff\xff\xff"));
+    response = grpc::ByteBuffer(&slice, 1);
+  }
+
+  if (!call->write_failed_) {
+    if (reorder_ && (call->held_ == nullptr)) {
+      call->held_.reset(new grpc::ByteBuffer(response));
+    } else {
+      call->write_queue_.push_back(response);
+      if (call->held_ != nullptr) {
+        call->write_queue_.push_back(*call->held_);
+        call->held_.reset();
+      }
+    }
+    if (!call->writing_ && !call->write_queue_.empty()) {
+      call->writing_ = true;
+      call->stream_.Write(call->write_queue_.front(), &call->write_tag_);
+    }
+  }
+
+  call->read_pending_ = true;
+  call->stream_.Read(&call->request_, &call->read_tag_);
+}
+
+void
+GrpcStandIn::OnWriteDone(Call* call, bool ok)
+{
+  call->write_queue_.pop_front();
+  if (!ok) {
+    // The stream is broken, the pending read fails too and finishes the
+    // stream unless it has failed already.
+    call->write_failed_ = true;
+    call->write_queue_.clear();
+  }
+
+  if (!call->write_queue_.empty()) {
+    call->writing_ = true;
+    call->stream_.Write(call->write_queue_.front(), &call->write_tag_);
+  } else if (call->read_done_) {
+    FinishStream(call);
+  }
+}
+
+void
+GrpcStandIn::FinishStream(Call* call)
+{
+  call->state_ = Call::FINISH;
+  call->read_pending_ = true;
+  call->stream_.Finish(grpc::Status::OK, &call->read_tag_);
+}
+
+grpc::ByteBuffer
+GrpcStandIn::Infer(grpc::ByteBuffer* request_buffer)
+{
+  InferRequest request;
+  grpc::SerializationTraits<InferRequest>::Deserialize(
+    request_buffer, &request);
+
+  InferResponse response;
+  response.set_id(request.id());
+  RequestStatus* status = response.mutable_request_status();
+  if (request.raw_input_size() != 1) {
+    status->set_code(RequestStatusCode::INVALID_ARG);
+    status->set_msg(
+      "expected 1 raw input, got " +
+      std::to_string(request.raw_input_size()));
+    return Serialize(response);
+  }
+
+  std::vector<std::string> raw_outputs;
+  model_.Infer(
+    request.meta_data(), request.raw_input(0), response.mutable_meta_data(),
+    &raw_outputs, status);
+  for (auto& raw_output : raw_outputs) {
+    response.add_raw_output()->swap(raw_output);
+  }
+
+  return Serialize(response);
+}
+
+}}}} // namespace nvidia::inferenceserver::client::test
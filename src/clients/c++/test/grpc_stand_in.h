@@ -0,0 +1,132 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <grpc++/grpc++.h>
+#include <grpc++/generic/async_generic_service.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/stand_in.h"
+
+namespace nvidia { namespace inferenceserver { namespace client {
+namespace test {
+
+//==============================================================================
+// GrpcStandIn
+//
+// A stand-in for the gRPC end point of the inference server, serving
+// the StandInModel on an ephemeral port of the TCP loopback address.
+// It handles the Status, Infer, StreamInfer and SharedMemoryControl
+// calls. The calls are handled one at a time by a single thread, so
+// inferences with a delay are always serialized.
+//
+class GrpcStandIn {
+public:
+  // Create and start a stand-in server.
+  // @param server - returns the new server
+  // @param options - the options of the server and its model
+  // @return Error object indicating success or failure.
+  static Error Create(
+    std::unique_ptr<GrpcStandIn>* server, const StandInOptions& options);
+
+  // Shut the server down, if not already.
+  ~GrpcStandIn();
+
+  // @return the URL of the server, for InferGrpcContext::Create().
+  std::string Url() const { return "127.0.0.1:" + std::to_string(port_); }
+
+  // @return the model of the server.
+  StandInModel& Model() { return model_; }
+
+  // Hold each odd response of a StreamInfer stream back until the
+  // next response is written, so the responses come out of order.
+  // @param reorder - whether the responses are reordered
+  void SetReorderStreamResponses(bool reorder) { reorder_ = reorder; }
+
+  // Replace the responses of StreamInfer streams by bytes that are
+  // not an InferResponse message.
+  // @param garble - whether the responses are replaced
+  void SetGarbleStreamResponses(bool garble) { garble_ = garble; }
+
+  // @return the number of requests received on StreamInfer streams.
+  size_t StreamRequestCount() const { return stream_request_count_; }
+
+  // @return the number of connections calls were received on, told
+  // apart by the address of the client.
+  size_t ConnectionCount() const { return connection_count_; }
+
+  // Shut the server down immediately, calls in progress are cancelled.
+  void Shutdown();
+
+private:
+  struct Call;
+  struct Tag {
+    Call* call_;
+    bool write_;
+  };
+
+  explicit GrpcStandIn(const StandInOptions& options);
+
+  void RequestCall();
+  void Serve();
+
+  // Handle the completion of an operation of 'call', with 'mutex_'
+  // held.
+  void OnEvent(Call* call, bool ok);
+  void OnWriteDone(Call* call, bool ok);
+  void OnStreamRequest(Call* call, bool ok);
+  void FinishStream(Call* call);
+  grpc::ByteBuffer Infer(grpc::ByteBuffer* request);
+
+  StandInModel model_;
+  std::atomic<bool> reorder_;
+  std::atomic<bool> garble_;
+  std::atomic<size_t> stream_request_count_;
+  std::atomic<size_t> connection_count_;
+
+  int port_;
+  grpc::AsyncGenericService service_;
+  std::unique_ptr<grpc::ServerCompletionQueue> cq_;
+  std::unique_ptr<grpc::Server> server_;
+  std::thread worker_;
+  std::once_flag shutdown_;
+
+  // Held by the worker while it handles an event, so that no operation
+  // starts after 'shutting_down_' is set.
+  std::mutex mutex_;
+  bool shutting_down_;
+
+  // The addresses of the clients calls were received from. Only used
+  // by the worker.
+  std::set<std::string> peers_;
+};
+
+}}}} // namespace nvidia::inferenceserver::client::test
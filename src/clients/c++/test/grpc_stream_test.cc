@@ -0,0 +1,295 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Test of the StreamInfer mode of InferGrpcContext against the gRPC
+// stand-in server, and a comparison of its latency and throughput with
+// the unary Infer mode. Usage: grpc_stream_test [<requests to measure>]
+
+#include <unistd.h>
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <thread>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/grpc_stand_in.h"
+#include "src/clients/c++/test/test_util.h"
+
+namespace nic = nvidia::inferenceserver::client;
+namespace nict = nvidia::inferenceserver::client::test;
+
+namespace {
+
+const size_t kElements = 16;
+
+std::unique_ptr<nic::InferContext>
+CreateContext(const std::string& url, bool streaming)
+{
+  std::unique_ptr<nic::InferContext> ctx;
+  FAIL_IF_ERR(
+    nic::InferGrpcContext::Create(&ctx, url, "m", -1, false, streaming),
+    "unable to create context");
+  FAIL_IF_ERR(nict::SetRawRunOptions(ctx.get(), 1), "unable to set options");
+  return ctx;
+}
+
+std::vector<float>
+Sample(float first)
+{
+  std::vector<float> sample(kElements, 0.0f);
+  sample[0] = first;
+  return sample;
+}
+
+// Pipeline requests with synchronous, asynchronous and callback runs
+// while the server answers out of order.
+void
+TestOutOfOrderResponses(nict::GrpcStandIn* server)
+{
+  server->SetReorderStreamResponses(true);
+  std::unique_ptr<nic::InferContext> ctx = CreateContext(server->Url(), true);
+  nict::Results results;
+
+  // The server holds the response to the asynchronous request back
+  // until the synchronous one is answered.
+  for (int i = 0; i < 10; i++) {
+    const std::vector<float> async_sample = Sample(i);
+    FAIL_IF_ERR(nict::SetInput(ctx.get(), async_sample), "set input");
+    std::shared_ptr<nic::InferContext::Request> request;
+    FAIL_IF_ERR(ctx->AsyncRun(&request), "async run");
+
+    const std::vector<float> sync_sample = Sample(1000 + i);
+    FAIL_IF_ERR(nict::SetInput(ctx.get(), sync_sample), "set input");
+    FAIL_IF_ERR(ctx->Run(&results), "sync run");
+    FAIL_UNLESS(
+      nict::OutputEquals(results, 0, sync_sample), "wrong sync result");
+
+    FAIL_IF_ERR(
+      ctx->GetAsyncRunResults(&results, request, true), "async results");
+    FAIL_UNLESS(
+      nict::OutputEquals(results, 0, async_sample), "wrong async result");
+  }
+
+  std::vector<std::vector<float>> samples;
+  for (int i = 0; i < 200; i++) {
+    samples.push_back(Sample(i));
+  }
+  std::vector<std::shared_ptr<nic::InferContext::Request>> requests;
+  for (const auto& sample : samples) {
+    FAIL_IF_ERR(nict::SetInput(ctx.get(), sample), "set input");
+    std::shared_ptr<nic::InferContext::Request> request;
+    FAIL_IF_ERR(ctx->AsyncRun(&request), "async run");
+    requests.push_back(request);
+  }
+  for (size_t i = 0; i < requests.size(); i++) {
+    FAIL_IF_ERR(
+      ctx->GetAsyncRunResults(&results, requests[i], true), "async results");
+    FAIL_UNLESS(
+      nict::OutputEquals(results, 0, samples[i]), "wrong async result");
+  }
+
+  std::atomic<int> callbacks(0);
+  std::atomic<int> failures(0);
+  for (int i = 0; i < 100; i++) {
+    FAIL_IF_ERR(nict::SetInput(ctx.get(), samples[i]), "set input");
+    const std::vector<float>* expected = &samples[i];
+    FAIL_IF_ERR(
+      ctx->AsyncRun([&callbacks, &failures, expected](
+                      const std::shared_ptr<nic::InferContext::Request>&,
+                      nict::Results* results, const nic::Error& err) {
+        if (!err.IsOk() || !nict::OutputEquals(*results, 0, *expected)) {
+          failures++;
+        }
+        callbacks++;
+      }),
+      "async run with callback");
+  }
+  while (callbacks < 100) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  FAIL_UNLESS(failures == 0, "wrong callback result");
+
+  nic::InferContext::Stat stat;
+  FAIL_IF_ERR(ctx->GetStat(&stat), "get stat");
+  FAIL_UNLESS(stat.completed_request_count == 320, "wrong request count");
+
+  // Destroy the context while the server holds a response back.
+  std::shared_ptr<nic::InferContext::Request> request;
+  FAIL_IF_ERR(ctx->AsyncRun(&request), "async run");
+  ctx.reset();
+  server->SetReorderStreamResponses(false);
+
+  std::cout << "out of order responses: ok" << std::endl;
+}
+
+// Run synchronous requests from several threads sharing a thread-safe
+// context. The responses are in order, as with reordering the last
+// request of a thread could wait forever for a next one.
+void
+TestThreadSafe(nict::GrpcStandIn* server)
+{
+  std::unique_ptr<nic::InferContext> ctx = CreateContext(server->Url(), true);
+  FAIL_IF_ERR(ctx->SetThreadSafeMode(true), "set thread-safe mode");
+
+  std::atomic<int> failures(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&ctx, &failures, t] {
+      nict::Results results;
+      for (int i = 0; i < 50; i++) {
+        const std::vector<float> sample = Sample(t * 1000 + i);
+        if (!nict::SetInput(ctx.get(), sample).IsOk() ||
+            !ctx->Run(&results).IsOk() ||
+            !nict::OutputEquals(results, 0, sample)) {
+          failures++;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  FAIL_UNLESS(failures == 0, "wrong threaded result");
+
+  std::cout << "thread-safe stream: ok" << std::endl;
+}
+
+// A response that does not parse fails the requests in flight and
+// ends the stream.
+void
+TestUnparsableResponse()
+{
+  std::unique_ptr<nict::GrpcStandIn> server;
+  FAIL_IF_ERR(
+    nict::GrpcStandIn::Create(&server, nict::StandInOptions()),
+    "unable to start server");
+  server->SetGarbleStreamResponses(true);
+
+  std::unique_ptr<nic::InferContext> ctx = CreateContext(server->Url(), true);
+  const std::vector<float> sample = Sample(1);
+  FAIL_IF_ERR(nict::SetInput(ctx.get(), sample), "set input");
+
+  std::shared_ptr<nic::InferContext::Request> request;
+  FAIL_IF_ERR(ctx->AsyncRun(&request), "async run");
+  nict::Results results;
+  FAIL_UNLESS(!ctx->Run(&results).IsOk(), "sync run should fail");
+  FAIL_UNLESS(
+    !ctx->GetAsyncRunResults(&results, request, true).IsOk(),
+    "async run should fail");
+  FAIL_UNLESS(!ctx->Run(&results).IsOk(), "closed stream should fail");
+
+  std::cout << "unparsable response: ok" << std::endl;
+}
+
+// Requests fail once the server is gone.
+void
+TestServerShutdown()
+{
+  std::unique_ptr<nict::GrpcStandIn> server;
+  FAIL_IF_ERR(
+    nict::GrpcStandIn::Create(&server, nict::StandInOptions()),
+    "unable to start server");
+
+  std::unique_ptr<nic::InferContext> ctx = CreateContext(server->Url(), true);
+  const std::vector<float> sample = Sample(1);
+  FAIL_IF_ERR(nict::SetInput(ctx.get(), sample), "set input");
+  nict::Results results;
+  FAIL_IF_ERR(ctx->Run(&results), "sync run");
+
+  server->Shutdown();
+  FAIL_UNLESS(!ctx->Run(&results).IsOk(), "run should fail after shutdown");
+  FAIL_UNLESS(!ctx->Run(&results).IsOk(), "run should keep failing");
+
+  std::cout << "server shutdown: ok" << std::endl;
+}
+
+// Measure the latency of synchronous requests and the throughput with
+// 32 asynchronous requests in flight, over a stream and unary calls.
+void
+CompareStreamingAndUnary(nict::GrpcStandIn* server, int count)
+{
+  for (int streaming = 0; streaming < 2; streaming++) {
+    std::unique_ptr<nic::InferContext> ctx =
+      CreateContext(server->Url(), streaming != 0);
+    const std::vector<float> sample = Sample(1);
+    FAIL_IF_ERR(nict::SetInput(ctx.get(), sample), "set input");
+    nict::Results results;
+    FAIL_IF_ERR(ctx->Run(&results), "warm-up run");
+
+    uint64_t start_ns = nict::NowNs();
+    for (int i = 0; i < count; i++) {
+      FAIL_IF_ERR(ctx->Run(&results), "sync run");
+    }
+    const uint64_t sync_ns = nict::NowNs() - start_ns;
+
+    start_ns = nict::NowNs();
+    std::deque<std::shared_ptr<nic::InferContext::Request>> in_flight;
+    for (int i = 0; i < count; i++) {
+      std::shared_ptr<nic::InferContext::Request> request;
+      FAIL_IF_ERR(ctx->AsyncRun(&request), "async run");
+      in_flight.push_back(request);
+      if (in_flight.size() >= 32) {
+        FAIL_IF_ERR(
+          ctx->GetAsyncRunResults(&results, in_flight.front(), true),
+          "async results");
+        in_flight.pop_front();
+      }
+    }
+    while (!in_flight.empty()) {
+      FAIL_IF_ERR(
+        ctx->GetAsyncRunResults(&results, in_flight.front(), true),
+        "async results");
+      in_flight.pop_front();
+    }
+    const uint64_t async_ns = nict::NowNs() - start_ns;
+
+    std::cout << (streaming ? "stream: " : "unary:  ") << "sync "
+              << (sync_ns / 1000.0 / count) << " usec/request, async "
+              << (count * 1e9 / async_ns) << " requests/sec" << std::endl;
+  }
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  const int count = (argc > 1) ? atoi(argv[1]) : 2000;
+
+  std::unique_ptr<nict::GrpcStandIn> server;
+  FAIL_IF_ERR(
+    nict::GrpcStandIn::Create(&server, nict::StandInOptions()),
+    "unable to start server");
+
+  TestOutOfOrderResponses(server.get());
+  TestThreadSafe(server.get());
+  TestUnparsableResponse();
+  TestServerShutdown();
+  CompareStreamingAndUnary(server.get(), count);
+
+  server.reset();
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
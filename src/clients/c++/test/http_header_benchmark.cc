@@ -0,0 +1,137 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark of the text and binary NV-InferRequest and NV-Status
+// headers against the HTTP stand-in server, for models with 1, 16 and
+// 64 outputs. Also checks that errors come through the binary status
+// and that the client falls back to text headers when the server stops
+// accepting binary ones. Usage: http_header_benchmark [<requests>]
+
+#include <iostream>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/http_stand_in.h"
+#include "src/clients/c++/test/test_util.h"
+
+namespace ni = nvidia::inferenceserver;
+namespace nic = nvidia::inferenceserver::client;
+namespace nict = nvidia::inferenceserver::client::test;
+
+namespace {
+
+void
+Benchmark(bool binary, size_t outputs, int count)
+{
+  nict::StandInOptions options;
+  options.elements = 1;
+  options.outputs = outputs;
+  std::unique_ptr<nict::HttpStandIn> server;
+  FAIL_IF_ERR(
+    nict::HttpStandIn::Create(&server, options), "unable to start server");
+  server->SetAcceptBinaryHeaders(binary);
+
+  std::unique_ptr<nic::InferContext> ctx;
+  FAIL_IF_ERR(
+    nic::InferHttpContext::Create(&ctx, server->Url(), "m"),
+    "unable to create context");
+  FAIL_IF_ERR(nict::SetRawRunOptions(ctx.get(), 2), "set options");
+
+  // Warm up, the first response tells the client if the server accepts
+  // binary headers.
+  const int warm_up = 10;
+  std::vector<float> batch(2);
+  nict::Results results;
+  uint64_t start_ns = 0;
+  uint64_t start_cpu_ns = 0;
+  for (int i = 0; i < count + warm_up; i++) {
+    if (i == warm_up) {
+      start_ns = nict::NowNs();
+      start_cpu_ns = nict::ThreadCpuNs();
+    }
+    batch[0] = i;
+    batch[1] = -i;
+    FAIL_IF_ERR(nict::SetInput(ctx.get(), batch), "set input");
+    FAIL_IF_ERR(ctx->Run(&results), "run");
+    FAIL_UNLESS(results.size() == outputs, "wrong number of results");
+    for (size_t o = 0; o < outputs; o++) {
+      FAIL_UNLESS(nict::OutputEquals(results, o, batch), "wrong result");
+    }
+  }
+  const uint64_t elapsed_ns = nict::NowNs() - start_ns;
+  const uint64_t cpu_ns = nict::ThreadCpuNs() - start_cpu_ns;
+
+  FAIL_UNLESS(
+    binary ? (server->BinaryRequestCount() >= size_t(count)) :
+             (server->BinaryRequestCount() == 0),
+    "wrong header encoding");
+
+  // A failed request reports the status of the server.
+  server->Model().SetFailInferences(true);
+  nic::Error err = ctx->Run(&results);
+  FAIL_UNLESS(
+    !err.IsOk() && (err.Code() == ni::RequestStatusCode::INTERNAL),
+    "expected the error of the server");
+  server->Model().SetFailInferences(false);
+
+  std::cout << (binary ? "binary" : "text  ") << " headers, " << outputs
+            << " outputs: " << (elapsed_ns / 1000.0 / count)
+            << " usec/request, client thread CPU "
+            << (cpu_ns / 1000.0 / count) << " usec/request";
+  if (!binary) {
+    std::cout << ", text request header " << server->LastTextHeaderSize()
+              << " bytes";
+  }
+  std::cout << std::endl;
+
+  if (binary) {
+    // The server replies with the text status from now on, the request
+    // it cannot read fails and the following ones are sent in text.
+    server->SetAcceptBinaryHeaders(false);
+    ctx->Run(&results);
+    const size_t binary_count = server->BinaryRequestCount();
+    FAIL_IF_ERR(ctx->Run(&results), "run after fallback");
+    FAIL_UNLESS(
+      nict::OutputEquals(results, 0, batch), "wrong result after fallback");
+    FAIL_UNLESS(
+      server->BinaryRequestCount() == binary_count,
+      "binary header sent after fallback");
+  }
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  const int count = (argc > 1) ? atoi(argv[1]) : 2000;
+
+  for (const size_t outputs : {1, 16, 64}) {
+    Benchmark(false, outputs, count);
+    Benchmark(true, outputs, count);
+  }
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
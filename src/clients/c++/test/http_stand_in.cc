@@ -0,0 +1,467 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "src/clients/c++/test/http_stand_in.h"
+
+#include <arpa/inet.h>
+#include <google/protobuf/text_format.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include "src/core/constants.h"
+
+namespace nvidia { namespace inferenceserver { namespace client {
+namespace test {
+
+namespace {
+
+const char kBase64Chars[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string
+Base64Encode(const std::string& data)
+{
+  std::string encoded;
+  uint32_t bits = 0;
+  int bit_count = 0;
+  for (const unsigned char c : data) {
+    bits = (bits << 8) | c;
+    bit_count += 8;
+    while (bit_count >= 6) {
+      bit_count -= 6;
+      encoded.push_back(kBase64Chars[(bits >> bit_count) & 0x3f]);
+    }
+  }
+  if (bit_count > 0) {
+    encoded.push_back(kBase64Chars[(bits << (6 - bit_count)) & 0x3f]);
+  }
+  while ((encoded.size() % 4) != 0) {
+    encoded.push_back('=');
+  }
+
+  return encoded;
+}
+
+bool
+Base64Decode(const std::string& encoded, std::string* data)
+{
+  data->clear();
+  uint32_t bits = 0;
+  int bit_count = 0;
+  for (const char c : encoded) {
+    if ((c == '=') || (c == ' ')) {
+      continue;
+    }
+    const char* pos = strchr(kBase64Chars, c);
+    if ((pos == nullptr) || (c == '\0')) {
+      return false;
+    }
+    bits = (bits << 6) | (pos - kBase64Chars);
+    bit_count += 6;
+    if (bit_count >= 8) {
+      bit_count -= 8;
+      data->push_back(static_cast<char>((bits >> bit_count) & 0xff));
+    }
+  }
+
+  return true;
+}
+
+// Read from 'fd' into 'buffer' until it holds at least 'size' bytes.
+bool
+Fill(int fd, std::string* buffer, size_t size)
+{
+  char chunk[64 * 1024];
+  while (buffer->size() < size) {
+    const ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buffer->append(chunk, n);
+  }
+
+  return true;
+}
+
+// Read a CRLF terminated line from 'fd', 'buffer' holds what has been
+// read from 'fd' but not consumed yet.
+bool
+ReadLine(int fd, std::string* buffer, std::string* line)
+{
+  size_t end;
+  while ((end = buffer->find("\r\n")) == std::string::npos) {
+    if (!Fill(fd, buffer, buffer->size() + 1)) {
+      return false;
+    }
+  }
+
+  line->assign(*buffer, 0, end);
+  buffer->erase(0, end + 2);
+  return true;
+}
+
+bool
+WriteAll(int fd, const std::string& data)
+{
+  size_t offset = 0;
+  while (offset < data.size()) {
+    const ssize_t n =
+      send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    offset += n;
+  }
+
+  return true;
+}
+
+} // namespace
+
+//==============================================================================
+
+Error
+HttpStandIn::Create(
+  std::unique_ptr<HttpStandIn>* server, const StandInOptions& options)
+{
+  std::unique_ptr<HttpStandIn> stand_in(new HttpStandIn(options));
+
+  Error err = stand_in->Listen(AF_INET);
+  if (err.IsOk() && !options.unix_socket_path.empty()) {
+    err = stand_in->Listen(AF_UNIX);
+  }
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  HttpStandIn* raw = stand_in.get();
+  for (const int fd : stand_in->listen_fds_) {
+    stand_in->accept_threads_.emplace_back([raw, fd] { raw->Accept(fd); });
+  }
+
+  *server = std::move(stand_in);
+  return Error::Success;
+}
+
+HttpStandIn::HttpStandIn(const StandInOptions& options)
+    : model_(options), accept_binary_(true), connection_count_(0),
+      binary_request_count_(0), last_text_header_size_(0), port_(0),
+      exiting_(false)
+{
+}
+
+HttpStandIn::~HttpStandIn()
+{
+  Shutdown();
+}
+
+Error
+HttpStandIn::Listen(int domain)
+{
+  const int fd = socket(domain, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return Error(
+      RequestStatusCode::INTERNAL,
+      "failed to create socket: " + std::string(strerror(errno)));
+  }
+  listen_fds_.push_back(fd);
+
+  int rc;
+  if (domain == AF_INET) {
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    rc = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    if (rc == 0) {
+      socklen_t len = sizeof(addr);
+      rc = getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+      port_ = ntohs(addr.sin_port);
+    }
+  } else {
+    const std::string& path = model_.Options().unix_socket_path;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+      return Error(
+        RequestStatusCode::INVALID_ARG, "socket path too long: " + path);
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    rc = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+  }
+
+  if ((rc != 0) || (listen(fd, 512) != 0)) {
+    return Error(
+      RequestStatusCode::INTERNAL,
+      "failed to listen: " + std::string(strerror(errno)));
+  }
+
+  return Error::Success;
+}
+
+void
+HttpStandIn::Shutdown()
+{
+  std::call_once(shutdown_, [this] {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      exiting_ = true;
+      for (const int fd : connection_fds_) {
+        shutdown(fd, SHUT_RDWR);
+      }
+    }
+
+    for (const int fd : listen_fds_) {
+      shutdown(fd, SHUT_RDWR);
+      close(fd);
+    }
+    for (auto& thread : accept_threads_) {
+      thread.join();
+    }
+
+    // No connection is accepted any more.
+    for (auto& thread : connection_threads_) {
+      thread.join();
+    }
+
+    if (!model_.Options().unix_socket_path.empty()) {
+      unlink(model_.Options().unix_socket_path.c_str());
+    }
+  });
+}
+
+void
+HttpStandIn::Accept(int listen_fd)
+{
+  while (true) {
+    const int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (exiting_) {
+      close(fd);
+      return;
+    }
+    connection_count_++;
+    connection_fds_.insert(fd);
+    connection_threads_.emplace_back([this, fd] { Serve(fd); });
+  }
+}
+
+void
+HttpStandIn::Serve(int fd)
+{
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  std::string buffer;
+  HttpRequest request;
+  while (ReadRequest(fd, &buffer, &request)) {
+    RequestStatus status;
+    std::string body;
+    if (request.path_.compare(0, 11, "/api/infer/") == 0) {
+      HandleInfer(request, &status, &body);
+    } else if (request.path_.compare(0, 11, "/api/status") == 0) {
+      HandleStatus(&status, &body);
+    } else if (request.path_.compare(0, 11, "/api/health") == 0) {
+      status.set_code(RequestStatusCode::SUCCESS);
+    } else if (request.path_.compare(0, 17, "/api/sharedmemory") == 0) {
+      HandleSharedMemory(request, &status);
+    } else {
+      status.set_code(RequestStatusCode::NOT_FOUND);
+      status.set_msg("unknown endpoint " + request.path_);
+    }
+
+    std::string status_header;
+    if (request.accept_binary_status_ && accept_binary_) {
+      status_header = std::string(kStatusBinaryHTTPHeader) + ": " +
+                      Base64Encode(status.SerializeAsString());
+    } else {
+      status_header =
+        std::string(kStatusHTTPHeader) + ": " + status.ShortDebugString();
+    }
+
+    const bool success = (status.code() == RequestStatusCode::SUCCESS);
+    const std::string response =
+      std::string(success ? "HTTP/1.1 200 OK" : "HTTP/1.1 400 Bad Request") +
+      "\r\n" + status_header + "\r\nContent-Length: " +
+      std::to_string(body.size()) + "\r\n\r\n" + body;
+    if (!WriteAll(fd, response)) {
+      break;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  connection_fds_.erase(fd);
+  close(fd);
+}
+
+bool
+HttpStandIn::ReadRequest(int fd, std::string* buffer, HttpRequest* request)
+{
+  std::string line;
+  if (!ReadLine(fd, buffer, &line)) {
+    return false;
+  }
+
+  // <method> <path> HTTP/1.1
+  const size_t path_start = line.find(' ');
+  const size_t path_end = line.find(' ', path_start + 1);
+  if ((path_start == std::string::npos) || (path_end == std::string::npos)) {
+    return false;
+  }
+  request->path_ = line.substr(path_start + 1, path_end - path_start - 1);
+  request->infer_header_.clear();
+  request->binary_infer_header_.clear();
+  request->shared_memory_control_.clear();
+  request->accept_binary_status_ = false;
+
+  size_t content_length = 0;
+  while (true) {
+    if (!ReadLine(fd, buffer, &line)) {
+      return false;
+    }
+    if (line.empty()) {
+      break;
+    }
+
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    const std::string name = line.substr(0, colon);
+    const size_t value_start = line.find_first_not_of(' ', colon + 1);
+    const std::string value = (value_start == std::string::npos) ?
+                                std::string() :
+                                line.substr(value_start);
+    if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+      content_length = std::stoul(value);
+    } else if (strcasecmp(name.c_str(), kInferRequestHTTPHeader) == 0) {
+      request->infer_header_ = value;
+    } else if (
+      strcasecmp(name.c_str(), kInferRequestBinaryHTTPHeader) == 0) {
+      request->binary_infer_header_ = value;
+    } else if (
+      strcasecmp(name.c_str(), kSharedMemoryControlHTTPHeader) == 0) {
+      request->shared_memory_control_ = value;
+    } else if (strcasecmp(name.c_str(), kHeaderEncodingHTTPHeader) == 0) {
+      request->accept_binary_status_ = (value == kBinaryHeaderEncoding);
+    }
+  }
+
+  if (!Fill(fd, buffer, content_length)) {
+    return false;
+  }
+  request->body_.assign(*buffer, 0, content_length);
+  buffer->erase(0, content_length);
+  return true;
+}
+
+void
+HttpStandIn::HandleStatus(RequestStatus* status, std::string* body)
+{
+  ServerStatus server_status;
+  server_status.set_id("stand-in");
+  server_status.set_ready_state(ServerReadyState::SERVER_READY);
+  model_.GetStatus(&(*server_status.mutable_model_status())[model_.Name()]);
+  server_status.SerializeToString(body);
+  status->set_code(RequestStatusCode::SUCCESS);
+}
+
+void
+HttpStandIn::HandleInfer(
+  const HttpRequest& request, RequestStatus* status, std::string* body)
+{
+  InferRequestHeader header;
+  bool parsed;
+  if (!request.binary_infer_header_.empty()) {
+    binary_request_count_++;
+  }
+  if (!request.binary_infer_header_.empty() && accept_binary_) {
+    std::string bytes;
+    parsed = Base64Decode(request.binary_infer_header_, &bytes) &&
+             header.ParseFromString(bytes);
+  } else {
+    last_text_header_size_ = request.infer_header_.size();
+    parsed = google::protobuf::TextFormat::ParseFromString(
+      request.infer_header_, &header);
+  }
+  if (!parsed) {
+    status->set_code(RequestStatusCode::INVALID_ARG);
+    status->set_msg("failed to parse the request header");
+    return;
+  }
+
+  InferResponseHeader response;
+  std::vector<std::string> raw_outputs;
+  model_.Infer(header, request.body_, &response, &raw_outputs, status);
+  if (status->code() != RequestStatusCode::SUCCESS) {
+    return;
+  }
+
+  for (const auto& raw_output : raw_outputs) {
+    body->append(raw_output);
+  }
+  body->append(response.SerializeAsString());
+}
+
+void
+HttpStandIn::HandleSharedMemory(
+  const HttpRequest& request, RequestStatus* status)
+{
+  SharedMemoryControl control;
+  if (!google::protobuf::TextFormat::ParseFromString(
+        request.shared_memory_control_, &control)) {
+    status->set_code(RequestStatusCode::INVALID_ARG);
+    status->set_msg("failed to parse the shared memory control header");
+    return;
+  }
+
+  model_.ControlSharedMemory(control, status);
+}
+
+}}}} // namespace nvidia::inferenceserver::client::test
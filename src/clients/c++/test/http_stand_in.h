@@ -0,0 +1,126 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/stand_in.h"
+
+namespace nvidia { namespace inferenceserver { namespace client {
+namespace test {
+
+//==============================================================================
+// HttpStandIn
+//
+// A stand-in for the HTTP end point of the inference server, serving
+// the StandInModel on an ephemeral port of the TCP loopback address.
+// It handles the status, infer and shared memory requests, with the
+// request and status headers in text or binary. Each connection is
+// served by its own thread.
+//
+class HttpStandIn {
+public:
+  // Create and start a stand-in server.
+  // @param server - returns the new server
+  // @param options - the options of the server and its model
+  // @return Error object indicating success or failure.
+  static Error Create(
+    std::unique_ptr<HttpStandIn>* server, const StandInOptions& options);
+
+  // Shut the server down, if not already.
+  ~HttpStandIn();
+
+  // @return the URL of the server, for InferHttpContext::Create().
+  std::string Url() const { return "127.0.0.1:" + std::to_string(port_); }
+
+  // @return the model of the server.
+  StandInModel& Model() { return model_; }
+
+  // Accept the binary request and status headers or not, as a server
+  // that predates them. Accepted by default.
+  // @param accept - whether binary headers are accepted
+  void SetAcceptBinaryHeaders(bool accept) { accept_binary_ = accept; }
+
+  // @return the number of connections accepted.
+  size_t ConnectionCount() const { return connection_count_; }
+
+  // @return the number of infer requests received with a binary
+  // request header, accepted or not.
+  size_t BinaryRequestCount() const { return binary_request_count_; }
+
+  // @return the size of the last text request header received.
+  size_t LastTextHeaderSize() const { return last_text_header_size_; }
+
+  // Shut the server down, closing all connections.
+  void Shutdown();
+
+private:
+  // An HTTP request, as far as the stand-in reads it.
+  struct HttpRequest {
+    std::string path_;
+    std::string infer_header_;
+    std::string binary_infer_header_;
+    std::string shared_memory_control_;
+    bool accept_binary_status_;
+    std::string body_;
+  };
+
+  explicit HttpStandIn(const StandInOptions& options);
+
+  Error Listen(int domain);
+  void Accept(int fd);
+  void Serve(int fd);
+  bool ReadRequest(int fd, std::string* buffer, HttpRequest* request);
+  void HandleStatus(RequestStatus* status, std::string* body);
+  void HandleInfer(
+    const HttpRequest& request, RequestStatus* status, std::string* body);
+  void HandleSharedMemory(const HttpRequest& request, RequestStatus* status);
+
+  StandInModel model_;
+  std::atomic<bool> accept_binary_;
+  std::atomic<size_t> connection_count_;
+  std::atomic<size_t> binary_request_count_;
+  std::atomic<size_t> last_text_header_size_;
+
+  int port_;
+  std::vector<int> listen_fds_;
+  std::vector<std::thread> accept_threads_;
+  std::once_flag shutdown_;
+
+  // The connections and their threads.
+  std::mutex mutex_;
+  bool exiting_;
+  std::set<int> connection_fds_;
+  std::vector<std::thread> connection_threads_;
+};
+
+}}}} // namespace nvidia::inferenceserver::client::test
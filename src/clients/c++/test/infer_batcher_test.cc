@@ -0,0 +1,180 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Test of InferBatcher against the HTTP and gRPC stand-in servers, with
+// and without a dynamic batching configuration of the model. Threads
+// submit single samples with Run() and check that each gets the result
+// of its own sample, then samples are submitted with AsyncRun() and the
+// batcher is destroyed with them in flight. Reports the number of
+// requests the server received and their average batch size. Usage:
+// infer_batcher_test [<threads> [<samples/thread>]]
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/grpc_stand_in.h"
+#include "src/clients/c++/test/http_stand_in.h"
+#include "src/clients/c++/test/test_util.h"
+
+namespace nic = nvidia::inferenceserver::client;
+namespace nict = nvidia::inferenceserver::client::test;
+
+namespace {
+
+const size_t kElements = 16;
+
+void
+Test(
+  bool grpc, const std::vector<int>& preferred_batch_sizes,
+  uint64_t max_queue_delay_us, uint64_t delay_us, size_t thread_count,
+  int count)
+{
+  nict::StandInOptions options;
+  options.elements = kElements;
+  options.preferred_batch_sizes = preferred_batch_sizes;
+  options.max_queue_delay_us = max_queue_delay_us;
+  options.delay_us = delay_us;
+
+  std::unique_ptr<nict::HttpStandIn> http_server;
+  std::unique_ptr<nict::GrpcStandIn> grpc_server;
+  std::unique_ptr<nic::InferContext> ctx;
+  nict::StandInModel* model;
+  if (grpc) {
+    FAIL_IF_ERR(
+      nict::GrpcStandIn::Create(&grpc_server, options),
+      "unable to start server");
+    FAIL_IF_ERR(
+      nic::InferGrpcContext::Create(&ctx, grpc_server->Url(), "m"),
+      "unable to create context");
+    model = &grpc_server->Model();
+  } else {
+    FAIL_IF_ERR(
+      nict::HttpStandIn::Create(&http_server, options),
+      "unable to start server");
+    FAIL_IF_ERR(
+      nic::InferHttpContext::Create(&ctx, http_server->Url(), "m"),
+      "unable to create context");
+    model = &http_server->Model();
+  }
+
+  std::unique_ptr<nic::InferBatcher> batcher;
+  FAIL_IF_ERR(
+    nic::InferBatcher::Create(&batcher, std::move(ctx)),
+    "unable to create batcher");
+  nict::Results results;
+  FAIL_UNLESS(
+    !batcher->Run(std::vector<const uint8_t*>(), &results).IsOk(),
+    "sample without inputs accepted");
+
+  const uint64_t start_ns = nict::NowNs();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back([&batcher, t, count] {
+      std::vector<float> sample(kElements);
+      for (int i = 0; i < count; i++) {
+        for (size_t e = 0; e < kElements; e++) {
+          sample[e] = t * 100000 + i * 100 + e;
+        }
+        nict::Results results;
+        FAIL_IF_ERR(
+          batcher->Run(
+            {reinterpret_cast<const uint8_t*>(&sample[0])}, &results),
+          "run");
+        FAIL_UNLESS(nict::OutputEquals(results, 0, sample), "wrong result");
+
+        // The results hold the batch entry of the sample only.
+        const uint8_t* buf;
+        size_t byte_size;
+        FAIL_UNLESS(
+          !results[0]->GetRaw(1, &buf, &byte_size).IsOk(),
+          "result of another batch entry returned");
+        float value;
+        FAIL_IF_ERR(results[0]->GetRawAtCursor(0, &value), "get value");
+        FAIL_UNLESS(value == sample[0], "wrong value at cursor");
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const uint64_t elapsed_ns = nict::NowNs() - start_ns;
+  const size_t requests = model->InferCount();
+  const size_t samples = model->SampleCount();
+  FAIL_UNLESS(
+    samples == thread_count * count, "wrong number of samples served");
+
+  // Destroying the batcher waits for the samples in flight.
+  const std::vector<float> sample(kElements, 7.0f);
+  std::atomic<int> completed(0);
+  std::atomic<int> failed(0);
+  for (int i = 0; i < 100; i++) {
+    FAIL_IF_ERR(
+      batcher->AsyncRun(
+        {reinterpret_cast<const uint8_t*>(&sample[0])},
+        [&](nict::Results* results, const nic::Error& err) {
+          if (!err.IsOk() || !nict::OutputEquals(*results, 0, sample)) {
+            failed++;
+          }
+          completed++;
+        }),
+      "async run");
+  }
+  batcher.reset();
+  FAIL_UNLESS(completed == 100, "samples in flight not completed");
+  FAIL_UNLESS(failed == 0, "samples in flight failed");
+
+  std::cout << (grpc ? "grpc" : "http");
+  if (preferred_batch_sizes.empty()) {
+    std::cout << " without dynamic batching";
+  } else {
+    std::cout << " preferred batch size";
+    for (const int size : preferred_batch_sizes) {
+      std::cout << " " << size;
+    }
+    std::cout << ", queue delay " << max_queue_delay_us << " usec";
+  }
+  std::cout << ": " << samples << " samples in " << (elapsed_ns / 1e6)
+            << " msec, " << requests << " requests, average batch "
+            << (double(samples) / requests) << std::endl;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  const size_t thread_count = (argc > 1) ? atoi(argv[1]) : 32;
+  const int count = (argc > 2) ? atoi(argv[2]) : 100;
+
+  Test(false, {}, 0, 1000, thread_count, count);
+  Test(false, {8, 16}, 500, 1000, thread_count, count);
+  Test(true, {}, 0, 0, thread_count, count);
+  Test(true, {8}, 200, 0, thread_count, count);
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
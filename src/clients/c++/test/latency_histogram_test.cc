@@ -0,0 +1,180 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// Test of LatencyHistogram. Lognormal latencies are recorded from
+// several threads into one histogram, and its count, mean and
+// percentiles are checked against the exact values of the sorted
+// samples. Merge and Subtract are checked to give the histogram of the
+// values recorded in between. Reports the largest relative error of the
+// percentiles. Usage: latency_histogram_test [<samples>]
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <thread>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/test_util.h"
+
+namespace nic = nvidia::inferenceserver::client;
+
+namespace {
+
+const size_t kThreads = 4;
+
+// @return the value at 'percentile' of the sorted 'values', the lowest
+// value that 'percentile' percent of the values are at or below.
+uint64_t
+ExactPercentile(const std::vector<uint64_t>& values, double percentile)
+{
+  size_t rank = std::ceil(percentile / 100 * values.size());
+  rank = std::max<size_t>(rank, 1);
+  return values[rank - 1];
+}
+
+// @return the relative error of 'value' against 'exact'.
+double
+RelativeError(uint64_t value, uint64_t exact)
+{
+  return std::fabs(double(value) - double(exact)) / exact;
+}
+
+void
+TestAccuracy(size_t sample_count)
+{
+  // About 1 msec, with a long tail.
+  std::vector<std::vector<uint64_t>> samples(kThreads);
+  std::mt19937_64 rng(1);
+  std::lognormal_distribution<double> distribution(std::log(1e6), 0.8);
+  for (size_t i = 0; i < sample_count; i++) {
+    samples[i % kThreads].push_back(uint64_t(distribution(rng)) + 1);
+  }
+
+  nic::LatencyHistogram histogram;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; t++) {
+    threads.emplace_back([&histogram, &samples, t] {
+      for (const uint64_t value : samples[t]) {
+        histogram.Record(value);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::vector<uint64_t> values;
+  uint64_t sum = 0;
+  for (const auto& thread_samples : samples) {
+    values.insert(values.end(), thread_samples.begin(), thread_samples.end());
+  }
+  for (const uint64_t value : values) {
+    sum += value;
+  }
+  std::sort(values.begin(), values.end());
+
+  FAIL_UNLESS(histogram.Count() == sample_count, "wrong count");
+  FAIL_UNLESS(histogram.Mean() == sum / sample_count, "wrong mean");
+  FAIL_UNLESS(histogram.Min() <= values.front(), "min above the smallest");
+  FAIL_UNLESS(histogram.Max() >= values.back(), "max below the largest");
+  FAIL_UNLESS(
+    RelativeError(histogram.Max(), values.back()) < 0.016, "max too high");
+
+  double max_error = 0;
+  for (const double percentile : {50.0, 90.0, 95.0, 99.0, 99.9}) {
+    const uint64_t value = histogram.ValueAtPercentile(percentile);
+    const uint64_t exact = ExactPercentile(values, percentile);
+    FAIL_UNLESS(value >= exact, "percentile below the exact value");
+    const double error = RelativeError(value, exact);
+    FAIL_UNLESS(error < 0.016, "percentile beyond the histogram precision");
+    max_error = std::max(max_error, error);
+    std::cout << "p" << percentile << ": " << value << " nsec, exact "
+              << exact << " nsec" << std::endl;
+  }
+  std::cout << sample_count << " samples, largest percentile error "
+            << (100 * max_error) << "%" << std::endl;
+}
+
+void
+TestMergeSubtract()
+{
+  nic::LatencyHistogram empty;
+  FAIL_UNLESS(empty.Count() == 0, "empty histogram has values");
+  FAIL_UNLESS(empty.Mean() == 0, "empty histogram has a mean");
+  FAIL_UNLESS(
+    empty.ValueAtPercentile(99) == 0, "empty histogram has a percentile");
+
+  // The values recorded after a copy are the difference to the copy.
+  nic::LatencyHistogram cumulative;
+  for (uint64_t value = 1; value <= 1000; value++) {
+    cumulative.Record(value * 1000);
+  }
+  const nic::LatencyHistogram start(cumulative);
+  for (uint64_t value = 1; value <= 100; value++) {
+    cumulative.Record(5000000);
+  }
+  nic::LatencyHistogram window(cumulative);
+  window.Subtract(start);
+  FAIL_UNLESS(window.Count() == 100, "wrong count after subtract");
+  FAIL_UNLESS(window.Mean() == 5000000, "wrong mean after subtract");
+  // The deviation is computed from the buckets, so it is only within
+  // the width of the bucket of the value.
+  FAIL_UNLESS(
+    window.StdDev() < 5000000 * 0.016, "wrong deviation after subtract");
+  FAIL_UNLESS(
+    RelativeError(window.ValueAtPercentile(50), 5000000) < 0.016,
+    "wrong percentile after subtract");
+
+  // Merging the window back gives the cumulative histogram.
+  nic::LatencyHistogram merged(start);
+  merged.Merge(window);
+  FAIL_UNLESS(merged.Count() == cumulative.Count(), "wrong merged count");
+  FAIL_UNLESS(merged.Mean() == cumulative.Mean(), "wrong merged mean");
+  for (const double percentile : {50.0, 90.0, 99.0}) {
+    FAIL_UNLESS(
+      merged.ValueAtPercentile(percentile) ==
+        cumulative.ValueAtPercentile(percentile),
+      "wrong merged percentile");
+  }
+
+  merged.Reset();
+  FAIL_UNLESS(merged.Count() == 0, "values left after reset");
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  const size_t sample_count = (argc > 1) ? atoi(argv[1]) : 200000;
+
+  TestAccuracy(sample_count);
+  TestMergeSubtract();
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
@@ -0,0 +1,89 @@
+#!/bin/bash
+# Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#  * Neither the name of NVIDIA CORPORATION nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Run perf_client in its measurement modes against stand-in servers to
+# reproduce the figures quoted for those modes. Most runs are against a
+# server that serializes 1 msec inferences, about 1000 inferences/sec,
+# the async worker runs against one without delay, where the client is
+# the bottleneck.
+# Usage: perf_client_modes.sh [<build directory>]
+
+set -e
+
+BUILDDIR=${1:-build}
+STAND_IN=$BUILDDIR/stand_in_server
+PERF_CLIENT=$BUILDDIR/perf_client
+
+SERVER_PIDS=
+URL_FILES=
+trap 'kill -INT $SERVER_PIDS; rm -f $URL_FILES' EXIT
+
+# Start a stand-in server with options "$@" and set URL to its URL.
+function start_server {
+    local url_file=$(mktemp)
+    URL_FILES="$URL_FILES $url_file"
+    $STAND_IN -i http "$@" > $url_file &
+    SERVER_PIDS="$SERVER_PIDS $!"
+
+    for i in $(seq 50); do
+        if [ -s $url_file ]; then
+            break
+        fi
+        sleep 0.1
+    done
+    URL=$(head -n 1 $url_file)
+    if [ -z "$URL" ]; then
+        echo "error: $STAND_IN did not start"
+        exit 1
+    fi
+}
+
+function run {
+    echo "=== perf_client $*"
+    $PERF_CLIENT -i http -u $URL -m m "$@"
+}
+
+start_server -d 1000 -s
+
+# Open-loop request rate, below and above the capacity of the server,
+# then above it with at most 16 requests outstanding.
+run -p 1000 -r 3 -R 500
+run -p 1000 -r 3 -R 1200
+run -p 1000 -r 3 -R 1200 -c 16
+
+# Search for the highest concurrency with a p99 latency under 10 msec,
+# then the same search stopped after 3 sec.
+run -p 500 -S -l 10 -P 99
+run -p 500 -S -l 10 -P 99 -T 3
+
+# Async requests from 1 and 4 worker threads, at a fixed concurrency
+# and with dynamic concurrency. The report warns when the client is
+# CPU-bound, more worker threads only help if cores are left.
+start_server
+run -p 1000 -r 3 -a -t 8 -w 1
+run -p 1000 -r 3 -a -t 8 -w 4
+run -p 500 -a -w 4 -d -l 100 -c 5
@@ -0,0 +1,167 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark of switching the run options of an InferContext between
+// batch sizes 1 and 8 with SetRunOptions() against prepared run
+// templates with SetRunTemplate(), alone and with a synchronous run
+// after each switch, for HTTP, gRPC and gRPC streaming. Also checks
+// that a template can't be used by another context.
+// Usage: run_template_benchmark [<requests>]
+
+#include <iostream>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/grpc_stand_in.h"
+#include "src/clients/c++/test/http_stand_in.h"
+#include "src/clients/c++/test/test_util.h"
+
+namespace nic = nvidia::inferenceserver::client;
+namespace nict = nvidia::inferenceserver::client::test;
+
+namespace {
+
+const size_t kElements = 16;
+const size_t kBatchSizes[2] = {1, 8};
+const int kSwitchCount = 100000;
+
+std::unique_ptr<nic::InferContext>
+CreateContext(bool grpc, bool streaming, const std::string& url)
+{
+  std::unique_ptr<nic::InferContext> ctx;
+  if (grpc) {
+    FAIL_IF_ERR(
+      nic::InferGrpcContext::Create(&ctx, url, "m", -1, false, streaming),
+      "unable to create context");
+  } else {
+    FAIL_IF_ERR(
+      nic::InferHttpContext::Create(&ctx, url, "m"),
+      "unable to create context");
+  }
+  return ctx;
+}
+
+// Switch 'ctx' to the options or template of batch size index 'idx'.
+void
+Switch(
+  nic::InferContext* ctx, bool use_template,
+  const std::unique_ptr<nic::InferContext::Options>* options,
+  const std::shared_ptr<nic::InferContext::RunTemplate>* templates, int idx)
+{
+  if (use_template) {
+    FAIL_IF_ERR(ctx->SetRunTemplate(templates[idx]), "set run template");
+  } else {
+    FAIL_IF_ERR(ctx->SetRunOptions(*options[idx]), "set run options");
+  }
+}
+
+void
+Benchmark(
+  const std::string& name, bool grpc, bool streaming, const std::string& url,
+  int count)
+{
+  std::unique_ptr<nic::InferContext> ctx = CreateContext(grpc, streaming, url);
+
+  std::unique_ptr<nic::InferContext::Options> options[2];
+  std::shared_ptr<nic::InferContext::RunTemplate> templates[2];
+  for (int i = 0; i < 2; i++) {
+    FAIL_IF_ERR(
+      nic::InferContext::Options::Create(&options[i]), "create options");
+    options[i]->SetBatchSize(kBatchSizes[i]);
+    FAIL_IF_ERR(
+      options[i]->AddRawResult(ctx->Outputs()[0]), "add raw result");
+    FAIL_IF_ERR(
+      ctx->PrepareRunTemplate(*options[i], &templates[i]),
+      "prepare run template");
+    FAIL_UNLESS(
+      templates[i]->BatchSize() == kBatchSizes[i], "wrong template batch");
+  }
+
+  std::unique_ptr<nic::InferContext> other =
+    CreateContext(grpc, streaming, url);
+  FAIL_UNLESS(
+    !other->SetRunTemplate(templates[0]).IsOk(),
+    "template used by another context");
+
+  for (const bool use_template : {false, true}) {
+    const uint64_t start_ns = nict::NowNs();
+    for (int i = 0; i < kSwitchCount; i++) {
+      Switch(ctx.get(), use_template, options, templates, i & 1);
+    }
+    const uint64_t elapsed_ns = nict::NowNs() - start_ns;
+    std::cout << name
+              << (use_template ? " switch SetRunTemplate: " :
+                                 " switch SetRunOptions:  ")
+              << (double(elapsed_ns) / kSwitchCount) << " nsec" << std::endl;
+  }
+
+  nict::Results results;
+  for (const bool use_template : {false, true}) {
+    const uint64_t start_ns = nict::NowNs();
+    for (int i = 0; i < count; i++) {
+      const int idx = i & 1;
+      Switch(ctx.get(), use_template, options, templates, idx);
+
+      std::vector<float> batch(kElements * kBatchSizes[idx]);
+      for (size_t j = 0; j < batch.size(); j++) {
+        batch[j] = i * 1000 + j;
+      }
+      FAIL_IF_ERR(nict::SetInput(ctx.get(), batch), "set input");
+      FAIL_IF_ERR(ctx->Run(&results), "run");
+      FAIL_UNLESS(nict::OutputEquals(results, 0, batch), "wrong result");
+    }
+    const uint64_t elapsed_ns = nict::NowNs() - start_ns;
+    std::cout << name
+              << (use_template ? " run SetRunTemplate:    " :
+                                 " run SetRunOptions:     ")
+              << (elapsed_ns / 1000.0 / count) << " usec/request"
+              << std::endl;
+  }
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  const int count = (argc > 1) ? atoi(argv[1]) : 2000;
+
+  nict::StandInOptions options;
+  options.elements = kElements;
+  std::unique_ptr<nict::HttpStandIn> http_server;
+  FAIL_IF_ERR(
+    nict::HttpStandIn::Create(&http_server, options),
+    "unable to start HTTP server");
+  std::unique_ptr<nict::GrpcStandIn> grpc_server;
+  FAIL_IF_ERR(
+    nict::GrpcStandIn::Create(&grpc_server, options),
+    "unable to start gRPC server");
+
+  Benchmark("http       ", false, false, http_server->Url(), count);
+  Benchmark("grpc       ", true, false, grpc_server->Url(), count);
+  Benchmark("grpc stream", true, true, grpc_server->Url(), count);
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
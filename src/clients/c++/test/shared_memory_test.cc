@@ -0,0 +1,399 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Test of the shared memory support of InferContext against the HTTP
+// and gRPC stand-in servers: inputs and outputs passed through a
+// registered region, the errors for bad references, and registering
+// regions concurrently with inferences. Also compares the latency of
+// requests with the tensors in the request and response and in shared
+// memory. Usage: shared_memory_test [<requests to measure>]
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/grpc_stand_in.h"
+#include "src/clients/c++/test/http_stand_in.h"
+#include "src/clients/c++/test/test_util.h"
+
+namespace ni = nvidia::inferenceserver;
+namespace nic = nvidia::inferenceserver::client;
+namespace nict = nvidia::inferenceserver::client::test;
+
+namespace {
+
+const char kShmKey[] = "/shared_memory_test";
+const size_t kBatchSize = 8;
+
+// Create the shared memory object 'kShmKey' of 'byte_size' bytes.
+void
+CreateSharedMemoryObject(size_t byte_size)
+{
+  shm_unlink(kShmKey);
+  const int fd = shm_open(kShmKey, O_RDWR | O_CREAT, 0600);
+  FAIL_UNLESS(fd != -1, "unable to create shared memory object");
+  FAIL_UNLESS(ftruncate(fd, byte_size) == 0, "unable to size object");
+  close(fd);
+}
+
+std::unique_ptr<nic::InferContext>
+CreateContext(bool grpc, const std::string& url)
+{
+  std::unique_ptr<nic::InferContext> ctx;
+  if (grpc) {
+    FAIL_IF_ERR(
+      nic::InferGrpcContext::Create(&ctx, url, "m"),
+      "unable to create context");
+  } else {
+    FAIL_IF_ERR(
+      nic::InferHttpContext::Create(&ctx, url, "m"),
+      "unable to create context");
+  }
+  return ctx;
+}
+
+std::shared_ptr<nic::InferContext::RunTemplate>
+PrepareTemplate(
+  nic::InferContext* ctx, bool shm_output, size_t offset, size_t byte_size)
+{
+  std::unique_ptr<nic::InferContext::Options> options;
+  FAIL_IF_ERR(nic::InferContext::Options::Create(&options), "options");
+  options->SetBatchSize(kBatchSize);
+  if (shm_output) {
+    FAIL_IF_ERR(
+      options->AddSharedMemoryResult(
+        ctx->Outputs()[0], "region", offset, byte_size),
+      "add shared memory result");
+  } else {
+    FAIL_IF_ERR(options->AddRawResult(ctx->Outputs()[0]), "add raw result");
+  }
+
+  std::shared_ptr<nic::InferContext::RunTemplate> run_template;
+  FAIL_IF_ERR(
+    ctx->PrepareRunTemplate(*options, &run_template), "prepare template");
+  return run_template;
+}
+
+// Round-trip the input and output through the request and response and
+// through shared memory, in all four combinations, then check the
+// errors and unregistering.
+void
+TestRoundTrip(
+  bool grpc, const std::string& url, nict::StandInModel* model,
+  size_t elements)
+{
+  const size_t byte_size = kBatchSize * elements * sizeof(float);
+  CreateSharedMemoryObject(4096 + 2 * byte_size);
+
+  std::unique_ptr<nic::InferContext> ctx = CreateContext(grpc, url);
+  const std::shared_ptr<nic::InferContext::Input> input = ctx->Inputs()[0];
+
+  // The region does not start on a page boundary. The input is at the
+  // start of the region and the output follows it.
+  FAIL_IF_ERR(
+    ctx->RegisterSharedMemory("region", kShmKey, 100, 2 * byte_size),
+    "register region");
+  FAIL_UNLESS(
+    !ctx->RegisterSharedMemory("region", kShmKey, 0, 16).IsOk(),
+    "region registered twice");
+  FAIL_UNLESS(
+    !ctx->RegisterSharedMemory("large", kShmKey, 0, 1ULL << 40).IsOk(),
+    "region larger than the object registered");
+  FAIL_UNLESS(
+    model->SharedMemoryRegionCount() == 1, "wrong number of regions");
+
+  uint8_t* base;
+  size_t region_size;
+  FAIL_IF_ERR(
+    ctx->GetSharedMemory("region", &base, &region_size), "get region");
+  FAIL_UNLESS(region_size == 2 * byte_size, "wrong region size");
+  float* shm_input = reinterpret_cast<float*>(base);
+  float* shm_output = reinterpret_cast<float*>(base + byte_size);
+
+  const std::shared_ptr<nic::InferContext::RunTemplate> shm_template =
+    PrepareTemplate(ctx.get(), true, byte_size, byte_size);
+  const std::shared_ptr<nic::InferContext::RunTemplate> raw_template =
+    PrepareTemplate(ctx.get(), false, 0, 0);
+
+  std::vector<float> batch(kBatchSize * elements);
+  nict::Results results;
+  for (const bool in_shm : {false, true}) {
+    for (const bool out_shm : {false, true}) {
+      const size_t shm_inputs = model->SharedMemoryInputCount();
+      const size_t shm_outputs = model->SharedMemoryOutputCount();
+      FAIL_IF_ERR(
+        ctx->SetRunTemplate(out_shm ? shm_template : raw_template),
+        "set template");
+
+      const float first = (in_shm ? 10 : 0) + (out_shm ? 1 : 0);
+      for (size_t i = 0; i < batch.size(); i++) {
+        batch[i] = first + i;
+      }
+      FAIL_IF_ERR(input->Reset(), "reset input");
+      if (in_shm) {
+        memcpy(shm_input, &batch[0], byte_size);
+        FAIL_IF_ERR(
+          input->SetSharedMemory("region", 0, byte_size), "set input");
+      } else {
+        FAIL_IF_ERR(
+          input->SetRawBatch(
+            reinterpret_cast<uint8_t*>(&batch[0]), byte_size),
+          "set input");
+      }
+      if (out_shm) {
+        memset(shm_output, 0, byte_size);
+      }
+
+      FAIL_IF_ERR(ctx->Run(&results), "run");
+      FAIL_UNLESS(nict::OutputEquals(results, 0, batch), "wrong result");
+      if (out_shm) {
+        const uint8_t* buf;
+        size_t size;
+        FAIL_IF_ERR(results[0]->GetRawBatch(&buf, &size), "get result");
+        FAIL_UNLESS(
+          buf == reinterpret_cast<uint8_t*>(shm_output),
+          "result not in the region");
+      }
+      FAIL_UNLESS(
+        model->SharedMemoryInputCount() == shm_inputs + (in_shm ? 1 : 0),
+        "input not read from shared memory");
+      FAIL_UNLESS(
+        model->SharedMemoryOutputCount() == shm_outputs + (out_shm ? 1 : 0),
+        "output not written to shared memory");
+    }
+  }
+
+  // Asynchronous run with both in shared memory.
+  FAIL_IF_ERR(ctx->SetRunTemplate(shm_template), "set template");
+  std::shared_ptr<nic::InferContext::Request> request;
+  FAIL_IF_ERR(ctx->AsyncRun(&request), "async run");
+  FAIL_IF_ERR(
+    ctx->GetAsyncRunResults(&results, request, true), "async results");
+  FAIL_UNLESS(nict::OutputEquals(results, 0, batch), "wrong async result");
+
+  // Errors.
+  std::vector<uint8_t> buffer(byte_size);
+  FAIL_UNLESS(
+    !ctx->SetOutputBuffer(
+          ctx->Outputs()[0], &buffer[0], byte_size, ni::TYPE_FP32)
+       .IsOk(),
+    "output buffer set for an output in shared memory");
+  FAIL_UNLESS(
+    !input->SetRawBatch(&buffer[0], byte_size).IsOk(),
+    "raw batch set for an input in shared memory");
+  FAIL_IF_ERR(input->Reset(), "reset input");
+  FAIL_IF_ERR(
+    input->SetSharedMemory("region", 0, byte_size - 4), "set input");
+  FAIL_UNLESS(!ctx->Run(&results).IsOk(), "run with a short input");
+  FAIL_IF_ERR(input->Reset(), "reset input");
+  FAIL_IF_ERR(
+    input->SetSharedMemory("unknown", 0, byte_size), "set input");
+  FAIL_UNLESS(!ctx->Run(&results).IsOk(), "run with an unknown region");
+  FAIL_IF_ERR(input->Reset(), "reset input");
+  FAIL_IF_ERR(
+    input->SetSharedMemory("region", byte_size + 4, byte_size), "set input");
+  FAIL_UNLESS(!ctx->Run(&results).IsOk(), "run past the region");
+
+  std::unique_ptr<nic::InferContext::Options> options;
+  FAIL_IF_ERR(nic::InferContext::Options::Create(&options), "options");
+  options->SetBatchSize(kBatchSize);
+  FAIL_IF_ERR(
+    options->AddSharedMemoryResult(
+      ctx->Outputs()[0], "region", byte_size, byte_size - 4),
+    "add shared memory result");
+  std::shared_ptr<nic::InferContext::RunTemplate> short_template;
+  FAIL_UNLESS(
+    !ctx->PrepareRunTemplate(*options, &short_template).IsOk(),
+    "template with a short output prepared");
+
+  // The results of a run stay valid after the region is unregistered,
+  // the following runs fail.
+  FAIL_IF_ERR(input->Reset(), "reset input");
+  FAIL_IF_ERR(input->SetSharedMemory("region", 0, byte_size), "set input");
+  FAIL_IF_ERR(ctx->Run(&results), "run");
+  FAIL_IF_ERR(ctx->UnregisterSharedMemory("region"), "unregister region");
+  FAIL_UNLESS(
+    !ctx->UnregisterSharedMemory("region").IsOk(),
+    "region unregistered twice");
+  FAIL_UNLESS(
+    nict::OutputEquals(results, 0, batch), "result lost on unregister");
+  FAIL_UNLESS(!ctx->Run(&results).IsOk(), "run with unregistered region");
+  FAIL_UNLESS(
+    model->SharedMemoryRegionCount() == 0, "region left registered");
+
+  shm_unlink(kShmKey);
+}
+
+// Register and unregister regions from several threads while another
+// runs inferences through a region of the same context.
+void
+TestConcurrentRegister(
+  bool grpc, const std::string& url, nict::StandInModel* model,
+  size_t elements)
+{
+  const size_t byte_size = kBatchSize * elements * sizeof(float);
+  CreateSharedMemoryObject(2 * byte_size);
+
+  std::unique_ptr<nic::InferContext> ctx = CreateContext(grpc, url);
+  FAIL_IF_ERR(ctx->SetThreadSafeMode(true), "set thread-safe mode");
+  FAIL_IF_ERR(
+    ctx->RegisterSharedMemory("region", kShmKey, 0, 2 * byte_size),
+    "register region");
+  FAIL_IF_ERR(
+    ctx->SetRunTemplate(
+      PrepareTemplate(ctx.get(), true, byte_size, byte_size)),
+    "set template");
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&ctx, &done, t] {
+      const std::string name = "region" + std::to_string(t);
+      while (!done) {
+        FAIL_IF_ERR(
+          ctx->RegisterSharedMemory(name, kShmKey, 0, 64), "register");
+        uint8_t* base;
+        size_t size;
+        FAIL_IF_ERR(ctx->GetSharedMemory(name, &base, &size), "get");
+        FAIL_IF_ERR(ctx->UnregisterSharedMemory(name), "unregister");
+      }
+    });
+  }
+
+  std::vector<float> batch(kBatchSize * elements);
+  uint8_t* base;
+  size_t size;
+  FAIL_IF_ERR(ctx->GetSharedMemory("region", &base, &size), "get region");
+  const std::shared_ptr<nic::InferContext::Input> input = ctx->Inputs()[0];
+  nict::Results results;
+  for (int i = 0; i < 200; i++) {
+    batch[0] = i;
+    memcpy(base, &batch[0], byte_size);
+    FAIL_IF_ERR(input->Reset(), "reset input");
+    FAIL_IF_ERR(input->SetSharedMemory("region", 0, byte_size), "set input");
+    FAIL_IF_ERR(ctx->Run(&results), "run");
+    FAIL_UNLESS(nict::OutputEquals(results, 0, batch), "wrong result");
+  }
+
+  done = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  FAIL_IF_ERR(ctx->UnregisterSharedMemory("region"), "unregister region");
+  FAIL_UNLESS(
+    model->SharedMemoryRegionCount() == 0, "regions left registered");
+  shm_unlink(kShmKey);
+}
+
+// Measure requests with the input and output sent with the request and
+// response against requests with both in shared memory.
+void
+CompareSocketAndSharedMemory(
+  bool grpc, const std::string& url, size_t elements, int count)
+{
+  const size_t byte_size = kBatchSize * elements * sizeof(float);
+  CreateSharedMemoryObject(2 * byte_size);
+
+  std::unique_ptr<nic::InferContext> ctx = CreateContext(grpc, url);
+  FAIL_IF_ERR(
+    ctx->RegisterSharedMemory("region", kShmKey, 0, 2 * byte_size),
+    "register region");
+  const std::shared_ptr<nic::InferContext::Input> input = ctx->Inputs()[0];
+
+  std::vector<float> batch(kBatchSize * elements, 1.0f);
+  nict::Results results;
+  uint64_t elapsed_ns[2];
+  for (const bool shm : {false, true}) {
+    FAIL_IF_ERR(
+      ctx->SetRunTemplate(
+        PrepareTemplate(ctx.get(), shm, byte_size, byte_size)),
+      "set template");
+    FAIL_IF_ERR(input->Reset(), "reset input");
+    if (shm) {
+      FAIL_IF_ERR(
+        input->SetSharedMemory("region", 0, byte_size), "set input");
+    } else {
+      FAIL_IF_ERR(
+        input->SetRawBatch(reinterpret_cast<uint8_t*>(&batch[0]), byte_size),
+        "set input");
+    }
+    FAIL_IF_ERR(ctx->Run(&results), "warm-up run");
+
+    const uint64_t start_ns = nict::NowNs();
+    for (int i = 0; i < count; i++) {
+      FAIL_IF_ERR(ctx->Run(&results), "run");
+    }
+    elapsed_ns[shm] = nict::NowNs() - start_ns;
+  }
+
+  std::cout << (grpc ? "grpc " : "http ") << byte_size
+            << " bytes in and out: socket " << (elapsed_ns[0] / 1000.0 / count)
+            << " usec/request, shared memory "
+            << (elapsed_ns[1] / 1000.0 / count) << " usec/request"
+            << std::endl;
+
+  FAIL_IF_ERR(ctx->UnregisterSharedMemory("region"), "unregister region");
+  shm_unlink(kShmKey);
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  const int count = (argc > 1) ? atoi(argv[1]) : 50;
+
+  for (const size_t elements : {16, 64 * 1024}) {
+    nict::StandInOptions options;
+    options.elements = elements;
+    const int requests = (elements > 16) ? count : 20 * count;
+
+    std::unique_ptr<nict::HttpStandIn> http_server;
+    FAIL_IF_ERR(
+      nict::HttpStandIn::Create(&http_server, options),
+      "unable to start HTTP server");
+    std::unique_ptr<nict::GrpcStandIn> grpc_server;
+    FAIL_IF_ERR(
+      nict::GrpcStandIn::Create(&grpc_server, options),
+      "unable to start gRPC server");
+
+    for (const bool grpc : {false, true}) {
+      const std::string url = grpc ? grpc_server->Url() : http_server->Url();
+      nict::StandInModel* model =
+        grpc ? &grpc_server->Model() : &http_server->Model();
+      TestRoundTrip(grpc, url, model, elements);
+      TestConcurrentRegister(grpc, url, model, elements);
+      CompareSocketAndSharedMemory(grpc, url, elements, requests);
+    }
+  }
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
@@ -0,0 +1,347 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "src/clients/c++/test/stand_in.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace nvidia { namespace inferenceserver { namespace client {
+namespace test {
+
+//==============================================================================
+
+// A registered shared memory region, unmapped when it is unregistered
+// and no inference uses it anymore.
+class StandInModel::SharedMemoryRegion {
+public:
+  SharedMemoryRegion(
+    uint8_t* base, size_t map_size, size_t offset, size_t byte_size)
+      : base_(base), map_size_(map_size), offset_(offset),
+        byte_size_(byte_size)
+  {
+  }
+  ~SharedMemoryRegion() { munmap(base_, map_size_); }
+
+  uint8_t* Data() const { return base_ + offset_; }
+  size_t ByteSize() const { return byte_size_; }
+
+private:
+  uint8_t* const base_;
+  const size_t map_size_;
+  const size_t offset_;
+  const size_t byte_size_;
+};
+
+//==============================================================================
+
+StandInModel::StandInModel(const StandInOptions& options)
+    : options_(options), name_("m"), fail_inferences_(false),
+      infer_count_(0), sample_count_(0), shm_input_count_(0),
+      shm_output_count_(0)
+{
+}
+
+void
+StandInModel::GetConfig(ModelConfig* config) const
+{
+  config->Clear();
+  config->set_name(name_);
+  config->set_max_batch_size(options_.max_batch_size);
+
+  ModelInput* input = config->add_input();
+  input->set_name("in");
+  input->set_data_type(DataType::TYPE_FP32);
+  input->add_dims(options_.elements);
+
+  for (size_t i = 0; i < options_.outputs; i++) {
+    ModelOutput* output = config->add_output();
+    output->set_name((i == 0) ? "out" : "out" + std::to_string(i));
+    output->set_data_type(DataType::TYPE_FP32);
+    output->add_dims(options_.elements);
+  }
+
+  if (!options_.preferred_batch_sizes.empty()) {
+    ModelDynamicBatching* batching = config->mutable_dynamic_batching();
+    for (const int size : options_.preferred_batch_sizes) {
+      batching->add_preferred_batch_size(size);
+    }
+    batching->set_max_queue_delay_microseconds(options_.max_queue_delay_us);
+  }
+}
+
+void
+StandInModel::GetStatus(ModelStatus* status) const
+{
+  GetConfig(status->mutable_config());
+
+  ModelVersionStatus& version = (*status->mutable_version_status())[1];
+  version.set_ready_state(ModelReadyState::MODEL_READY);
+
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  for (const auto& pr : stats_) {
+    InferRequestStats& stats = (*version.mutable_infer_stats())[pr.first];
+    *stats.mutable_success() = pr.second;
+    *stats.mutable_compute() = pr.second;
+  }
+}
+
+void
+StandInModel::ControlSharedMemory(
+  const SharedMemoryControl& control, RequestStatus* status)
+{
+  status->Clear();
+  std::lock_guard<std::mutex> lock(shared_memory_mutex_);
+
+  if (control.type() == SharedMemoryControl::UNREGISTER) {
+    if (shared_memory_regions_.erase(control.name()) == 0) {
+      status->set_code(RequestStatusCode::NOT_FOUND);
+      status->set_msg(
+        "shared memory region '" + control.name() + "' is not registered");
+      return;
+    }
+    status->set_code(RequestStatusCode::SUCCESS);
+    return;
+  }
+
+  if (shared_memory_regions_.find(control.name()) !=
+      shared_memory_regions_.end()) {
+    status->set_code(RequestStatusCode::INVALID_ARG);
+    status->set_msg(
+      "shared memory region '" + control.name() + "' is already registered");
+    return;
+  }
+
+  const int fd = shm_open(control.shm_key().c_str(), O_RDWR, 0);
+  if (fd == -1) {
+    status->set_code(RequestStatusCode::INVALID_ARG);
+    status->set_msg(
+      "unable to open shared memory object '" + control.shm_key() +
+      "': " + strerror(errno));
+    return;
+  }
+
+  // Map from the start of the object as the offset of the region need
+  // not be page aligned.
+  const size_t map_size = control.offset() + control.byte_size();
+  struct stat st;
+  void* base = MAP_FAILED;
+  if ((fstat(fd, &st) == 0) && (size_t(st.st_size) >= map_size)) {
+    base = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) {
+    status->set_code(RequestStatusCode::INVALID_ARG);
+    status->set_msg(
+      "unable to map " + std::to_string(control.byte_size()) +
+      " bytes at offset " + std::to_string(control.offset()) +
+      " of shared memory object '" + control.shm_key() + "'");
+    return;
+  }
+
+  shared_memory_regions_.emplace(
+    control.name(),
+    std::make_shared<SharedMemoryRegion>(
+      reinterpret_cast<uint8_t*>(base), map_size, control.offset(),
+      control.byte_size()));
+  status->set_code(RequestStatusCode::SUCCESS);
+}
+
+size_t
+StandInModel::SharedMemoryRegionCount() const
+{
+  std::lock_guard<std::mutex> lock(shared_memory_mutex_);
+  return shared_memory_regions_.size();
+}
+
+bool
+StandInModel::GetSharedMemory(
+  const SharedMemoryReference& reference,
+  std::shared_ptr<SharedMemoryRegion>* region, uint8_t** addr,
+  RequestStatus* status) const
+{
+  {
+    std::lock_guard<std::mutex> lock(shared_memory_mutex_);
+    auto itr = shared_memory_regions_.find(reference.name());
+    if (itr != shared_memory_regions_.end()) {
+      *region = itr->second;
+    }
+  }
+
+  if (*region == nullptr) {
+    status->set_code(RequestStatusCode::NOT_FOUND);
+    status->set_msg(
+      "shared memory region '" + reference.name() + "' is not registered");
+    return false;
+  }
+  if (reference.offset() + reference.byte_size() > (*region)->ByteSize()) {
+    status->set_code(RequestStatusCode::INVALID_ARG);
+    status->set_msg(
+      std::to_string(reference.byte_size()) + " bytes at offset " +
+      std::to_string(reference.offset()) + " exceed shared memory region '" +
+      reference.name() + "'");
+    return false;
+  }
+
+  *addr = (*region)->Data() + reference.offset();
+  return true;
+}
+
+void
+StandInModel::Infer(
+  const InferRequestHeader& request, const std::string& input,
+  InferResponseHeader* response, std::vector<std::string>* raw_outputs,
+  RequestStatus* status)
+{
+  const auto start = std::chrono::steady_clock::now();
+  const size_t batch_size = request.batch_size();
+
+  status->Clear();
+  response->Clear();
+  raw_outputs->clear();
+
+  if (fail_inferences_) {
+    status->set_code(RequestStatusCode::INTERNAL);
+    status->set_msg("inference failed by request of the test");
+    return;
+  }
+
+  // The regions referenced by the request stay mapped until it is done.
+  std::vector<std::shared_ptr<SharedMemoryRegion>> regions;
+
+  std::string shm_input;
+  const std::string* values = &input;
+  if ((request.input_size() > 0) && request.input(0).has_shared_memory()) {
+    const SharedMemoryReference& reference = request.input(0).shared_memory();
+    std::shared_ptr<SharedMemoryRegion> region;
+    uint8_t* addr;
+    if (!input.empty()) {
+      status->set_code(RequestStatusCode::INVALID_ARG);
+      status->set_msg("input values sent for an input in shared memory");
+      return;
+    }
+    if (!GetSharedMemory(reference, &region, &addr, status)) {
+      return;
+    }
+    shm_input.assign(reinterpret_cast<char*>(addr), reference.byte_size());
+    values = &shm_input;
+  }
+
+  const size_t byte_size = batch_size * options_.elements * sizeof(float);
+  if (values->size() != byte_size) {
+    status->set_code(RequestStatusCode::INVALID_ARG);
+    status->set_msg(
+      "expected " + std::to_string(byte_size) + " bytes of input, got " +
+      std::to_string(values->size()));
+    return;
+  }
+
+  // The address each output is written to, or nullptr if it is not in
+  // shared memory.
+  std::vector<uint8_t*> output_addrs;
+  for (const auto& output : request.output()) {
+    output_addrs.push_back(nullptr);
+    if (!output.has_shared_memory()) {
+      continue;
+    }
+    const SharedMemoryReference& reference = output.shared_memory();
+    std::shared_ptr<SharedMemoryRegion> region;
+    if (!GetSharedMemory(
+          reference, &region, &output_addrs.back(), status)) {
+      return;
+    }
+    if (reference.byte_size() < byte_size) {
+      status->set_code(RequestStatusCode::INVALID_ARG);
+      status->set_msg(
+        "expected " + std::to_string(byte_size) +
+        " bytes of shared memory for output '" + output.name() + "', got " +
+        std::to_string(reference.byte_size()));
+      return;
+    }
+    regions.push_back(std::move(region));
+  }
+
+  if (options_.delay_us > 0) {
+    std::unique_lock<std::mutex> lock(serialize_mutex_, std::defer_lock);
+    if (options_.serialize) {
+      lock.lock();
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(options_.delay_us));
+  }
+
+  response->set_model_name(name_);
+  response->set_model_version(1);
+  response->set_batch_size(batch_size);
+  for (int idx = 0; idx < request.output_size(); idx++) {
+    const InferRequestHeader::Output& output = request.output(idx);
+    InferResponseHeader::Output* routput = response->add_output();
+    routput->set_name(output.name());
+    if (output.has_cls()) {
+      for (size_t b = 0; b < batch_size; b++) {
+        InferResponseHeader::Output::Class* cls =
+          routput->add_batch_classes()->add_cls();
+        cls->set_idx(0);
+        cls->set_value(1.0);
+        cls->set_label("echo");
+      }
+    } else if (output_addrs[idx] != nullptr) {
+      routput->mutable_raw()->set_byte_size(
+        options_.elements * sizeof(float));
+      *routput->mutable_shared_memory() = output.shared_memory();
+      memcpy(output_addrs[idx], values->data(), byte_size);
+      raw_outputs->emplace_back();
+    } else {
+      routput->mutable_raw()->set_byte_size(
+        options_.elements * sizeof(float));
+      raw_outputs->push_back(*values);
+    }
+  }
+
+  status->set_code(RequestStatusCode::SUCCESS);
+
+  infer_count_++;
+  sample_count_ += batch_size;
+  if (values == &shm_input) {
+    shm_input_count_++;
+  }
+  shm_output_count_ += regions.size();
+
+  const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  StatDuration& stat = stats_[batch_size];
+  stat.set_count(stat.count() + 1);
+  stat.set_total_time_ns(stat.total_time_ns() + ns);
+}
+
+}}}} // namespace nvidia::inferenceserver::client::test
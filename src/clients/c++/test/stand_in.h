@@ -0,0 +1,178 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "src/core/api.pb.h"
+#include "src/core/model_config.pb.h"
+#include "src/core/request_status.pb.h"
+#include "src/core/server_status.pb.h"
+
+namespace nvidia { namespace inferenceserver { namespace client {
+namespace test {
+
+//==============================================================================
+// StandInOptions
+//
+// The stand-in servers serve one model, "m" version 1, that copies its
+// FP32 input "in" to each of its FP32 outputs "out", "out1", .... They
+// speak enough of the HTTP and gRPC APIs of the inference server for
+// the client library to be tested and measured without a server.
+//
+struct StandInOptions {
+  // The number of elements of the input and of each output.
+  size_t elements = 16;
+
+  // The number of outputs of the model.
+  size_t outputs = 1;
+
+  // The maximum batch size of the model.
+  int max_batch_size = 64;
+
+  // The preferred batch sizes and the maximum queue delay, in usec, of
+  // the dynamic batching configuration of the model. The model has no
+  // dynamic batching configuration if there are no preferred sizes.
+  std::vector<int> preferred_batch_sizes;
+  uint64_t max_queue_delay_us = 0;
+
+  // The time each inference takes, in usec, and whether inferences run
+  // one at a time as on a single instance of the model.
+  uint64_t delay_us = 0;
+  bool serialize = false;
+
+  // If not empty, the path of a Unix domain socket the server listens
+  // on in addition to the TCP loopback port.
+  std::string unix_socket_path;
+};
+
+//==============================================================================
+// StandInModel
+//
+// The model served by a stand-in server and the counters the tests
+// check. All functions are thread-safe.
+//
+class StandInModel {
+public:
+  explicit StandInModel(const StandInOptions& options);
+
+  // @return the options of the model.
+  const StandInOptions& Options() const { return options_; }
+
+  // @return the name of the model.
+  const std::string& Name() const { return name_; }
+
+  // Get the configuration of the model.
+  // @param config - returns the configuration
+  void GetConfig(ModelConfig* config) const;
+
+  // Get the status of the model, with the inference statistics of
+  // version 1 for each batch size run so far.
+  // @param status - returns the status
+  void GetStatus(ModelStatus* status) const;
+
+  // Register or unregister a shared memory region.
+  // @param control - the request to register or unregister the region
+  // @param status - returns the status of the request
+  void ControlSharedMemory(
+    const SharedMemoryControl& control, RequestStatus* status);
+
+  // Run an inference. The input is read from shared memory instead of
+  // 'input' if the request references a region for it, and the raw
+  // outputs requested in shared memory are written there.
+  // @param request - the header of the request
+  // @param input - the raw input of the request, for the whole batch
+  // @param response - returns the header of the response
+  // @param raw_outputs - returns the raw data of each output requested
+  // as raw data, in request order, empty for the outputs written to
+  // shared memory
+  // @param status - returns the status of the request
+  void Infer(
+    const InferRequestHeader& request, const std::string& input,
+    InferResponseHeader* response, std::vector<std::string>* raw_outputs,
+    RequestStatus* status);
+
+  // Make all following inferences fail with INTERNAL, or succeed again.
+  // @param fail - whether the inferences fail
+  void SetFailInferences(bool fail) { fail_inferences_ = fail; }
+
+  // @return the number of inferences run.
+  size_t InferCount() const { return infer_count_; }
+
+  // @return the sum of the batch sizes of the inferences run.
+  size_t SampleCount() const { return sample_count_; }
+
+  // @return the number of inputs read from shared memory.
+  size_t SharedMemoryInputCount() const { return shm_input_count_; }
+
+  // @return the number of outputs written to shared memory.
+  size_t SharedMemoryOutputCount() const { return shm_output_count_; }
+
+  // @return the number of shared memory regions registered.
+  size_t SharedMemoryRegionCount() const;
+
+private:
+  class SharedMemoryRegion;
+
+  // Get the memory of 'reference' in a registered region.
+  // @param reference - the region, offset and size of the memory
+  // @param region - returns the region, which stays mapped as long as
+  // it is held
+  // @param addr - returns the address of the memory
+  // @param status - returns the error if the memory is not in a region
+  // @return true on success.
+  bool GetSharedMemory(
+    const SharedMemoryReference& reference,
+    std::shared_ptr<SharedMemoryRegion>* region, uint8_t** addr,
+    RequestStatus* status) const;
+
+  const StandInOptions options_;
+  const std::string name_;
+  std::atomic<bool> fail_inferences_;
+  std::atomic<size_t> infer_count_;
+  std::atomic<size_t> sample_count_;
+  std::atomic<size_t> shm_input_count_;
+  std::atomic<size_t> shm_output_count_;
+
+  // Held for the duration of an inference if 'options_.serialize'.
+  std::mutex serialize_mutex_;
+
+  // The count and total time of the inferences of each batch size.
+  mutable std::mutex stats_mutex_;
+  std::map<uint32_t, StatDuration> stats_;
+
+  // The shared memory regions registered, by name.
+  mutable std::mutex shared_memory_mutex_;
+  std::map<std::string, std::shared_ptr<SharedMemoryRegion>>
+    shared_memory_regions_;
+};
+
+}}}} // namespace nvidia::inferenceserver::client::test
@@ -0,0 +1,158 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <thread>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/grpc_stand_in.h"
+#include "src/clients/c++/test/http_stand_in.h"
+
+namespace nic = nvidia::inferenceserver::client;
+namespace nict = nvidia::inferenceserver::client::test;
+
+//==============================================================================
+// Stand-in Server
+//
+// Serves the stand-in model, "m", until interrupted, so that the
+// clients such as perf_client can be run and measured without an
+// inference server. The URL to reach the server is printed on start.
+//
+
+namespace {
+
+volatile sig_atomic_t early_exit = 0;
+
+void
+SignalHandler(int signum)
+{
+  early_exit = 1;
+}
+
+void
+Usage(char** argv, const std::string& msg = std::string())
+{
+  if (!msg.empty()) {
+    std::cerr << "error: " << msg << std::endl;
+  }
+
+  std::cerr << "Usage: " << argv[0] << " [options]" << std::endl;
+  std::cerr << "\t-i <Protocol served>" << std::endl;
+  std::cerr << "\t-d <inference time (in usec)>" << std::endl;
+  std::cerr << "\t-s" << std::endl;
+  std::cerr << "\t-e <number of elements of the input and outputs>"
+    << std::endl;
+  std::cerr << "\t-o <number of outputs>" << std::endl;
+  std::cerr << "\t-b <maximum batch size>" << std::endl;
+  std::cerr << "\t-U <Unix domain socket path>" << std::endl;
+  std::cerr << std::endl;
+  std::cerr
+    << "For -i, available protocols are gRPC and HTTP. Default is gRPC."
+    << std::endl;
+  std::cerr
+    << "The -s flag runs one inference at a time, as a single instance of"
+    << " a model would. It has no effect unless -d is set." << std::endl;
+  std::cerr
+    << "For -U, it indicates a Unix domain socket the server listens on in"
+    << " addition to a TCP port of the loopback address." << std::endl;
+
+  exit(1);
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  nict::StandInOptions options;
+  std::string protocol("grpc");
+
+  int opt;
+  while ((opt = getopt(argc, argv, "si:d:e:o:b:U:")) != -1) {
+    switch (opt) {
+      case 's':
+        options.serialize = true;
+        break;
+      case 'i':
+        protocol = optarg;
+        std::transform(
+          protocol.begin(), protocol.end(), protocol.begin(), ::tolower);
+        break;
+      case 'd':
+        options.delay_us = std::stoull(optarg);
+        break;
+      case 'e':
+        options.elements = std::stoul(optarg);
+        break;
+      case 'o':
+        options.outputs = std::stoul(optarg);
+        break;
+      case 'b':
+        options.max_batch_size = std::stoi(optarg);
+        break;
+      case 'U':
+        options.unix_socket_path = optarg;
+        break;
+      case '?':
+        Usage(argv);
+        break;
+    }
+  }
+
+  if ((protocol != "grpc") && (protocol != "http")) {
+    Usage(argv, "unsupported protocol \"" + protocol + "\"");
+  }
+  if ((options.elements == 0) || (options.outputs == 0)) {
+    Usage(argv, "-e and -o must be positive");
+  }
+
+  std::unique_ptr<nict::GrpcStandIn> grpc_server;
+  std::unique_ptr<nict::HttpStandIn> http_server;
+  nic::Error err;
+  if (protocol == "grpc") {
+    err = nict::GrpcStandIn::Create(&grpc_server, options);
+  } else {
+    err = nict::HttpStandIn::Create(&http_server, options);
+  }
+  if (!err.IsOk()) {
+    std::cerr << "error: " << err << std::endl;
+    return 1;
+  }
+  std::cout << ((grpc_server != nullptr) ? grpc_server->Url() :
+                                           http_server->Url())
+            << std::endl;
+
+  signal(SIGINT, SignalHandler);
+  signal(SIGTERM, SignalHandler);
+  while (!early_exit) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+
+  return 0;
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <time.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "src/clients/c++/request.h"
+
+// Exit the test with 'MSG' if the Error 'X' is not ok.
+#define FAIL_IF_ERR(X, MSG)                                                   \
+  do {                                                                        \
+    const nvidia::inferenceserver::client::Error err__ = (X);                 \
+    if (!err__.IsOk()) {                                                      \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": " << (MSG) << ": "      \
+                << err__ << std::endl;                                        \
+      exit(1);                                                                \
+    }                                                                         \
+  } while (false)
+
+// Exit the test with 'MSG' unless 'X' holds.
+#define FAIL_UNLESS(X, MSG)                                                   \
+  do {                                                                        \
+    if (!(X)) {                                                               \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": " << (MSG) << " ("       \
+                << #X << ")" << std::endl;                                    \
+      exit(1);                                                                \
+    }                                                                         \
+  } while (false)
+
+namespace nvidia { namespace inferenceserver { namespace client {
+namespace test {
+
+using Results = std::vector<std::unique_ptr<InferContext::Result>>;
+
+// @return the time of the monotonic clock, in nsec.
+inline uint64_t
+NowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+// @return the CPU time used by the calling thread, in nsec.
+inline uint64_t
+ThreadCpuNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// @return the CPU time used by the process, in nsec.
+inline uint64_t
+ProcessCpuNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Set the run options of 'ctx' to 'batch_size' with all outputs
+// returned as raw data.
+inline Error
+SetRawRunOptions(InferContext* ctx, size_t batch_size)
+{
+  std::unique_ptr<InferContext::Options> options;
+  Error err = InferContext::Options::Create(&options);
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  options->SetBatchSize(batch_size);
+  for (const auto& output : ctx->Outputs()) {
+    err = options->AddRawResult(output);
+    if (!err.IsOk()) {
+      return err;
+    }
+  }
+
+  return ctx->SetRunOptions(*options);
+}
+
+// Set the input of 'ctx', which has one input, to 'batch'.
+inline Error
+SetInput(InferContext* ctx, const std::vector<float>& batch)
+{
+  Error err = ctx->Inputs()[0]->Reset();
+  if (!err.IsOk()) {
+    return err;
+  }
+
+  return ctx->Inputs()[0]->SetRawBatch(
+    reinterpret_cast<const uint8_t*>(&batch[0]), batch.size() * sizeof(float));
+}
+
+// @return true if the 'idx'-th raw output of 'results' is 'expected'.
+inline bool
+OutputEquals(
+  const Results& results, size_t idx, const std::vector<float>& expected)
+{
+  const uint8_t* buf;
+  size_t byte_size;
+  if ((results.size() <= idx) ||
+      !results[idx]->GetRawBatch(&buf, &byte_size).IsOk()) {
+    return false;
+  }
+
+  return (byte_size == expected.size() * sizeof(float)) &&
+         (memcmp(buf, &expected[0], byte_size) == 0);
+}
+
+}}}} // namespace nvidia::inferenceserver::client::test
@@ -0,0 +1,241 @@
+// Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark of one thread-safe InferContext shared by several threads
+// against one context per thread, for HTTP and gRPC with synchronous
+// and asynchronous runs. Each thread checks that it gets the results
+// of its own inputs, also when writing them to its own output buffer.
+// Also checks that the requests retrieved by several threads with
+// GetReadyAsyncRequest() are each returned to one of them.
+// Usage: thread_safe_context_benchmark [<threads> [<requests/thread>]]
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include "src/clients/c++/request.h"
+#include "src/clients/c++/test/grpc_stand_in.h"
+#include "src/clients/c++/test/http_stand_in.h"
+#include "src/clients/c++/test/test_util.h"
+
+namespace ni = nvidia::inferenceserver;
+namespace nic = nvidia::inferenceserver::client;
+namespace nict = nvidia::inferenceserver::client::test;
+
+namespace {
+
+const size_t kElements = 16;
+const size_t kBatchSize = 2;
+
+std::unique_ptr<nic::InferContext>
+CreateContext(bool grpc, const std::string& url)
+{
+  std::unique_ptr<nic::InferContext> ctx;
+  if (grpc) {
+    FAIL_IF_ERR(
+      nic::InferGrpcContext::Create(&ctx, url, "m"),
+      "unable to create context");
+  } else {
+    FAIL_IF_ERR(
+      nic::InferHttpContext::Create(&ctx, url, "m"),
+      "unable to create context");
+  }
+  FAIL_IF_ERR(
+    nict::SetRawRunOptions(ctx.get(), kBatchSize), "unable to set options");
+  return ctx;
+}
+
+// Run 'count' requests with the inputs of thread 'index', one in three
+// with the output written to a buffer of the thread.
+void
+Worker(nic::InferContext* ctx, size_t index, int count, bool async)
+{
+  std::vector<float> batch(kElements * kBatchSize);
+  for (size_t i = 0; i < batch.size(); i++) {
+    batch[i] = index * 1000 + i;
+  }
+  std::vector<float> output(batch.size());
+  FAIL_IF_ERR(nict::SetInput(ctx, batch), "set input");
+
+  for (int i = 0; i < count; i++) {
+    const bool use_buffer = ((i % 3) == 0);
+    if (use_buffer) {
+      FAIL_IF_ERR(
+        ctx->SetOutputBuffer(
+          ctx->Outputs()[0], reinterpret_cast<uint8_t*>(&output[0]),
+          output.size() * sizeof(float), ni::TYPE_FP32),
+        "set output buffer");
+    }
+
+    nict::Results results;
+    if (async) {
+      std::shared_ptr<nic::InferContext::Request> request;
+      FAIL_IF_ERR(ctx->AsyncRun(&request), "async run");
+      FAIL_IF_ERR(
+        ctx->GetAsyncRunResults(&results, request, true), "async results");
+    } else {
+      FAIL_IF_ERR(ctx->Run(&results), "run");
+    }
+
+    FAIL_UNLESS(nict::OutputEquals(results, 0, batch), "wrong result");
+    if (use_buffer) {
+      FAIL_UNLESS(output == batch, "result not in the output buffer");
+    }
+  }
+}
+
+// Send 'count' asynchronous requests on a thread-safe context and
+// retrieve them with GetReadyAsyncRequest() from 'thread_count'
+// threads, each request must be returned to exactly one thread.
+// 'count' must be at least 'thread_count'.
+void
+ShareReadyRequests(
+  bool grpc, const std::string& url, size_t thread_count, int count)
+{
+  std::unique_ptr<nic::InferContext> ctx = CreateContext(grpc, url);
+  FAIL_IF_ERR(ctx->SetThreadSafeMode(true), "set thread-safe mode");
+  std::vector<float> batch(kElements * kBatchSize);
+  for (size_t i = 0; i < batch.size(); i++) {
+    batch[i] = i;
+  }
+  FAIL_IF_ERR(nict::SetInput(ctx.get(), batch), "set input");
+
+  for (int i = 0; i < count; i++) {
+    std::shared_ptr<nic::InferContext::Request> request;
+    FAIL_IF_ERR(ctx->AsyncRun(&request), "async run");
+  }
+
+  // All threads hold a ready request before any of them retrieves its
+  // results, so that a request returned twice is caught.
+  std::atomic<size_t> holding(0);
+  std::atomic<int> retrieved(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back([&ctx, &batch, &holding, &retrieved, thread_count] {
+      for (bool first = true;; first = false) {
+        std::shared_ptr<nic::InferContext::Request> request;
+        if (!ctx->GetReadyAsyncRequest(&request, true).IsOk()) {
+          FAIL_UNLESS(!first, "no ready request");
+          return;
+        }
+        if (first) {
+          holding++;
+          while (holding < thread_count) {
+            std::this_thread::yield();
+          }
+        }
+        nict::Results results;
+        FAIL_IF_ERR(
+          ctx->GetAsyncRunResults(&results, request, true),
+          "results of a ready request");
+        FAIL_UNLESS(nict::OutputEquals(results, 0, batch), "wrong result");
+        retrieved++;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  FAIL_UNLESS(retrieved == count, "wrong number of ready requests");
+}
+
+void
+Benchmark(
+  bool grpc, const std::string& url, size_t thread_count, int count,
+  bool shared, bool async)
+{
+  const uint64_t start_ns = nict::NowNs();
+  const uint64_t start_cpu_ns = nict::ProcessCpuNs();
+
+  std::vector<std::unique_ptr<nic::InferContext>> contexts;
+  if (shared) {
+    contexts.push_back(CreateContext(grpc, url));
+    FAIL_IF_ERR(
+      contexts[0]->SetThreadSafeMode(true), "set thread-safe mode");
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; t++) {
+    if (!shared) {
+      contexts.push_back(CreateContext(grpc, url));
+    }
+    threads.emplace_back(Worker, contexts.back().get(), t, count, async);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  const uint64_t elapsed_ns = nict::NowNs() - start_ns;
+  const uint64_t cpu_ns = nict::ProcessCpuNs() - start_cpu_ns;
+
+  size_t completed = 0;
+  for (const auto& ctx : contexts) {
+    nic::InferContext::Stat stat;
+    FAIL_IF_ERR(ctx->GetStat(&stat), "get stat");
+    completed += stat.completed_request_count;
+  }
+  FAIL_UNLESS(
+    completed == thread_count * count, "wrong number of completed requests");
+
+  std::cout << (grpc ? "grpc " : "http ") << (async ? "async " : "sync  ")
+            << (shared ? "shared context:     " : "context per thread: ")
+            << (elapsed_ns / 1e6) << " msec, process CPU " << (cpu_ns / 1e6)
+            << " msec" << std::endl;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  const size_t thread_count = (argc > 1) ? atoi(argv[1]) : 16;
+  const int count = (argc > 2) ? atoi(argv[2]) : 200;
+
+  nict::StandInOptions options;
+  options.elements = kElements;
+  std::unique_ptr<nict::HttpStandIn> http_server;
+  FAIL_IF_ERR(
+    nict::HttpStandIn::Create(&http_server, options),
+    "unable to start HTTP server");
+  std::unique_ptr<nict::GrpcStandIn> grpc_server;
+  FAIL_IF_ERR(
+    nict::GrpcStandIn::Create(&grpc_server, options),
+    "unable to start gRPC server");
+
+  std::cout << thread_count << " threads x " << count << " requests"
+            << std::endl;
+  for (const bool grpc : {false, true}) {
+    const std::string url = grpc ? grpc_server->Url() : http_server->Url();
+    ShareReadyRequests(grpc, url, thread_count, count);
+    for (const bool async : {false, true}) {
+      Benchmark(grpc, url, thread_count, count, true, async);
+      Benchmark(grpc, url, thread_count, count, false, async);
+    }
+  }
+
+  std::cout << "PASSED" << std::endl;
+  return 0;
+}
@@ -546,11 +546,12 @@ InferContextResultNextRaw(
         "no raw result available for empty result");
   }
 
-  const std::vector<uint8_t>* buf;
-  nic::Error err = ctx->result->GetRaw(batch_idx, &buf);
+  const uint8_t* buf;
+  size_t byte_size;
+  nic::Error err = ctx->result->GetRaw(batch_idx, &buf, &byte_size);
   if (err.IsOk()) {
-    *val = reinterpret_cast<const char*>(&((*buf)[0]));
-    *val_len = buf->size();
+    *val = reinterpret_cast<const char*>(buf);
+    *val_len = byte_size;
   }
 
   return new nic::Error(err);
@@ -32,10 +32,26 @@ namespace nvidia { namespace inferenceserver {
 constexpr char kInferRequestHTTPHeader[] = "NV-InferRequest";
 constexpr char kStatusHTTPHeader[] = "NV-Status";
 
+// Binary variants of the headers above, holding the base64 encoded
+// protobuf instead of the protobuf text format. A client sending
+// kHeaderEncodingHTTPHeader with kBinaryHeaderEncoding accepts the
+// status in kStatusBinaryHTTPHeader, and once a server has replied
+// with it the client may send kInferRequestBinaryHTTPHeader instead
+// of kInferRequestHTTPHeader.
+constexpr char kInferRequestBinaryHTTPHeader[] = "NV-InferRequest-Bin";
+constexpr char kStatusBinaryHTTPHeader[] = "NV-Status-Bin";
+constexpr char kHeaderEncodingHTTPHeader[] = "NV-Header-Encoding";
+constexpr char kBinaryHeaderEncoding[] = "binary";
+
+// Header holding the SharedMemoryControl protobuf, in text format, of
+// a request to kSharedMemoryRESTEndpoint.
+constexpr char kSharedMemoryControlHTTPHeader[] = "NV-SharedMemoryControl";
+
 constexpr char kInferRESTEndpoint[] = "api/infer";
 constexpr char kStatusRESTEndpoint[] = "api/status";
 constexpr char kProfileRESTEndpoint[] = "api/profile";
 constexpr char kHealthRESTEndpoint[] = "api/health";
+constexpr char kSharedMemoryRESTEndpoint[] = "api/sharedmemory";
 
 constexpr char kTensorFlowGraphDefPlatform[] = "tensorflow_graphdef";
 constexpr char kTensorFlowSavedModelPlatform[] = "tensorflow_savedmodel";